@@ -0,0 +1,473 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <learnopengl/animation.h>
+#include <learnopengl/simd_math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ANIM_BLEND_SSE 1
+#endif
+
+//Local pose of a skeleton, one entry per node of Animation::GetNodes(), stored as structure of
+//arrays so blending handles 4 nodes per SSE instruction. The arrays are padded to a multiple of 4
+//with identity transforms.
+struct LocalPose
+{
+	std::vector<float> tx, ty, tz;
+	std::vector<float> rx, ry, rz, rw;
+	std::vector<float> sx, sy, sz;
+
+	size_t Size() const { return m_Count; }
+	size_t PaddedSize() const { return tx.size(); }
+
+	void Resize(size_t count)
+	{
+		m_Count = count;
+		const size_t padded = (count + 3) & ~size_t(3);
+		for (std::vector<float>* component : { &tx, &ty, &tz, &rx, &ry, &rz })
+			component->assign(padded, 0.0f);
+		rw.assign(padded, 1.0f);
+		sx.assign(padded, 1.0f);
+		sy.assign(padded, 1.0f);
+		sz.assign(padded, 1.0f);
+	}
+
+	void Set(size_t node, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale)
+	{
+		tx[node] = translation.x; ty[node] = translation.y; tz[node] = translation.z;
+		rx[node] = rotation.x; ry[node] = rotation.y; rz[node] = rotation.z; rw[node] = rotation.w;
+		sx[node] = scale.x; sy[node] = scale.y; sz[node] = scale.z;
+	}
+
+	glm::vec3 GetTranslation(size_t node) const { return glm::vec3(tx[node], ty[node], tz[node]); }
+	glm::quat GetRotation(size_t node) const { return glm::quat(rw[node], rx[node], ry[node], rz[node]); }
+	glm::vec3 GetScale(size_t node) const { return glm::vec3(sx[node], sy[node], sz[node]); }
+
+private:
+	size_t m_Count = 0;
+};
+
+//Samples animation at animationTime into pose (already Resize'd to its node count). cursors holds
+//animation.GetTrackCount() BoneCursors, as for Animation::Evaluate.
+inline void SampleLocalPose(const Animation& animation, float animationTime, BoneCursor* cursors, LocalPose& pose)
+{
+	const std::vector<AnimationNode>& nodes = animation.GetNodes();
+	const CompressedClip* clip = animation.GetClip();
+	const std::vector<Bone>& bones = animation.GetBones();
+	assert(pose.Size() == nodes.size());
+	glm::vec3 translation, scale;
+	glm::quat rotation;
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		const AnimationNode& node = nodes[i];
+		if (node.bone < 0)
+			pose.Set(i, node.bindTranslation, node.bindRotation, node.bindScale);
+		else
+		{
+			if (clip)
+				clip->Sample(node.bone, animationTime, cursors[node.bone], translation, rotation, scale);
+			else
+				bones[node.bone].Sample(animationTime, cursors[node.bone], translation, rotation, scale);
+			pose.Set(i, translation, rotation, scale);
+		}
+	}
+}
+
+//out = a blended toward b by weight: translations and scales are lerped, rotations nlerped along
+//the shortest path. out may be a or b.
+inline void BlendLocalPoses(const LocalPose& a, const LocalPose& b, float weight, LocalPose& out)
+{
+	const size_t count = a.PaddedSize();
+#ifdef ANIM_BLEND_SSE
+	const __m128 w = _mm_set1_ps(weight);
+	const __m128 iw = _mm_set1_ps(1.0f - weight);
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	const __m128 one = _mm_set1_ps(1.0f);
+	auto lerp = [&](const std::vector<float>& x, const std::vector<float>& y, std::vector<float>& result, size_t i) {
+		_mm_storeu_ps(&result[i], _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&x[i]), iw), _mm_mul_ps(_mm_loadu_ps(&y[i]), w)));
+	};
+	for (size_t i = 0; i < count; i += 4)
+	{
+		lerp(a.tx, b.tx, out.tx, i); lerp(a.ty, b.ty, out.ty, i); lerp(a.tz, b.tz, out.tz, i);
+		lerp(a.sx, b.sx, out.sx, i); lerp(a.sy, b.sy, out.sy, i); lerp(a.sz, b.sz, out.sz, i);
+
+		const __m128 ax = _mm_loadu_ps(&a.rx[i]), ay = _mm_loadu_ps(&a.ry[i]), az = _mm_loadu_ps(&a.rz[i]), aw = _mm_loadu_ps(&a.rw[i]);
+		const __m128 bx = _mm_loadu_ps(&b.rx[i]), by = _mm_loadu_ps(&b.ry[i]), bz = _mm_loadu_ps(&b.rz[i]), bw = _mm_loadu_ps(&b.rw[i]);
+		const __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_add_ps(_mm_mul_ps(az, bz), _mm_mul_ps(aw, bw)));
+		//b's weight takes the sign of the dot product: b is flipped to a's hemisphere
+		const __m128 bWeight = _mm_xor_ps(w, _mm_and_ps(dot, sign));
+		const __m128 x = _mm_add_ps(_mm_mul_ps(ax, iw), _mm_mul_ps(bx, bWeight));
+		const __m128 y = _mm_add_ps(_mm_mul_ps(ay, iw), _mm_mul_ps(by, bWeight));
+		const __m128 z = _mm_add_ps(_mm_mul_ps(az, iw), _mm_mul_ps(bz, bWeight));
+		const __m128 rw = _mm_add_ps(_mm_mul_ps(aw, iw), _mm_mul_ps(bw, bWeight));
+		const __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(rw, rw))));
+		const __m128 invLength = _mm_div_ps(one, length);
+		_mm_storeu_ps(&out.rx[i], _mm_mul_ps(x, invLength));
+		_mm_storeu_ps(&out.ry[i], _mm_mul_ps(y, invLength));
+		_mm_storeu_ps(&out.rz[i], _mm_mul_ps(z, invLength));
+		_mm_storeu_ps(&out.rw[i], _mm_mul_ps(rw, invLength));
+	}
+#else
+	const float iw = 1.0f - weight;
+	for (size_t i = 0; i < count; i++)
+	{
+		out.tx[i] = a.tx[i] * iw + b.tx[i] * weight;
+		out.ty[i] = a.ty[i] * iw + b.ty[i] * weight;
+		out.tz[i] = a.tz[i] * iw + b.tz[i] * weight;
+		out.sx[i] = a.sx[i] * iw + b.sx[i] * weight;
+		out.sy[i] = a.sy[i] * iw + b.sy[i] * weight;
+		out.sz[i] = a.sz[i] * iw + b.sz[i] * weight;
+
+		const float dot = a.rx[i] * b.rx[i] + a.ry[i] * b.ry[i] + a.rz[i] * b.rz[i] + a.rw[i] * b.rw[i];
+		const float bWeight = dot < 0.0f ? -weight : weight;
+		const float x = a.rx[i] * iw + b.rx[i] * bWeight;
+		const float y = a.ry[i] * iw + b.ry[i] * bWeight;
+		const float z = a.rz[i] * iw + b.rz[i] * bWeight;
+		const float w = a.rw[i] * iw + b.rw[i] * bWeight;
+		const float invLength = 1.0f / std::sqrt(x * x + y * y + z * z + w * w);
+		out.rx[i] = x * invLength;
+		out.ry[i] = y * invLength;
+		out.rz[i] = z * invLength;
+		out.rw[i] = w * invLength;
+	}
+#endif
+}
+
+//Turns pose into a difference from reference, for ApplyAdditivePose: translation offset,
+//rotation conjugate(reference) * rotation, scale ratio
+inline void MakeAdditivePose(LocalPose& pose, const LocalPose& reference)
+{
+	for (size_t i = 0; i < pose.Size(); i++)
+	{
+		const glm::quat delta = glm::conjugate(reference.GetRotation(i)) * pose.GetRotation(i);
+		pose.Set(i, pose.GetTranslation(i) - reference.GetTranslation(i), delta, pose.GetScale(i) / reference.GetScale(i));
+	}
+}
+
+//Adds an additive pose (MakeAdditivePose) on top of base, node i weighted by weight * mask[i].
+//mask holds base.PaddedSize() weights, nullptr applies weight to every node.
+inline void ApplyAdditivePose(LocalPose& base, const LocalPose& additive, float weight, const float* mask)
+{
+	const size_t count = base.PaddedSize();
+#ifdef ANIM_BLEND_SSE
+	const __m128 globalWeight = _mm_set1_ps(weight);
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	const __m128 one = _mm_set1_ps(1.0f);
+	for (size_t i = 0; i < count; i += 4)
+	{
+		const __m128 w = mask ? _mm_mul_ps(globalWeight, _mm_loadu_ps(mask + i)) : globalWeight;
+
+		_mm_storeu_ps(&base.tx[i], _mm_add_ps(_mm_loadu_ps(&base.tx[i]), _mm_mul_ps(_mm_loadu_ps(&additive.tx[i]), w)));
+		_mm_storeu_ps(&base.ty[i], _mm_add_ps(_mm_loadu_ps(&base.ty[i]), _mm_mul_ps(_mm_loadu_ps(&additive.ty[i]), w)));
+		_mm_storeu_ps(&base.tz[i], _mm_add_ps(_mm_loadu_ps(&base.tz[i]), _mm_mul_ps(_mm_loadu_ps(&additive.tz[i]), w)));
+		//scale * mix(1, delta, w)
+		_mm_storeu_ps(&base.sx[i], _mm_mul_ps(_mm_loadu_ps(&base.sx[i]), _mm_add_ps(one, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&additive.sx[i]), one), w))));
+		_mm_storeu_ps(&base.sy[i], _mm_mul_ps(_mm_loadu_ps(&base.sy[i]), _mm_add_ps(one, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&additive.sy[i]), one), w))));
+		_mm_storeu_ps(&base.sz[i], _mm_mul_ps(_mm_loadu_ps(&base.sz[i]), _mm_add_ps(one, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&additive.sz[i]), one), w))));
+
+		//delta nlerped from identity by w, on the identity's hemisphere
+		const __m128 dw = _mm_loadu_ps(&additive.rw[i]);
+		const __m128 signedW = _mm_xor_ps(w, _mm_and_ps(dw, sign));
+		const __m128 qx = _mm_mul_ps(_mm_loadu_ps(&additive.rx[i]), signedW);
+		const __m128 qy = _mm_mul_ps(_mm_loadu_ps(&additive.ry[i]), signedW);
+		const __m128 qz = _mm_mul_ps(_mm_loadu_ps(&additive.rz[i]), signedW);
+		const __m128 qw = _mm_add_ps(_mm_sub_ps(one, w), _mm_mul_ps(dw, signedW));
+		const __m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(qx, qx), _mm_mul_ps(qy, qy)), _mm_add_ps(_mm_mul_ps(qz, qz), _mm_mul_ps(qw, qw)))));
+		const __m128 bx = _mm_mul_ps(qx, invLength), by = _mm_mul_ps(qy, invLength), bz = _mm_mul_ps(qz, invLength), bw = _mm_mul_ps(qw, invLength);
+
+		//base rotation * delta
+		const __m128 ax = _mm_loadu_ps(&base.rx[i]), ay = _mm_loadu_ps(&base.ry[i]), az = _mm_loadu_ps(&base.rz[i]), aw = _mm_loadu_ps(&base.rw[i]);
+		_mm_storeu_ps(&base.rw[i], _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(aw, bw), _mm_mul_ps(ax, bx)), _mm_add_ps(_mm_mul_ps(ay, by), _mm_mul_ps(az, bz))));
+		_mm_storeu_ps(&base.rx[i], _mm_add_ps(_mm_add_ps(_mm_mul_ps(aw, bx), _mm_mul_ps(ax, bw)), _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by))));
+		_mm_storeu_ps(&base.ry[i], _mm_add_ps(_mm_sub_ps(_mm_mul_ps(aw, by), _mm_mul_ps(ax, bz)), _mm_add_ps(_mm_mul_ps(ay, bw), _mm_mul_ps(az, bx))));
+		_mm_storeu_ps(&base.rz[i], _mm_add_ps(_mm_add_ps(_mm_mul_ps(aw, bz), _mm_mul_ps(ax, by)), _mm_sub_ps(_mm_mul_ps(az, bw), _mm_mul_ps(ay, bx))));
+	}
+#else
+	for (size_t i = 0; i < count; i++)
+	{
+		const float w = mask ? weight * mask[i] : weight;
+		base.tx[i] += additive.tx[i] * w;
+		base.ty[i] += additive.ty[i] * w;
+		base.tz[i] += additive.tz[i] * w;
+		base.sx[i] *= 1.0f + (additive.sx[i] - 1.0f) * w;
+		base.sy[i] *= 1.0f + (additive.sy[i] - 1.0f) * w;
+		base.sz[i] *= 1.0f + (additive.sz[i] - 1.0f) * w;
+
+		const float signedW = additive.rw[i] < 0.0f ? -w : w;
+		const glm::quat delta = glm::normalize(glm::quat(1.0f - w + additive.rw[i] * signedW,
+			additive.rx[i] * signedW, additive.ry[i] * signedW, additive.rz[i] * signedW));
+		const glm::quat rotation = base.GetRotation(i) * delta;
+		base.rx[i] = rotation.x; base.ry[i] = rotation.y; base.rz[i] = rotation.z; base.rw[i] = rotation.w;
+	}
+#endif
+}
+
+//Per node weights for ApplyAdditivePose: weight for rootName and every node below it, 0 elsewhere
+//(an upper body mask from the spine, for example)
+inline std::vector<float> MakeNodeMask(const Animation& skeleton, const std::string& rootName, float weight = 1.0f)
+{
+	const std::vector<AnimationNode>& nodes = skeleton.GetNodes();
+	std::vector<float> mask((nodes.size() + 3) & ~size_t(3), 0.0f);
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		if (skeleton.GetNodeName(i) == rootName || (nodes[i].parent >= 0 && mask[nodes[i].parent] != 0.0f))
+			mask[i] = weight;
+	}
+	return mask;
+}
+
+//Hierarchy pass over a local pose: global transform of every node of skeleton, and the final bone
+//matrices of its bone slots (same buffers as Animation::Evaluate)
+inline void ComputeBoneMatrices(const Animation& skeleton, const LocalPose& pose, SimdMat4* globalTransforms, SimdMat4* finalBoneMatrices)
+{
+	const std::vector<AnimationNode>& nodes = skeleton.GetNodes();
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		const AnimationNode& node = nodes[i];
+		const SimdMat4 local = composeTRS(pose.GetTranslation(i), pose.GetRotation(i), pose.GetScale(i));
+		globalTransforms[i] = node.parent >= 0 ? globalTransforms[node.parent] * local : local;
+		if (node.boneSlot >= 0)
+			finalBoneMatrices[node.boneSlot] = globalTransforms[i] * node.offset;
+	}
+}
+
+//Blend tree over animations of one skeleton (same node hierarchy as the skeleton Animation).
+//Leaves are clips, inner nodes blend two children (cross-fades, locomotion blends) or add a
+//masked additive layer on top of a base. Every clip is sampled into a local pose taken from a
+//pool indexed by tree depth, poses are blended there and only the result goes through the
+//hierarchy pass. All buffers are sized while the tree is built: Update never allocates.
+class BlendTree
+{
+public:
+	explicit BlendTree(const Animation* skeleton)
+		: m_Skeleton(skeleton)
+	{
+		m_GlobalTransforms.resize(skeleton->GetNodes().size());
+		m_FinalBoneMatrices.assign(skeleton->GetBoneSlotCount(), SimdMat4(1.0f));
+	}
+
+	//Leaf playing animation at speed times its normal rate, looping
+	int AddClip(Animation* animation, float speed = 1.0f)
+	{
+		assert(animation->GetNodes().size() == m_Skeleton->GetNodes().size());
+		Node node = MakeNode(CLIP);
+		node.animation = animation;
+		node.speed = speed;
+		node.firstCursor = m_Cursors.size();
+		m_Cursors.resize(m_Cursors.size() + animation->GetTrackCount());
+		return AddNode(node);
+	}
+
+	//Leaf playing animation as a difference from its pose at referenceTime (in ticks), to be
+	//used as the additive child of AddLayer
+	int AddAdditiveClip(Animation* animation, float referenceTime = 0.0f, float speed = 1.0f)
+	{
+		const int id = AddClip(animation, speed);
+		Node& node = m_Nodes[id];
+		node.reference = static_cast<int>(m_ReferencePoses.size());
+		m_ReferencePoses.emplace_back();
+		m_ReferencePoses.back().Resize(m_Skeleton->GetNodes().size());
+		std::vector<BoneCursor> cursors(animation->GetTrackCount());
+		SampleLocalPose(*animation, referenceTime, cursors.data(), m_ReferencePoses.back());
+		return id;
+	}
+
+	//Blends child a toward child b by weight (0 plays a only, 1 plays b only)
+	int AddBlend(int a, int b, float weight = 0.0f)
+	{
+		Node node = MakeNode(BLEND);
+		node.a = a;
+		node.b = b;
+		node.weight = node.targetWeight = weight;
+		return AddNode(node);
+	}
+
+	//Adds the additive clip node additive on top of base, scaled by weight and by mask (one weight
+	//per skeleton node, see MakeNodeMask; empty for the whole body)
+	int AddLayer(int base, int additive, float weight = 1.0f, const std::vector<float>& mask = std::vector<float>())
+	{
+		assert(m_Nodes[additive].type == CLIP && m_Nodes[additive].reference >= 0);
+		Node node = MakeNode(LAYER);
+		node.a = base;
+		node.b = additive;
+		node.weight = node.targetWeight = weight;
+		if (!mask.empty())
+		{
+			node.mask = static_cast<int>(m_Masks.size());
+			m_Masks.push_back(mask);
+			m_Masks.back().resize((m_Skeleton->GetNodes().size() + 3) & ~size_t(3), 0.0f);
+		}
+		return AddNode(node);
+	}
+
+	void SetRoot(int node)
+	{
+		m_Root = node;
+		const size_t depth = Depth(node);
+		while (m_Pool.size() < depth)
+		{
+			m_Pool.emplace_back();
+			m_Pool.back().Resize(m_Skeleton->GetNodes().size());
+		}
+	}
+
+	//Moves the weight of a blend or layer node to weight, linearly over fadeSeconds (a cross-fade
+	//when the node blends the previous and the next clip)
+	void SetWeight(int node, float weight, float fadeSeconds = 0.0f)
+	{
+		Node& target = m_Nodes[node];
+		target.targetWeight = weight;
+		if (fadeSeconds > 0.0f)
+			target.fadeRate = std::abs(weight - target.weight) / fadeSeconds;
+		else
+			target.weight = weight;
+	}
+
+	float GetWeight(int node) const { return m_Nodes[node].weight; }
+
+	//Restarts a clip node at time seconds of the clip, whatever the node's speed
+	void SetTime(int node, float seconds)
+	{
+		Node& clip = m_Nodes[node];
+		const float duration = clip.animation->GetDuration();
+		clip.time = fmod(seconds * clip.animation->GetTicksPerSecond(), duration);
+		if (clip.time < 0.0f)
+			clip.time += duration;
+	}
+
+	//Advances every clip and fade by dt seconds and evaluates the tree from its root
+	void Update(float dt)
+	{
+		for (Node& node : m_Nodes)
+		{
+			if (node.type == CLIP)
+				Advance(node, dt);
+			else if (node.weight != node.targetWeight)
+			{
+				const float step = node.fadeRate * dt;
+				node.weight = node.weight < node.targetWeight ? std::min(node.weight + step, node.targetWeight)
+					: std::max(node.weight - step, node.targetWeight);
+			}
+		}
+		if (m_Root < 0)
+			return;
+		Evaluate(m_Root, 0);
+		ComputeBoneMatrices(*m_Skeleton, m_Pool[0], m_GlobalTransforms.data(), m_FinalBoneMatrices.data());
+	}
+
+	const std::vector<SimdMat4>& GetFinalBoneMatrices() const { return m_FinalBoneMatrices; }
+
+	//blended local pose of the last Update
+	const LocalPose& GetPose() const { return m_Pool[0]; }
+
+private:
+	enum NodeType { CLIP, BLEND, LAYER };
+
+	struct Node
+	{
+		NodeType type;
+		Animation* animation; //CLIP
+		float time; //CLIP, in ticks
+		float speed; //CLIP
+		size_t firstCursor; //CLIP, first of its BoneCursors in m_Cursors
+		int reference; //additive CLIP, index in m_ReferencePoses, -1 otherwise
+		int a, b; //BLEND and LAYER children
+		float weight, targetWeight, fadeRate; //BLEND and LAYER
+		int mask; //LAYER, index in m_Masks, -1 for none
+	};
+
+	const Animation* m_Skeleton;
+	std::vector<Node> m_Nodes;
+	std::vector<BoneCursor> m_Cursors;
+	std::vector<LocalPose> m_Pool; //m_Pool[d] holds the pose of the node evaluated at depth d
+	std::vector<LocalPose> m_ReferencePoses;
+	std::vector<std::vector<float>> m_Masks;
+	std::vector<SimdMat4> m_GlobalTransforms;
+	std::vector<SimdMat4> m_FinalBoneMatrices;
+	int m_Root = -1;
+
+	static Node MakeNode(NodeType type)
+	{
+		Node node;
+		node.type = type;
+		node.animation = nullptr;
+		node.time = 0.0f;
+		node.speed = 1.0f;
+		node.firstCursor = 0;
+		node.reference = -1;
+		node.a = node.b = -1;
+		node.weight = node.targetWeight = node.fadeRate = 0.0f;
+		node.mask = -1;
+		return node;
+	}
+
+	int AddNode(const Node& node)
+	{
+		m_Nodes.push_back(node);
+		if (m_Pool.empty())
+		{
+			m_Pool.emplace_back();
+			m_Pool.back().Resize(m_Skeleton->GetNodes().size());
+		}
+		return static_cast<int>(m_Nodes.size()) - 1;
+	}
+
+	//number of poses evaluating node needs at once
+	size_t Depth(int node) const
+	{
+		const Node& current = m_Nodes[node];
+		if (current.type == CLIP)
+			return 1;
+		return std::max(Depth(current.a), Depth(current.b) + 1);
+	}
+
+	void Advance(Node& clip, float dt)
+	{
+		const float duration = clip.animation->GetDuration();
+		clip.time = fmod(clip.time + clip.animation->GetTicksPerSecond() * clip.speed * dt, duration);
+		if (clip.time < 0.0f)
+			clip.time += duration;
+	}
+
+	void Evaluate(int id, size_t depth)
+	{
+		const Node& node = m_Nodes[id];
+		LocalPose& pose = m_Pool[depth];
+		switch (node.type)
+		{
+		case CLIP:
+			SampleLocalPose(*node.animation, node.time, &m_Cursors[node.firstCursor], pose);
+			if (node.reference >= 0)
+				MakeAdditivePose(pose, m_ReferencePoses[node.reference]);
+			break;
+		case BLEND:
+			//a fully weighted side is the only one sampled
+			if (node.weight <= 0.0f)
+				Evaluate(node.a, depth);
+			else if (node.weight >= 1.0f)
+				Evaluate(node.b, depth);
+			else
+			{
+				Evaluate(node.a, depth);
+				Evaluate(node.b, depth + 1);
+				BlendLocalPoses(pose, m_Pool[depth + 1], node.weight, pose);
+			}
+			break;
+		case LAYER:
+			Evaluate(node.a, depth);
+			if (node.weight > 0.0f)
+			{
+				Evaluate(node.b, depth + 1);
+				ApplyAdditivePose(pose, m_Pool[depth + 1], node.weight, node.mask >= 0 ? m_Masks[node.mask].data() : nullptr);
+			}
+			break;
+		}
+	}
+};
@@ -0,0 +1,381 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <learnopengl/bone.h>
+#include <learnopengl/simd_math.h>
+
+/* Compressed animation clip (.clip files written by CompileClip, anim_clip_compiler.h)
+
+   Layout, every section 4 byte aligned:
+     ClipHeader
+     ClipNode[nodeCount]     flattened hierarchy, parents first (same order as Animation::GetNodes)
+     ClipTrack[trackCount]   one per animated bone
+     char[stringBytes]       node names, not null terminated
+     key data                per channel: uint16 times[keyCount] (padded to an even count),
+                             then uint16 values[3 * keyCount]
+
+   Times are quantized to 16 bits over the clip duration. Positions and scales are quantized to
+   16 bits per component over the channel's range, rotations are stored smallest three: the
+   largest component is dropped (rebuilt from the unit length) and the other three, which lie in
+   [-1/sqrt(2), 1/sqrt(2)], get 15 bits each, the top bits of the first two words holding the
+   index of the dropped component. A channel with a single key is constant. */
+
+struct ClipHeader
+{
+	static const uint32_t CURRENT_VERSION = 1;
+
+	char magic[4]; //"PBRC"
+	uint32_t version;
+	float duration; //in ticks
+	float ticksPerSecond;
+	uint32_t nodeCount;
+	uint32_t trackCount;
+	uint32_t stringBytes; //padded to a multiple of 4
+	uint32_t keyBytes;
+};
+
+struct ClipNode
+{
+	float transformation[16]; //bind pose local transform, column major
+	int32_t parent; //-1 for the root
+	int32_t track; //index of the ClipTrack animating the node, -1 if none
+	uint32_t nameOffset; //in the string section
+	uint32_t nameLength;
+};
+
+struct ClipChannel
+{
+	uint32_t keyCount;
+	uint32_t keyOffset; //byte offset of the channel's times in the key data
+	float origin[3]; //position and scale values are origin + q * step
+	float step[3];
+};
+
+struct ClipTrack
+{
+	ClipChannel position;
+	ClipChannel rotation;
+	ClipChannel scale;
+};
+
+inline uint16_t QuantizeClipUnit(float value)
+{
+	return static_cast<uint16_t>(std::min(std::max(value, 0.0f), 1.0f) * 65535.0f + 0.5f);
+}
+
+//q's components in [-1/sqrt(2), 1/sqrt(2)] mapped to 15 bits
+inline void EncodeSmallestThree(glm::quat q, uint16_t out[3])
+{
+	int largest = 0;
+	for (int i = 1; i < 4; i++)
+	{
+		if (std::abs(q[i]) > std::abs(q[largest]))
+			largest = i;
+	}
+	if (q[largest] < 0.0f)
+		q = -q;
+	int word = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		if (i == largest)
+			continue;
+		const float unit = (q[i] * 0.70710678f + 0.5f); //scaled by sqrt(2) / 2 to [0, 1]
+		out[word++] = static_cast<uint16_t>(std::min(std::max(unit, 0.0f), 1.0f) * 32767.0f + 0.5f);
+	}
+	out[0] |= static_cast<uint16_t>((largest >> 1) << 15);
+	out[1] |= static_cast<uint16_t>((largest & 1) << 15);
+}
+
+inline glm::quat DecodeSmallestThree(const uint16_t in[3])
+{
+	const int largest = ((in[0] >> 15) << 1) | (in[1] >> 15);
+	const float scale = 1.41421356f / 32767.0f;
+	const float a = float(in[0] & 0x7fff) * scale - 0.70710678f;
+	const float b = float(in[1] & 0x7fff) * scale - 0.70710678f;
+	const float c = float(in[2] & 0x7fff) * scale - 0.70710678f;
+	const float d = std::sqrt(std::max(0.0f, 1.0f - a * a - b * b - c * c));
+	switch (largest)
+	{
+	case 0: return glm::quat(c, d, a, b); //glm::quat(w, x, y, z), q[0] is x
+	case 1: return glm::quat(c, a, d, b);
+	case 2: return glm::quat(c, a, b, d);
+	default: return glm::quat(d, a, b, c);
+	}
+}
+
+//Read only view of a .clip, memory mapped from disk (Open) or over a caller's buffer (OpenMemory).
+//Sampling only decodes the two keys around the requested time in each channel, and keeps its
+//playback state in a BoneCursor like Bone::Sample, so instances can share one clip.
+class CompressedClip
+{
+public:
+	CompressedClip() = default;
+
+	explicit CompressedClip(const std::string& path)
+	{
+		Open(path);
+	}
+
+	~CompressedClip()
+	{
+		Close();
+	}
+
+	CompressedClip(const CompressedClip&) = delete;
+	CompressedClip& operator=(const CompressedClip&) = delete;
+
+	bool Open(const std::string& path)
+	{
+		Close();
+#ifdef _WIN32
+		m_File = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		LARGE_INTEGER size;
+		if (m_File == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_File, &size) || size.QuadPart == 0)
+		{
+			std::cout << "ERROR::CLIP:: failed to open " << path << std::endl;
+			Close();
+			return false;
+		}
+		m_Mapping = CreateFileMappingA(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		m_MappedData = m_Mapping ? MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+		m_MappedSize = static_cast<size_t>(size.QuadPart);
+#else
+		const int file = open(path.c_str(), O_RDONLY);
+		struct stat status;
+		if (file < 0 || fstat(file, &status) != 0 || status.st_size == 0)
+		{
+			std::cout << "ERROR::CLIP:: failed to open " << path << std::endl;
+			if (file >= 0)
+				close(file);
+			return false;
+		}
+		void* data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+		close(file);
+		m_MappedData = data != MAP_FAILED ? data : nullptr;
+		m_MappedSize = static_cast<size_t>(status.st_size);
+#endif
+		if (!m_MappedData || !OpenMemory(m_MappedData, m_MappedSize))
+		{
+			std::cout << "ERROR::CLIP:: failed to map " << path << std::endl;
+			Close();
+			return false;
+		}
+		return true;
+	}
+
+	//data must stay valid and unmodified while the clip is used. Every count and offset of the
+	//clip is checked against size first: a truncated or corrupt file is rejected, never read
+	//out of bounds.
+	bool OpenMemory(const void* data, size_t size)
+	{
+		m_Header = nullptr;
+		const char* bytes = static_cast<const char*>(data);
+		if (size < sizeof(ClipHeader))
+			return false;
+		const ClipHeader* header = reinterpret_cast<const ClipHeader*>(bytes);
+		if (std::memcmp(header->magic, "PBRC", 4) != 0 || header->version != ClipHeader::CURRENT_VERSION)
+			return false;
+		if (!(header->duration >= 0.0f) || header->stringBytes % 4 != 0)
+			return false;
+		//64 bit sums, so that huge counts cannot wrap around to the file size
+		const uint64_t nodesBytes = uint64_t(header->nodeCount) * sizeof(ClipNode);
+		const uint64_t tracksBytes = uint64_t(header->trackCount) * sizeof(ClipTrack);
+		if (uint64_t(size) != sizeof(ClipHeader) + nodesBytes + tracksBytes + header->stringBytes + header->keyBytes)
+			return false;
+		const ClipNode* nodes = reinterpret_cast<const ClipNode*>(bytes + sizeof(ClipHeader));
+		const ClipTrack* tracks = reinterpret_cast<const ClipTrack*>(bytes + sizeof(ClipHeader) + nodesBytes);
+
+		for (uint32_t i = 0; i < header->nodeCount; i++)
+		{
+			//parents come first, Animation::Evaluate relies on it
+			const ClipNode& node = nodes[i];
+			if (node.parent < -1 || int64_t(node.parent) >= int64_t(i))
+				return false;
+			if (node.track < -1 || int64_t(node.track) >= int64_t(header->trackCount))
+				return false;
+			if (uint64_t(node.nameOffset) + node.nameLength > header->stringBytes)
+				return false;
+		}
+		for (uint32_t i = 0; i < header->trackCount; i++)
+		{
+			if (!IsValidChannel(tracks[i].position, header->keyBytes) || !IsValidChannel(tracks[i].rotation, header->keyBytes)
+				|| !IsValidChannel(tracks[i].scale, header->keyBytes))
+				return false;
+		}
+
+		m_Nodes = nodes;
+		m_Tracks = tracks;
+		m_Strings = bytes + sizeof(ClipHeader) + nodesBytes + tracksBytes;
+		m_Keys = m_Strings + header->stringBytes;
+		m_Size = size;
+		m_Header = header;
+		m_TimeToKey = header->duration > 0.0f ? 65535.0f / header->duration : 0.0f;
+		return true;
+	}
+
+	void Close()
+	{
+#ifdef _WIN32
+		if (m_MappedData)
+			UnmapViewOfFile(m_MappedData);
+		if (m_Mapping)
+			CloseHandle(m_Mapping);
+		if (m_File != INVALID_HANDLE_VALUE)
+			CloseHandle(m_File);
+		m_Mapping = nullptr;
+		m_File = INVALID_HANDLE_VALUE;
+#else
+		if (m_MappedData)
+			munmap(m_MappedData, m_MappedSize);
+#endif
+		m_MappedData = nullptr;
+		m_MappedSize = 0;
+		m_Header = nullptr;
+	}
+
+	bool IsOpen() const { return m_Header != nullptr; }
+	float GetDuration() const { return m_Header->duration; }
+	float GetTicksPerSecond() const { return m_Header->ticksPerSecond; }
+	uint32_t GetNodeCount() const { return m_Header->nodeCount; }
+	uint32_t GetTrackCount() const { return m_Header->trackCount; }
+	size_t GetSizeInBytes() const { return m_Size; }
+	const ClipNode& GetNode(uint32_t node) const { return m_Nodes[node]; }
+
+	std::string GetNodeName(uint32_t node) const
+	{
+		return std::string(m_Strings + m_Nodes[node].nameOffset, m_Nodes[node].nameLength);
+	}
+
+	//local transform of track at animationTime (in ticks), same contract as Bone::Sample
+	SimdMat4 Sample(uint32_t track, float animationTime, BoneCursor& cursor) const
+	{
+		const ClipTrack& clipTrack = m_Tracks[track];
+		const float keyTime = animationTime * m_TimeToKey;
+		return composeTRS(SampleVector(clipTrack.position, keyTime, cursor.position),
+			SampleRotation(clipTrack.rotation, keyTime, cursor.rotation),
+			SampleVector(clipTrack.scale, keyTime, cursor.scale));
+	}
+
+	void Sample(uint32_t track, float animationTime, BoneCursor& cursor, glm::vec3& translation, glm::quat& rotation, glm::vec3& scale) const
+	{
+		const ClipTrack& clipTrack = m_Tracks[track];
+		const float keyTime = animationTime * m_TimeToKey;
+		translation = SampleVector(clipTrack.position, keyTime, cursor.position);
+		rotation = SampleRotation(clipTrack.rotation, keyTime, cursor.rotation);
+		scale = SampleVector(clipTrack.scale, keyTime, cursor.scale);
+	}
+
+private:
+	const ClipHeader* m_Header = nullptr;
+	const ClipNode* m_Nodes = nullptr;
+	const ClipTrack* m_Tracks = nullptr;
+	const char* m_Strings = nullptr;
+	const char* m_Keys = nullptr;
+	size_t m_Size = 0;
+	float m_TimeToKey = 0.0f;
+
+	void* m_MappedData = nullptr;
+	size_t m_MappedSize = 0;
+#ifdef _WIN32
+	HANDLE m_File = INVALID_HANDLE_VALUE;
+	HANDLE m_Mapping = nullptr;
+#endif
+
+	//one key at least (GetSegment reads keys keyCount - 2 and keyCount - 1 of longer channels), and
+	//the times and values inside the key data
+	static bool IsValidChannel(const ClipChannel& channel, uint32_t keyBytes)
+	{
+		const uint64_t words = ((uint64_t(channel.keyCount) + 1) & ~uint64_t(1)) + uint64_t(channel.keyCount) * 3;
+		return channel.keyCount >= 1 && channel.keyOffset % 2 == 0
+			&& uint64_t(channel.keyOffset) + words * sizeof(uint16_t) <= keyBytes;
+	}
+
+	const uint16_t* GetTimes(const ClipChannel& channel) const
+	{
+		return reinterpret_cast<const uint16_t*>(m_Keys + channel.keyOffset);
+	}
+
+	const uint16_t* GetValues(const ClipChannel& channel) const
+	{
+		return GetTimes(channel) + ((channel.keyCount + 1) & ~1u);
+	}
+
+	//Same search as KeyTrack::GetSegment on the quantized times, with the blend factor
+	static uint32_t GetSegment(const ClipChannel& channel, const uint16_t* times, float keyTime, size_t& cursor, float& factor)
+	{
+		const uint32_t last = channel.keyCount - 2;
+		uint32_t index;
+		if (cursor <= last && times[cursor] <= keyTime)
+		{
+			index = static_cast<uint32_t>(cursor);
+			for (int steps = 0; index < last && times[index + 1] <= keyTime; ++steps, ++index)
+			{
+				if (steps == 4)
+				{
+					index = static_cast<uint32_t>(std::upper_bound(times + index + 1, times + last + 1, keyTime) - times) - 1;
+					break;
+				}
+			}
+		}
+		else
+			index = static_cast<uint32_t>(std::upper_bound(times + 1, times + last + 1, keyTime) - times) - 1;
+		cursor = index;
+		const float t0 = times[index];
+		const float span = float(times[index + 1]) - t0;
+		factor = span > 0.0f ? std::min(std::max((keyTime - t0) / span, 0.0f), 1.0f) : 1.0f;
+		return index;
+	}
+
+	glm::vec3 DecodeVector(const ClipChannel& channel, const uint16_t* values, uint32_t key) const
+	{
+		const uint16_t* q = values + key * 3;
+		return glm::vec3(channel.origin[0] + q[0] * channel.step[0], channel.origin[1] + q[1] * channel.step[1],
+			channel.origin[2] + q[2] * channel.step[2]);
+	}
+
+	glm::vec3 SampleVector(const ClipChannel& channel, float keyTime, size_t& cursor) const
+	{
+		const uint16_t* values = GetValues(channel);
+		if (channel.keyCount == 1)
+			return DecodeVector(channel, values, 0);
+		float factor;
+		const uint32_t key = GetSegment(channel, GetTimes(channel), keyTime, cursor, factor);
+		return glm::mix(DecodeVector(channel, values, key), DecodeVector(channel, values, key + 1), factor);
+	}
+
+	//normalized lerp along the shortest path, the interpolation CompileClip validates against
+	glm::quat SampleRotation(const ClipChannel& channel, float keyTime, size_t& cursor) const
+	{
+		const uint16_t* values = GetValues(channel);
+		if (channel.keyCount == 1)
+			return DecodeSmallestThree(values);
+		float factor;
+		const uint32_t key = GetSegment(channel, GetTimes(channel), keyTime, cursor, factor);
+		const glm::quat q0 = DecodeSmallestThree(values + key * 3);
+		glm::quat q1 = DecodeSmallestThree(values + key * 3 + 3);
+		if (glm::dot(q0, q1) < 0.0f)
+			q1 = -q1;
+		return glm::normalize(q0 * (1.0f - factor) + q1 * factor);
+	}
+};
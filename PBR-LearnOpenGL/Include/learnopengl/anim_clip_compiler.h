@@ -0,0 +1,262 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <learnopengl/animation.h>
+#include <learnopengl/anim_clip.h>
+
+//Largest error CompileClip may introduce, per channel, measured against the source keys. It covers
+//both the dropped keys and the 16 bit quantization of times and values (see ReduceClipKeys).
+struct ClipTolerances
+{
+	float position = 1e-3f; //distance, in model units
+	float rotation = 5e-3f; //angle, in radians (about 0.3 degree)
+	float scale = 1e-4f; //per axis scale factor distance
+};
+
+//value of track at time, blending the two keys around it with interpolate
+template<typename T, typename Interpolate>
+T SampleKeyTrack(const KeyTrack<T>& track, float time, Interpolate interpolate)
+{
+	if (track.Size() == 1)
+		return track.values[0];
+	size_t cursor = 0;
+	const int segment = track.GetSegment(time, cursor);
+	return interpolate(track.values[segment], track.values[segment + 1], track.GetFactor(segment, time));
+}
+
+//Indices of the keys of track to keep so that interpolating the kept keys with interpolate stays
+//within tolerance (measured by distance) of every source key. keyTimes and keyValues are what the
+//clip stores for each key, decoded: the quantized time, and the quantized value of the track at
+//that time. Checking those rather than the source keys keeps the quantization error inside the
+//tolerance. The first and last keys are always kept, and a track that never leaves tolerance of
+//its first stored value is reduced to that key.
+template<typename T, typename Interpolate, typename Distance>
+std::vector<uint32_t> ReduceClipKeys(const KeyTrack<T>& track, const std::vector<float>& keyTimes, const std::vector<T>& keyValues,
+	float tolerance, Interpolate interpolate, Distance distance)
+{
+	const std::vector<float>& times = track.timeStamps;
+	const std::vector<T>& values = track.values;
+	const uint32_t count = static_cast<uint32_t>(values.size());
+
+	bool constant = true;
+	for (uint32_t k = 0; k < count && constant; k++)
+		constant = distance(keyValues[0], values[k]) <= tolerance;
+	if (constant)
+		return std::vector<uint32_t>(1, 0);
+
+	std::vector<uint32_t> kept(1, 0);
+	uint32_t anchor = 0;
+	for (uint32_t end = 2; end < count; end++)
+	{
+		//the ends are checked too: their stored times moved a little from the source times
+		const float span = keyTimes[end] - keyTimes[anchor];
+		for (uint32_t k = anchor; k <= end; k++)
+		{
+			const float factor = span > 0.0f ? std::min(std::max((times[k] - keyTimes[anchor]) / span, 0.0f), 1.0f) : 1.0f;
+			if (distance(interpolate(keyValues[anchor], keyValues[end], factor), values[k]) > tolerance)
+			{
+				//end is too far: the key before it becomes the next anchor
+				anchor = end - 1;
+				kept.push_back(anchor);
+				break;
+			}
+		}
+	}
+	kept.push_back(count - 1);
+	return kept;
+}
+
+//Builds the .clip image (see anim_clip.h for the layout) of a flattened hierarchy, nodes and
+//nodeNames in the order of Animation::GetNodes, whose node.bone index bones, over duration ticks
+inline std::vector<char> BuildClip(const std::vector<AnimationNode>& nodes, const std::vector<std::string>& nodeNames,
+	const std::vector<Bone>& bones, float duration, float ticksPerSecond, const ClipTolerances& tolerances = ClipTolerances())
+{
+	const float timeToUnit = duration > 0.0f ? 1.0f / duration : 0.0f;
+
+	std::vector<ClipNode> clipNodes(nodes.size());
+	std::string strings;
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		const glm::mat4 transformation = toPacked(nodes[i].transformation);
+		std::memcpy(clipNodes[i].transformation, &transformation[0][0], sizeof(clipNodes[i].transformation));
+		clipNodes[i].parent = nodes[i].parent;
+		clipNodes[i].track = nodes[i].bone;
+		clipNodes[i].nameOffset = static_cast<uint32_t>(strings.size());
+		clipNodes[i].nameLength = static_cast<uint32_t>(nodeNames[i].size());
+		strings += nodeNames[i];
+	}
+	strings.resize((strings.size() + 3) & ~size_t(3), '\0');
+
+	std::vector<ClipTrack> clipTracks(bones.size());
+	std::vector<uint16_t> keys;
+
+	//times of the kept keys, skipping keys that quantize to the time of the previous kept key
+	auto writeTimes = [&](ClipChannel& channel, const std::vector<float>& times, std::vector<uint32_t>& kept) {
+		std::vector<uint32_t> unique;
+		for (uint32_t key : kept)
+		{
+			const uint16_t time = QuantizeClipUnit(times[key] * timeToUnit);
+			if (!unique.empty() && keys.back() == time)
+			{
+				unique.back() = key;
+				continue;
+			}
+			keys.push_back(time);
+			unique.push_back(key);
+		}
+		kept.swap(unique);
+		if (kept.size() & 1)
+			keys.push_back(0);
+		channel.keyCount = static_cast<uint32_t>(kept.size());
+	};
+
+	//key times as stored, back in ticks
+	auto storedTimes = [&](const std::vector<float>& times) {
+		std::vector<float> stored(times.size());
+		for (size_t k = 0; k < times.size(); k++)
+			stored[k] = QuantizeClipUnit(times[k] * timeToUnit) / 65535.0f * duration;
+		return stored;
+	};
+
+	auto mix = [](const glm::vec3& a, const glm::vec3& b, float t) { return glm::mix(a, b, t); };
+
+	auto writeVectors = [&](ClipChannel& channel, const KeyTrack<glm::vec3>& track, float tolerance) {
+		const uint32_t count = static_cast<uint32_t>(track.Size());
+		const std::vector<float> keyTimes = storedTimes(track.timeStamps);
+		std::vector<glm::vec3> samples(count);
+		for (uint32_t k = 0; k < count; k++)
+			samples[k] = SampleKeyTrack(track, keyTimes[k], mix);
+
+		glm::vec3 low = samples[0], high = low;
+		for (const glm::vec3& sample : samples)
+		{
+			low = glm::min(low, sample);
+			high = glm::max(high, sample);
+		}
+		const glm::vec3 step = (high - low) / 65535.0f;
+		std::vector<uint16_t> words(count * 3);
+		std::vector<glm::vec3> decoded(count);
+		for (uint32_t k = 0; k < count; k++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				words[k * 3 + c] = step[c] > 0.0f ? QuantizeClipUnit((samples[k][c] - low[c]) / (high[c] - low[c])) : 0;
+				decoded[k][c] = low[c] + words[k * 3 + c] * step[c];
+			}
+		}
+
+		std::vector<uint32_t> kept = ReduceClipKeys(track, keyTimes, decoded, tolerance, mix,
+			[](const glm::vec3& a, const glm::vec3& b) { return glm::length(a - b); });
+		channel.keyOffset = static_cast<uint32_t>(keys.size() * sizeof(uint16_t));
+		writeTimes(channel, track.timeStamps, kept);
+		for (int c = 0; c < 3; c++)
+		{
+			channel.origin[c] = low[c];
+			channel.step[c] = step[c];
+		}
+		for (uint32_t key : kept)
+			keys.insert(keys.end(), &words[key * 3], &words[key * 3] + 3);
+	};
+
+	auto writeRotations = [&](ClipChannel& channel, const KeyTrack<glm::quat>& track, float tolerance) {
+		const uint32_t count = static_cast<uint32_t>(track.Size());
+		const std::vector<float> keyTimes = storedTimes(track.timeStamps);
+		std::vector<uint16_t> words(count * 3);
+		std::vector<glm::quat> decoded(count);
+		for (uint32_t k = 0; k < count; k++)
+		{
+			//sampled with slerp, as Bone plays the source keys
+			const glm::quat sample = SampleKeyTrack(track, keyTimes[k],
+				[](const glm::quat& a, const glm::quat& b, float t) { return glm::slerp(a, b, t); });
+			EncodeSmallestThree(glm::normalize(sample), &words[k * 3]);
+			decoded[k] = DecodeSmallestThree(&words[k * 3]);
+		}
+
+		std::vector<uint32_t> kept = ReduceClipKeys(track, keyTimes, decoded, tolerance,
+			[](const glm::quat& a, glm::quat b, float t) {
+				if (glm::dot(a, b) < 0.0f)
+					b = -b;
+				return glm::normalize(a * (1.0f - t) + b * t);
+			},
+			[](const glm::quat& a, glm::quat b) {
+				//from the chord between the unit quaternions: acos of their dot loses too much
+				//precision at the small angles compared here
+				const glm::quat na = glm::normalize(a);
+				b = glm::normalize(b);
+				if (glm::dot(na, b) < 0.0f)
+					b = -b;
+				return 4.0f * std::asin(std::min(glm::length(glm::vec4(na.x - b.x, na.y - b.y, na.z - b.z, na.w - b.w)) * 0.5f, 1.0f));
+			});
+		channel.keyOffset = static_cast<uint32_t>(keys.size() * sizeof(uint16_t));
+		writeTimes(channel, track.timeStamps, kept);
+		for (int c = 0; c < 3; c++)
+		{
+			channel.origin[c] = 0.0f;
+			channel.step[c] = 0.0f;
+		}
+		for (uint32_t key : kept)
+			keys.insert(keys.end(), &words[key * 3], &words[key * 3] + 3);
+	};
+
+	for (size_t i = 0; i < bones.size(); i++)
+	{
+		writeVectors(clipTracks[i].position, bones[i].GetPositionTrack(), tolerances.position);
+		writeRotations(clipTracks[i].rotation, bones[i].GetRotationTrack(), tolerances.rotation);
+		writeVectors(clipTracks[i].scale, bones[i].GetScaleTrack(), tolerances.scale);
+	}
+
+	ClipHeader header;
+	std::memcpy(header.magic, "PBRC", 4);
+	header.version = ClipHeader::CURRENT_VERSION;
+	header.duration = duration;
+	header.ticksPerSecond = ticksPerSecond;
+	header.nodeCount = static_cast<uint32_t>(clipNodes.size());
+	header.trackCount = static_cast<uint32_t>(clipTracks.size());
+	header.stringBytes = static_cast<uint32_t>(strings.size());
+	header.keyBytes = static_cast<uint32_t>(keys.size() * sizeof(uint16_t));
+
+	std::vector<char> clip;
+	auto append = [&clip](const void* data, size_t size) {
+		const char* bytes = static_cast<const char*>(data);
+		clip.insert(clip.end(), bytes, bytes + size);
+	};
+	append(&header, sizeof(header));
+	append(clipNodes.data(), clipNodes.size() * sizeof(ClipNode));
+	append(clipTracks.data(), clipTracks.size() * sizeof(ClipTrack));
+	append(strings.data(), strings.size());
+	append(keys.data(), keys.size() * sizeof(uint16_t));
+	return clip;
+}
+
+//Builds the .clip image of animation
+inline std::vector<char> BuildClip(const Animation& animation, const ClipTolerances& tolerances = ClipTolerances())
+{
+	std::vector<std::string> nodeNames(animation.GetNodes().size());
+	for (size_t i = 0; i < nodeNames.size(); i++)
+		nodeNames[i] = animation.GetNodeName(i);
+	return BuildClip(animation.GetNodes(), nodeNames, animation.GetBones(), animation.GetDuration(),
+		animation.GetTicksPerSecond(), tolerances);
+}
+
+//Compiles animation (loaded through Assimp) into a .clip file at path, to be opened with
+//CompressedClip and played through Animation(clip, model)
+inline bool CompileClip(const Animation& animation, const std::string& path, const ClipTolerances& tolerances = ClipTolerances())
+{
+	const std::vector<char> clip = BuildClip(animation, tolerances);
+	std::ofstream file(path, std::ios::binary);
+	if (!file.write(clip.data(), clip.size()))
+	{
+		std::cout << "ERROR::CLIP:: failed to write " << path << std::endl;
+		return false;
+	}
+	return true;
+}
@@ -2,12 +2,19 @@
 
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <glm/glm.hpp>
 #include <assimp/scene.h>
 #include <learnopengl/bone.h>
 #include <functional>
 #include <learnopengl/animdata.h>
 #include <learnopengl/model_animation.h>
+#include <learnopengl/simd_math.h>
+#include <learnopengl/anim_clip.h>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtx/matrix_decompose.hpp>
+#include <algorithm>
+#include <memory>
 
 struct AssimpNodeData
 {
@@ -17,6 +24,20 @@ struct AssimpNodeData
 	std::vector<AssimpNodeData> children;
 };
 
+//One node of the hierarchy flattened at load time. Nodes are stored depth first, so a parent always
+//comes before its children and one forward pass evaluates the whole skeleton.
+struct AnimationNode
+{
+	SimdMat4 transformation; //bind pose local transform, used when no channel animates the node
+	SimdMat4 offset; //BoneInfo::offset of boneSlot
+	int parent; //index of the parent node, -1 for the root
+	int bone; //track animating this node (GetBones() or clip track index), -1 if none
+	int boneSlot; //index in the final bone matrices (BoneInfo::id), -1 if no mesh is skinned to it
+	glm::vec3 bindTranslation; //transformation decomposed, the local pose of unanimated nodes
+	glm::quat bindRotation;
+	glm::vec3 bindScale;
+};
+
 class Animation
 {
 public:
@@ -34,28 +55,92 @@ public:
 		globalTransformation = globalTransformation.Inverse();
 		ReadHeirarchyData(m_RootNode, scene->mRootNode);
 		ReadMissingBones(animation, *model);
+		FlattenHierarchy(m_RootNode, -1);
 	}
 
-	~Animation()
+	//Plays a compressed clip (anim_clip.h) instead of re-importing the source file with Assimp:
+	//hierarchy and keys come from the clip, only the bone slots are resolved against model.
+	//GetBones() is empty and FindBone finds nothing for such an animation.
+	Animation(std::shared_ptr<const CompressedClip> clip, Model* model)
+		: Animation(std::move(clip), model->GetBoneInfoMap(), model->GetBoneCount())
 	{
 	}
 
-	Bone* FindBone(const std::string& name)
+	//Same with the bone slots given directly (Model::GetBoneInfoMap and GetBoneCount): animated
+	//nodes missing from boneInfoMap are added to it, numbered on from boneCount
+	Animation(std::shared_ptr<const CompressedClip> clip, std::map<std::string, BoneInfo>& boneInfoMap, int& boneCount)
+		: m_Clip(std::move(clip))
 	{
-		auto iter = std::find_if(m_Bones.begin(), m_Bones.end(),
-			[&](const Bone& Bone)
+		assert(m_Clip && m_Clip->IsOpen());
+		m_Duration = m_Clip->GetDuration();
+		m_TicksPerSecond = static_cast<int>(m_Clip->GetTicksPerSecond());
+
+		for (uint32_t i = 0; i < m_Clip->GetNodeCount(); i++)
+		{
+			if (m_Clip->GetNode(i).track >= 0 && boneInfoMap.find(m_Clip->GetNodeName(i)) == boneInfoMap.end())
 			{
-				return Bone.GetBoneName() == name;
+				boneInfoMap[m_Clip->GetNodeName(i)].id = boneCount;
+				boneCount++;
 			}
-		);
-		if (iter == m_Bones.end()) return nullptr;
-		else return &(*iter);
+		}
+		m_BoneInfoMap = boneInfoMap;
+
+		for (uint32_t i = 0; i < m_Clip->GetNodeCount(); i++)
+		{
+			const ClipNode& node = m_Clip->GetNode(i);
+			AddNode(m_Clip->GetNodeName(i), glm::make_mat4(node.transformation), node.parent, node.track);
+		}
+	}
+
+	~Animation()
+	{
+	}
+
+	Bone* FindBone(const std::string& name)
+	{
+		auto iter = m_BoneIndices.find(name);
+		if (iter == m_BoneIndices.end()) return nullptr;
+		else return &m_Bones[iter->second];
 	}
 
 	
-	inline float GetTicksPerSecond() { return m_TicksPerSecond; }
-	inline float GetDuration() { return m_Duration;}
+	inline float GetTicksPerSecond() const { return m_TicksPerSecond; }
+	inline float GetDuration() const { return m_Duration;}
 	inline const AssimpNodeData& GetRootNode() { return m_RootNode; }
+	inline const std::vector<AnimationNode>& GetNodes() const { return m_Nodes; }
+	inline const std::string& GetNodeName(size_t node) const { return m_NodeNames[node]; }
+	inline std::vector<Bone>& GetBones() { return m_Bones; }
+	inline const std::vector<Bone>& GetBones() const { return m_Bones; }
+	//compressed clip the animation plays, nullptr if its keys come from GetBones()
+	inline const CompressedClip* GetClip() const { return m_Clip.get(); }
+	//number of animated tracks, i.e. of BoneCursors Evaluate needs
+	inline size_t GetTrackCount() const { return m_Clip ? m_Clip->GetTrackCount() : m_Bones.size(); }
+	//number of final bone matrices the nodes write to
+	inline int GetBoneSlotCount() const { return m_BoneSlotCount; }
+
+	//Evaluates the flattened hierarchy at animationTime in one forward pass: parents come first, so
+	//their global transform is always ready. cursors holds GetTrackCount() BoneCursors,
+	//globalTransforms one matrix per GetNodes() entry, finalBoneMatrices GetBoneSlotCount() matrices.
+	//The Animation is not modified, so instances with their own buffers can evaluate it in parallel.
+	void Evaluate(float animationTime, BoneCursor* cursors, SimdMat4* globalTransforms, SimdMat4* finalBoneMatrices) const
+	{
+		for (size_t i = 0; i < m_Nodes.size(); i++)
+		{
+			const AnimationNode& node = m_Nodes[i];
+			SimdMat4& globalTransformation = globalTransforms[i];
+			if (node.bone >= 0)
+			{
+				const SimdMat4 local = m_Clip ? m_Clip->Sample(node.bone, animationTime, cursors[node.bone])
+					: m_Bones[node.bone].Sample(animationTime, cursors[node.bone]);
+				globalTransformation = node.parent >= 0 ? globalTransforms[node.parent] * local : local;
+			}
+			else
+				globalTransformation = node.parent >= 0 ? globalTransforms[node.parent] * node.transformation : node.transformation;
+
+			if (node.boneSlot >= 0)
+				finalBoneMatrices[node.boneSlot] = globalTransformation * node.offset;
+		}
+	}
 	inline const std::map<std::string,BoneInfo>& GetBoneIDMap() 
 	{ 
 		return m_BoneInfoMap;
@@ -80,6 +165,7 @@ private:
 				boneInfoMap[boneName].id = boneCount;
 				boneCount++;
 			}
+			m_BoneIndices[boneName] = static_cast<int>(m_Bones.size());
 			m_Bones.push_back(Bone(channel->mNodeName.data,
 				boneInfoMap[channel->mNodeName.data].id, channel));
 		}
@@ -102,10 +188,48 @@ private:
 			dest.children.push_back(newData);
 		}
 	}
+	//Resolves every name of the hierarchy once, so evaluating it never touches a string
+	void FlattenHierarchy(const AssimpNodeData& src, int parent)
+	{
+		auto bone = m_BoneIndices.find(src.name);
+		const int index = AddNode(src.name, src.transformation, parent, bone != m_BoneIndices.end() ? bone->second : -1);
+		for (const AssimpNodeData& child : src.children)
+			FlattenHierarchy(child, index);
+	}
+
+	int AddNode(const std::string& name, const glm::mat4& transformation, int parent, int bone)
+	{
+		AnimationNode node;
+		node.transformation = toSimd(transformation);
+		node.offset = SimdMat4(1.0f);
+		node.parent = parent;
+		node.bone = bone;
+		glm::vec3 skew;
+		glm::vec4 perspective;
+		glm::decompose(transformation, node.bindScale, node.bindRotation, node.bindTranslation, skew, perspective);
+		auto boneInfo = m_BoneInfoMap.find(name);
+		node.boneSlot = -1;
+		if (boneInfo != m_BoneInfoMap.end())
+		{
+			node.boneSlot = boneInfo->second.id;
+			node.offset = toSimd(boneInfo->second.offset);
+			m_BoneSlotCount = std::max(m_BoneSlotCount, node.boneSlot + 1);
+		}
+
+		m_Nodes.push_back(node);
+		m_NodeNames.push_back(name);
+		return static_cast<int>(m_Nodes.size()) - 1;
+	}
+
 	float m_Duration;
 	int m_TicksPerSecond;
 	std::vector<Bone> m_Bones;
+	std::unordered_map<std::string, int> m_BoneIndices; //bone name -> index in m_Bones
 	AssimpNodeData m_RootNode;
+	std::vector<AnimationNode> m_Nodes;
+	std::vector<std::string> m_NodeNames;
+	std::shared_ptr<const CompressedClip> m_Clip;
+	int m_BoneSlotCount = 0;
 	std::map<std::string, BoneInfo> m_BoneInfoMap;
 };
 
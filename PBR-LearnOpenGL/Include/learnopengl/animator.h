@@ -7,6 +7,7 @@
 #include <assimp/Importer.hpp>
 #include <learnopengl/animation.h>
 #include <learnopengl/bone.h>
+#include <learnopengl/simd_math.h>
 
 class Animator
 {
@@ -15,11 +16,7 @@ public:
 	{
 		m_CurrentTime = 0.0;
 		m_CurrentAnimation = animation;
-
-		m_FinalBoneMatrices.reserve(100);
-
-		for (int i = 0; i < 100; i++)
-			m_FinalBoneMatrices.push_back(glm::mat4(1.0f));
+		ReserveFor(animation);
 	}
 
 	void UpdateAnimation(float dt)
@@ -29,7 +26,7 @@ public:
 		{
 			m_CurrentTime += m_CurrentAnimation->GetTicksPerSecond() * dt;
 			m_CurrentTime = fmod(m_CurrentTime, m_CurrentAnimation->GetDuration());
-			CalculateBoneTransform(&m_CurrentAnimation->GetRootNode(), glm::mat4(1.0f));
+			CalculateBoneTransforms();
 		}
 	}
 
@@ -37,42 +34,36 @@ public:
 	{
 		m_CurrentAnimation = pAnimation;
 		m_CurrentTime = 0.0f;
+		ReserveFor(pAnimation);
 	}
 
-	void CalculateBoneTransform(const AssimpNodeData* node, glm::mat4 parentTransform)
+	//Evaluates the current animation into the final bone matrices, without strings or allocations
+	void CalculateBoneTransforms()
 	{
-		std::string nodeName = node->name;
-		glm::mat4 nodeTransform = node->transformation;
-
-		Bone* Bone = m_CurrentAnimation->FindBone(nodeName);
-
-		if (Bone)
-		{
-			Bone->Update(m_CurrentTime);
-			nodeTransform = Bone->GetLocalTransform();
-		}
-
-		glm::mat4 globalTransformation = parentTransform * nodeTransform;
-
-		auto boneInfoMap = m_CurrentAnimation->GetBoneIDMap();
-		if (boneInfoMap.find(nodeName) != boneInfoMap.end())
-		{
-			int index = boneInfoMap[nodeName].id;
-			glm::mat4 offset = boneInfoMap[nodeName].offset;
-			m_FinalBoneMatrices[index] = globalTransformation * offset;
-		}
-
-		for (int i = 0; i < node->childrenCount; i++)
-			CalculateBoneTransform(&node->children[i], globalTransformation);
+		m_CurrentAnimation->Evaluate(m_CurrentTime, m_Cursors.data(), m_GlobalTransforms.data(), m_FinalBoneMatrices.data());
 	}
 
-	std::vector<glm::mat4> GetFinalBoneMatrices()
+	const std::vector<SimdMat4>& GetFinalBoneMatrices() const
 	{
 		return m_FinalBoneMatrices;
 	}
 
 private:
-	std::vector<glm::mat4> m_FinalBoneMatrices;
+	//Sizes the per-node and final matrix buffers once per animation, not per frame. There is no
+	//fixed bone limit: the palette holds the animation's bone slots (see BonePaletteBuffer).
+	void ReserveFor(Animation* animation)
+	{
+		if (!animation)
+			return;
+		m_GlobalTransforms.resize(animation->GetNodes().size());
+		m_Cursors.assign(animation->GetTrackCount(), BoneCursor());
+		if (m_FinalBoneMatrices.size() < static_cast<size_t>(animation->GetBoneSlotCount()))
+			m_FinalBoneMatrices.resize(animation->GetBoneSlotCount(), SimdMat4(1.0f));
+	}
+
+	std::vector<SimdMat4> m_FinalBoneMatrices;
+	std::vector<SimdMat4> m_GlobalTransforms; //per node of Animation::GetNodes()
+	std::vector<BoneCursor> m_Cursors; //per bone of Animation::GetBones()
 	Animation* m_CurrentAnimation;
 	float m_CurrentTime;
 	float m_DeltaTime;
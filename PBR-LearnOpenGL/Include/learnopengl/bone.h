@@ -5,27 +5,104 @@
 #include <vector>
 #include <assimp/scene.h>
 #include <list>
+#include <algorithm>
+#include <cmath>
 #include <glm/glm.hpp>
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/quaternion.hpp>
 #include <learnopengl/assimp_glm_helpers.h>
-
-struct KeyPosition
+#include <learnopengl/simd_math.h>
+
+//Keyframes of one channel stored as two arrays, timestamps apart from values, so finding the
+//current key only walks the packed times. Lookups take a cursor, the segment returned last:
+//playback moves forward a key or two per frame, so the next lookup starts there and is O(1)
+//amortized. Jumps (seeks, loops) fall back to a binary search, and evenly spaced keys, the
+//common case for baked clips, compute their segment directly. The track itself is never
+//modified, the cursors are the playback state.
+template<typename T>
+struct KeyTrack
 {
-	glm::vec3 position;
-	float timeStamp;
-};
+	std::vector<float> timeStamps;
+	std::vector<T> values;
 
-struct KeyRotation
-{
-	glm::quat orientation;
-	float timeStamp;
+	//called once all keys are added
+	void Finalize()
+	{
+		m_Uniform = false;
+		const size_t count = timeStamps.size();
+		if (count < 3)
+			return;
+		const float step = (timeStamps.back() - timeStamps.front()) / float(count - 1);
+		if (!(step > 0.0f))
+			return;
+		for (size_t i = 1; i < count; ++i)
+		{
+			if (std::abs(timeStamps[i] - (timeStamps.front() + step * float(i))) > step * 1e-3f)
+				return;
+		}
+		m_Uniform = true;
+		m_InvStep = 1.0f / step;
+	}
+
+	size_t Size() const { return timeStamps.size(); }
+
+	//Index i of the segment [i, i + 1] to interpolate at animationTime. Times before the first
+	//or after the last key return the first or last segment, GetFactor clamps the blend.
+	int GetSegment(float animationTime, size_t& cursor) const
+	{
+		const size_t last = timeStamps.size() - 2;
+		size_t index;
+		if (m_Uniform)
+		{
+			const float position = (animationTime - timeStamps.front()) * m_InvStep;
+			index = position > 0.0f ? std::min(static_cast<size_t>(position), last) : 0;
+		}
+		else if (cursor <= last && timeStamps[cursor] <= animationTime)
+		{
+			//forward playback: a few steps from the previous segment, then give up and search
+			index = cursor;
+			for (int steps = 0; index < last && timeStamps[index + 1] <= animationTime; ++steps, ++index)
+			{
+				if (steps == 4)
+				{
+					index = Search(animationTime);
+					break;
+				}
+			}
+		}
+		else
+			index = Search(animationTime);
+		cursor = index;
+		return static_cast<int>(index);
+	}
+
+	//blend factor between keys segment and segment + 1, clamped to [0, 1]
+	float GetFactor(int segment, float animationTime) const
+	{
+		const float lastTimeStamp = timeStamps[segment];
+		const float framesDiff = timeStamps[segment + 1] - lastTimeStamp;
+		const float factor = (animationTime - lastTimeStamp) / framesDiff;
+		return std::min(std::max(factor, 0.0f), 1.0f);
+	}
+
+private:
+	bool m_Uniform = false;
+	float m_InvStep = 0.0f;
+
+	size_t Search(float animationTime) const
+	{
+		//first key strictly after animationTime, among keys 1 .. count - 1
+		const auto next = std::upper_bound(timeStamps.begin() + 1, timeStamps.end() - 1, animationTime);
+		return static_cast<size_t>(next - timeStamps.begin()) - 1;
+	}
 };
 
-struct KeyScale
+//Playback state of one Bone for one animation instance
+struct BoneCursor
 {
-	glm::vec3 scale;
-	float timeStamp;
+	size_t position = 0;
+	size_t rotation = 0;
+	size_t scale = 0;
 };
 
 class Bone
@@ -37,151 +114,121 @@ public:
 		m_ID(ID),
 		m_LocalTransform(1.0f)
 	{
-		m_NumPositions = channel->mNumPositionKeys;
-
-		for (int positionIndex = 0; positionIndex < m_NumPositions; ++positionIndex)
+		m_Positions.timeStamps.reserve(channel->mNumPositionKeys);
+		m_Positions.values.reserve(channel->mNumPositionKeys);
+		for (unsigned int positionIndex = 0; positionIndex < channel->mNumPositionKeys; ++positionIndex)
 		{
-			aiVector3D aiPosition = channel->mPositionKeys[positionIndex].mValue;
-			float timeStamp = channel->mPositionKeys[positionIndex].mTime;
-			KeyPosition data;
-			data.position = AssimpGLMHelpers::GetGLMVec(aiPosition);
-			data.timeStamp = timeStamp;
-			m_Positions.push_back(data);
+			m_Positions.timeStamps.push_back(static_cast<float>(channel->mPositionKeys[positionIndex].mTime));
+			m_Positions.values.push_back(AssimpGLMHelpers::GetGLMVec(channel->mPositionKeys[positionIndex].mValue));
 		}
+		m_Positions.Finalize();
 
-		m_NumRotations = channel->mNumRotationKeys;
-		for (int rotationIndex = 0; rotationIndex < m_NumRotations; ++rotationIndex)
+		m_Rotations.timeStamps.reserve(channel->mNumRotationKeys);
+		m_Rotations.values.reserve(channel->mNumRotationKeys);
+		for (unsigned int rotationIndex = 0; rotationIndex < channel->mNumRotationKeys; ++rotationIndex)
 		{
-			aiQuaternion aiOrientation = channel->mRotationKeys[rotationIndex].mValue;
-			float timeStamp = channel->mRotationKeys[rotationIndex].mTime;
-			KeyRotation data;
-			data.orientation = AssimpGLMHelpers::GetGLMQuat(aiOrientation);
-			data.timeStamp = timeStamp;
-			m_Rotations.push_back(data);
+			m_Rotations.timeStamps.push_back(static_cast<float>(channel->mRotationKeys[rotationIndex].mTime));
+			m_Rotations.values.push_back(AssimpGLMHelpers::GetGLMQuat(channel->mRotationKeys[rotationIndex].mValue));
 		}
+		m_Rotations.Finalize();
 
-		m_NumScalings = channel->mNumScalingKeys;
-		for (int keyIndex = 0; keyIndex < m_NumScalings; ++keyIndex)
+		m_Scales.timeStamps.reserve(channel->mNumScalingKeys);
+		m_Scales.values.reserve(channel->mNumScalingKeys);
+		for (unsigned int keyIndex = 0; keyIndex < channel->mNumScalingKeys; ++keyIndex)
 		{
-			aiVector3D scale = channel->mScalingKeys[keyIndex].mValue;
-			float timeStamp = channel->mScalingKeys[keyIndex].mTime;
-			KeyScale data;
-			data.scale = AssimpGLMHelpers::GetGLMVec(scale);
-			data.timeStamp = timeStamp;
-			m_Scales.push_back(data);
+			m_Scales.timeStamps.push_back(static_cast<float>(channel->mScalingKeys[keyIndex].mTime));
+			m_Scales.values.push_back(AssimpGLMHelpers::GetGLMVec(channel->mScalingKeys[keyIndex].mValue));
 		}
+		m_Scales.Finalize();
 	}
 	
 	void Update(float animationTime)
 	{
-		glm::mat4 translation = InterpolatePosition(animationTime);
-		glm::mat4 rotation = InterpolateRotation(animationTime);
-		glm::mat4 scale = InterpolateScaling(animationTime);
-		m_LocalTransform = translation * rotation * scale;
+		m_LocalTransform = Sample(animationTime, m_Cursor);
+	}
+
+	//Local transform at animationTime. Only cursor is modified, so any number of threads can sample
+	//the same Bone as long as each one has its own cursor.
+	SimdMat4 Sample(float animationTime, BoneCursor& cursor) const
+	{
+		return composeTRS(InterpolatePosition(animationTime, cursor.position),
+			InterpolateRotation(animationTime, cursor.rotation), InterpolateScaling(animationTime, cursor.scale));
 	}
-	glm::mat4 GetLocalTransform() { return m_LocalTransform; }
+
+	//Same as Sample, before composing the matrix: for blending (anim_blend.h)
+	void Sample(float animationTime, BoneCursor& cursor, glm::vec3& translation, glm::quat& rotation, glm::vec3& scale) const
+	{
+		translation = InterpolatePosition(animationTime, cursor.position);
+		rotation = InterpolateRotation(animationTime, cursor.rotation);
+		scale = InterpolateScaling(animationTime, cursor.scale);
+	}
+	const SimdMat4& GetLocalTransform() const { return m_LocalTransform; }
 	std::string GetBoneName() const { return m_Name; }
+	const KeyTrack<glm::vec3>& GetPositionTrack() const { return m_Positions; }
+	const KeyTrack<glm::quat>& GetRotationTrack() const { return m_Rotations; }
+	const KeyTrack<glm::vec3>& GetScaleTrack() const { return m_Scales; }
 	int GetBoneID() { return m_ID; }
 	
 
 
 	int GetPositionIndex(float animationTime)
 	{
-		for (int index = 0; index < m_NumPositions - 1; ++index)
-		{
-			if (animationTime < m_Positions[index + 1].timeStamp)
-				return index;
-		}
-		assert(0);
+		return m_Positions.GetSegment(animationTime, m_Cursor.position);
 	}
 
 	int GetRotationIndex(float animationTime)
 	{
-		for (int index = 0; index < m_NumRotations - 1; ++index)
-		{
-			if (animationTime < m_Rotations[index + 1].timeStamp)
-				return index;
-		}
-		assert(0);
+		return m_Rotations.GetSegment(animationTime, m_Cursor.rotation);
 	}
 
 	int GetScaleIndex(float animationTime)
 	{
-		for (int index = 0; index < m_NumScalings - 1; ++index)
-		{
-			if (animationTime < m_Scales[index + 1].timeStamp)
-				return index;
-		}
-		assert(0);
+		return m_Scales.GetSegment(animationTime, m_Cursor.scale);
 	}
 
 
 private:
 
-	float GetScaleFactor(float lastTimeStamp, float nextTimeStamp, float animationTime)
+	glm::vec3 InterpolatePosition(float animationTime, size_t& cursor) const
 	{
-		float scaleFactor = 0.0f;
-		float midWayLength = animationTime - lastTimeStamp;
-		float framesDiff = nextTimeStamp - lastTimeStamp;
-		scaleFactor = midWayLength / framesDiff;
-		return scaleFactor;
-	}
+		if (1 == m_Positions.Size())
+			return m_Positions.values[0];
 
-	glm::mat4 InterpolatePosition(float animationTime)
-	{
-		if (1 == m_NumPositions)
-			return glm::translate(glm::mat4(1.0f), m_Positions[0].position);
-
-		int p0Index = GetPositionIndex(animationTime);
-		int p1Index = p0Index + 1;
-		float scaleFactor = GetScaleFactor(m_Positions[p0Index].timeStamp,
-			m_Positions[p1Index].timeStamp, animationTime);
-		glm::vec3 finalPosition = glm::mix(m_Positions[p0Index].position, m_Positions[p1Index].position
+		int p0Index = m_Positions.GetSegment(animationTime, cursor);
+		float scaleFactor = m_Positions.GetFactor(p0Index, animationTime);
+		return glm::mix(m_Positions.values[p0Index], m_Positions.values[p0Index + 1]
 			, scaleFactor);
-		return glm::translate(glm::mat4(1.0f), finalPosition);
 	}
 
-	glm::mat4 InterpolateRotation(float animationTime)
+	glm::quat InterpolateRotation(float animationTime, size_t& cursor) const
 	{
-		if (1 == m_NumRotations)
-		{
-			auto rotation = glm::normalize(m_Rotations[0].orientation);
-			return glm::toMat4(rotation);
-		}
+		if (1 == m_Rotations.Size())
+			return glm::normalize(m_Rotations.values[0]);
 
-		int p0Index = GetRotationIndex(animationTime);
-		int p1Index = p0Index + 1;
-		float scaleFactor = GetScaleFactor(m_Rotations[p0Index].timeStamp,
-			m_Rotations[p1Index].timeStamp, animationTime);
-		glm::quat finalRotation = glm::slerp(m_Rotations[p0Index].orientation, m_Rotations[p1Index].orientation
+		int p0Index = m_Rotations.GetSegment(animationTime, cursor);
+		float scaleFactor = m_Rotations.GetFactor(p0Index, animationTime);
+		glm::quat finalRotation = glm::slerp(m_Rotations.values[p0Index], m_Rotations.values[p0Index + 1]
 			, scaleFactor);
-		finalRotation = glm::normalize(finalRotation);
-		return glm::toMat4(finalRotation);
-
+		return glm::normalize(finalRotation);
 	}
 
-	glm::mat4 InterpolateScaling(float animationTime)
+	glm::vec3 InterpolateScaling(float animationTime, size_t& cursor) const
 	{
-		if (1 == m_NumScalings)
-			return glm::scale(glm::mat4(1.0f), m_Scales[0].scale);
-
-		int p0Index = GetScaleIndex(animationTime);
-		int p1Index = p0Index + 1;
-		float scaleFactor = GetScaleFactor(m_Scales[p0Index].timeStamp,
-			m_Scales[p1Index].timeStamp, animationTime);
-		glm::vec3 finalScale = glm::mix(m_Scales[p0Index].scale, m_Scales[p1Index].scale
+		if (1 == m_Scales.Size())
+			return m_Scales.values[0];
+
+		int p0Index = m_Scales.GetSegment(animationTime, cursor);
+		float scaleFactor = m_Scales.GetFactor(p0Index, animationTime);
+		return glm::mix(m_Scales.values[p0Index], m_Scales.values[p0Index + 1]
 			, scaleFactor);
-		return glm::scale(glm::mat4(1.0f), finalScale);
 	}
 
-	std::vector<KeyPosition> m_Positions;
-	std::vector<KeyRotation> m_Rotations;
-	std::vector<KeyScale> m_Scales;
-	int m_NumPositions;
-	int m_NumRotations;
-	int m_NumScalings;
+	KeyTrack<glm::vec3> m_Positions;
+	KeyTrack<glm::quat> m_Rotations;
+	KeyTrack<glm::vec3> m_Scales;
+	BoneCursor m_Cursor; //used by Update and the Get*Index functions
 
-	glm::mat4 m_LocalTransform;
+	SimdMat4 m_LocalTransform;
 	std::string m_Name;
 	int m_ID;
 };
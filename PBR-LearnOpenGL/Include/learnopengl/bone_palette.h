@@ -0,0 +1,161 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/shader.h>
+#include <learnopengl/simd_math.h>
+
+//Layout of one bone in a BonePaletteBuffer, matching boneFormat in shaders/pbr_skinned.vert
+enum class BonePaletteFormat
+{
+	Matrix3x4 = 0, //3 texels: the rows of the bone matrix without its constant last row
+	DualQuaternion = 1 //2 texels: real and dual part (rotation and translation only, scale is dropped)
+};
+
+inline int GetBonePaletteTexelsPerBone(BonePaletteFormat format)
+{
+	return format == BonePaletteFormat::Matrix3x4 ? 3 : 2;
+}
+
+//Writes count bone matrices in format to palette (GetBonePaletteTexelsPerBone(format) vec4s each).
+//The same layout serves the GPU (BonePaletteBuffer) and the CPU skinning kernels (cpu_skinning.h).
+inline void PackBonePalette(BonePaletteFormat format, const SimdMat4* matrices, size_t count, glm::vec4* palette)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		const glm::mat4 m = toPacked(matrices[i]);
+		if (format == BonePaletteFormat::Matrix3x4)
+		{
+			for (int row = 0; row < 3; row++)
+				*palette++ = glm::vec4(m[0][row], m[1][row], m[2][row], m[3][row]);
+		}
+		else
+		{
+			const glm::quat real = glm::normalize(glm::quat_cast(glm::mat3(glm::normalize(glm::vec3(m[0])),
+				glm::normalize(glm::vec3(m[1])), glm::normalize(glm::vec3(m[2])))));
+			const glm::quat dual = glm::quat(0.0f, glm::vec3(m[3])) * real * 0.5f;
+			*palette++ = glm::vec4(real.x, real.y, real.z, real.w);
+			*palette++ = glm::vec4(dual.x, dual.y, dual.z, dual.w);
+		}
+	}
+}
+
+//Bone palettes of every skinned draw of a frame in one texture buffer (RGBA32F texels). Each
+//palette is appended with Add, which returns its first texel; after one Upload per frame a draw
+//only sets that offset (SetPalette) instead of a mat4 uniform per bone, so palettes are not
+//limited to a fixed bone count. Texture buffers are used rather than a uniform buffer because a
+//uniform block is capped at 64KB, 4096 texels or about 1365 bones in 3x4 form for every skinned
+//draw of the frame together.
+class BonePaletteBuffer
+{
+public:
+	explicit BonePaletteBuffer(BonePaletteFormat format = BonePaletteFormat::Matrix3x4)
+		: m_Format(format)
+	{
+		glGenBuffers(1, &m_Buffer);
+		glGenTextures(1, &m_Texture);
+		//the texture reads whatever store the buffer has: Upload can reallocate it freely
+		GLStateCache::bindTextureBuffer(0, m_Texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_Buffer);
+	}
+
+	~BonePaletteBuffer()
+	{
+		glDeleteTextures(1, &m_Texture);
+		glDeleteBuffers(1, &m_Buffer);
+	}
+
+	BonePaletteBuffer(const BonePaletteBuffer&) = delete;
+	BonePaletteBuffer& operator=(const BonePaletteBuffer&) = delete;
+
+	BonePaletteFormat GetFormat() const { return m_Format; }
+	int GetTexelsPerBone() const { return GetBonePaletteTexelsPerBone(m_Format); }
+
+	//Starts a new frame of palettes
+	void Clear()
+	{
+		m_Texels.clear();
+	}
+
+	//Appends count bone matrices (Animator::GetFinalBoneMatrices, a BlendTree or a CrowdAnimator
+	//palette) and returns the first texel of the palette, for SetPalette
+	int Add(const SimdMat4* matrices, size_t count)
+	{
+		const int first = static_cast<int>(m_Texels.size());
+		m_Texels.resize(m_Texels.size() + count * GetTexelsPerBone());
+		PackBonePalette(m_Format, matrices, count, &m_Texels[first]);
+		return first;
+	}
+
+	int Add(const std::vector<SimdMat4>& matrices)
+	{
+		return Add(matrices.data(), matrices.size());
+	}
+
+	//Appends the model matrices of an instanced draw, one per instance, and returns the first texel
+	//for SetPalette. They take 3 texels each (rows of the 3x4 matrix) whatever the palette format.
+	int AddModels(const glm::mat4* models, size_t count)
+	{
+		const int first = static_cast<int>(m_Texels.size());
+		m_Texels.resize(m_Texels.size() + count * 3);
+		for (size_t i = 0; i < count; i++)
+		{
+			for (int row = 0; row < 3; row++)
+				m_Texels[first + i * 3 + row] = glm::vec4(models[i][0][row], models[i][1][row], models[i][2][row], models[i][3][row]);
+		}
+		return first;
+	}
+
+	int AddModels(const std::vector<glm::mat4>& models)
+	{
+		return AddModels(models.data(), models.size());
+	}
+
+	//Sends the palettes added since Clear to the GPU, in one call
+	void Upload()
+	{
+		const GLsizeiptr size = m_Texels.size() * sizeof(glm::vec4);
+		glBindBuffer(GL_TEXTURE_BUFFER, m_Buffer);
+		if (size > m_Capacity)
+			m_Capacity = std::max<GLsizeiptr>(size, m_Capacity * 2);
+		//a fresh store each frame (orphaning), so draws of the previous frame do not stall the upload
+		glBufferData(GL_TEXTURE_BUFFER, m_Capacity, nullptr, GL_STREAM_DRAW);
+		if (size > 0)
+			glBufferSubData(GL_TEXTURE_BUFFER, 0, size, m_Texels.data());
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+
+	//Binds the palettes for draws with shader (once per frame and shader), on the unit the shader
+	//hands out for bonePalette
+	void Bind(Shader& shader) const
+	{
+		const int unit = shader.getSamplerUnit("bonePalette");
+		if (unit >= 0)
+			GLStateCache::bindTextureBuffer(unit, m_Texture);
+		shader.setInt("boneFormat", static_cast<int>(m_Format));
+	}
+
+	//Selects the palette starting at first (returned by Add) for the next draws. Instanced draws
+	//read instance i's palette at first + i * stride, in texels: stride is paletteSize *
+	//GetTexelsPerBone() for the palettes of a CrowdAnimator added in one Add. models is the first
+	//texel of the instances' model matrices (AddModels); with -1 every instance is placed by the
+	//model uniform.
+	void SetPalette(const Shader& shader, int first, int stride = 0, int models = -1) const
+	{
+		shader.setInt("boneBase", first);
+		shader.setInt("boneStride", stride);
+		shader.setInt("modelBase", models);
+	}
+
+private:
+	BonePaletteFormat m_Format;
+	unsigned int m_Buffer = 0;
+	unsigned int m_Texture = 0;
+	GLsizeiptr m_Capacity = 0;
+	std::vector<glm::vec4> m_Texels;
+};
@@ -0,0 +1,670 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp> //glm::vec3
+#include <cstdint> //uint32_t
+#include <vector> //std::vector
+#include <algorithm> //std::min, std::max, std::swap
+#include <limits> //std::numeric_limits
+
+#include <learnopengl/entity.h>
+
+//Axis aligned box as min/max corners, the form tree building and ray tests want
+struct BvhBox
+{
+	glm::vec3 min{ 0.f, 0.f, 0.f };
+	glm::vec3 max{ 0.f, 0.f, 0.f };
+
+	BvhBox() = default;
+
+	BvhBox(const glm::vec3& inMin, const glm::vec3& inMax)
+		: min{ inMin }, max{ inMax }
+	{}
+
+	explicit BvhBox(const AABB& aabb)
+		: min{ aabb.center - aabb.extents }, max{ aabb.center + aabb.extents }
+	{}
+
+	//Contains nothing; growing it by a box gives that box
+	static BvhBox empty()
+	{
+		return BvhBox(glm::vec3(std::numeric_limits<float>::max()), glm::vec3(std::numeric_limits<float>::lowest()));
+	}
+
+	void grow(const BvhBox& other)
+	{
+		min = glm::min(min, other.min);
+		max = glm::max(max, other.max);
+	}
+
+	void grow(const glm::vec3& point)
+	{
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+
+	bool contains(const BvhBox& other) const
+	{
+		return min.x <= other.min.x && min.y <= other.min.y && min.z <= other.min.z &&
+			other.max.x <= max.x && other.max.y <= max.y && other.max.z <= max.z;
+	}
+
+	glm::vec3 center() const
+	{
+		return (min + max) * 0.5f;
+	}
+
+	//Surface area, the SAH cost of a node; 0 for an empty box
+	float area() const
+	{
+		const glm::vec3 d = max - min;
+		if (d.x < 0.f || d.y < 0.f || d.z < 0.f)
+			return 0.f;
+		return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+	}
+};
+
+inline BvhBox mergeBoxes(const BvhBox& a, const BvhBox& b)
+{
+	return BvhBox(glm::min(a.min, b.min), glm::max(a.max, b.max));
+}
+
+//Slab test. Returns the distance along dir at which the ray enters box (0 if it starts inside),
+//or a negative value if it misses it or enters it beyond maxDistance. invDir is 1 / dir.
+inline float intersectRayBox(const glm::vec3& origin, const glm::vec3& invDir, const BvhBox& box, float maxDistance)
+{
+	const glm::vec3 t0 = (box.min - origin) * invDir;
+	const glm::vec3 t1 = (box.max - origin) * invDir;
+	const glm::vec3 tNear = glm::min(t0, t1);
+	const glm::vec3 tFar = glm::max(t0, t1);
+	const float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.f));
+	const float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+	return enter <= exit ? enter : -1.f;
+}
+
+//Dynamic bounding volume hierarchy over world AABBs. Every leaf holds one object (identified by
+//the userData given at insertion); internal nodes always have two children. It answers the same
+//frustum query as the linear cull, but rejects or accepts whole subtrees with one box test, and
+//ray queries for picking.
+//
+//build() makes a good tree for a set of boxes at once (binned surface area heuristic). Objects
+//can then be inserted, removed and moved one by one. A leaf stores its box enlarged by a margin,
+//so a move that stays inside it costs nothing; otherwise the boxes on the path to the root are
+//refit and every node on the way tries one tree rotation (swapping a child with a grandchild
+//when that shrinks the surface area), which keeps the tree tight without reinserting anything.
+//After the scene changed a lot, build() again.
+//
+//Queries use an internal stack: they are not reentrant and must not run concurrently.
+class DynamicBvh
+{
+public:
+	static const uint32_t NULL_NODE = ~0u;
+
+	struct Node
+	{
+		BvhBox box; //enlarged by the margin for leaves
+		BvhBox tight; //leaves only: the box given by the caller
+		uint32_t parent = NULL_NODE; //next free node while on the free list
+		uint32_t left = NULL_NODE; //NULL_NODE for leaves
+		uint32_t right = NULL_NODE;
+		uint32_t userData = 0;
+
+		bool isLeaf() const
+		{
+			return left == NULL_NODE;
+		}
+	};
+
+	explicit DynamicBvh(float margin = 0.1f)
+		: m_margin{ margin }
+	{}
+
+	uint32_t root() const
+	{
+		return m_root;
+	}
+
+	const Node& node(uint32_t id) const
+	{
+		return m_nodes[id];
+	}
+
+	size_t leafCount() const
+	{
+		return m_leafCount;
+	}
+
+	void clear()
+	{
+		m_nodes.clear();
+		m_root = NULL_NODE;
+		m_freeList = NULL_NODE;
+		m_leafCount = 0;
+	}
+
+	//Replaces the whole tree by one built over boxes; leaf i gets userData i and its id is written
+	//to proxies[i], to be passed to move() and remove()
+	void build(const std::vector<BvhBox>& boxes, std::vector<uint32_t>& proxies)
+	{
+		clear();
+		proxies.resize(boxes.size());
+		if (boxes.empty())
+			return;
+		m_nodes.reserve(boxes.size() * 2);
+		std::vector<uint32_t> leaves(boxes.size());
+		std::vector<glm::vec3> centers(boxes.size());
+		for (size_t i = 0; i < boxes.size(); ++i)
+		{
+			proxies[i] = leaves[i] = createLeaf(boxes[i], static_cast<uint32_t>(i));
+			centers[i] = boxes[i].center();
+		}
+		m_leafCount = boxes.size();
+		m_root = buildRange(leaves, centers, 0, leaves.size());
+		m_nodes[m_root].parent = NULL_NODE;
+	}
+
+	//Adds a leaf for box and returns its id
+	uint32_t insert(const BvhBox& box, uint32_t userData)
+	{
+		const uint32_t leaf = createLeaf(box, userData);
+		insertLeaf(leaf);
+		++m_leafCount;
+		return leaf;
+	}
+
+	void remove(uint32_t proxy)
+	{
+		removeLeaf(proxy);
+		freeNode(proxy);
+		--m_leafCount;
+	}
+
+	//Gives the leaf its new box. Returns false if it still fit in the enlarged one (nothing else
+	//changes), true if the path to the root was refit.
+	bool move(uint32_t proxy, const BvhBox& box)
+	{
+		Node& leaf = m_nodes[proxy];
+		leaf.tight = box;
+		if (leaf.box.contains(box))
+			return false;
+		leaf.box = enlarge(box);
+		refitFrom(leaf.parent);
+		return true;
+	}
+
+	//Sum of the internal node areas relative to the root's, the expected number of internal nodes
+	//a random ray visits. Grows as moves degrade the tree; compare with a fresh build().
+	float cost() const
+	{
+		if (m_root == NULL_NODE || m_nodes[m_root].isLeaf())
+			return 0.f;
+		float sum = 0.f;
+		visitSubtree(m_root, [&](uint32_t id) {
+			if (!m_nodes[id].isLeaf())
+				sum += m_nodes[id].box.area();
+		}, true);
+		return sum / std::max(m_nodes[m_root].box.area(), std::numeric_limits<float>::min());
+	}
+
+	//Calls visit(userData) for every leaf whose box is at least partly inside frustum. A node inside
+	//a plane stops being tested against it, and a node inside all six reports its leaves untested.
+	//Returns the number of nodes whose box was tested.
+	template<typename F>
+	size_t cullFrustum(const Frustum& frustum, F&& visit) const
+	{
+		if (m_root == NULL_NODE)
+			return 0;
+		const Plan* planes[6] = { &frustum.leftFace, &frustum.rightFace, &frustum.topFace,
+			&frustum.bottomFace, &frustum.nearFace, &frustum.farFace };
+		size_t tested = 0;
+		m_stack.clear();
+		m_stack.push_back(uint64_t(m_root) << 6 | 0x3f);
+		while (!m_stack.empty())
+		{
+			const uint64_t entry = m_stack.back();
+			m_stack.pop_back();
+			const uint32_t id = static_cast<uint32_t>(entry >> 6);
+			unsigned int mask = static_cast<unsigned int>(entry & 0x3f);
+			const Node& n = m_nodes[id];
+			if (mask == 0)
+			{
+				//fully inside: everything below is visible
+				visitSubtree(id, [&](uint32_t leaf) { visit(m_nodes[leaf].userData); }, false);
+				continue;
+			}
+			++tested;
+			const BvhBox& box = n.isLeaf() ? n.tight : n.box;
+			const glm::vec3 center = box.center();
+			const glm::vec3 extents = box.max - center;
+			bool outside = false;
+			for (int k = 0; k < 6 && !outside; ++k)
+			{
+				if (!(mask & (1u << k)))
+					continue;
+				const Plan& plan = *planes[k];
+				const float r = extents.x * std::abs(plan.normal.x) + extents.y * std::abs(plan.normal.y) +
+					extents.z * std::abs(plan.normal.z);
+				const float dist = plan.getSignedDistanceToPlan(center);
+				if (dist < -r)
+					outside = true;
+				else if (dist >= r)
+					mask &= ~(1u << k);
+			}
+			if (outside)
+				continue;
+			if (n.isLeaf())
+			{
+				visit(n.userData);
+				continue;
+			}
+			m_stack.push_back(uint64_t(n.right) << 6 | mask);
+			m_stack.push_back(uint64_t(n.left) << 6 | mask);
+		}
+		return tested;
+	}
+
+	//Closest hit of the ray origin + t * dir, t in [0, distance]. intersect(userData, boxEntry) is
+	//called for leaves whose box the ray enters at boxEntry and returns the exact hit distance of
+	//the object, or a negative value for a miss. Returns the userData of the closest hit (and
+	//shortens distance to it), or NULL_NODE.
+	template<typename F>
+	uint32_t raycast(const glm::vec3& origin, const glm::vec3& dir, float& distance, F&& intersect) const
+	{
+		uint32_t hit = NULL_NODE;
+		if (m_root == NULL_NODE)
+			return hit;
+		const glm::vec3 invDir = 1.f / dir;
+		m_stack.clear();
+		m_stack.push_back(m_root);
+		while (!m_stack.empty())
+		{
+			const Node& n = m_nodes[static_cast<uint32_t>(m_stack.back())];
+			m_stack.pop_back();
+			if (n.isLeaf())
+			{
+				const float entry = intersectRayBox(origin, invDir, n.tight, distance);
+				if (entry < 0.f)
+					continue;
+				const float t = intersect(n.userData, entry);
+				if (t >= 0.f && t <= distance)
+				{
+					distance = t;
+					hit = n.userData;
+				}
+				continue;
+			}
+			//visit the nearer child first, so the farther one is usually pruned by the shortened distance
+			const float tLeft = intersectRayBox(origin, invDir, m_nodes[n.left].box, distance);
+			const float tRight = intersectRayBox(origin, invDir, m_nodes[n.right].box, distance);
+			const bool leftFirst = tLeft >= 0.f && (tRight < 0.f || tLeft <= tRight);
+			const uint32_t first = leftFirst ? n.left : n.right;
+			const uint32_t second = leftFirst ? n.right : n.left;
+			if ((leftFirst ? tRight : tLeft) >= 0.f)
+				m_stack.push_back(second);
+			if ((leftFirst ? tLeft : tRight) >= 0.f)
+				m_stack.push_back(first);
+		}
+		return hit;
+	}
+
+	//Same, hitting the leaf boxes themselves
+	uint32_t raycast(const glm::vec3& origin, const glm::vec3& dir, float& distance) const
+	{
+		return raycast(origin, dir, distance, [](uint32_t, float entry) { return entry; });
+	}
+
+private:
+	static const unsigned int BINS = 16;
+
+	std::vector<Node> m_nodes;
+	uint32_t m_root = NULL_NODE;
+	uint32_t m_freeList = NULL_NODE;
+	size_t m_leafCount = 0;
+	float m_margin;
+	mutable std::vector<uint64_t> m_stack;
+
+	BvhBox enlarge(const BvhBox& box) const
+	{
+		return BvhBox(box.min - glm::vec3(m_margin), box.max + glm::vec3(m_margin));
+	}
+
+	uint32_t allocateNode()
+	{
+		if (m_freeList != NULL_NODE)
+		{
+			const uint32_t id = m_freeList;
+			m_freeList = m_nodes[id].parent;
+			m_nodes[id] = Node();
+			return id;
+		}
+		m_nodes.push_back(Node());
+		return static_cast<uint32_t>(m_nodes.size() - 1);
+	}
+
+	void freeNode(uint32_t id)
+	{
+		m_nodes[id].parent = m_freeList;
+		m_nodes[id].left = m_nodes[id].right = NULL_NODE;
+		m_freeList = id;
+	}
+
+	uint32_t createLeaf(const BvhBox& box, uint32_t userData)
+	{
+		const uint32_t leaf = allocateNode();
+		m_nodes[leaf].box = enlarge(box);
+		m_nodes[leaf].tight = box;
+		m_nodes[leaf].userData = userData;
+		return leaf;
+	}
+
+	uint32_t createParent(uint32_t left, uint32_t right)
+	{
+		const uint32_t id = allocateNode();
+		m_nodes[id].left = left;
+		m_nodes[id].right = right;
+		m_nodes[id].box = mergeBoxes(m_nodes[left].box, m_nodes[right].box);
+		m_nodes[left].parent = id;
+		m_nodes[right].parent = id;
+		return id;
+	}
+
+	//Top down binned SAH build of leaves[begin, end): the centers are binned along the widest axis
+	//and the split between bins with the lowest area * count cost wins
+	uint32_t buildRange(std::vector<uint32_t>& leaves, std::vector<glm::vec3>& centers, size_t begin, size_t end)
+	{
+		if (end - begin == 1)
+			return leaves[begin];
+
+		BvhBox centerBounds = BvhBox::empty();
+		for (size_t i = begin; i < end; ++i)
+			centerBounds.grow(centers[i]);
+		const glm::vec3 size = centerBounds.max - centerBounds.min;
+		const int axis = size.x >= size.y && size.x >= size.z ? 0 : (size.y >= size.z ? 1 : 2);
+
+		size_t mid = begin;
+		if (size[axis] > 0.f)
+		{
+			BvhBox binBoxes[BINS];
+			size_t binCounts[BINS] = {};
+			for (unsigned int b = 0; b < BINS; ++b)
+				binBoxes[b] = BvhBox::empty();
+			const float scale = BINS / size[axis];
+			for (size_t i = begin; i < end; ++i)
+			{
+				const unsigned int b = binOf(centers[i][axis], centerBounds.min[axis], scale);
+				binBoxes[b].grow(m_nodes[leaves[i]].box);
+				binCounts[b]++;
+			}
+			//sweep from the right to get the cost of every split in two passes
+			float rightCost[BINS];
+			BvhBox accumulated = BvhBox::empty();
+			size_t count = 0;
+			for (unsigned int b = BINS - 1; b > 0; --b)
+			{
+				accumulated.grow(binBoxes[b]);
+				count += binCounts[b];
+				rightCost[b] = accumulated.area() * count;
+			}
+			float bestCost = std::numeric_limits<float>::max();
+			unsigned int bestSplit = 0;
+			accumulated = BvhBox::empty();
+			count = 0;
+			for (unsigned int b = 1; b < BINS; ++b)
+			{
+				accumulated.grow(binBoxes[b - 1]);
+				count += binCounts[b - 1];
+				const float splitCost = accumulated.area() * count + rightCost[b];
+				if (count > 0 && count < end - begin && splitCost < bestCost)
+				{
+					bestCost = splitCost;
+					bestSplit = b;
+				}
+			}
+			if (bestSplit > 0)
+			{
+				size_t left = begin;
+				for (size_t i = begin; i < end; ++i)
+				{
+					if (binOf(centers[i][axis], centerBounds.min[axis], scale) < bestSplit)
+					{
+						std::swap(leaves[i], leaves[left]);
+						std::swap(centers[i], centers[left]);
+						++left;
+					}
+				}
+				mid = left;
+			}
+		}
+		if (mid == begin || mid == end)
+			mid = begin + (end - begin) / 2; //all centers in one bin: any split is as good
+
+		const uint32_t left = buildRange(leaves, centers, begin, mid);
+		const uint32_t right = buildRange(leaves, centers, mid, end);
+		return createParent(left, right);
+	}
+
+	static unsigned int binOf(float value, float minValue, float scale)
+	{
+		const int b = static_cast<int>((value - minValue) * scale);
+		return static_cast<unsigned int>(std::min(std::max(b, 0), static_cast<int>(BINS) - 1));
+	}
+
+	//Descends towards the child whose box grows the least (area cost of the new parent plus the
+	//growth of every ancestor), then pairs the leaf with the node found
+	void insertLeaf(uint32_t leaf)
+	{
+		if (m_root == NULL_NODE)
+		{
+			m_root = leaf;
+			m_nodes[leaf].parent = NULL_NODE;
+			return;
+		}
+		const BvhBox& box = m_nodes[leaf].box;
+		uint32_t sibling = m_root;
+		while (!m_nodes[sibling].isLeaf())
+		{
+			const Node& n = m_nodes[sibling];
+			const float area = n.box.area();
+			const float combinedArea = mergeBoxes(n.box, box).area();
+			const float pairCost = 2.f * combinedArea; //make a new parent for this node and the leaf
+			const float inheritedCost = 2.f * (combinedArea - area); //growth pushed onto the ancestors
+			const float leftCost = descendCost(n.left, box) + inheritedCost;
+			const float rightCost = descendCost(n.right, box) + inheritedCost;
+			if (pairCost < leftCost && pairCost < rightCost)
+				break;
+			sibling = leftCost < rightCost ? n.left : n.right;
+		}
+
+		const uint32_t oldParent = m_nodes[sibling].parent;
+		const uint32_t newParent = createParent(sibling, leaf);
+		m_nodes[newParent].parent = oldParent;
+		if (oldParent == NULL_NODE)
+		{
+			m_root = newParent;
+			return;
+		}
+		if (m_nodes[oldParent].left == sibling)
+			m_nodes[oldParent].left = newParent;
+		else
+			m_nodes[oldParent].right = newParent;
+		refitFrom(oldParent);
+	}
+
+	float descendCost(uint32_t child, const BvhBox& box) const
+	{
+		const BvhBox merged = mergeBoxes(m_nodes[child].box, box);
+		if (m_nodes[child].isLeaf())
+			return merged.area();
+		return merged.area() - m_nodes[child].box.area();
+	}
+
+	//Unlinks leaf; its sibling takes the place of their parent
+	void removeLeaf(uint32_t leaf)
+	{
+		if (leaf == m_root)
+		{
+			m_root = NULL_NODE;
+			return;
+		}
+		const uint32_t parent = m_nodes[leaf].parent;
+		const uint32_t grandParent = m_nodes[parent].parent;
+		const uint32_t sibling = m_nodes[parent].left == leaf ? m_nodes[parent].right : m_nodes[parent].left;
+		m_nodes[sibling].parent = grandParent;
+		freeNode(parent);
+		if (grandParent == NULL_NODE)
+		{
+			m_root = sibling;
+			return;
+		}
+		if (m_nodes[grandParent].left == parent)
+			m_nodes[grandParent].left = sibling;
+		else
+			m_nodes[grandParent].right = sibling;
+		refitFrom(grandParent);
+	}
+
+	//Recomputes the boxes from node up to the root, rotating each node on the way
+	void refitFrom(uint32_t id)
+	{
+		while (id != NULL_NODE)
+		{
+			Node& n = m_nodes[id];
+			n.box = mergeBoxes(m_nodes[n.left].box, m_nodes[n.right].box);
+			rotate(id);
+			id = n.parent;
+		}
+	}
+
+	//Tries the four swaps of a child of id with a grandchild on the other side and applies the one
+	//that shrinks the other child's box the most, if any. id's own box does not change.
+	void rotate(uint32_t id)
+	{
+		const uint32_t left = m_nodes[id].left;
+		const uint32_t right = m_nodes[id].right;
+		float bestGain = 0.f;
+		uint32_t bestChild = NULL_NODE; //the child of id that moves down
+		uint32_t bestGrandChild = NULL_NODE; //the grandchild that moves up
+		const uint32_t sides[2][2] = { { left, right }, { right, left } };
+		for (int s = 0; s < 2; ++s)
+		{
+			const uint32_t child = sides[s][0];
+			const uint32_t other = sides[s][1];
+			const Node& o = m_nodes[other];
+			if (o.isLeaf())
+				continue;
+			const float area = o.box.area();
+			//child swaps with o.left: o becomes child + o.right, and the other way round
+			const float gainLeft = area - mergeBoxes(m_nodes[child].box, m_nodes[o.right].box).area();
+			const float gainRight = area - mergeBoxes(m_nodes[child].box, m_nodes[o.left].box).area();
+			if (gainLeft > bestGain)
+			{
+				bestGain = gainLeft;
+				bestChild = child;
+				bestGrandChild = o.left;
+			}
+			if (gainRight > bestGain)
+			{
+				bestGain = gainRight;
+				bestChild = child;
+				bestGrandChild = o.right;
+			}
+		}
+		if (bestChild == NULL_NODE)
+			return;
+
+		const uint32_t other = bestChild == left ? right : left;
+		Node& o = m_nodes[other];
+		if (o.left == bestGrandChild)
+			o.left = bestChild;
+		else
+			o.right = bestChild;
+		m_nodes[bestChild].parent = other;
+		o.box = mergeBoxes(m_nodes[o.left].box, m_nodes[o.right].box);
+
+		Node& n = m_nodes[id];
+		if (n.left == bestChild)
+			n.left = bestGrandChild;
+		else
+			n.right = bestGrandChild;
+		m_nodes[bestGrandChild].parent = id;
+	}
+
+	//Calls f(node) for id and everything below it (or only for the leaves)
+	template<typename F>
+	void visitSubtree(uint32_t id, F&& f, bool internalNodes) const
+	{
+		const size_t base = m_stack.size();
+		m_stack.push_back(id);
+		while (m_stack.size() > base)
+		{
+			const uint32_t current = static_cast<uint32_t>(m_stack.back());
+			m_stack.pop_back();
+			const Node& n = m_nodes[current];
+			if (n.isLeaf() || internalNodes)
+				f(current);
+			if (!n.isLeaf())
+			{
+				m_stack.push_back(n.right);
+				m_stack.push_back(n.left);
+			}
+		}
+	}
+};
+
+//Entity tree kept in a DynamicBvh, the hierarchical counterpart of EntityCuller (culling.h)
+class EntityBvh
+{
+public:
+	DynamicBvh tree;
+	std::vector<Entity*> entities; //a leaf's userData indexes this
+
+	//Call after the tree's transforms are up to date. The first call, and any call after entities
+	//were added or removed, builds the tree; otherwise only the leaves of moved entities change.
+	void gather(Entity& root)
+	{
+		m_collected.clear();
+		collect(root);
+		if (m_collected != entities)
+		{
+			entities.swap(m_collected);
+			std::vector<BvhBox> boxes(entities.size());
+			for (size_t i = 0; i < entities.size(); ++i)
+				boxes[i] = BvhBox(entities[i]->getGlobalAABB());
+			tree.build(boxes, m_proxies);
+			return;
+		}
+		for (size_t i = 0; i < entities.size(); ++i)
+			tree.move(m_proxies[i], BvhBox(entities[i]->getGlobalAABB()));
+	}
+
+	//Same contract as Entity::drawSelfAndChild
+	void draw(const Frustum& frustum, Shader& ourShader, unsigned int& display, unsigned int& total)
+	{
+		tree.cullFrustum(frustum, [&](uint32_t index) {
+			Entity* entity = entities[index];
+			ourShader.setMat4("model", entity->transform.getModelMatrix());
+			entity->pModel->Draw(ourShader);
+			display++;
+		});
+		total += static_cast<unsigned int>(entities.size());
+	}
+
+	//Entity whose world box the ray hits first, or nullptr
+	Entity* pick(const glm::vec3& origin, const glm::vec3& dir, float maxDistance = std::numeric_limits<float>::max())
+	{
+		const uint32_t hit = tree.raycast(origin, dir, maxDistance);
+		return hit == DynamicBvh::NULL_NODE ? nullptr : entities[hit];
+	}
+
+private:
+	std::vector<Entity*> m_collected;
+	std::vector<uint32_t> m_proxies;
+
+	void collect(Entity& entity)
+	{
+		m_collected.push_back(&entity);
+		for (auto&& child : entity.children)
+			collect(*child);
+	}
+};
+#endif
@@ -0,0 +1,322 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <learnopengl/mesh.h>
+#include <learnopengl/bone_palette.h>
+#include <learnopengl/job_system.h>
+#include <learnopengl/simd_math.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CPU_SKINNING_AVX2 1
+#endif
+
+//Skinning input of one mesh as structure of arrays, so the AVX2 kernel loads 8 vertices per
+//instruction. Built once from the vertices of model_animation.h: the used influences come first,
+//so influence 0 is the first used bone (the hemisphere reference of dual quaternion blending, as
+//in the shader), unused ones (bone id -1) become bone 0 with weight 0, and the arrays are padded to
+//a multiple of 8 with such vertices.
+struct SkinningSource
+{
+	std::vector<float> positionX, positionY, positionZ;
+	std::vector<float> normalX, normalY, normalZ;
+	std::vector<int> boneIds[MAX_BONE_INFLUENCE];
+	std::vector<float> weights[MAX_BONE_INFLUENCE];
+
+	size_t Size() const { return m_Count; }
+
+	void Build(const std::vector<Vertex>& vertices)
+	{
+		m_Count = vertices.size();
+		const size_t padded = (m_Count + 7) & ~size_t(7);
+		for (std::vector<float>* component : { &positionX, &positionY, &positionZ, &normalX, &normalY, &normalZ })
+			component->assign(padded, 0.0f);
+		for (int k = 0; k < MAX_BONE_INFLUENCE; k++)
+		{
+			boneIds[k].assign(padded, 0);
+			weights[k].assign(padded, 0.0f);
+		}
+		for (size_t i = 0; i < m_Count; i++)
+		{
+			const Vertex& vertex = vertices[i];
+			positionX[i] = vertex.Position.x;
+			positionY[i] = vertex.Position.y;
+			positionZ[i] = vertex.Position.z;
+			normalX[i] = vertex.Normal.x;
+			normalY[i] = vertex.Normal.y;
+			normalZ[i] = vertex.Normal.z;
+			int used = 0;
+			for (int k = 0; k < MAX_BONE_INFLUENCE; k++)
+			{
+				if (vertex.m_BoneIDs[k] < 0)
+					continue;
+				boneIds[used][i] = vertex.m_BoneIDs[k];
+				weights[used][i] = vertex.m_Weights[k];
+				used++;
+			}
+		}
+	}
+
+private:
+	size_t m_Count = 0;
+};
+
+//Reference kernel: skins vertices [begin, end) of source with palette (PackBonePalette layout),
+//writing positions and, when not null, normals. Matches shaders/pbr_skinned.vert: weight missing
+//from a total of 1 goes to the identity, so that share of the vertex keeps its bind pose (for dual
+//quaternions, on the hemisphere of the first bone like the bones), and normals are not renormalized.
+inline void SkinVerticesScalar(const SkinningSource& source, const glm::vec4* palette, BonePaletteFormat format,
+	size_t begin, size_t end, glm::vec3* positions, glm::vec3* normals)
+{
+	for (size_t i = begin; i < end; i++)
+	{
+		const glm::vec3 position(source.positionX[i], source.positionY[i], source.positionZ[i]);
+		const glm::vec3 normal(source.normalX[i], source.normalY[i], source.normalZ[i]);
+		float total = 0.0f;
+		if (format == BonePaletteFormat::Matrix3x4)
+		{
+			glm::vec4 row0(0.0f), row1(0.0f), row2(0.0f);
+			for (int k = 0; k < MAX_BONE_INFLUENCE; k++)
+			{
+				const float weight = source.weights[k][i];
+				const glm::vec4* bone = palette + source.boneIds[k][i] * 3;
+				row0 += bone[0] * weight;
+				row1 += bone[1] * weight;
+				row2 += bone[2] * weight;
+				total += weight;
+			}
+			row0.x += 1.0f - total;
+			row1.y += 1.0f - total;
+			row2.z += 1.0f - total;
+			positions[i] = glm::vec3(glm::dot(glm::vec3(row0), position) + row0.w,
+				glm::dot(glm::vec3(row1), position) + row1.w, glm::dot(glm::vec3(row2), position) + row2.w);
+			if (normals)
+				normals[i] = glm::vec3(glm::dot(glm::vec3(row0), normal), glm::dot(glm::vec3(row1), normal), glm::dot(glm::vec3(row2), normal));
+		}
+		else
+		{
+			glm::vec4 real(0.0f), dual(0.0f);
+			const glm::vec4 first = palette[source.boneIds[0][i] * 2];
+			for (int k = 0; k < MAX_BONE_INFLUENCE; k++)
+			{
+				const glm::vec4* bone = palette + source.boneIds[k][i] * 2;
+				const float weight = glm::dot(first, bone[0]) < 0.0f ? -source.weights[k][i] : source.weights[k][i];
+				real += bone[0] * weight;
+				dual += bone[1] * weight;
+				total += source.weights[k][i];
+			}
+			real.w += first.w < 0.0f ? total - 1.0f : 1.0f - total;
+			const float invLength = 1.0f / glm::length(real);
+			real *= invLength;
+			dual *= invLength;
+			const glm::vec3 axis(real);
+			positions[i] = position + 2.0f * glm::cross(axis, glm::cross(axis, position) + real.w * position)
+				+ 2.0f * (real.w * glm::vec3(dual) - dual.w * axis + glm::cross(axis, glm::vec3(dual)));
+			if (normals)
+				normals[i] = normal + 2.0f * glm::cross(axis, glm::cross(axis, normal) + real.w * normal);
+		}
+	}
+}
+
+#ifdef CPU_SKINNING_AVX2
+namespace cpu_skinning_detail
+{
+	inline __m256 Madd(__m256 a, __m256 b, __m256 c)
+	{
+		return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+	}
+
+	//Row row of the palette entries of 8 vertices (entry ids[j] of stride vec4s for lane j), as 4
+	//vectors of 8 lanes: 8 row loads and a transpose, cheaper than 4 gathers
+	inline void LoadRows(const glm::vec4* palette, const int* ids, int stride, int row, __m256 out[4])
+	{
+		auto pair = [&](int low, int high) {
+			return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(&palette[ids[low] * stride + row].x)),
+				_mm_loadu_ps(&palette[ids[high] * stride + row].x), 1);
+		};
+		const __m256 a0 = pair(0, 4), a1 = pair(1, 5), a2 = pair(2, 6), a3 = pair(3, 7);
+		const __m256 t0 = _mm256_unpacklo_ps(a0, a1); //x0 x1 y0 y1 | x4 x5 y4 y5
+		const __m256 t1 = _mm256_unpackhi_ps(a0, a1); //z0 z1 w0 w1 | z4 z5 w4 w5
+		const __m256 t2 = _mm256_unpacklo_ps(a2, a3);
+		const __m256 t3 = _mm256_unpackhi_ps(a2, a3);
+		out[0] = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+		out[1] = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+		out[2] = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+		out[3] = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+	}
+
+	//writes lanes [0, count) of x, y, z as packed vec3s
+	inline void StoreVec3(__m256 x, __m256 y, __m256 z, size_t count, glm::vec3* out)
+	{
+		alignas(32) float lanes[3][8];
+		_mm256_store_ps(lanes[0], x);
+		_mm256_store_ps(lanes[1], y);
+		_mm256_store_ps(lanes[2], z);
+		for (size_t j = 0; j < count; j++)
+			out[j] = glm::vec3(lanes[0][j], lanes[1][j], lanes[2][j]);
+	}
+}
+#endif
+
+//Same as SkinVerticesScalar, 8 vertices per iteration with AVX2 when the target has it.
+//begin must be a multiple of 8 (the source is padded, so end need not be).
+inline void SkinVertices(const SkinningSource& source, const glm::vec4* palette, BonePaletteFormat format,
+	size_t begin, size_t end, glm::vec3* positions, glm::vec3* normals)
+{
+#ifdef CPU_SKINNING_AVX2
+	using namespace cpu_skinning_detail;
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 sign = _mm256_set1_ps(-0.0f);
+	const __m256 zero = _mm256_setzero_ps();
+	for (size_t i = begin; i < end; i += 8)
+	{
+		const __m256 px = _mm256_loadu_ps(&source.positionX[i]);
+		const __m256 py = _mm256_loadu_ps(&source.positionY[i]);
+		const __m256 pz = _mm256_loadu_ps(&source.positionZ[i]);
+		const __m256 nx = _mm256_loadu_ps(&source.normalX[i]);
+		const __m256 ny = _mm256_loadu_ps(&source.normalY[i]);
+		const __m256 nz = _mm256_loadu_ps(&source.normalZ[i]);
+		const size_t count = std::min<size_t>(8, end - i);
+		__m256 total = _mm256_setzero_ps();
+		__m256 x, y, z, normalX, normalY, normalZ;
+		if (format == BonePaletteFormat::Matrix3x4)
+		{
+			//blended 3x4 matrix, m[row * 4 + column]
+			__m256 m[12];
+			for (int c = 0; c < 12; c++)
+				m[c] = _mm256_setzero_ps();
+			for (int k = 0; k < MAX_BONE_INFLUENCE; k++)
+			{
+				const __m256 weight = _mm256_loadu_ps(&source.weights[k][i]);
+				if (_mm256_movemask_ps(_mm256_cmp_ps(weight, zero, _CMP_NEQ_OQ)) == 0)
+					continue; //no vertex of the 8 uses this influence: skip its loads
+				__m256 bone[12];
+				for (int row = 0; row < 3; row++)
+					LoadRows(palette, &source.boneIds[k][i], 3, row, bone + row * 4);
+				for (int c = 0; c < 12; c++)
+					m[c] = Madd(bone[c], weight, m[c]);
+				total = _mm256_add_ps(total, weight);
+			}
+			const __m256 rest = _mm256_sub_ps(one, total);
+			m[0] = _mm256_add_ps(m[0], rest);
+			m[5] = _mm256_add_ps(m[5], rest);
+			m[10] = _mm256_add_ps(m[10], rest);
+			x = Madd(m[0], px, Madd(m[1], py, Madd(m[2], pz, m[3])));
+			y = Madd(m[4], px, Madd(m[5], py, Madd(m[6], pz, m[7])));
+			z = Madd(m[8], px, Madd(m[9], py, Madd(m[10], pz, m[11])));
+			normalX = Madd(m[0], nx, Madd(m[1], ny, _mm256_mul_ps(m[2], nz)));
+			normalY = Madd(m[4], nx, Madd(m[5], ny, _mm256_mul_ps(m[6], nz)));
+			normalZ = Madd(m[8], nx, Madd(m[9], ny, _mm256_mul_ps(m[10], nz)));
+		}
+		else
+		{
+			//blended dual quaternion, q[0..3] real xyzw, q[4..7] dual xyzw
+			__m256 q[8], first[4];
+			for (int c = 0; c < 8; c++)
+				q[c] = _mm256_setzero_ps();
+			for (int k = 0; k < MAX_BONE_INFLUENCE; k++)
+			{
+				const __m256 weight = _mm256_loadu_ps(&source.weights[k][i]);
+				if (k > 0 && _mm256_movemask_ps(_mm256_cmp_ps(weight, zero, _CMP_NEQ_OQ)) == 0)
+					continue;
+				__m256 bone[8];
+				LoadRows(palette, &source.boneIds[k][i], 2, 0, bone);
+				LoadRows(palette, &source.boneIds[k][i], 2, 1, bone + 4);
+				if (k == 0)
+				{
+					for (int c = 0; c < 4; c++)
+						first[c] = bone[c];
+				}
+				//negate the weight of bones on the other hemisphere than the first one
+				const __m256 dot = Madd(first[0], bone[0], Madd(first[1], bone[1], Madd(first[2], bone[2], _mm256_mul_ps(first[3], bone[3]))));
+				const __m256 signedWeight = _mm256_xor_ps(weight, _mm256_and_ps(dot, sign));
+				for (int c = 0; c < 8; c++)
+					q[c] = Madd(bone[c], signedWeight, q[c]);
+				total = _mm256_add_ps(total, weight);
+			}
+			q[3] = _mm256_add_ps(q[3], _mm256_xor_ps(_mm256_sub_ps(one, total), _mm256_and_ps(_mm256_cmp_ps(first[3], zero, _CMP_LT_OQ), sign)));
+			const __m256 invLength = _mm256_div_ps(one, _mm256_sqrt_ps(Madd(q[0], q[0], Madd(q[1], q[1], Madd(q[2], q[2], _mm256_mul_ps(q[3], q[3]))))));
+			for (int c = 0; c < 8; c++)
+				q[c] = _mm256_mul_ps(q[c], invLength);
+			const __m256 two = _mm256_set1_ps(2.0f);
+
+			//v + 2 * cross(r, cross(r, v) + w * v)
+			auto rotate = [&](__m256 vx, __m256 vy, __m256 vz, __m256& ox, __m256& oy, __m256& oz) {
+				const __m256 cx = Madd(q[3], vx, _mm256_sub_ps(_mm256_mul_ps(q[1], vz), _mm256_mul_ps(q[2], vy)));
+				const __m256 cy = Madd(q[3], vy, _mm256_sub_ps(_mm256_mul_ps(q[2], vx), _mm256_mul_ps(q[0], vz)));
+				const __m256 cz = Madd(q[3], vz, _mm256_sub_ps(_mm256_mul_ps(q[0], vy), _mm256_mul_ps(q[1], vx)));
+				ox = Madd(two, _mm256_sub_ps(_mm256_mul_ps(q[1], cz), _mm256_mul_ps(q[2], cy)), vx);
+				oy = Madd(two, _mm256_sub_ps(_mm256_mul_ps(q[2], cx), _mm256_mul_ps(q[0], cz)), vy);
+				oz = Madd(two, _mm256_sub_ps(_mm256_mul_ps(q[0], cy), _mm256_mul_ps(q[1], cx)), vz);
+			};
+			rotate(px, py, pz, x, y, z);
+			rotate(nx, ny, nz, normalX, normalY, normalZ);
+			//+ 2 * (w * dual - dual.w * real + cross(real, dual))
+			x = Madd(two, _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(q[3], q[4]), _mm256_mul_ps(q[7], q[0])), _mm256_sub_ps(_mm256_mul_ps(q[1], q[6]), _mm256_mul_ps(q[2], q[5]))), x);
+			y = Madd(two, _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(q[3], q[5]), _mm256_mul_ps(q[7], q[1])), _mm256_sub_ps(_mm256_mul_ps(q[2], q[4]), _mm256_mul_ps(q[0], q[6]))), y);
+			z = Madd(two, _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(q[3], q[6]), _mm256_mul_ps(q[7], q[2])), _mm256_sub_ps(_mm256_mul_ps(q[0], q[5]), _mm256_mul_ps(q[1], q[4]))), z);
+		}
+		StoreVec3(x, y, z, count, positions + i);
+		if (normals)
+			StoreVec3(normalX, normalY, normalZ, count, normals + i);
+	}
+#else
+	SkinVerticesScalar(source, palette, format, begin, end, positions, normals);
+#endif
+}
+
+//Skins meshes on the CPU, for headless renders, bounds updates and picking. SetPalette packs the
+//frame's bone matrices once; Skin writes every vertex into caller owned streams (preallocated
+//arrays, or a mapped vertex buffer of packed vec3s), split into jobs over vertex ranges.
+class CpuSkinner
+{
+public:
+	explicit CpuSkinner(BonePaletteFormat format = BonePaletteFormat::Matrix3x4)
+		: m_Format(format)
+	{
+	}
+
+	BonePaletteFormat GetFormat() const { return m_Format; }
+
+	//count final bone matrices (Animator::GetFinalBoneMatrices...)
+	void SetPalette(const SimdMat4* matrices, size_t count)
+	{
+		m_Palette.resize(std::max<size_t>(count, 1) * GetBonePaletteTexelsPerBone(m_Format));
+		if (count == 0)
+		{
+			const SimdMat4 identity(1.0f);
+			PackBonePalette(m_Format, &identity, 1, m_Palette.data());
+		}
+		PackBonePalette(m_Format, matrices, count, m_Palette.data());
+	}
+
+	void SetPalette(const std::vector<SimdMat4>& matrices)
+	{
+		SetPalette(matrices.data(), matrices.size());
+	}
+
+	//positions (and normals, unless null) hold source.Size() vertices
+	void Skin(const SkinningSource& source, glm::vec3* positions, glm::vec3* normals = nullptr) const
+	{
+		SkinVertices(source, m_Palette.data(), m_Format, 0, source.Size(), positions, normals);
+	}
+
+	//chunkSize is rounded up to a multiple of 8
+	void Skin(JobSystem& jobs, const SkinningSource& source, glm::vec3* positions, glm::vec3* normals = nullptr,
+		size_t chunkSize = 4096) const
+	{
+		chunkSize = (std::max<size_t>(chunkSize, 8) + 7) & ~size_t(7);
+		const glm::vec4* palette = m_Palette.data();
+		const BonePaletteFormat format = m_Format;
+		jobs.parallelFor(source.Size(), chunkSize, [&](size_t begin, size_t end) {
+			SkinVertices(source, palette, format, begin, end, positions, normals);
+		});
+	}
+
+private:
+	BonePaletteFormat m_Format;
+	std::vector<glm::vec4> m_Palette;
+};
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+#include <learnopengl/animation.h>
+#include <learnopengl/job_system.h>
+#include <learnopengl/simd_math.h>
+
+//Plays thousands of animation instances at once. Instances only own their playback state (time,
+//speed and bone cursors); the Animation they play is shared and read only, so instances are
+//evaluated in parallel jobs (Animation::Evaluate).
+//
+//The final bone matrices of all instances form one contiguous palette buffer, paletteSize matrices
+//per instance, in instance order: it can be uploaded in one call, or UpdateAnimations can write it
+//straight into a mapped GL buffer. Nothing is allocated per frame once the instances are added.
+class CrowdAnimator
+{
+public:
+	//paletteSize is the number of matrices per instance in the palette buffer; it must cover the
+	//bone slots of every animation played. 0 takes the bone slot count of the first instance's
+	//animation.
+	explicit CrowdAnimator(int paletteSize = 0)
+		: m_PaletteSize(paletteSize)
+	{
+	}
+
+	void Reserve(size_t instanceCount)
+	{
+		m_Instances.reserve(instanceCount);
+		m_Palettes.reserve(instanceCount * m_PaletteSize);
+	}
+
+	//Adds an instance playing animation from startTime (in seconds of the clip, whatever the speed)
+	//at speed times its normal rate. Returns the instance index, which is also the index of its
+	//palette.
+	size_t AddInstance(Animation* animation, float startTime = 0.0f, float speed = 1.0f)
+	{
+		if (m_PaletteSize == 0)
+			m_PaletteSize = std::max(1, animation->GetBoneSlotCount());
+		assert(animation->GetBoneSlotCount() <= m_PaletteSize);
+		Instance instance;
+		instance.animation = animation;
+		instance.speed = speed;
+		instance.firstCursor = m_Cursors.size();
+		const float duration = animation->GetDuration();
+		instance.time = fmod(startTime * animation->GetTicksPerSecond(), duration);
+		if (instance.time < 0.0f)
+			instance.time += duration;
+		m_Instances.push_back(instance);
+
+		m_Cursors.resize(m_Cursors.size() + animation->GetTrackCount());
+		m_Palettes.resize(m_Palettes.size() + m_PaletteSize, SimdMat4(1.0f));
+		m_MaxNodeCount = std::max(m_MaxNodeCount, animation->GetNodes().size());
+		return m_Instances.size() - 1;
+	}
+
+	//Advances every instance by dt seconds and evaluates it, chunkSize instances per job.
+	//The palettes are written to destination when given, for example a mapped GL buffer of
+	//GetPaletteBufferSize() bytes (16 byte aligned), and to GetPalettes() otherwise. Matrices past
+	//an animation's GetBoneSlotCount() are left untouched in destination.
+	void UpdateAnimations(JobSystem& jobs, float dt, SimdMat4* destination = nullptr, size_t chunkSize = 64)
+	{
+		SimdMat4* palettes = destination ? destination : m_Palettes.data();
+
+		//scratch global transforms, one buffer per participating thread
+		if (m_Scratch.size() != jobs.threadCount())
+			m_Scratch.resize(jobs.threadCount());
+		for (std::vector<SimdMat4>& scratch : m_Scratch)
+		{
+			if (scratch.size() < m_MaxNodeCount)
+				scratch.resize(m_MaxNodeCount);
+		}
+
+		jobs.parallelFor(m_Instances.size(), chunkSize, [&](size_t begin, size_t end) {
+			SimdMat4* globalTransforms = m_Scratch[jobs.currentThreadIndex()].data();
+			for (size_t i = begin; i < end; i++)
+			{
+				Instance& instance = m_Instances[i];
+				Advance(instance, dt);
+				instance.animation->Evaluate(instance.time, &m_Cursors[instance.firstCursor], globalTransforms,
+					palettes + i * m_PaletteSize);
+			}
+		});
+	}
+
+	size_t GetInstanceCount() const { return m_Instances.size(); }
+	int GetPaletteSize() const { return m_PaletteSize; }
+	size_t GetPaletteBufferSize() const { return m_Instances.size() * m_PaletteSize * sizeof(SimdMat4); }
+
+	//all palettes, instance i starting at i * GetPaletteSize()
+	const std::vector<SimdMat4>& GetPalettes() const { return m_Palettes; }
+
+	const SimdMat4* GetPalette(size_t instance) const
+	{
+		return &m_Palettes[instance * m_PaletteSize];
+	}
+
+private:
+	struct Instance
+	{
+		Animation* animation;
+		float time; //in ticks, like Animator
+		float speed;
+		size_t firstCursor; //first of the instance's BoneCursors in m_Cursors
+	};
+
+	void Advance(Instance& instance, float dt)
+	{
+		const float duration = instance.animation->GetDuration();
+		instance.time = fmod(instance.time + instance.animation->GetTicksPerSecond() * instance.speed * dt, duration);
+		if (instance.time < 0.0f)
+			instance.time += duration;
+	}
+
+	int m_PaletteSize;
+	std::vector<Instance> m_Instances;
+	std::vector<BoneCursor> m_Cursors;
+	std::vector<SimdMat4> m_Palettes;
+	std::vector<std::vector<SimdMat4>> m_Scratch;
+	size_t m_MaxNodeCount = 0;
+};
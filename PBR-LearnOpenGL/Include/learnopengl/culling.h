@@ -0,0 +1,400 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <glm/glm.hpp> //glm::vec3
+#include <cstdint> //uint64_t
+#include <cstddef> //size_t
+#include <vector> //std::vector
+#include <algorithm> //std::sort
+#include <functional> //std::less
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define CULLING_AVX 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CULLING_SSE 1
+#endif
+
+#include <learnopengl/entity.h>
+#include <learnopengl/scene_graph.h>
+
+//Population count of a visibility word, without relying on a POPCNT capable target
+inline unsigned int countVisibleBits(uint64_t word)
+{
+	word = word - ((word >> 1) & 0x5555555555555555ull);
+	word = (word & 0x3333333333333333ull) + ((word >> 2) & 0x3333333333333333ull);
+	word = (word + (word >> 4)) & 0x0f0f0f0f0f0f0f0full;
+	return static_cast<unsigned int>((word * 0x0101010101010101ull) >> 56);
+}
+
+//World space AABBs stored as structure of arrays (one array per component), so a frustum test
+//can load 4 (SSE) or 8 (AVX) boxes per instruction. The arrays are always padded to a multiple
+//of 8 entries; padding boxes are never reported as visible.
+class BoundsSoA
+{
+public:
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<float> extentX, extentY, extentZ;
+
+	size_t size() const
+	{
+		return m_count;
+	}
+
+	void clear()
+	{
+		resize(0);
+	}
+
+	void resize(size_t count)
+	{
+		m_count = count;
+		const size_t padded = (count + 7) & ~size_t(7);
+		centerX.resize(padded, 0.f);
+		centerY.resize(padded, 0.f);
+		centerZ.resize(padded, 0.f);
+		extentX.resize(padded, 0.f);
+		extentY.resize(padded, 0.f);
+		extentZ.resize(padded, 0.f);
+	}
+
+	void set(size_t index, const glm::vec3& center, const glm::vec3& extents)
+	{
+		centerX[index] = center.x;
+		centerY[index] = center.y;
+		centerZ[index] = center.z;
+		extentX[index] = extents.x;
+		extentY[index] = extents.y;
+		extentZ[index] = extents.z;
+	}
+
+	//Stores the world AABB of a local AABB moved by modelMatrix: the center is transformed and the
+	//extents become |M| * extents (upper 3x3, absolute values), the same box Entity::getGlobalAABB builds
+	void setTransformed(size_t index, const AABB& local, const glm::mat4& modelMatrix)
+	{
+		const glm::vec3 center{ modelMatrix * glm::vec4(local.center, 1.f) };
+		const glm::vec3 extents{
+			std::abs(modelMatrix[0][0]) * local.extents.x + std::abs(modelMatrix[1][0]) * local.extents.y + std::abs(modelMatrix[2][0]) * local.extents.z,
+			std::abs(modelMatrix[0][1]) * local.extents.x + std::abs(modelMatrix[1][1]) * local.extents.y + std::abs(modelMatrix[2][1]) * local.extents.z,
+			std::abs(modelMatrix[0][2]) * local.extents.x + std::abs(modelMatrix[1][2]) * local.extents.y + std::abs(modelMatrix[2][2]) * local.extents.z };
+		set(index, center, extents);
+	}
+
+	size_t push(const glm::vec3& center, const glm::vec3& extents)
+	{
+		const size_t index = m_count;
+		resize(m_count + 1);
+		set(index, center, extents);
+		return index;
+	}
+
+private:
+	size_t m_count = 0;
+};
+
+//Frustum planes in the form the batch test wants: normal, distance and absolute normal per plane
+struct FrustumPlanesSoA
+{
+	float nx[6], ny[6], nz[6], d[6];
+	float ax[6], ay[6], az[6];
+
+	explicit FrustumPlanesSoA(const Frustum& frustum)
+	{
+		const Plan* planes[6] = { &frustum.leftFace, &frustum.rightFace, &frustum.topFace,
+			&frustum.bottomFace, &frustum.nearFace, &frustum.farFace };
+		for (int i = 0; i < 6; ++i)
+		{
+			nx[i] = planes[i]->normal.x;
+			ny[i] = planes[i]->normal.y;
+			nz[i] = planes[i]->normal.z;
+			d[i] = planes[i]->distance;
+			ax[i] = std::abs(nx[i]);
+			ay[i] = std::abs(ny[i]);
+			az[i] = std::abs(nz[i]);
+		}
+	}
+};
+
+//Reference version of cullFrustum, one box at a time. Same test as AABB::isOnOrForwardPlan:
+//a box is kept while -r <= signed distance of its center for every plane.
+inline size_t cullFrustumScalar(const Frustum& frustum, const BoundsSoA& bounds, std::vector<uint64_t>& visibleMask)
+{
+	const FrustumPlanesSoA p(frustum);
+	const size_t count = bounds.size();
+	visibleMask.assign((count + 63) / 64, 0);
+	size_t visible = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		bool inside = true;
+		for (int k = 0; k < 6 && inside; ++k)
+		{
+			const float dist = p.nx[k] * bounds.centerX[i] + p.ny[k] * bounds.centerY[i] + p.nz[k] * bounds.centerZ[i] - p.d[k];
+			const float r = p.ax[k] * bounds.extentX[i] + p.ay[k] * bounds.extentY[i] + p.az[k] * bounds.extentZ[i];
+			inside = -r <= dist;
+		}
+		if (inside)
+		{
+			visibleMask[i >> 6] |= uint64_t(1) << (i & 63);
+			++visible;
+		}
+	}
+	return visible;
+}
+
+//Tests boxes [begin, end) of bounds and ORs one bit per visible box into visibleMask (bit i of
+//word i / 64). begin must be a multiple of 64 and end a multiple of 8 or bounds.centerX.size(), so
+//ranges handed to different threads never share a mask word. Padding boxes may set bits; callers
+//clear them (see cullFrustum).
+inline void cullFrustumRange(const FrustumPlanesSoA& p, const BoundsSoA& bounds, size_t begin, size_t end, uint64_t* visibleMask)
+{
+#if defined(CULLING_AVX) || defined(CULLING_SSE)
+#if defined(CULLING_AVX)
+	const size_t WIDTH = 8;
+	__m256 nx[6], ny[6], nz[6], d[6], ax[6], ay[6], az[6];
+	for (int k = 0; k < 6; ++k)
+	{
+		nx[k] = _mm256_set1_ps(p.nx[k]); ny[k] = _mm256_set1_ps(p.ny[k]); nz[k] = _mm256_set1_ps(p.nz[k]);
+		d[k] = _mm256_set1_ps(p.d[k]);
+		ax[k] = _mm256_set1_ps(p.ax[k]); ay[k] = _mm256_set1_ps(p.ay[k]); az[k] = _mm256_set1_ps(p.az[k]);
+	}
+	const __m256 zero = _mm256_setzero_ps();
+	for (size_t i = begin; i < end; i += WIDTH)
+	{
+		const __m256 cx = _mm256_loadu_ps(&bounds.centerX[i]);
+		const __m256 cy = _mm256_loadu_ps(&bounds.centerY[i]);
+		const __m256 cz = _mm256_loadu_ps(&bounds.centerZ[i]);
+		const __m256 ex = _mm256_loadu_ps(&bounds.extentX[i]);
+		const __m256 ey = _mm256_loadu_ps(&bounds.extentY[i]);
+		const __m256 ez = _mm256_loadu_ps(&bounds.extentZ[i]);
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int k = 0; k < 6; ++k)
+		{
+			//dist + r >= 0  <=>  -r <= dist
+			__m256 dist = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx[k], cx), _mm256_mul_ps(ny[k], cy)), _mm256_mul_ps(nz[k], cz)), d[k]);
+			__m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax[k], ex), _mm256_mul_ps(ay[k], ey)), _mm256_mul_ps(az[k], ez));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(dist, r), zero, _CMP_GE_OQ));
+		}
+		const uint64_t bits = static_cast<unsigned int>(_mm256_movemask_ps(inside));
+		visibleMask[i >> 6] |= bits << (i & 63);
+	}
+#else
+	const size_t WIDTH = 4;
+	__m128 nx[6], ny[6], nz[6], d[6], ax[6], ay[6], az[6];
+	for (int k = 0; k < 6; ++k)
+	{
+		nx[k] = _mm_set1_ps(p.nx[k]); ny[k] = _mm_set1_ps(p.ny[k]); nz[k] = _mm_set1_ps(p.nz[k]);
+		d[k] = _mm_set1_ps(p.d[k]);
+		ax[k] = _mm_set1_ps(p.ax[k]); ay[k] = _mm_set1_ps(p.ay[k]); az[k] = _mm_set1_ps(p.az[k]);
+	}
+	const __m128 zero = _mm_setzero_ps();
+	for (size_t i = begin; i < end; i += WIDTH)
+	{
+		const __m128 cx = _mm_loadu_ps(&bounds.centerX[i]);
+		const __m128 cy = _mm_loadu_ps(&bounds.centerY[i]);
+		const __m128 cz = _mm_loadu_ps(&bounds.centerZ[i]);
+		const __m128 ex = _mm_loadu_ps(&bounds.extentX[i]);
+		const __m128 ey = _mm_loadu_ps(&bounds.extentY[i]);
+		const __m128 ez = _mm_loadu_ps(&bounds.extentZ[i]);
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int k = 0; k < 6; ++k)
+		{
+			//dist + r >= 0  <=>  -r <= dist
+			__m128 dist = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[k], cx), _mm_mul_ps(ny[k], cy)), _mm_mul_ps(nz[k], cz)), d[k]);
+			__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax[k], ex), _mm_mul_ps(ay[k], ey)), _mm_mul_ps(az[k], ez));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(dist, r), zero));
+		}
+		const uint64_t bits = static_cast<unsigned int>(_mm_movemask_ps(inside));
+		visibleMask[i >> 6] |= bits << (i & 63);
+	}
+#endif
+#else
+	for (size_t i = begin; i < end; ++i)
+	{
+		bool inside = true;
+		for (int k = 0; k < 6 && inside; ++k)
+		{
+			const float dist = p.nx[k] * bounds.centerX[i] + p.ny[k] * bounds.centerY[i] + p.nz[k] * bounds.centerZ[i] - p.d[k];
+			const float r = p.ax[k] * bounds.extentX[i] + p.ay[k] * bounds.extentY[i] + p.az[k] * bounds.extentZ[i];
+			inside = -r <= dist;
+		}
+		if (inside)
+			visibleMask[i >> 6] |= uint64_t(1) << (i & 63);
+	}
+#endif
+}
+
+//Clears the bits of padding boxes (index >= count) and returns how many bits are left
+inline size_t trimVisibleMask(std::vector<uint64_t>& visibleMask, size_t count)
+{
+	visibleMask.resize((count + 63) / 64);
+	if (count & 63)
+		visibleMask.back() &= (uint64_t(1) << (count & 63)) - 1;
+	size_t visible = 0;
+	for (uint64_t word : visibleMask)
+		visible += countVisibleBits(word);
+	return visible;
+}
+
+//Tests every box of bounds against the six frustum planes and writes one bit per box into
+//visibleMask (bit i of word i / 64, set when box i is at least partly inside). Returns the number
+//of visible boxes. Uses 8-wide AVX or 4-wide SSE when the target has it, the scalar loop otherwise.
+inline size_t cullFrustum(const Frustum& frustum, const BoundsSoA& bounds, std::vector<uint64_t>& visibleMask)
+{
+	const FrustumPlanesSoA p(frustum);
+	const size_t padded = bounds.centerX.size();
+	visibleMask.assign((padded + 63) / 64, 0);
+	if (padded)
+		cullFrustumRange(p, bounds, 0, padded, visibleMask.data());
+	return trimVisibleMask(visibleMask, bounds.size());
+}
+
+//Fills bounds with the world AABB of every node of scene (after SceneGraph::update), so bit i of a
+//cullFrustum mask refers to node i. Nodes without a model get an empty box at their origin.
+//The range version only writes nodes [begin, end); bounds must already have scene.size() entries.
+inline void gatherSceneBounds(const SceneGraph& scene, BoundsSoA& bounds, size_t begin, size_t end)
+{
+	for (size_t i = begin; i < end; ++i)
+	{
+		glm::vec3 c, e;
+		transformAABB(scene.worldMatrices[i], scene.boundsCenters[i], scene.boundsExtents[i], c, e);
+		bounds.centerX[i] = c.x;
+		bounds.centerY[i] = c.y;
+		bounds.centerZ[i] = c.z;
+		bounds.extentX[i] = e.x;
+		bounds.extentY[i] = e.y;
+		bounds.extentZ[i] = e.z;
+	}
+}
+
+inline void gatherSceneBounds(const SceneGraph& scene, BoundsSoA& bounds)
+{
+	bounds.resize(scene.size());
+	gatherSceneBounds(scene, bounds, 0, scene.size());
+}
+
+//Culls a whole Entity tree in one batch instead of one virtual isOnFrustum call per node:
+//gather() flattens the tree and stores every world AABB in a BoundsSoA, draw() culls the batch
+//and draws the visible entities.
+class EntityCuller
+{
+public:
+	BoundsSoA bounds;
+	std::vector<Entity*> entities;
+	std::vector<uint64_t> visibleMask;
+
+	//Call after the tree's transforms are up to date
+	void gather(Entity& root)
+	{
+		entities.clear();
+		collect(root);
+		bounds.resize(entities.size());
+		for (size_t i = 0; i < entities.size(); ++i)
+		{
+			const AABB& box = entities[i]->getGlobalAABB();
+			bounds.set(i, box.center, box.extents);
+		}
+	}
+
+	//Same contract as Entity::drawSelfAndChild
+	void draw(const Frustum& frustum, Shader& ourShader, unsigned int& display, unsigned int& total)
+	{
+		cull(frustum);
+		drawVisible(ourShader, display, total);
+	}
+
+	//draw() in two steps, so visibleMask can be narrowed further in between (e.g. by occlusion.h)
+	size_t cull(const Frustum& frustum)
+	{
+		return cullFrustum(frustum, bounds, visibleMask);
+	}
+
+	void drawVisible(Shader& ourShader, unsigned int& display, unsigned int& total)
+	{
+		for (size_t word = 0; word < visibleMask.size(); ++word)
+		{
+			for (uint64_t bits = visibleMask[word]; bits; bits &= bits - 1)
+			{
+				const size_t bit = countVisibleBits((bits & (~bits + 1)) - 1); //index of the lowest set bit
+				Entity* entity = entities[word * 64 + bit];
+				ourShader.setMat4("model", entity->transform.getModelMatrix());
+				entity->pModel->Draw(ourShader);
+				display++;
+			}
+		}
+		total += static_cast<unsigned int>(entities.size());
+	}
+
+private:
+	void collect(Entity& entity)
+	{
+		entities.push_back(&entity);
+		for (auto&& child : entity.children)
+			collect(*child);
+	}
+};
+//Frame culling of a SceneGraph on a JobSystem. The nodes are cut into chunks; each job builds
+//the world boxes of its chunk, culls them and appends the visible nodes that have a model to
+//the draw list of the thread it runs on. The per-thread lists are then merged and sorted by model,
+//so the context thread only walks one list and issues the GL calls (draw()).
+class SceneCuller
+{
+public:
+	static const size_t CHUNK_SIZE = 4096; //multiple of 64: chunks never share a mask word
+
+	BoundsSoA bounds;
+	std::vector<uint64_t> visibleMask;
+	std::vector<uint32_t> drawList; //visible model nodes, grouped by model
+
+	//Call after SceneGraph::update/updateParallel. Returns the number of visible nodes (with or without a model).
+	size_t cull(JobSystem& jobs, const SceneGraph& scene, const Frustum& frustum)
+	{
+		const FrustumPlanesSoA planes(frustum);
+		const size_t count = scene.size();
+		bounds.resize(count);
+		const size_t padded = bounds.centerX.size();
+		visibleMask.assign((padded + 63) / 64, 0);
+		m_threadLists.resize(jobs.threadCount());
+		for (std::vector<uint32_t>& list : m_threadLists)
+			list.clear();
+
+		jobs.parallelFor(count, CHUNK_SIZE, [&](size_t begin, size_t end) {
+			gatherSceneBounds(scene, bounds, begin, end);
+			//the padding of the last chunk is zero sized boxes at the origin; they are dropped below
+			const size_t testEnd = end == count ? padded : end;
+			cullFrustumRange(planes, bounds, begin, testEnd, visibleMask.data());
+			std::vector<uint32_t>& list = m_threadLists[jobs.currentThreadIndex()];
+			for (size_t word = begin >> 6; word < (testEnd + 63) >> 6; ++word)
+			{
+				for (uint64_t bits = visibleMask[word]; bits; bits &= bits - 1)
+				{
+					const size_t node = word * 64 + countVisibleBits((bits & (~bits + 1)) - 1);
+					if (node < end && scene.models[node])
+						list.push_back(static_cast<uint32_t>(node));
+				}
+			}
+		});
+
+		drawList.clear();
+		for (const std::vector<uint32_t>& list : m_threadLists)
+			drawList.insert(drawList.end(), list.begin(), list.end());
+		std::sort(drawList.begin(), drawList.end(), [&scene](uint32_t a, uint32_t b) {
+			return scene.models[a] != scene.models[b] ? std::less<Model*>()(scene.models[a], scene.models[b]) : a < b;
+		});
+		return trimVisibleMask(visibleMask, count);
+	}
+
+	//GL submission of the last cull(); context thread only
+	void draw(const SceneGraph& scene, Shader& ourShader) const
+	{
+		for (uint32_t node : drawList)
+		{
+			ourShader.setMat4("model", scene.worldMatrices[node]);
+			scene.models[node]->Draw(ourShader);
+		}
+	}
+
+private:
+	std::vector<std::vector<uint32_t>> m_threadLists;
+};
+#endif
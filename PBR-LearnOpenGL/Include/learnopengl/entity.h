@@ -5,67 +5,95 @@
 #include <list> //std::list
 #include <array> //std::array
 #include <memory> //std::unique_ptr
+#include <limits> //std::numeric_limits
+#include <glm/gtc/quaternion.hpp> //glm::quat
 
+#include <learnopengl/simd_math.h>
+
+//Local transform stored as translation, rotation quaternion and scale. The local matrix is cached
+//and only rebuilt after a setter changed it; computeModelMatrix also caches the global scale, so
+//culling never takes square roots. A transform nobody touches costs nothing per frame.
+//Both matrices are SimdMat4, aligned SIMD storage when PBR_SIMD_MATH is defined (simd_math.h).
 class Transform
 {
 protected:
 	//Local space information
 	glm::vec3 m_pos = { 0.0f, 0.0f, 0.0f };
-	glm::vec3 m_eulerRot = { 0.0f, 0.0f, 0.0f }; //In degrees
+	glm::quat m_rotation = { 1.0f, 0.0f, 0.0f, 0.0f };
 	glm::vec3 m_scale = { 1.0f, 1.0f, 1.0f };
+	SimdMat4 m_localMatrix = SimdMat4(1.0f);
 
 	//Global space informaiton concatenate in matrix
-	glm::mat4 m_modelMatrix = glm::mat4(1.0f);
+	SimdMat4 m_modelMatrix = SimdMat4(1.0f);
+	glm::vec3 m_globalScale = { 1.0f, 1.0f, 1.0f };
 
-	//Dirty flag
+	//Dirty flags: m_isDirty until the model matrix is recomputed, m_isLocalDirty until the local one is
 	bool m_isDirty = true;
+	bool m_isLocalDirty = true;
 
 protected:
-	glm::mat4 getLocalModelMatrix()
+	const SimdMat4& getLocalModelMatrix()
 	{
-		const glm::mat4 transformX = glm::rotate(glm::mat4(1.0f), glm::radians(m_eulerRot.x), glm::vec3(1.0f, 0.0f, 0.0f));
-		const glm::mat4 transformY = glm::rotate(glm::mat4(1.0f), glm::radians(m_eulerRot.y), glm::vec3(0.0f, 1.0f, 0.0f));
-		const glm::mat4 transformZ = glm::rotate(glm::mat4(1.0f), glm::radians(m_eulerRot.z), glm::vec3(0.0f, 0.0f, 1.0f));
-
-		// Y * X * Z
-		const glm::mat4 roationMatrix = transformY * transformX * transformZ;
+		if (m_isLocalDirty)
+		{
+			// translation * rotation * scale (also know as TRS matrix), written directly
+			m_localMatrix = composeTRS(m_pos, m_rotation, m_scale);
+			m_isLocalDirty = false;
+		}
+		return m_localMatrix;
+	}
 
-		// translation * rotation * scale (also know as TRS matrix)
-		return glm::translate(glm::mat4(1.0f), m_pos) * roationMatrix * glm::scale(glm::mat4(1.0f), m_scale);
+	void cacheGlobalScale()
+	{
+		m_globalScale = { glm::length(getRight()), glm::length(getUp()), glm::length(getBackward()) };
 	}
+
 public:
 
 	void computeModelMatrix()
 	{
 		m_modelMatrix = getLocalModelMatrix();
+		cacheGlobalScale();
+		m_isDirty = false;
 	}
 
-	void computeModelMatrix(const glm::mat4& parentGlobalModelMatrix)
+	void computeModelMatrix(const SimdMat4& parentGlobalModelMatrix)
 	{
 		m_modelMatrix = parentGlobalModelMatrix * getLocalModelMatrix();
+		cacheGlobalScale();
+		m_isDirty = false;
 	}
 
 	void setLocalPosition(const glm::vec3& newPosition)
 	{
 		m_pos = newPosition;
-		m_isDirty = true;
+		m_isDirty = m_isLocalDirty = true;
 	}
 
+	//Euler angles in degrees, applied in Y * X * Z order
 	void setLocalRotation(const glm::vec3& newRotation)
 	{
-		m_eulerRot = newRotation;
-		m_isDirty = true;
+		const glm::quat rotX = glm::angleAxis(glm::radians(newRotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
+		const glm::quat rotY = glm::angleAxis(glm::radians(newRotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
+		const glm::quat rotZ = glm::angleAxis(glm::radians(newRotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
+		setLocalRotation(rotY * rotX * rotZ);
+	}
+
+	void setLocalRotation(const glm::quat& newRotation)
+	{
+		m_rotation = newRotation;
+		m_isDirty = m_isLocalDirty = true;
 	}
 
 	void setLocalScale(const glm::vec3& newScale)
 	{
 		m_scale = newScale;
-		m_isDirty = true;
+		m_isDirty = m_isLocalDirty = true;
 	}
 
-	const glm::vec3& getGlobalPosition() const
+	glm::vec3 getGlobalPosition() const
 	{
-		return m_modelMatrix[3];
+		return glm::vec3(m_modelMatrix[3]);
 	}
 
 	const glm::vec3& getLocalPosition() const
@@ -73,9 +101,9 @@ public:
 		return m_pos;
 	}
 
-	const glm::vec3& getLocalRotation() const
+	const glm::quat& getLocalRotation() const
 	{
-		return m_eulerRot;
+		return m_rotation;
 	}
 
 	const glm::vec3& getLocalScale() const
@@ -83,35 +111,36 @@ public:
 		return m_scale;
 	}
 
-	const glm::mat4& getModelMatrix() const
+	const SimdMat4& getModelMatrix() const
 	{
 		return m_modelMatrix;
 	}
 
 	glm::vec3 getRight() const
 	{
-		return m_modelMatrix[0];
+		return glm::vec3(m_modelMatrix[0]);
 	}
 
 
 	glm::vec3 getUp() const
 	{
-		return m_modelMatrix[1];
+		return glm::vec3(m_modelMatrix[1]);
 	}
 
 	glm::vec3 getBackward() const
 	{
-		return m_modelMatrix[2];
+		return glm::vec3(m_modelMatrix[2]);
 	}
 
 	glm::vec3 getForward() const
 	{
-		return -m_modelMatrix[2];
+		return -glm::vec3(m_modelMatrix[2]);
 	}
 
-	glm::vec3 getGlobalScale() const
+	//Length of each model matrix axis, cached by computeModelMatrix
+	const glm::vec3& getGlobalScale() const
 	{
-		return { glm::length(getRight()), glm::length(getUp()), glm::length(getBackward()) };
+		return m_globalScale;
 	}
 
 	bool isDirty() const
@@ -181,19 +210,27 @@ struct Sphere : public BoundingVolume
 		return plan.getSignedDistanceToPlan(center) > -radius;
 	}
 
-	bool isOnFrustum(const Frustum& camFrustum, const Transform& transform) const final
+	using BoundingVolume::isOnFrustum;
+
+	//World space sphere of this local one moved by transform
+	Sphere getGlobalSphere(const Transform& transform) const
 	{
 		//Get global scale thanks to our transform
-		const glm::vec3 globalScale = transform.getGlobalScale();
+		const glm::vec3& globalScale = transform.getGlobalScale();
 
 		//Get our global center with process it with the global model matrix of our transform
-		const glm::vec3 globalCenter{ transform.getModelMatrix() * glm::vec4(center, 1.f) };
+		const glm::vec3 globalCenter = transformPoint(transform.getModelMatrix(), center);
 
 		//To wrap correctly our shape, we need the maximum scale scalar.
 		const float maxScale = std::max(std::max(globalScale.x, globalScale.y), globalScale.z);
 
 		//Max scale is assuming for the diameter. So, we need the half to apply it to our radius
-		Sphere globalSphere(globalCenter, radius * (maxScale * 0.5f));
+		return Sphere(globalCenter, radius * (maxScale * 0.5f));
+	}
+
+	bool isOnFrustum(const Frustum& camFrustum, const Transform& transform) const final
+	{
+		const Sphere globalSphere = getGlobalSphere(transform);
 
 		//Check Firstly the result that have the most chance to faillure to avoid to call all functions.
 		return (globalSphere.isOnOrForwardPlan(camFrustum.leftFace) &&
@@ -221,10 +258,12 @@ struct SquareAABB : public BoundingVolume
 		return -r <= plan.getSignedDistanceToPlan(center);
 	}
 
+	using BoundingVolume::isOnFrustum;
+
 	bool isOnFrustum(const Frustum& camFrustum, const Transform& transform) const final
 	{
 		//Get global scale thanks to our transform
-		const glm::vec3 globalCenter{ transform.getModelMatrix() * glm::vec4(center, 1.f) };
+		const glm::vec3 globalCenter = transformPoint(transform.getModelMatrix(), center);
 
 		// Scaled orientation
 		const glm::vec3 right = transform.getRight() * extent;
@@ -291,36 +330,20 @@ struct AABB : public BoundingVolume
 		return -r <= plan.getSignedDistanceToPlan(center);
 	}
 
-	bool isOnFrustum(const Frustum& camFrustum, const Transform& transform) const final
-	{
-		//Get global scale thanks to our transform
-		const glm::vec3 globalCenter{ transform.getModelMatrix() * glm::vec4(center, 1.f) };
-
-		// Scaled orientation
-		const glm::vec3 right = transform.getRight() * extents.x;
-		const glm::vec3 up = transform.getUp() * extents.y;
-		const glm::vec3 forward = transform.getForward() * extents.z;
-
-		const float newIi = std::abs(glm::dot(glm::vec3{ 1.f, 0.f, 0.f }, right)) +
-			std::abs(glm::dot(glm::vec3{ 1.f, 0.f, 0.f }, up)) +
-			std::abs(glm::dot(glm::vec3{ 1.f, 0.f, 0.f }, forward));
-
-		const float newIj = std::abs(glm::dot(glm::vec3{ 0.f, 1.f, 0.f }, right)) +
-			std::abs(glm::dot(glm::vec3{ 0.f, 1.f, 0.f }, up)) +
-			std::abs(glm::dot(glm::vec3{ 0.f, 1.f, 0.f }, forward));
-
-		const float newIk = std::abs(glm::dot(glm::vec3{ 0.f, 0.f, 1.f }, right)) +
-			std::abs(glm::dot(glm::vec3{ 0.f, 0.f, 1.f }, up)) +
-			std::abs(glm::dot(glm::vec3{ 0.f, 0.f, 1.f }, forward));
+	using BoundingVolume::isOnFrustum;
 
-		const AABB globalAABB(globalCenter, newIi, newIj, newIk);
+	//World space box enclosing this local one moved by transform: the center is transformed and the
+	//extents become |M| * extents (upper 3x3 of the model matrix, absolute values)
+	AABB getGlobalAABB(const Transform& transform) const
+	{
+		glm::vec3 globalCenter, globalExtents;
+		transformAABB(transform.getModelMatrix(), center, extents, globalCenter, globalExtents);
+		return AABB(globalCenter, globalExtents.x, globalExtents.y, globalExtents.z);
+	}
 
-		return (globalAABB.isOnOrForwardPlan(camFrustum.leftFace) &&
-			globalAABB.isOnOrForwardPlan(camFrustum.rightFace) &&
-			globalAABB.isOnOrForwardPlan(camFrustum.topFace) &&
-			globalAABB.isOnOrForwardPlan(camFrustum.bottomFace) &&
-			globalAABB.isOnOrForwardPlan(camFrustum.nearFace) &&
-			globalAABB.isOnOrForwardPlan(camFrustum.farFace));
+	bool isOnFrustum(const Frustum& camFrustum, const Transform& transform) const final
+	{
+		return getGlobalAABB(transform).isOnFrustum(camFrustum);
 	};
 };
 
@@ -344,7 +367,7 @@ Frustum createFrustumFromCamera(const Camera& cam, float aspect, float fovY, flo
 AABB generateAABB(const Model& model)
 {
 	glm::vec3 minAABB = glm::vec3(std::numeric_limits<float>::max());
-	glm::vec3 maxAABB = glm::vec3(std::numeric_limits<float>::min());
+	glm::vec3 maxAABB = glm::vec3(std::numeric_limits<float>::lowest());
 	for (auto&& mesh : model.meshes)
 	{
 		for (auto&& vertex : mesh.vertices)
@@ -364,7 +387,7 @@ AABB generateAABB(const Model& model)
 Sphere generateSphereBV(const Model& model)
 {
 	glm::vec3 minAABB = glm::vec3(std::numeric_limits<float>::max());
-	glm::vec3 maxAABB = glm::vec3(std::numeric_limits<float>::min());
+	glm::vec3 maxAABB = glm::vec3(std::numeric_limits<float>::lowest());
 	for (auto&& mesh : model.meshes)
 	{
 		for (auto&& vertex : mesh.vertices)
@@ -397,35 +420,24 @@ public:
 
 
 	// constructor, expects a filepath to a 3D model.
-	Entity(Model& model) : pModel{ &model }
+	Entity(Model& model) : pModel{ &model }, m_globalAABB{ generateAABB(model) }
 	{
-		boundingVolume = std::make_unique<AABB>(generateAABB(model));
+		boundingVolume = std::make_unique<AABB>(m_globalAABB);
 		//boundingVolume = std::make_unique<Sphere>(generateSphereBV(model));
 	}
 
-	AABB getGlobalAABB()
+	//World space bounds, refreshed whenever the transform is recomputed
+	const AABB& getGlobalAABB() const
 	{
-		//Get global scale thanks to our transform
-		const glm::vec3 globalCenter{ transform.getModelMatrix() * glm::vec4(boundingVolume->center, 1.f) };
-
-		// Scaled orientation
-		const glm::vec3 right = transform.getRight() * boundingVolume->extents.x;
-		const glm::vec3 up = transform.getUp() * boundingVolume->extents.y;
-		const glm::vec3 forward = transform.getForward() * boundingVolume->extents.z;
-
-		const float newIi = std::abs(glm::dot(glm::vec3{ 1.f, 0.f, 0.f }, right)) +
-			std::abs(glm::dot(glm::vec3{ 1.f, 0.f, 0.f }, up)) +
-			std::abs(glm::dot(glm::vec3{ 1.f, 0.f, 0.f }, forward));
-
-		const float newIj = std::abs(glm::dot(glm::vec3{ 0.f, 1.f, 0.f }, right)) +
-			std::abs(glm::dot(glm::vec3{ 0.f, 1.f, 0.f }, up)) +
-			std::abs(glm::dot(glm::vec3{ 0.f, 1.f, 0.f }, forward));
-
-		const float newIk = std::abs(glm::dot(glm::vec3{ 0.f, 0.f, 1.f }, right)) +
-			std::abs(glm::dot(glm::vec3{ 0.f, 0.f, 1.f }, up)) +
-			std::abs(glm::dot(glm::vec3{ 0.f, 0.f, 1.f }, forward));
+		return m_globalAABB;
+	}
 
-		return AABB(globalCenter, newIi, newIj, newIk);
+	//Replaces the local bounds, for models whose shape changes (skinned meshes, see SkinnedBounds),
+	//and refreshes the world bounds right away with the current transform
+	void setLocalBounds(const glm::vec3& center, const glm::vec3& extents)
+	{
+		*boundingVolume = AABB(center, extents.x, extents.y, extents.z);
+		m_globalAABB = boundingVolume->getGlobalAABB(transform);
 	}
 
 	//Add child. Argument input is argument of any constructor that you create. By default you can use the default constructor and don't put argument input.
@@ -436,13 +448,20 @@ public:
 		children.back()->parent = this;
 	}
 
-	//Update transform if it was changed
+	//Update transform if it was changed. A clean node still has to look at its children, one of them may be dirty.
+	//For large scenes prefer SceneGraph (scene_graph.h), which does the same in one linear pass.
 	void updateSelfAndChild()
 	{
-		if (!transform.isDirty())
+		if (transform.isDirty())
+		{
+			forceUpdateSelfAndChild();
 			return;
+		}
 
-		forceUpdateSelfAndChild();
+		for (auto&& child : children)
+		{
+			child->updateSelfAndChild();
+		}
 	}
 
 	//Force update of transform even if local space don't change
@@ -452,6 +471,7 @@ public:
 			transform.computeModelMatrix(parent->transform.getModelMatrix());
 		else
 			transform.computeModelMatrix();
+		m_globalAABB = boundingVolume->getGlobalAABB(transform);
 
 		for (auto&& child : children)
 		{
@@ -462,7 +482,7 @@ public:
 
 	void drawSelfAndChild(const Frustum& frustum, Shader& ourShader, unsigned int& display, unsigned int& total)
 	{
-		if (boundingVolume->isOnFrustum(frustum, transform))
+		if (m_globalAABB.isOnFrustum(frustum))
 		{
 			ourShader.setMat4("model", transform.getModelMatrix());
 			pModel->Draw(ourShader);
@@ -475,5 +495,8 @@ public:
 			child->drawSelfAndChild(frustum, ourShader, display, total);
 		}
 	}
+
+private:
+	AABB m_globalAABB;
 };
 #endif
@@ -0,0 +1,134 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+// shadows the few pieces of GL state that are changed on every draw (program, vertex array,
+// active texture unit and the 2D / 2D array / cube / buffer texture bound to each unit) so redundant binds are skipped.
+// The shadow is only correct if every bind goes through here: code that changes this state
+// directly (third-party renderers, raw glBind* calls) has to call invalidate() afterwards.
+class GLStateCache
+{
+public:
+    static const unsigned int MAX_TEXTURE_UNITS = 32;
+
+    static void useProgram(unsigned int program)
+    {
+        State &s = state();
+        if (s.program == program)
+            return;
+        glUseProgram(program);
+        s.program = program;
+    }
+
+    static void bindVertexArray(unsigned int vao)
+    {
+        State &s = state();
+        if (s.vao == vao)
+            return;
+        glBindVertexArray(vao);
+        s.vao = vao;
+    }
+
+    static void bindTexture2D(unsigned int unit, unsigned int texture)
+    {
+        State &s = state();
+        if (unit < MAX_TEXTURE_UNITS && s.textures[unit] == texture)
+            return;
+        if (s.activeUnit != unit)
+        {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            s.activeUnit = unit;
+        }
+        glBindTexture(GL_TEXTURE_2D, texture);
+        if (unit < MAX_TEXTURE_UNITS)
+            s.textures[unit] = texture;
+    }
+
+    static void bindTexture2DArray(unsigned int unit, unsigned int texture)
+    {
+        State &s = state();
+        if (unit < MAX_TEXTURE_UNITS && s.textureArrays[unit] == texture)
+            return;
+        if (s.activeUnit != unit)
+        {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            s.activeUnit = unit;
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        if (unit < MAX_TEXTURE_UNITS)
+            s.textureArrays[unit] = texture;
+    }
+
+    static void bindTextureCube(unsigned int unit, unsigned int texture)
+    {
+        State &s = state();
+        if (unit < MAX_TEXTURE_UNITS && s.textureCubes[unit] == texture)
+            return;
+        if (s.activeUnit != unit)
+        {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            s.activeUnit = unit;
+        }
+        glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+        if (unit < MAX_TEXTURE_UNITS)
+            s.textureCubes[unit] = texture;
+    }
+
+    static void bindTextureBuffer(unsigned int unit, unsigned int texture)
+    {
+        State &s = state();
+        if (unit < MAX_TEXTURE_UNITS && s.textureBuffers[unit] == texture)
+            return;
+        if (s.activeUnit != unit)
+        {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            s.activeUnit = unit;
+        }
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        if (unit < MAX_TEXTURE_UNITS)
+            s.textureBuffers[unit] = texture;
+    }
+
+    // forget everything; the next bind of each kind is always issued
+    static void invalidate()
+    {
+        state() = makeUnknown();
+    }
+
+private:
+    static const unsigned int UNKNOWN = ~0u;
+
+    struct State {
+        unsigned int program;
+        unsigned int vao;
+        unsigned int activeUnit;
+        unsigned int textures[MAX_TEXTURE_UNITS];
+        unsigned int textureArrays[MAX_TEXTURE_UNITS];
+        unsigned int textureCubes[MAX_TEXTURE_UNITS];
+        unsigned int textureBuffers[MAX_TEXTURE_UNITS];
+    };
+
+    static State &state()
+    {
+        static State s = makeUnknown();
+        return s;
+    }
+
+    static State makeUnknown()
+    {
+        State s;
+        s.program = UNKNOWN;
+        s.vao = UNKNOWN;
+        s.activeUnit = UNKNOWN;
+        for (unsigned int i = 0; i < MAX_TEXTURE_UNITS; i++)
+        {
+            s.textures[i] = UNKNOWN;
+            s.textureArrays[i] = UNKNOWN;
+            s.textureCubes[i] = UNKNOWN;
+            s.textureBuffers[i] = UNKNOWN;
+        }
+        return s;
+    }
+};
+#endif
@@ -0,0 +1,211 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// tracks a group of jobs; JobSystem::wait(counter) returns once all of them finished.
+// The first exception thrown by one of the jobs is rethrown from wait().
+struct JobCounter
+{
+    std::atomic<int> pending{ 0 };
+    std::mutex failureMutex;
+    std::exception_ptr failure;
+};
+
+// work-stealing job system. Every participating thread owns a queue: jobs are pushed to and
+// popped from the back of the caller's own queue (most recent first, which keeps data warm),
+// while idle threads steal from the front of the others'. The thread that creates the system is
+// participant 0 and helps executing jobs while it waits, so nothing ever blocks on a full pool.
+// Jobs run on worker threads without a GL context: only CPU work may be pushed.
+class JobSystem
+{
+public:
+    explicit JobSystem(unsigned int threadCount = std::thread::hardware_concurrency())
+    {
+        if (threadCount == 0)
+            threadCount = 1;
+        for (unsigned int i = 0; i < threadCount; i++)
+            queues.emplace_back(new Queue());
+        for (unsigned int i = 1; i < threadCount; i++)
+            workers.emplace_back([this, i] { workerLoop(i); });
+    }
+
+    ~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // number of participants, the creating thread included
+    unsigned int threadCount() const { return static_cast<unsigned int>(queues.size()); }
+
+    // participant index of the calling thread in this system, in [0, threadCount()). Useful to
+    // index per-thread output. Threads that are not workers of this system (its creator, or a
+    // worker of another JobSystem) get participant 0's slot, so only one of them may drive this
+    // system at a time.
+    unsigned int currentThreadIndex() const
+    {
+        const ThreadSlot &slot = threadSlot();
+        return slot.owner == this ? slot.index : 0;
+    }
+
+    // queues job on the calling thread's queue and accounts it to counter
+    void run(JobCounter &counter, std::function<void()> job)
+    {
+        counter.pending++;
+        Queue &queue = *queues[currentThreadIndex()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back(Job{ std::move(job), &counter });
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            queuedJobs++;
+        }
+        wakeUp.notify_one();
+    }
+
+    // executes queued jobs (own first, then stolen ones) until every job of counter finished
+    void wait(JobCounter &counter)
+    {
+        while (counter.pending.load() > 0)
+        {
+            if (!runOne(currentThreadIndex()))
+                std::this_thread::yield();
+        }
+        if (counter.failure)
+            std::rethrow_exception(counter.failure);
+    }
+
+    // calls body(begin, end) for consecutive ranges of at most chunkSize indices covering
+    // [0, count), spread over all participants, and returns once every range is done
+    template<typename F>
+    void parallelFor(size_t count, size_t chunkSize, F &&body)
+    {
+        if (count == 0)
+            return;
+        chunkSize = std::max<size_t>(chunkSize, 1);
+        if (count <= chunkSize || queues.size() == 1)
+        {
+            body(size_t(0), count);
+            return;
+        }
+        JobCounter counter;
+        for (size_t begin = 0; begin < count; begin += chunkSize)
+        {
+            const size_t end = std::min(count, begin + chunkSize);
+            run(counter, [&body, begin, end] { body(begin, end); });
+        }
+        wait(counter);
+    }
+
+private:
+    struct Job {
+        std::function<void()> function;
+        JobCounter *counter;
+    };
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    std::atomic<int> queuedJobs{ 0 };
+    bool stopping = false;
+
+    // the worker slot of the calling thread and the system it works for; thread_local is shared
+    // by every JobSystem, so the index is only meaningful to its owner
+    struct ThreadSlot {
+        const JobSystem *owner;
+        unsigned int index;
+    };
+
+    static ThreadSlot &threadSlot()
+    {
+        static thread_local ThreadSlot slot = { nullptr, 0 };
+        return slot;
+    }
+
+    bool popOwn(unsigned int self, Job &job)
+    {
+        Queue &queue = *queues[self];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.jobs.empty())
+            return false;
+        job = std::move(queue.jobs.back());
+        queue.jobs.pop_back();
+        return true;
+    }
+
+    bool steal(unsigned int self, Job &job)
+    {
+        const unsigned int count = threadCount();
+        for (unsigned int offset = 1; offset < count; offset++)
+        {
+            Queue &queue = *queues[(self + offset) % count];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.jobs.empty())
+                continue;
+            job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+            return true;
+        }
+        return false;
+    }
+
+    // runs one job if any participant has one queued; false if all queues were empty
+    bool runOne(unsigned int self)
+    {
+        Job job;
+        if (!popOwn(self, job) && !steal(self, job))
+            return false;
+        queuedJobs--;
+        try
+        {
+            job.function();
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(job.counter->failureMutex);
+            if (!job.counter->failure)
+                job.counter->failure = std::current_exception();
+        }
+        job.counter->pending--;
+        return true;
+    }
+
+    void workerLoop(unsigned int self)
+    {
+        threadSlot() = ThreadSlot{ this, self };
+        for (;;)
+        {
+            if (runOne(self))
+                continue;
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wakeUp.wait(lock, [this] { return stopping || queuedJobs.load() > 0; });
+            if (stopping)
+                return;
+        }
+    }
+};
+#endif
@@ -6,6 +6,7 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <learnopengl/gl_state.h>
 #include <learnopengl/shader.h>
 
 #include <string>
@@ -48,9 +49,9 @@ public:
     // constructor
     Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        this->textures = std::move(textures);
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
         setupMesh();
@@ -59,14 +60,43 @@ public:
     // render the mesh
     void Draw(Shader &shader) 
     {
-        // bind appropriate textures
+        // bind appropriate textures, skipping units that already hold the right one
+        const vector<TextureBinding> &bindings = getTextureBindings(shader);
+        for(unsigned int i = 0; i < bindings.size(); i++)
+            GLStateCache::bindTexture2D(bindings[i].unit, bindings[i].id);
+        
+        // draw mesh
+        GLStateCache::bindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+    }
+
+private:
+    // render data 
+    unsigned int VBO, EBO;
+
+    struct TextureBinding {
+        unsigned int unit;
+        unsigned int id;
+    };
+    // sampler units resolved once per shader program this mesh was drawn with (program ID -> bindings).
+    // the textures vector is assumed not to change after construction.
+    vector<pair<unsigned int, vector<TextureBinding>>> textureBindings;
+
+    const vector<TextureBinding> &getTextureBindings(Shader &shader)
+    {
+        for(unsigned int i = 0; i < textureBindings.size(); i++)
+        {
+            if(textureBindings[i].first == shader.ID)
+                return textureBindings[i].second;
+        }
+
+        vector<TextureBinding> bindings;
         unsigned int diffuseNr  = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr   = 1;
         unsigned int heightNr   = 1;
         for(unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
             string number;
             string name = textures[i].type;
@@ -79,25 +109,15 @@ public:
              else if(name == "texture_height")
                 number = std::to_string(heightNr++); // transfer unsigned int to string
 
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            // samplers the shader doesn't use get no unit and are never bound
+            int unit = shader.getSamplerUnit(name + number);
+            if(unit >= 0)
+                bindings.push_back({ static_cast<unsigned int>(unit), textures[i].id });
         }
-        
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+        textureBindings.push_back(make_pair(shader.ID, std::move(bindings)));
+        return textureBindings.back().second;
     }
 
-private:
-    // render data 
-    unsigned int VBO, EBO;
-
     // initializes all the buffer objects/arrays
     void setupMesh()
     {
@@ -106,7 +126,7 @@ private:
         glGenBuffers(1, &VBO);
         glGenBuffers(1, &EBO);
 
-        glBindVertexArray(VAO);
+        GLStateCache::bindVertexArray(VAO);
         // load data into vertex buffers
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
         // A great thing about structs is that their memory layout is sequential for all its items.
@@ -140,7 +160,7 @@ private:
 		// weights
 		glEnableVertexAttribArray(6);
 		glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
-        glBindVertexArray(0);
+        GLStateCache::bindVertexArray(0);
     }
 };
 #endif
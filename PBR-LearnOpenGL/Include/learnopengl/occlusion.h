@@ -0,0 +1,412 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <glm/glm.hpp> //glm::mat4
+#include <cstdint> //uint64_t
+#include <cstddef> //size_t
+#include <vector> //std::vector
+#include <algorithm> //std::min, std::max
+#include <atomic> //std::atomic
+#include <cmath> //std::floor
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OCCLUSION_SSE 1
+#endif
+
+#include <learnopengl/culling.h>
+#include <learnopengl/job_system.h>
+
+struct OcclusionStats
+{
+	size_t occluderTriangles = 0; //submitted this frame
+	size_t rasterizedTriangles = 0; //left after near plane, degenerate and off screen rejection
+	size_t tested = 0; //boxes tested against the Hi-Z pyramid
+	size_t occluded = 0; //of those, the hidden ones
+
+	float culledRatio() const
+	{
+		return tested ? static_cast<float>(occluded) / static_cast<float>(tested) : 0.f;
+	}
+};
+
+//Software occlusion culling on the CPU. Every frame a few occluder meshes (low detail proxies of
+//large objects) are rasterized into a small depth buffer, a Hi-Z pyramid is built from it and boxes
+//are tested against the pyramid before their draw calls are issued.
+//
+//Depth is NDC z mapped to [0, 1], 1 being the far plane and the cleared value. Occluders keep the
+//nearest depth per pixel and every Hi-Z texel holds the farthest depth of the pixels it covers, so a
+//box is hidden only if its nearest point is behind everything in its screen rectangle. Everything
+//that can't be decided (a box crossing the near plane, an occluder triangle crossing it) errs
+//towards visible. Pixel centers on an edge shared by two triangles belong to exactly one of them
+//(top-left rule), so a mesh leaves no far plane cracks along its diagonals.
+//
+//The screen is split into tiles; triangles are binned per tile and the tiles are rasterized as
+//separate jobs, 4 pixels at a time with SSE2 (scalar otherwise). Nothing here touches GL.
+class OcclusionBuffer
+{
+public:
+	static const int TILE_WIDTH = 32; //multiple of 4, the SIMD span
+	static const int TILE_HEIGHT = 16;
+
+	OcclusionStats stats;
+
+	//The size is rounded up to whole tiles; 256x128 is plenty for culling
+	OcclusionBuffer(int width = 256, int height = 128)
+	{
+		m_tilesX = std::max(1, (width + TILE_WIDTH - 1) / TILE_WIDTH);
+		m_tilesY = std::max(1, (height + TILE_HEIGHT - 1) / TILE_HEIGHT);
+		m_width = m_tilesX * TILE_WIDTH;
+		m_height = m_tilesY * TILE_HEIGHT;
+		m_bins.resize(m_tilesX * m_tilesY);
+
+		int w = m_width, h = m_height;
+		m_levels.push_back(Level{ w, h, std::vector<float>(w * h, 1.f) });
+		while (w > 1 || h > 1)
+		{
+			w = (w + 1) / 2;
+			h = (h + 1) / 2;
+			m_levels.push_back(Level{ w, h, std::vector<float>(w * h, 1.f) });
+		}
+	}
+
+	int width() const
+	{
+		return m_width;
+	}
+
+	int height() const
+	{
+		return m_height;
+	}
+
+	//Depth of pixel (x, y), y going up; level 0 of the pyramid
+	float depth(int x, int y) const
+	{
+		return m_levels[0].depth[y * m_width + x];
+	}
+
+	//Starts a frame seen through viewProjection: forgets last frame's occluders and statistics
+	void begin(const glm::mat4& viewProjection)
+	{
+		m_viewProjection = viewProjection;
+		m_triangles.clear();
+		for (std::vector<uint32_t>& bin : m_bins)
+			bin.clear();
+		stats = OcclusionStats();
+	}
+
+	//Adds the triangles of an indexed mesh placed by modelMatrix
+	void addOccluder(const glm::vec3* positions, size_t stride, const unsigned int* indices, size_t indexCount, const glm::mat4& modelMatrix)
+	{
+		const glm::mat4 transform = m_viewProjection * modelMatrix;
+		const unsigned char* base = reinterpret_cast<const unsigned char*>(positions);
+		for (size_t i = 0; i + 2 < indexCount; i += 3)
+		{
+			glm::vec4 clip[3];
+			for (int k = 0; k < 3; ++k)
+				clip[k] = transform * glm::vec4(*reinterpret_cast<const glm::vec3*>(base + indices[i + k] * stride), 1.f);
+			setupTriangle(clip);
+		}
+		stats.occluderTriangles += indexCount / 3;
+	}
+
+	//Adds every mesh of model; meant for low detail proxies, the cost is linear in triangles
+	void addOccluder(const Model& model, const glm::mat4& modelMatrix)
+	{
+		for (auto&& mesh : model.meshes)
+		{
+			if (!mesh.vertices.empty() && !mesh.indices.empty())
+				addOccluder(&mesh.vertices[0].Position, sizeof(Vertex), mesh.indices.data(), mesh.indices.size(), modelMatrix);
+		}
+	}
+
+	//Rasterizes the binned triangles, one job per tile, then builds the Hi-Z pyramid
+	void render(JobSystem& jobs)
+	{
+		jobs.parallelFor(m_bins.size(), 1, [this](size_t begin, size_t end) {
+			for (size_t tile = begin; tile < end; ++tile)
+				rasterizeTile(tile);
+		});
+		buildPyramid(jobs);
+	}
+
+	//Single threaded render(), for tests and tools
+	void render()
+	{
+		for (size_t tile = 0; tile < m_bins.size(); ++tile)
+			rasterizeTile(tile);
+		buildPyramid();
+	}
+
+	//False if the world space box is certainly hidden behind the occluders
+	bool isVisible(const glm::vec3& center, const glm::vec3& extents) const
+	{
+		float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f, minZ = 1e30f;
+		//the corners are the projected center plus or minus the projected half axes
+		const glm::vec4 clipCenter = m_viewProjection * glm::vec4(center, 1.f);
+		const glm::vec4 axisX = m_viewProjection[0] * extents.x;
+		const glm::vec4 axisY = m_viewProjection[1] * extents.y;
+		const glm::vec4 axisZ = m_viewProjection[2] * extents.z;
+		for (int corner = 0; corner < 8; ++corner)
+		{
+			const glm::vec4 clip = clipCenter + ((corner & 1) ? axisX : -axisX) + ((corner & 2) ? axisY : -axisY) + ((corner & 4) ? axisZ : -axisZ);
+			if (clip.w <= NEAR_W)
+				return true; //crosses the camera plane, can't bound it on screen
+			const float invW = 1.f / clip.w;
+			const float x = (clip.x * invW * 0.5f + 0.5f) * m_width;
+			const float y = (clip.y * invW * 0.5f + 0.5f) * m_height;
+			minX = std::min(minX, x);
+			maxX = std::max(maxX, x);
+			minY = std::min(minY, y);
+			maxY = std::max(maxY, y);
+			minZ = std::min(minZ, clip.z * invW * 0.5f + 0.5f);
+		}
+		if (maxX < 0.f || maxY < 0.f || minX >= m_width || minY >= m_height)
+			return true; //off screen, that's the frustum test's business
+		const int x0 = std::max(0, static_cast<int>(minX));
+		const int y0 = std::max(0, static_cast<int>(minY));
+		const int x1 = std::min(m_width - 1, static_cast<int>(maxX));
+		const int y1 = std::min(m_height - 1, static_cast<int>(maxY));
+
+		//coarsest level at which the rectangle spans at most 2x2 texels
+		size_t level = 0;
+		while (level + 1 < m_levels.size() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+			++level;
+		const Level& l = m_levels[level];
+		for (int y = y0 >> level; y <= (y1 >> level); ++y)
+		{
+			for (int x = x0 >> level; x <= (x1 >> level); ++x)
+			{
+				if (minZ <= l.depth[y * l.width + x])
+					return true;
+			}
+		}
+		return false;
+	}
+
+	//Clears the bits of visibleMask whose box in bounds is hidden; bits already clear are not
+	//tested. Returns the number of boxes culled. Call after render().
+	size_t cullOccluded(const BoundsSoA& bounds, std::vector<uint64_t>& visibleMask)
+	{
+		size_t tested = 0;
+		const size_t occluded = cullRange(bounds, visibleMask, 0, visibleMask.size(), tested);
+		stats.tested += tested;
+		stats.occluded += occluded;
+		return occluded;
+	}
+
+	//Same, spread over the job system in chunks of whole mask words
+	size_t cullOccluded(JobSystem& jobs, const BoundsSoA& bounds, std::vector<uint64_t>& visibleMask)
+	{
+		std::atomic<size_t> occluded(0), tested(0);
+		jobs.parallelFor(visibleMask.size(), 16, [&](size_t begin, size_t end) {
+			size_t chunkTested = 0;
+			occluded += cullRange(bounds, visibleMask, begin, end, chunkTested);
+			tested += chunkTested;
+		});
+		stats.tested += tested.load();
+		stats.occluded += occluded.load();
+		return occluded.load();
+	}
+
+private:
+	//clip space w under which a vertex counts as behind the camera
+	static constexpr float NEAR_W = 1e-5f;
+
+	struct Level
+	{
+		int width, height;
+		std::vector<float> depth;
+	};
+
+	//a screen space triangle, counter clockwise: covered pixels have all three edge values > 0,
+	//or == 0 on a top or left edge
+	struct Triangle
+	{
+		float edgeA[3], edgeB[3], edgeC[3]; //edge k at pixel center p: A * p.x + B * p.y + C
+		bool topLeft[3];
+		float zA, zB, zC; //depth plane
+		int minX, minY, maxX, maxY; //pixel bounds, clamped to the screen
+	};
+
+	int m_width, m_height;
+	int m_tilesX, m_tilesY;
+	glm::mat4 m_viewProjection{ 1.f };
+	std::vector<Level> m_levels;
+	std::vector<Triangle> m_triangles;
+	std::vector<std::vector<uint32_t>> m_bins; //triangle ids per tile, row major
+
+	void setupTriangle(const glm::vec4* clip)
+	{
+		//dropping a triangle only makes the buffer less occluding, so near plane crossings are not clipped
+		if (clip[0].w <= NEAR_W || clip[1].w <= NEAR_W || clip[2].w <= NEAR_W)
+			return;
+		glm::vec3 v[3];
+		for (int k = 0; k < 3; ++k)
+		{
+			const float invW = 1.f / clip[k].w;
+			v[k] = glm::vec3((clip[k].x * invW * 0.5f + 0.5f) * m_width, (clip[k].y * invW * 0.5f + 0.5f) * m_height,
+				clip[k].z * invW * 0.5f + 0.5f);
+		}
+		float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y);
+		if (std::abs(area) < 1e-6f)
+			return;
+		if (area < 0.f)
+		{
+			//both faces occlude: make it counter clockwise
+			std::swap(v[1], v[2]);
+			area = -area;
+		}
+
+		Triangle t;
+		t.minX = std::max(0, static_cast<int>(std::floor(std::min(v[0].x, std::min(v[1].x, v[2].x)))));
+		t.minY = std::max(0, static_cast<int>(std::floor(std::min(v[0].y, std::min(v[1].y, v[2].y)))));
+		t.maxX = std::min(m_width - 1, static_cast<int>(std::floor(std::max(v[0].x, std::max(v[1].x, v[2].x)))));
+		t.maxY = std::min(m_height - 1, static_cast<int>(std::floor(std::max(v[0].y, std::max(v[1].y, v[2].y)))));
+		if (t.minX > t.maxX || t.minY > t.maxY)
+			return;
+		for (int k = 0; k < 3; ++k)
+		{
+			//set up from the lower end of the edge and negated if need be, so the two triangles
+			//sharing an edge get exactly opposite values at every pixel
+			const bool reversed = v[(k + 1) % 3].x < v[k].x || (v[(k + 1) % 3].x == v[k].x && v[(k + 1) % 3].y < v[k].y);
+			const glm::vec3& a = reversed ? v[(k + 1) % 3] : v[k];
+			const glm::vec3& b = reversed ? v[k] : v[(k + 1) % 3];
+			const float sign = reversed ? -1.f : 1.f;
+			t.edgeA[k] = sign * (a.y - b.y);
+			t.edgeB[k] = sign * (b.x - a.x);
+			t.edgeC[k] = sign * (-(a.y - b.y) * a.x - (b.x - a.x) * a.y);
+			//y goes up and the winding is counter clockwise: left edges go down, top edges go left
+			t.topLeft[k] = t.edgeA[k] > 0.f || (t.edgeA[k] == 0.f && t.edgeB[k] < 0.f);
+		}
+		t.zA = ((v[1].z - v[0].z) * (v[2].y - v[0].y) - (v[2].z - v[0].z) * (v[1].y - v[0].y)) / area;
+		t.zB = ((v[2].z - v[0].z) * (v[1].x - v[0].x) - (v[1].z - v[0].z) * (v[2].x - v[0].x)) / area;
+		t.zC = v[0].z - t.zA * v[0].x - t.zB * v[0].y;
+
+		const uint32_t id = static_cast<uint32_t>(m_triangles.size());
+		m_triangles.push_back(t);
+		stats.rasterizedTriangles++;
+		for (int ty = t.minY / TILE_HEIGHT; ty <= t.maxY / TILE_HEIGHT; ++ty)
+			for (int tx = t.minX / TILE_WIDTH; tx <= t.maxX / TILE_WIDTH; ++tx)
+				m_bins[ty * m_tilesX + tx].push_back(id);
+	}
+
+	//Clears the tile to the far plane and rasterizes its bin; only writes the tile's own pixels
+	void rasterizeTile(size_t tile)
+	{
+		const int tileX = static_cast<int>(tile % m_tilesX) * TILE_WIDTH;
+		const int tileY = static_cast<int>(tile / m_tilesX) * TILE_HEIGHT;
+		float* depth = m_levels[0].depth.data();
+		for (int y = tileY; y < tileY + TILE_HEIGHT; ++y)
+			std::fill(depth + y * m_width + tileX, depth + y * m_width + tileX + TILE_WIDTH, 1.f);
+
+		for (uint32_t id : m_bins[tile])
+		{
+			const Triangle& t = m_triangles[id];
+			const int x0 = std::max(t.minX, tileX) & ~3;
+			const int x1 = std::min(t.maxX, tileX + TILE_WIDTH - 1);
+			const int y0 = std::max(t.minY, tileY);
+			const int y1 = std::min(t.maxY, tileY + TILE_HEIGHT - 1);
+			for (int y = y0; y <= y1; ++y)
+			{
+				float* row = depth + y * m_width;
+				const float py = y + 0.5f;
+#if defined(OCCLUSION_SSE)
+				const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+				for (int x = x0; x <= x1; x += 4)
+				{
+					const __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), offsets);
+					__m128 inside = insideSSE(t, 0, px, py);
+					inside = _mm_and_ps(inside, insideSSE(t, 1, px, py));
+					inside = _mm_and_ps(inside, insideSSE(t, 2, px, py));
+					if (_mm_movemask_ps(inside) == 0)
+						continue;
+					const __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.zA), px), _mm_set1_ps(t.zB * py + t.zC));
+					const __m128 old = _mm_loadu_ps(row + x);
+					const __m128 nearest = _mm_min_ps(old, z);
+					_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+				}
+#else
+				for (int x = x0; x <= x1; ++x)
+				{
+					const float px = x + 0.5f;
+					bool inside = true;
+					for (int k = 0; k < 3 && inside; ++k)
+					{
+						const float edge = t.edgeA[k] * px + t.edgeB[k] * py + t.edgeC[k];
+						inside = edge > 0.f || (edge == 0.f && t.topLeft[k]);
+					}
+					if (inside)
+						row[x] = std::min(row[x], t.zA * px + t.zB * py + t.zC);
+				}
+#endif
+			}
+		}
+	}
+
+#if defined(OCCLUSION_SSE)
+	static __m128 insideSSE(const Triangle& t, int k, __m128 px, float py)
+	{
+		const __m128 edge = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.edgeA[k]), px), _mm_set1_ps(t.edgeB[k] * py + t.edgeC[k]));
+		return t.topLeft[k] ? _mm_cmpge_ps(edge, _mm_setzero_ps()) : _mm_cmpgt_ps(edge, _mm_setzero_ps());
+	}
+#endif
+
+	//Level l + 1 texel = farthest of the (up to) 2x2 texels of level l below it
+	void downsampleRows(size_t level, int begin, int end)
+	{
+		const Level& src = m_levels[level - 1];
+		Level& dst = m_levels[level];
+		for (int y = begin; y < end; ++y)
+		{
+			const int sy0 = y * 2, sy1 = std::min(y * 2 + 1, src.height - 1);
+			for (int x = 0; x < dst.width; ++x)
+			{
+				const int sx0 = x * 2, sx1 = std::min(x * 2 + 1, src.width - 1);
+				dst.depth[y * dst.width + x] = std::max(
+					std::max(src.depth[sy0 * src.width + sx0], src.depth[sy0 * src.width + sx1]),
+					std::max(src.depth[sy1 * src.width + sx0], src.depth[sy1 * src.width + sx1]));
+			}
+		}
+	}
+
+	void buildPyramid(JobSystem& jobs)
+	{
+		for (size_t level = 1; level < m_levels.size(); ++level)
+		{
+			jobs.parallelFor(m_levels[level].height, 8, [this, level](size_t begin, size_t end) {
+				downsampleRows(level, static_cast<int>(begin), static_cast<int>(end));
+			});
+		}
+	}
+
+	void buildPyramid()
+	{
+		for (size_t level = 1; level < m_levels.size(); ++level)
+			downsampleRows(level, 0, m_levels[level].height);
+	}
+
+	size_t cullRange(const BoundsSoA& bounds, std::vector<uint64_t>& visibleMask, size_t beginWord, size_t endWord, size_t& tested) const
+	{
+		size_t occluded = 0;
+		for (size_t word = beginWord; word < endWord; ++word)
+		{
+			for (uint64_t bits = visibleMask[word]; bits; bits &= bits - 1)
+			{
+				const uint64_t lowest = bits & (~bits + 1);
+				const size_t i = word * 64 + countVisibleBits(lowest - 1);
+				++tested;
+				const glm::vec3 center(bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]);
+				const glm::vec3 extents(bounds.extentX[i], bounds.extentY[i], bounds.extentZ[i]);
+				if (!isVisible(center, extents))
+				{
+					visibleMask[word] &= ~lowest;
+					++occluded;
+				}
+			}
+		}
+		return occluded;
+	}
+};
+#endif
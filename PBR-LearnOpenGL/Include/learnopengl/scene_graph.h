@@ -0,0 +1,206 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <glm/glm.hpp> //glm::mat4
+#include <glm/gtc/quaternion.hpp> //glm::quat
+#include <cstdint> //uint32_t
+#include <vector> //std::vector
+#include <atomic> //std::atomic
+#include <algorithm> //std::max
+
+#include <learnopengl/entity.h>
+#include <learnopengl/job_system.h>
+#include <learnopengl/simd_math.h>
+
+//Scene graph kept as parallel arrays indexed by node, in parent-before-child order: a node's
+//parent always has a smaller index, so one forward pass over the arrays visits every parent
+//before its children. Nothing is allocated per node and nothing is reached through a pointer,
+//which keeps updates of 100k+ nodes a linear walk through memory.
+//
+//Nodes are only ever appended (createNode requires an existing parent), which is what keeps
+//the order valid; there is no reparenting or removal.
+//
+//updateParallel() does the same work on a JobSystem, one depth level at a time: nodes of a level
+//only read their parents' matrices, which the previous level finished.
+class SceneGraph
+{
+public:
+	static const uint32_t NO_PARENT = ~0u;
+
+	//Per node data, all indexed by node id
+	std::vector<uint32_t> parents;
+	std::vector<glm::vec3> localPositions;
+	std::vector<glm::quat> localRotations;
+	std::vector<glm::vec3> localScales;
+	std::vector<SimdMat4> worldMatrices;
+	std::vector<uint8_t> dirty; //local transform changed since the last update()
+	std::vector<Model*> models; //nullptr for pure transform nodes
+	std::vector<glm::vec3> boundsCenters; //local space AABB of the model
+	std::vector<glm::vec3> boundsExtents;
+
+	size_t size() const
+	{
+		return parents.size();
+	}
+
+	void reserve(size_t count)
+	{
+		parents.reserve(count);
+		localPositions.reserve(count);
+		localRotations.reserve(count);
+		localScales.reserve(count);
+		worldMatrices.reserve(count);
+		dirty.reserve(count);
+		models.reserve(count);
+		boundsCenters.reserve(count);
+		boundsExtents.reserve(count);
+		m_updated.reserve(count);
+		m_depths.reserve(count);
+	}
+
+	//Appends a node under parent (NO_PARENT for a root) and returns its id
+	uint32_t createNode(uint32_t parent = NO_PARENT, Model* model = nullptr)
+	{
+		const uint32_t node = static_cast<uint32_t>(parents.size());
+		if (parent >= node)
+			parent = NO_PARENT;
+		parents.push_back(parent);
+		localPositions.push_back(glm::vec3(0.0f));
+		localRotations.push_back(glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+		localScales.push_back(glm::vec3(1.0f));
+		worldMatrices.push_back(SimdMat4(1.0f));
+		dirty.push_back(1);
+		models.push_back(model);
+		m_updated.push_back(0);
+		m_depths.push_back(parent == NO_PARENT ? 0 : m_depths[parent] + 1);
+		m_levelsValid = false;
+		if (model)
+		{
+			const AABB bounds = generateAABB(*model);
+			boundsCenters.push_back(bounds.center);
+			boundsExtents.push_back(bounds.extents);
+		}
+		else
+		{
+			boundsCenters.push_back(glm::vec3(0.0f));
+			boundsExtents.push_back(glm::vec3(0.0f));
+		}
+		return node;
+	}
+
+	void setLocalPosition(uint32_t node, const glm::vec3& newPosition)
+	{
+		localPositions[node] = newPosition;
+		dirty[node] = 1;
+	}
+
+	//Euler angles in degrees, applied in the same Y * X * Z order as Transform
+	void setLocalRotation(uint32_t node, const glm::vec3& eulerDegrees)
+	{
+		const glm::quat rotX = glm::angleAxis(glm::radians(eulerDegrees.x), glm::vec3(1.0f, 0.0f, 0.0f));
+		const glm::quat rotY = glm::angleAxis(glm::radians(eulerDegrees.y), glm::vec3(0.0f, 1.0f, 0.0f));
+		const glm::quat rotZ = glm::angleAxis(glm::radians(eulerDegrees.z), glm::vec3(0.0f, 0.0f, 1.0f));
+		setLocalRotation(node, rotY * rotX * rotZ);
+	}
+
+	void setLocalRotation(uint32_t node, const glm::quat& rotation)
+	{
+		localRotations[node] = rotation;
+		dirty[node] = 1;
+	}
+
+	void setLocalScale(uint32_t node, const glm::vec3& newScale)
+	{
+		localScales[node] = newScale;
+		dirty[node] = 1;
+	}
+
+	//Replaces the local bounds of a node whose model changes shape (skinned meshes, see
+	//SkinnedBounds); gatherSceneBounds picks them up, no update() needed
+	void setLocalBounds(uint32_t node, const glm::vec3& center, const glm::vec3& extents)
+	{
+		boundsCenters[node] = center;
+		boundsExtents[node] = extents;
+	}
+
+	const SimdMat4& getWorldMatrix(uint32_t node) const
+	{
+		return worldMatrices[node];
+	}
+
+	//Recomputes the world matrix of every dirty node and of everything below one, in one pass.
+	//Returns how many nodes were recomputed.
+	size_t update()
+	{
+		const size_t count = parents.size();
+		size_t recomputed = 0;
+		for (size_t i = 0; i < count; ++i)
+			recomputed += updateNode(i);
+		return recomputed;
+	}
+
+	//Same result as update(), with every depth level split into chunks of chunkSize nodes that run
+	//on the job system. Levels smaller than a chunk run inline on the calling thread, and a single
+	//threaded job system just runs update(), whose id order walks memory linearly.
+	size_t updateParallel(JobSystem& jobs, size_t chunkSize = 1024)
+	{
+		if (jobs.threadCount() == 1)
+			return update();
+		if (!m_levelsValid)
+			buildLevels();
+		std::atomic<size_t> recomputed(0);
+		for (size_t level = 0; level + 1 < m_levelStarts.size(); ++level)
+		{
+			const uint32_t* levelNodes = &m_levelNodes[m_levelStarts[level]];
+			jobs.parallelFor(m_levelStarts[level + 1] - m_levelStarts[level], chunkSize, [&](size_t begin, size_t end) {
+				size_t chunkRecomputed = 0;
+				for (size_t k = begin; k < end; ++k)
+					chunkRecomputed += updateNode(levelNodes[k]);
+				recomputed += chunkRecomputed;
+			});
+		}
+		return recomputed.load();
+	}
+
+private:
+	std::vector<uint8_t> m_updated; //world matrix changed in the current update() pass
+	std::vector<uint32_t> m_depths; //0 for roots
+	std::vector<uint32_t> m_levelNodes; //node ids grouped by depth, ascending id inside a level
+	std::vector<size_t> m_levelStarts; //level l is m_levelNodes[m_levelStarts[l], m_levelStarts[l + 1])
+	bool m_levelsValid = false;
+
+	size_t updateNode(size_t i)
+	{
+		const uint32_t parent = parents[i];
+		const bool parentUpdated = parent != NO_PARENT && m_updated[parent];
+		if (!dirty[i] && !parentUpdated)
+		{
+			m_updated[i] = 0;
+			return 0;
+		}
+		const SimdMat4 local = composeTRS(localPositions[i], localRotations[i], localScales[i]);
+		worldMatrices[i] = parent != NO_PARENT ? worldMatrices[parent] * local : local;
+		dirty[i] = 0;
+		m_updated[i] = 1;
+		return 1;
+	}
+
+	//counting sort of the node ids by depth
+	void buildLevels()
+	{
+		uint32_t levels = 0;
+		for (uint32_t depth : m_depths)
+			levels = std::max(levels, depth + 1);
+		m_levelStarts.assign(levels + 1, 0);
+		for (uint32_t depth : m_depths)
+			m_levelStarts[depth + 1]++;
+		for (uint32_t level = 0; level < levels; ++level)
+			m_levelStarts[level + 1] += m_levelStarts[level];
+		std::vector<size_t> next(m_levelStarts.begin(), m_levelStarts.end() - 1);
+		m_levelNodes.resize(m_depths.size());
+		for (uint32_t node = 0; node < m_depths.size(); ++node)
+			m_levelNodes[next[m_depths[node]]++] = node;
+		m_levelsValid = true;
+	}
+};
+#endif
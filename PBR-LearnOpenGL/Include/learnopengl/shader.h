@@ -3,7 +3,13 @@
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#ifdef PBR_SIMD_MATH
+#include <glm/gtc/type_aligned.hpp>
+#endif
+
+#include <learnopengl/gl_state.h>
 
+#include <map>
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -100,7 +106,41 @@ public:
     // ------------------------------------------------------------------------
     void use() 
     { 
-        glUseProgram(ID); 
+        GLStateCache::useProgram(ID); 
+    }
+    // texture unit reserved for a sampler uniform of this program. Units are handed out on the
+    // first request for a name and the sampler is pointed at it once, so every mesh drawn with
+    // this shader agrees on the mapping. Returns -1 if the program has no such active uniform.
+    // Pointing the sampler needs this program bound (GL 3.3 has no glProgramUniform), so the
+    // first request binds it and then restores whichever program was bound before.
+    // ------------------------------------------------------------------------
+    int getSamplerUnit(const std::string &name)
+    {
+        std::map<std::string, int>::const_iterator it = samplerUnits.find(name);
+        if (it != samplerUnits.end())
+            return it->second;
+
+        int unit = -1;
+        int location = glGetUniformLocation(ID, name.c_str());
+        if (location != -1)
+        {
+            unit = nextSamplerUnit++;
+            GLint previous = 0;
+            glGetIntegerv(GL_CURRENT_PROGRAM, &previous);
+            use();
+            glUniform1i(location, unit);
+            GLStateCache::useProgram(static_cast<unsigned int>(previous));
+        }
+        samplerUnits[name] = unit;
+        return unit;
+    }
+    // connects the uniform block called name to an indexed GL_UNIFORM_BUFFER binding point; no-op if the block is absent
+    // ------------------------------------------------------------------------
+    void setUniformBlockBinding(const std::string &name, unsigned int binding) const
+    {
+        GLuint blockIndex = glGetUniformBlockIndex(ID, name.c_str());
+        if (blockIndex != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID, blockIndex, binding);
     }
     // utility uniform functions
     // ------------------------------------------------------------------------
@@ -160,8 +200,18 @@ public:
     {
         glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
     }
+#ifdef PBR_SIMD_MATH
+    // aligned matrices (simd_math.h) have the same column major float layout
+    void setMat4(const std::string &name, const glm::aligned_mat4 &mat) const
+    {
+        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    }
+#endif
 
 private:
+    std::map<std::string, int> samplerUnits;
+    int nextSamplerUnit = 0;
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
@@ -0,0 +1,87 @@
+#ifndef SIMD_MATH_H
+#define SIMD_MATH_H
+
+//Storage types for the hot transform and skinning loops (entity transforms, scene graph world
+//matrices, bone matrices) and the few operations those loops need.
+//
+//Defining PBR_SIMD_MATH (msbuild /p:PbrSimdMath=true, x64 only) switches them to GLM's aligned
+//types: 16 byte aligned columns on which the bundled GLM runs its SSE code paths (mat4 * mat4,
+//mat4 * vec4, abs, ...). Without it they are plain glm::mat4/vec4/quat and nothing changes.
+//Newer GLM versions gate those paths behind GLM_FORCE_INTRINSICS, which the project defines next to
+//PBR_SIMD_MATH; 0.9.9.3 enables them for aligned types on every SSE2 target.
+//
+//Aligned types rely on the allocator returning 16 byte aligned memory for std::vector and
+//std::make_unique, which C++14 only guarantees in practice on x64, hence no Win32 build.
+
+#include <glm/glm.hpp> //glm::mat4
+#include <glm/gtc/quaternion.hpp> //glm::quat
+
+#ifdef PBR_SIMD_MATH
+#include <glm/gtc/type_aligned.hpp> //glm::aligned_mat4
+
+#if GLM_CONFIG_SIMD != GLM_ENABLE
+#error "PBR_SIMD_MATH needs GLM's SIMD code paths (SSE2 target and compiler language extensions)"
+#endif
+
+typedef glm::aligned_mat4 SimdMat4;
+typedef glm::aligned_vec4 SimdVec4;
+typedef glm::qua<float, glm::aligned_highp> SimdQuat;
+
+//Conversions at the boundary with code that keeps packed types (assimp data, uniforms)
+inline SimdMat4 toSimd(const glm::mat4& m)
+{
+	return SimdMat4(m);
+}
+
+inline glm::mat4 toPacked(const SimdMat4& m)
+{
+	return glm::mat4(m);
+}
+#else
+typedef glm::mat4 SimdMat4;
+typedef glm::vec4 SimdVec4;
+typedef glm::quat SimdQuat;
+
+inline const glm::mat4& toSimd(const glm::mat4& m)
+{
+	return m;
+}
+
+inline const glm::mat4& toPacked(const glm::mat4& m)
+{
+	return m;
+}
+#endif
+
+//translation * rotation * scale written directly from the quaternion, instead of building three
+//matrices and multiplying them. rotation must be normalized.
+inline SimdMat4 composeTRS(const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale)
+{
+	const float xx = rotation.x * rotation.x, yy = rotation.y * rotation.y, zz = rotation.z * rotation.z;
+	const float xy = rotation.x * rotation.y, xz = rotation.x * rotation.z, yz = rotation.y * rotation.z;
+	const float wx = rotation.w * rotation.x, wy = rotation.w * rotation.y, wz = rotation.w * rotation.z;
+
+	SimdMat4 m;
+	m[0] = SimdVec4(1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (xz - wy), 0.0f) * scale.x;
+	m[1] = SimdVec4(2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx), 0.0f) * scale.y;
+	m[2] = SimdVec4(2.0f * (xz + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy), 0.0f) * scale.z;
+	m[3] = SimdVec4(translation, 1.0f);
+	return m;
+}
+
+inline glm::vec3 transformPoint(const SimdMat4& m, const glm::vec3& point)
+{
+	return glm::vec3(m[0] * point.x + m[1] * point.y + m[2] * point.z + m[3]);
+}
+
+//World box enclosing the local box (center, extents) moved by m: the center is transformed and the
+//extents become |M| * extents, with |M| the absolute upper 3x3 of m. One column per SIMD lane group.
+inline void transformAABB(const SimdMat4& m, const glm::vec3& center, const glm::vec3& extents,
+	glm::vec3& globalCenter, glm::vec3& globalExtents)
+{
+	const SimdVec4 c = m[0] * center.x + m[1] * center.y + m[2] * center.z + m[3];
+	const SimdVec4 e = glm::abs(m[0]) * extents.x + glm::abs(m[1]) * extents.y + glm::abs(m[2]) * extents.z;
+	globalCenter = glm::vec3(c);
+	globalExtents = glm::vec3(e);
+}
+#endif
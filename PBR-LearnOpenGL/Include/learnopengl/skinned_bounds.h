@@ -0,0 +1,122 @@
+#pragma once
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <learnopengl/mesh.h>
+#include <learnopengl/simd_math.h>
+
+//Animated bounds of a skinned model in O(bones) per frame. Build records, once at load time, the
+//bind space box of the vertices each bone influences. Compute moves every box by its final bone
+//matrix and merges them: a linearly blended vertex is a weighted average of its bone transformed
+//positions, each inside its bone's moved box, so it stays inside the merged box. Weight missing
+//from a total of 1 goes to the identity (the rule of pbr_skinned.vert and cpu_skinning.h), so
+//such vertices also keep part of their bind position, which has its own box. A shortfall under
+//1e-3 is taken for the rounding of normalized weights and ignored.
+//Dual quaternion skinning can bulge slightly past the box on strongly twisted joints.
+//The result is local space bounds for Entity::setLocalBounds or SceneGraph::setLocalBounds.
+class SkinnedBounds
+{
+public:
+	void Build(const std::vector<Mesh>& meshes)
+	{
+		Clear();
+		for (const Mesh& mesh : meshes)
+			AddVertices(mesh.vertices);
+	}
+
+	void Clear()
+	{
+		m_BoneMin.clear();
+		m_BoneMax.clear();
+		m_Bones.clear();
+		m_BindMin = glm::vec3(std::numeric_limits<float>::max());
+		m_BindMax = glm::vec3(std::numeric_limits<float>::lowest());
+	}
+
+	//Adds the vertices of one more mesh of the model
+	void AddVertices(const std::vector<Vertex>& vertices)
+	{
+		const glm::vec3 empty(std::numeric_limits<float>::max());
+		for (const Vertex& vertex : vertices)
+		{
+			float total = 0.0f;
+			for (int k = 0; k < MAX_BONE_INFLUENCE; k++)
+			{
+				const int bone = vertex.m_BoneIDs[k];
+				if (bone < 0 || vertex.m_Weights[k] <= 0.0f)
+					continue;
+				if (static_cast<size_t>(bone) >= m_BoneMin.size())
+				{
+					m_BoneMin.resize(bone + 1, empty);
+					m_BoneMax.resize(bone + 1, -empty);
+				}
+				m_BoneMin[bone] = glm::min(m_BoneMin[bone], vertex.Position);
+				m_BoneMax[bone] = glm::max(m_BoneMax[bone], vertex.Position);
+				total += vertex.m_Weights[k];
+			}
+			if (total < 0.999f)
+			{
+				m_BindMin = glm::min(m_BindMin, vertex.Position);
+				m_BindMax = glm::max(m_BindMax, vertex.Position);
+			}
+		}
+
+		//Compute only visits the bones that influence a vertex
+		m_Bones.clear();
+		for (size_t bone = 0; bone < m_BoneMin.size(); bone++)
+		{
+			if (m_BoneMin[bone].x > m_BoneMax[bone].x)
+				continue;
+			BoneBox box;
+			box.slot = static_cast<int>(bone);
+			box.center = (m_BoneMin[bone] + m_BoneMax[bone]) * 0.5f;
+			box.extents = (m_BoneMax[bone] - m_BoneMin[bone]) * 0.5f;
+			m_Bones.push_back(box);
+		}
+	}
+
+	//number of bone slots the final bone matrices given to Compute must cover
+	int GetBoneSlotCount() const { return m_Bones.empty() ? 0 : m_Bones.back().slot + 1; }
+
+	size_t GetInfluencingBoneCount() const { return m_Bones.size(); }
+
+	//Local space bounds of the model posed by finalBoneMatrices (Animator::GetFinalBoneMatrices,
+	//a BlendTree or a CrowdAnimator palette). Returns false, leaving center and extents untouched,
+	//for a model without vertices.
+	bool Compute(const SimdMat4* finalBoneMatrices, glm::vec3& center, glm::vec3& extents) const
+	{
+		glm::vec3 low = m_BindMin, high = m_BindMax;
+		glm::vec3 boneCenter, boneExtents;
+		for (const BoneBox& box : m_Bones)
+		{
+			transformAABB(finalBoneMatrices[box.slot], box.center, box.extents, boneCenter, boneExtents);
+			low = glm::min(low, boneCenter - boneExtents);
+			high = glm::max(high, boneCenter + boneExtents);
+		}
+		if (low.x > high.x)
+			return false;
+		center = (low + high) * 0.5f;
+		extents = (high - low) * 0.5f;
+		return true;
+	}
+
+	bool Compute(const std::vector<SimdMat4>& finalBoneMatrices, glm::vec3& center, glm::vec3& extents) const
+	{
+		return Compute(finalBoneMatrices.data(), center, extents);
+	}
+
+private:
+	struct BoneBox
+	{
+		int slot; //index in the final bone matrices
+		glm::vec3 center; //bind space box of the vertices the bone influences
+		glm::vec3 extents;
+	};
+
+	std::vector<BoneBox> m_Bones;
+	std::vector<glm::vec3> m_BoneMin, m_BoneMax; //per bone slot, while vertices are added
+	glm::vec3 m_BindMin = glm::vec3(std::numeric_limits<float>::max());
+	glm::vec3 m_BindMax = glm::vec3(std::numeric_limits<float>::lowest());
+};
@@ -0,0 +1,130 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// a small fixed-size pool of worker threads. Work items are picked up in FIFO order and
+// submit() hands back a future so the caller can wait for (and collect) the result.
+// None of the workers own a GL context: only CPU work may be pushed through the pool.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned int threadCount = std::thread::hardware_concurrency())
+    {
+        if (threadCount == 0)
+            threadCount = 1;
+        for (unsigned int i = 0; i < threadCount; i++)
+            workers.emplace_back([this] { workerLoop(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers.size(); }
+
+    // queues a callable and returns a future for its result
+    template<typename F>
+    auto submit(F&& task) -> std::future<decltype(task())>
+    {
+        using Result = decltype(task());
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+        std::future<Result> result = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            tasks.emplace([packaged] { (*packaged)(); });
+        }
+        wakeUp.notify_one();
+        return result;
+    }
+
+    // calls body(i) for every i in [0, count) spread over the workers and the calling thread,
+    // and blocks until all of them returned. Exceptions thrown by body are rethrown here.
+    template<typename F>
+    void parallelFor(size_t count, F&& body)
+    {
+        if (count == 0)
+            return;
+        if (count == 1 || workers.size() == 1)
+        {
+            for (size_t i = 0; i < count; i++)
+                body(i);
+            return;
+        }
+
+        std::atomic<size_t> next(0);
+        auto drain = [&]()
+        {
+            for (size_t i = next++; i < count; i = next++)
+                body(i);
+        };
+
+        const size_t helpers = std::min(workers.size(), count - 1);
+        std::vector<std::future<void>> pending;
+        pending.reserve(helpers);
+        for (size_t i = 0; i < helpers; i++)
+            pending.push_back(submit(drain));
+        // every helper must be done with the locals above before anything is rethrown
+        std::exception_ptr failure;
+        try
+        {
+            drain();
+        }
+        catch (...)
+        {
+            failure = std::current_exception();
+            next = count;
+        }
+        for (std::future<void>& f : pending)
+            f.wait();
+        if (failure)
+            std::rethrow_exception(failure);
+        for (std::future<void>& f : pending)
+            f.get();
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex queueMutex;
+    std::condition_variable wakeUp;
+    bool stopping = false;
+
+    void workerLoop()
+    {
+        for (;;)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                wakeUp.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty())
+                    return;
+                task = std::move(tasks.front());
+                tasks.pop();
+            }
+            task();
+        }
+    }
+};
+#endif
@@ -0,0 +1,118 @@
+//Keyframe lookup of bone.h on 128 bones with 10k-key clips, evenly and unevenly spaced: the
+//cursor based KeyTrack::GetSegment against the linear scan from the start of the track that it
+//replaced, for forward playback, long jumps and random seeks, plus the full Bone::Update.
+//Fails if the two lookups ever pick a different segment.
+//usage: bone_keys_bench [bones] [keys]
+#include <learnopengl/bone.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double millisecondsSince(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+//the lookup Bone used before key tracks: first key after animationTime, scanning from key 0
+static int linearSegment(const std::vector<float>& timeStamps, float animationTime)
+{
+	for (int index = 0; index + 1 < static_cast<int>(timeStamps.size()); ++index)
+	{
+		if (animationTime < timeStamps[index + 1])
+			return index;
+	}
+	return static_cast<int>(timeStamps.size()) - 2;
+}
+
+static std::unique_ptr<aiNodeAnim> makeChannel(unsigned int keys, bool even, std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> uniform(-1.f, 1.f);
+	std::unique_ptr<aiNodeAnim> channel(new aiNodeAnim());
+	channel->mNumPositionKeys = channel->mNumRotationKeys = channel->mNumScalingKeys = keys;
+	channel->mPositionKeys = new aiVectorKey[keys];
+	channel->mRotationKeys = new aiQuatKey[keys];
+	channel->mScalingKeys = new aiVectorKey[keys];
+	double time = 0.0;
+	for (unsigned int k = 0; k < keys; ++k)
+	{
+		time += even ? 1.0 : 0.5 + std::abs(uniform(rng));
+		aiQuaternion rotation(uniform(rng), uniform(rng), uniform(rng), uniform(rng));
+		rotation.Normalize();
+		channel->mPositionKeys[k] = aiVectorKey(time, aiVector3D(uniform(rng), uniform(rng), uniform(rng)));
+		channel->mRotationKeys[k] = aiQuatKey(time, rotation);
+		channel->mScalingKeys[k] = aiVectorKey(time, aiVector3D(1.f));
+	}
+	return channel;
+}
+
+int main(int argc, char** argv)
+{
+	const int boneCount = argc > 1 ? std::max(1, atoi(argv[1])) : 128;
+	const unsigned int keyCount = argc > 2 ? std::max(3, atoi(argv[2])) : 10000;
+	const int frames = 200;
+	size_t mismatches = 0;
+	std::mt19937 rng(3);
+	printf("%d bones, %u keys per channel, ms per frame\n", boneCount, keyCount);
+	printf("%-8s %-12s %12s %12s %14s\n", "keys", "access", "linear scan", "GetSegment", "Bone::Update");
+	for (bool even : { true, false })
+	{
+		std::vector<std::unique_ptr<aiNodeAnim>> channels;
+		std::vector<Bone> bones;
+		for (int b = 0; b < boneCount; ++b)
+		{
+			channels.push_back(makeChannel(keyCount, even, rng));
+			bones.emplace_back("bone", b, channels.back().get());
+		}
+		const float duration = static_cast<float>(channels[0]->mPositionKeys[keyCount - 1].mTime);
+
+		const char* accessNames[3] = { "playback", "long jumps", "random seeks" };
+		std::uniform_real_distribution<float> seek(0.f, duration);
+		for (int access = 0; access < 3; ++access)
+		{
+			//playback runs from the middle of the clip, where a scan from key 0 pays its average cost
+			std::vector<float> times(frames);
+			for (int f = 0; f < frames; ++f)
+				times[f] = access == 0 ? duration * 0.5f + f * 0.37f : access == 1 ? f * duration * 0.999f / frames : seek(rng);
+
+			//the lookups alone, one track per bone (all three tracks share their key times here)
+			volatile int sink = 0;
+			Clock::time_point start = Clock::now();
+			for (int f = 0; f < frames; ++f)
+				for (const Bone& bone : bones)
+					sink += linearSegment(bone.GetPositionTrack().timeStamps, times[f]);
+			const double linearMs = millisecondsSince(start) / frames;
+
+			std::vector<size_t> cursors(bones.size(), 0);
+			start = Clock::now();
+			for (int f = 0; f < frames; ++f)
+				for (size_t b = 0; b < bones.size(); ++b)
+					sink += bones[b].GetPositionTrack().GetSegment(times[f], cursors[b]);
+			const double segmentMs = millisecondsSince(start) / frames;
+
+			start = Clock::now();
+			for (int f = 0; f < frames; ++f)
+				for (Bone& bone : bones)
+					bone.Update(times[f]);
+			const double updateMs = millisecondsSince(start) / frames;
+
+			for (size_t b = 0; b < bones.size(); ++b)
+			{
+				size_t cursor = 0;
+				for (int f = 0; f < frames; ++f)
+				{
+					const std::vector<float>& timeStamps = bones[b].GetPositionTrack().timeStamps;
+					mismatches += bones[b].GetPositionTrack().GetSegment(times[f], cursor) != linearSegment(timeStamps, times[f]);
+				}
+			}
+			printf("%-8s %-12s %12.3f %12.3f %14.3f\n", even ? "even" : "uneven", accessNames[access], linearMs, segmentMs, updateMs);
+		}
+	}
+	if (mismatches)
+		printf("MISMATCH: %zu lookups picked a different segment than the linear scan\n", mismatches);
+	return mismatches ? 1 : 0;
+}
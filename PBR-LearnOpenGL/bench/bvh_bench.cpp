@@ -0,0 +1,165 @@
+//DynamicBvh (bvh.h) against the linear paths it replaces: frustum culling vs the per-box plane
+//test and the SoA batch cull, ray picking vs testing every box, plus build, incremental insert
+//and moving 10% of the boxes a frame. Fails if a query disagrees with the linear answer.
+//usage: bvh_bench [boxes]
+#include <glad/glad.h>
+#include <learnopengl/shader.h>
+#include <learnopengl/camera.h>
+#include <learnopengl/model.h>
+#include <learnopengl/culling.h>
+#include <learnopengl/bvh.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double millisecondsSince(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static bool isOnFrustumLinear(const AABB& box, const Frustum& frustum)
+{
+	return box.isOnOrForwardPlan(frustum.leftFace) && box.isOnOrForwardPlan(frustum.rightFace) &&
+		box.isOnOrForwardPlan(frustum.topFace) && box.isOnOrForwardPlan(frustum.bottomFace) &&
+		box.isOnOrForwardPlan(frustum.nearFace) && box.isOnOrForwardPlan(frustum.farFace);
+}
+
+int main(int argc, char** argv)
+{
+	const size_t count = argc > 1 ? std::max(1, atoi(argv[1])) : 100000;
+	const int repeats = 20;
+	bool agree = true;
+
+	//a wide, flat world like a level: most boxes are outside any one view
+	std::mt19937 rng(5);
+	std::uniform_real_distribution<float> position(-500.f, 500.f), extent(0.5f, 3.f);
+	std::vector<BvhBox> boxes(count);
+	std::vector<AABB> aabbs;
+	aabbs.reserve(count);
+	BoundsSoA bounds;
+	bounds.resize(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		const glm::vec3 center(position(rng), position(rng) * 0.2f, position(rng));
+		const glm::vec3 extents(extent(rng), extent(rng), extent(rng));
+		boxes[i] = BvhBox(center - extents, center + extents);
+		aabbs.emplace_back(center - extents, center + extents);
+		bounds.set(i, center, extents);
+	}
+
+	DynamicBvh bvh;
+	std::vector<uint32_t> proxies;
+	Clock::time_point start = Clock::now();
+	bvh.build(boxes, proxies);
+	printf("%zu boxes: build %.2f ms (SAH cost %.1f)", count, millisecondsSince(start), bvh.cost());
+	DynamicBvh incremental;
+	start = Clock::now();
+	for (size_t i = 0; i < count; ++i)
+		incremental.insert(boxes[i], static_cast<uint32_t>(i));
+	printf(", incremental insert %.2f ms (cost %.1f)\n", millisecondsSince(start), incremental.cost());
+
+	printf("%6s %9s %12s %12s %12s %14s\n", "yaw", "visible", "linear ms", "SoA ms", "BVH ms", "nodes tested");
+	Camera camera(glm::vec3(0.f, 10.f, 0.f));
+	for (float yaw : { -90.f, 0.f, 45.f })
+	{
+		camera.Yaw = yaw;
+		camera.ProcessMouseMovement(0.f, 0.f);
+		const Frustum frustum = createFrustumFromCamera(camera, 16.f / 9.f, glm::radians(45.f), 0.1f, 150.f);
+
+		size_t linearVisible = 0, soaVisible = 0, bvhVisible = 0, tested = 0;
+		start = Clock::now();
+		for (int r = 0; r < repeats; ++r)
+		{
+			linearVisible = 0;
+			for (const AABB& box : aabbs)
+				linearVisible += isOnFrustumLinear(box, frustum);
+		}
+		const double linearMs = millisecondsSince(start) / repeats;
+
+		std::vector<uint64_t> mask;
+		start = Clock::now();
+		for (int r = 0; r < repeats; ++r)
+			soaVisible = cullFrustum(frustum, bounds, mask);
+		const double soaMs = millisecondsSince(start) / repeats;
+
+		start = Clock::now();
+		for (int r = 0; r < repeats; ++r)
+		{
+			bvhVisible = 0;
+			tested = bvh.cullFrustum(frustum, [&](uint32_t) { ++bvhVisible; });
+		}
+		const double bvhMs = millisecondsSince(start) / repeats;
+
+		printf("%6.0f %9zu %12.3f %12.3f %12.3f %14zu\n", yaw, bvhVisible, linearMs, soaMs, bvhMs, tested);
+		if (linearVisible != bvhVisible || soaVisible != bvhVisible)
+		{
+			printf("  MISMATCH: linear %zu, SoA %zu, BVH %zu visible\n", linearVisible, soaVisible, bvhVisible);
+			agree = false;
+		}
+	}
+
+	//picking: 1000 rays cast down into the world, nearest hit
+	const int rays = 1000;
+	size_t rayMismatches = 0;
+	double linearRayMs = 0.0, bvhRayMs = 0.0;
+	for (int i = 0; i < rays; ++i)
+	{
+		const glm::vec3 origin(position(rng), 50.f, position(rng));
+		const glm::vec3 dir = glm::normalize(glm::vec3(position(rng), -200.f, position(rng)));
+		const glm::vec3 invDir = 1.f / dir;
+
+		start = Clock::now();
+		float nearest = std::numeric_limits<float>::max();
+		uint32_t linearHit = DynamicBvh::NULL_NODE;
+		for (size_t k = 0; k < count; ++k)
+		{
+			const float t = intersectRayBox(origin, invDir, boxes[k], nearest);
+			if (t >= 0.f && t < nearest)
+			{
+				nearest = t;
+				linearHit = static_cast<uint32_t>(k);
+			}
+		}
+		linearRayMs += millisecondsSince(start);
+
+		start = Clock::now();
+		float distance = std::numeric_limits<float>::max();
+		const uint32_t bvhHit = bvh.raycast(origin, dir, distance);
+		bvhRayMs += millisecondsSince(start);
+
+		//two boxes hit at the same distance are both correct answers
+		if (bvhHit != linearHit && !(bvhHit != DynamicBvh::NULL_NODE && linearHit != DynamicBvh::NULL_NODE && std::abs(distance - nearest) < 1e-4f))
+			++rayMismatches;
+	}
+	printf("ray pick: linear %.4f ms, BVH %.4f ms per ray, %zu mismatches\n", linearRayMs / rays, bvhRayMs / rays, rayMismatches);
+	agree = agree && rayMismatches == 0;
+
+	//10% of the boxes move by up to 2 units a frame
+	std::uniform_real_distribution<float> step(-2.f, 2.f);
+	double moveMs = 0.0;
+	size_t refits = 0;
+	const int frames = 5;
+	for (int frame = 0; frame < frames; ++frame)
+	{
+		start = Clock::now();
+		for (size_t i = 0; i < count; i += 10)
+		{
+			const glm::vec3 delta(step(rng), step(rng), step(rng));
+			boxes[i].min += delta;
+			boxes[i].max += delta;
+			refits += bvh.move(proxies[i], boxes[i]);
+		}
+		moveMs += millisecondsSince(start);
+	}
+	DynamicBvh rebuilt;
+	std::vector<uint32_t> rebuiltProxies;
+	rebuilt.build(boxes, rebuiltProxies);
+	printf("move %zu boxes: %.2f ms per frame, %zu refits over %d frames; cost %.1f vs %.1f rebuilt\n",
+		(count + 9) / 10, moveMs / frames, refits, frames, bvh.cost(), rebuilt.cost());
+
+	return agree ? 0 : 1;
+}
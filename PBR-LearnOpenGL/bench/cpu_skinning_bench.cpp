@@ -0,0 +1,111 @@
+//CPU skinning throughput of cpu_skinning.h in million vertices per second, for both palette
+//formats: SkinVerticesScalar, SkinVertices (AVX2 when the build targets it) with and without
+//normals, and CpuSkinner on a JobSystem. The vertices have one to four bones, a fifth of them
+//with weights summing to less than 1. Fails if SkinVertices differs from the scalar kernel.
+//usage: cpu_skinning_bench [vertices] [repeats]
+#include <learnopengl/cpu_skinning.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double millisecondsSince(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+	const size_t vertexCount = argc > 1 ? std::max(8, atoi(argv[1])) : 200000;
+	const int repeats = argc > 2 ? std::max(1, atoi(argv[2])) : 20;
+	const int boneCount = 64;
+#ifdef CPU_SKINNING_AVX2
+	const char* path = "AVX2";
+#else
+	const char* path = "scalar";
+#endif
+
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> uniform(-1.f, 1.f), positive(0.05f, 1.f);
+	std::vector<Vertex> vertices(vertexCount);
+	for (size_t i = 0; i < vertexCount; ++i)
+	{
+		Vertex& vertex = vertices[i];
+		vertex.Position = glm::vec3(uniform(rng), uniform(rng), uniform(rng));
+		vertex.Normal = glm::normalize(glm::vec3(uniform(rng), uniform(rng), uniform(rng)) + glm::vec3(0.f, 0.f, 2.f));
+		const int used = 1 + static_cast<int>(i % MAX_BONE_INFLUENCE);
+		const float total = i % 5 == 0 ? 0.7f : 1.f;
+		float sum = 0.f;
+		for (int k = 0; k < MAX_BONE_INFLUENCE; ++k)
+		{
+			vertex.m_BoneIDs[k] = k < used ? static_cast<int>(rng() % boneCount) : -1;
+			vertex.m_Weights[k] = k < used ? positive(rng) : 0.f;
+			sum += vertex.m_Weights[k];
+		}
+		for (int k = 0; k < used; ++k)
+			vertex.m_Weights[k] *= total / sum;
+	}
+	SkinningSource source;
+	source.Build(vertices);
+
+	std::vector<SimdMat4> bones(boneCount);
+	for (SimdMat4& bone : bones)
+	{
+		const glm::quat rotation = glm::normalize(glm::quat(1.f + uniform(rng), uniform(rng) * 0.5f, uniform(rng) * 0.5f, uniform(rng) * 0.5f));
+		bone = toSimd(glm::translate(glm::mat4(1.f), glm::vec3(uniform(rng), uniform(rng), uniform(rng))) * glm::mat4_cast(rotation));
+	}
+
+	const unsigned int threads = std::max(2u, std::thread::hardware_concurrency());
+	JobSystem jobs(threads);
+	std::vector<glm::vec3> scalarPositions(vertexCount), scalarNormals(vertexCount), positions(vertexCount), normals(vertexCount);
+	bool same = true;
+	printf("%zu vertices, %d bones, Mvert/s\n", vertexCount, boneCount);
+	printf("%16s %10s %10s %16s %10s\n", "format", "scalar", path, "positions only", "jobs");
+	for (BonePaletteFormat format : { BonePaletteFormat::Matrix3x4, BonePaletteFormat::DualQuaternion })
+	{
+		std::vector<glm::vec4> palette(boneCount * GetBonePaletteTexelsPerBone(format));
+		PackBonePalette(format, bones.data(), boneCount, palette.data());
+		CpuSkinner skinner(format);
+		skinner.SetPalette(bones);
+		auto rate = [&](double milliseconds) { return vertexCount / milliseconds * 1e-3; };
+
+		Clock::time_point start = Clock::now();
+		for (int r = 0; r < repeats; ++r)
+			SkinVerticesScalar(source, palette.data(), format, 0, vertexCount, scalarPositions.data(), scalarNormals.data());
+		const double scalarMs = millisecondsSince(start) / repeats;
+
+		start = Clock::now();
+		for (int r = 0; r < repeats; ++r)
+			SkinVertices(source, palette.data(), format, 0, vertexCount, positions.data(), normals.data());
+		const double kernelMs = millisecondsSince(start) / repeats;
+		double difference = 0.0;
+		for (size_t i = 0; i < vertexCount; ++i)
+			difference = std::max<double>(difference, std::max(glm::length(positions[i] - scalarPositions[i]), glm::length(normals[i] - scalarNormals[i])));
+
+		start = Clock::now();
+		for (int r = 0; r < repeats; ++r)
+			SkinVertices(source, palette.data(), format, 0, vertexCount, positions.data(), nullptr);
+		const double positionsMs = millisecondsSince(start) / repeats;
+
+		start = Clock::now();
+		for (int r = 0; r < repeats; ++r)
+			skinner.Skin(jobs, source, positions.data(), normals.data());
+		const double jobsMs = millisecondsSince(start) / repeats;
+
+		printf("%16s %10.0f %10.0f %16.0f %10.0f\n", format == BonePaletteFormat::Matrix3x4 ? "3x4 matrix" : "dual quaternion",
+			rate(scalarMs), rate(kernelMs), rate(positionsMs), rate(jobsMs));
+		if (difference > 1e-5)
+		{
+			printf("  MISMATCH: %s differs from the scalar kernel by %.2e\n", path, difference);
+			same = false;
+		}
+	}
+	printf("jobs: %u threads on %u hardware threads\n", threads, std::thread::hardware_concurrency());
+	return same ? 0 : 1;
+}
@@ -0,0 +1,153 @@
+//How many characters CrowdAnimator (crowd_animator.h) animates within a frame budget: milliseconds
+//per UpdateAnimations for 256 to 8192 instances of a 64 bone, 300 key clip (compiled with
+//anim_clip_compiler.h, default tolerances), on JobSystems of 1, 2, 4... threads up to the hardware
+//threads. For each thread count, the largest swept crowd that fits the budget and the count the
+//per-character cost of the largest crowd allows. Fails if a threaded run's palettes differ from
+//the single threaded ones.
+//usage: crowd_animator_bench [budget ms] [frames]
+#include <learnopengl/anim_clip_compiler.h>
+#include <learnopengl/crowd_animator.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <thread>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double millisecondsSince(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static const int BONE_COUNT = 64;
+static const unsigned int KEY_COUNT = 300;
+
+static std::unique_ptr<aiNodeAnim> makeChannel(int bone, std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> uniform(0.f, 6.28f);
+	const float phase = uniform(rng), frequency = 0.5f + uniform(rng) * 0.3f;
+	const glm::vec3 axis = glm::normalize(glm::vec3(1.f, std::sin(phase), 0.3f));
+	std::unique_ptr<aiNodeAnim> channel(new aiNodeAnim());
+	channel->mNumPositionKeys = channel->mNumRotationKeys = channel->mNumScalingKeys = KEY_COUNT;
+	channel->mPositionKeys = new aiVectorKey[KEY_COUNT];
+	channel->mRotationKeys = new aiQuatKey[KEY_COUNT];
+	channel->mScalingKeys = new aiVectorKey[KEY_COUNT];
+	for (unsigned int k = 0; k < KEY_COUNT; ++k)
+	{
+		const float seconds = k / 30.f;
+		const aiVector3D position = bone % 16 == 0
+			? aiVector3D(2.f * std::sin(seconds * frequency + phase), 0.1f * seconds, std::cos(seconds + phase))
+			: aiVector3D(0.f, 0.5f, 0.f);
+		const glm::quat rotation = glm::angleAxis(0.8f * std::sin(seconds * frequency * 2.f + phase), axis);
+		channel->mPositionKeys[k] = aiVectorKey(k, position);
+		channel->mRotationKeys[k] = aiQuatKey(k, aiQuaternion(rotation.w, rotation.x, rotation.y, rotation.z));
+		channel->mScalingKeys[k] = aiVectorKey(k, aiVector3D(1.f));
+	}
+	return channel;
+}
+
+int main(int argc, char** argv)
+{
+	const double budgetMs = argc > 1 ? std::max(0.01, atof(argv[1])) : 4.0;
+	const int frames = argc > 2 ? std::max(1, atoi(argv[2])) : 30;
+	const size_t crowdSizes[] = { 256, 512, 1024, 2048, 4096, 8192 };
+	const size_t sizeCount = sizeof(crowdSizes) / sizeof(crowdSizes[0]);
+
+	//four chains of 16 bones, every node skinned
+	std::mt19937 rng(11);
+	std::vector<Bone> bones;
+	std::vector<AnimationNode> nodes;
+	std::vector<std::string> nodeNames;
+	for (int b = 0; b < BONE_COUNT; ++b)
+	{
+		const std::string name = "bone_" + std::to_string(b);
+		std::unique_ptr<aiNodeAnim> channel = makeChannel(b, rng);
+		bones.push_back(Bone(name, b, channel.get()));
+		AnimationNode node;
+		node.transformation = SimdMat4(1.f);
+		node.parent = b % 16 == 0 ? -1 : b - 1;
+		node.bone = b;
+		nodes.push_back(node);
+		nodeNames.push_back(name);
+	}
+	const std::vector<char> image = BuildClip(nodes, nodeNames, bones, float(KEY_COUNT - 1), 30.f);
+	std::shared_ptr<CompressedClip> clip = std::make_shared<CompressedClip>();
+	if (!clip->OpenMemory(image.data(), image.size()))
+	{
+		printf("FAILED: the compiled clip does not open\n");
+		return 1;
+	}
+	std::map<std::string, BoneInfo> boneInfoMap;
+	int boneSlots = 0;
+	Animation animation(clip, boneInfoMap, boneSlots);
+
+	//every character starts somewhere else in the clip and plays at its own speed
+	std::uniform_real_distribution<float> startTime(0.f, animation.GetDuration() / animation.GetTicksPerSecond());
+	std::uniform_real_distribution<float> speed(0.8f, 1.2f);
+	std::vector<float> starts(crowdSizes[sizeCount - 1]), speeds(crowdSizes[sizeCount - 1]);
+	for (size_t i = 0; i < starts.size(); ++i)
+	{
+		starts[i] = startTime(rng);
+		speeds[i] = speed(rng);
+	}
+
+	std::vector<unsigned int> threadCounts;
+	const unsigned int hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+	for (unsigned int threads = 1; threads < std::max(2u, hardwareThreads); threads *= 2)
+		threadCounts.push_back(threads);
+	threadCounts.push_back(std::max(2u, hardwareThreads));
+
+	printf("%d bones, %u keys, %zu byte clip, %d frames of 1/60 s, ms per update\n", BONE_COUNT, KEY_COUNT, image.size(), frames);
+	printf("%8s", "threads");
+	for (size_t size : crowdSizes)
+		printf(" %8zu", size);
+	printf(" %12s %16s\n", "us per char", "chars in budget");
+
+	std::vector<SimdMat4> reference;
+	bool same = true;
+	for (unsigned int threads : threadCounts)
+	{
+		JobSystem jobs(threads);
+		printf("%8u", threads);
+		size_t fits = 0;
+		double microsecondsPerCharacter = 0.0;
+		for (size_t size : crowdSizes)
+		{
+			CrowdAnimator crowd;
+			crowd.Reserve(size);
+			for (size_t i = 0; i < size; ++i)
+				crowd.AddInstance(&animation, starts[i], speeds[i]);
+			crowd.UpdateAnimations(jobs, 1.f / 60.f); //warm up: scratch buffers and caches
+
+			const Clock::time_point start = Clock::now();
+			for (int f = 0; f < frames; ++f)
+				crowd.UpdateAnimations(jobs, 1.f / 60.f);
+			const double ms = millisecondsSince(start) / frames;
+			printf(" %8.2f", ms);
+			if (ms <= budgetMs)
+				fits = size;
+			microsecondsPerCharacter = ms * 1000.0 / size;
+
+			if (size != crowdSizes[sizeCount - 1])
+				continue;
+			if (reference.empty())
+				reference = crowd.GetPalettes();
+			else if (crowd.GetPalettes().size() != reference.size()
+				|| std::memcmp(crowd.GetPalettes().data(), reference.data(), reference.size() * sizeof(SimdMat4)) != 0)
+			{
+				same = false;
+			}
+		}
+		printf(" %12.2f %7zu / %-6.0f\n", microsecondsPerCharacter, fits, budgetMs * 1000.0 / microsecondsPerCharacter);
+	}
+	printf("chars in budget: largest swept crowd within %.1f ms / budget over the cost per character of %zu\n",
+		budgetMs, crowdSizes[sizeCount - 1]);
+	printf("hardware threads: %u\n", hardwareThreads);
+	if (!same)
+		printf("MISMATCH: threaded palettes differ from the single threaded run\n");
+	return same ? 0 : 1;
+}
@@ -0,0 +1,86 @@
+//Frustum culling throughput of culling.h: the scalar reference, the SoA batch test (AVX or SSE,
+//whichever the build targets) and the per-entity virtual AABB::isOnFrustum it replaced, for
+//10k to 1M random boxes around the camera. Fails if the batch mask differs from the scalar one.
+//usage: culling_bench [repeats]
+#include <glad/glad.h>
+#include <learnopengl/shader.h>
+#include <learnopengl/camera.h>
+#include <learnopengl/model.h>
+#include <learnopengl/culling.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double millisecondsSince(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+	const int repeats = argc > 1 ? std::max(1, atoi(argv[1])) : 20;
+#if defined(CULLING_AVX)
+	const char* path = "AVX";
+#elif defined(CULLING_SSE)
+	const char* path = "SSE";
+#else
+	const char* path = "scalar";
+#endif
+	Camera camera(glm::vec3(0.f));
+	const Frustum frustum = createFrustumFromCamera(camera, 16.f / 9.f, glm::radians(45.f), 0.1f, 100.f);
+	Transform identity;
+	identity.computeModelMatrix();
+
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> position(-150.f, 150.f), extent(0.1f, 3.f);
+	bool same = true;
+	printf("%10s %9s %12s %12s %12s\n", "boxes", "visible", "scalar ms", "batch ms", "virtual ms");
+	for (size_t count : { size_t(10000), size_t(100000), size_t(1000000) })
+	{
+		BoundsSoA bounds;
+		bounds.resize(count);
+		std::vector<AABB> boxes;
+		boxes.reserve(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			const glm::vec3 center(position(rng), position(rng), position(rng));
+			const glm::vec3 extents(extent(rng), extent(rng), extent(rng));
+			bounds.set(i, center, extents);
+			boxes.emplace_back(center, extents.x, extents.y, extents.z);
+		}
+
+		std::vector<uint64_t> scalarMask, batchMask;
+		size_t scalarVisible = 0, batchVisible = 0, virtualVisible = 0;
+		Clock::time_point start = Clock::now();
+		for (int r = 0; r < repeats; ++r)
+			scalarVisible = cullFrustumScalar(frustum, bounds, scalarMask);
+		const double scalarMs = millisecondsSince(start) / repeats;
+
+		start = Clock::now();
+		for (int r = 0; r < repeats; ++r)
+			batchVisible = cullFrustum(frustum, bounds, batchMask);
+		const double batchMs = millisecondsSince(start) / repeats;
+
+		start = Clock::now();
+		for (int r = 0; r < repeats; ++r)
+		{
+			virtualVisible = 0;
+			for (const AABB& box : boxes)
+				virtualVisible += static_cast<const BoundingVolume&>(box).isOnFrustum(frustum, identity);
+		}
+		const double virtualMs = millisecondsSince(start) / repeats;
+
+		printf("%10zu %9zu %12.3f %12.3f %12.3f\n", count, batchVisible, scalarMs, batchMs, virtualMs);
+		if (scalarMask != batchMask || scalarVisible != batchVisible || virtualVisible != batchVisible)
+		{
+			printf("  MISMATCH: scalar %zu, %s %zu, virtual %zu visible\n", scalarVisible, path, batchVisible, virtualVisible);
+			same = false;
+		}
+	}
+	printf("batch path: %s\n", path);
+	return same ? 0 : 1;
+}
@@ -0,0 +1,97 @@
+//Microbenchmarks of the simd_math.h operations behind the transform and bone loops: mat4 chains,
+//quaternion to matrix (the translate * toMat4 * scale it replaced vs composeTRS) and AABB
+//transforms. Build it twice, with and without -DPBR_SIMD_MATH (plus -DGLM_FORCE_INTRINSICS on
+//newer GLM), and compare; the checksums must match between the two builds up to rounding.
+//usage: simd_math_bench [count]
+#include <learnopengl/simd_math.h>
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/quaternion.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double millisecondsSince(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+	const size_t count = argc > 1 ? std::max(2, atoi(argv[1])) : 100000;
+	const int repeats = 20;
+#ifdef PBR_SIMD_MATH
+	printf("PBR_SIMD_MATH: aligned GLM types, %zu elements, ms per pass\n", count);
+#else
+	printf("packed GLM types, %zu elements, ms per pass\n", count);
+#endif
+
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> uniform(-1.f, 1.f);
+	std::vector<glm::vec3> translations(count), scales(count), centers(count), extents(count);
+	std::vector<glm::quat> rotations(count);
+	std::vector<SimdMat4> matrices(count), parents(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		translations[i] = glm::vec3(uniform(rng), uniform(rng), uniform(rng));
+		scales[i] = glm::vec3(1.5f + uniform(rng));
+		rotations[i] = glm::normalize(glm::quat(uniform(rng), uniform(rng), uniform(rng), uniform(rng)));
+		centers[i] = glm::vec3(uniform(rng), uniform(rng), uniform(rng));
+		extents[i] = glm::abs(glm::vec3(uniform(rng), uniform(rng), uniform(rng)));
+		parents[i] = composeTRS(translations[i], rotations[i], glm::vec3(1.f));
+	}
+
+	//quaternion to matrix: three matrices and two products, as Bone and Transform used to
+	Clock::time_point start = Clock::now();
+	for (int r = 0; r < repeats; ++r)
+		for (size_t i = 0; i < count; ++i)
+			matrices[i] = toSimd(glm::translate(glm::mat4(1.f), translations[i]) * glm::toMat4(rotations[i]) * glm::scale(glm::mat4(1.f), scales[i]));
+	const double trsProductMs = millisecondsSince(start) / repeats;
+	double checksum = matrices[count - 1][3][0];
+
+	start = Clock::now();
+	for (int r = 0; r < repeats; ++r)
+		for (size_t i = 0; i < count; ++i)
+			matrices[i] = composeTRS(translations[i], rotations[i], scales[i]);
+	const double composeMs = millisecondsSince(start) / repeats;
+	checksum += matrices[count - 1][2][1];
+
+	//world = parent world * local * offset, each depending on the previous, like a bone chain
+	std::vector<SimdMat4> chain(count);
+	start = Clock::now();
+	for (int r = 0; r < repeats; ++r)
+	{
+		chain[0] = parents[0];
+		for (size_t i = 1; i < count; ++i)
+			chain[i] = chain[i - 1] * parents[i] * parents[count - i];
+	}
+	const double chainMs = millisecondsSince(start) / repeats;
+	checksum += chain[count / 2][1][1];
+
+	glm::vec3 sum(0.f);
+	start = Clock::now();
+	for (int r = 0; r < repeats; ++r)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			glm::vec3 center, extent;
+			transformAABB(matrices[i], centers[i], extents[i], center, extent);
+			sum += center + extent;
+		}
+	}
+	const double aabbMs = millisecondsSince(start) / repeats;
+	checksum += sum.x + sum.y + sum.z;
+
+	printf("%-36s %8.3f\n", "translate * toMat4 * scale", trsProductMs);
+	printf("%-36s %8.3f\n", "composeTRS", composeMs);
+	printf("%-36s %8.3f\n", "mat4 chain (2 products per element)", chainMs);
+	printf("%-36s %8.3f\n", "transformAABB", aabbMs);
+	printf("checksum %.6g\n", checksum);
+	return 0;
+}
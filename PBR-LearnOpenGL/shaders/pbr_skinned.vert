@@ -0,0 +1,111 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 5) in ivec4 aBoneIds;
+layout (location = 6) in vec4 aWeights;
+
+out vec2 TexCoords;
+out vec3 WorldPos;
+out vec3 Normal;
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform mat4 model;
+
+// bone palettes of the frame (BonePaletteBuffer), one RGBA32F texel per vec4
+uniform samplerBuffer bonePalette;
+uniform int boneFormat;  // 0: 3 texels per bone, rows of a 3x4 matrix. 1: 2 texels, dual quaternion
+uniform int boneBase;    // first texel of this draw's palette
+uniform int boneStride;  // texels between the palettes of consecutive instances
+uniform int modelBase;   // first texel of the per-instance model matrices (rows of a 3x4 matrix,
+                         // 3 texels each), -1 to place every instance with model
+
+// Weight missing from a total of 1 (no bone at all, or influences past the fourth dropped at
+// import) goes to the identity: that part of the vertex keeps its bind pose. cpu_skinning.h and
+// skinned_bounds.h follow the same rule.
+
+void skinMatrix3x4(int base, out vec3 position, out vec3 normal)
+{
+    vec4 row0 = vec4(0.0);
+    vec4 row1 = vec4(0.0);
+    vec4 row2 = vec4(0.0);
+    float total = 0.0;
+    for (int i = 0; i < 4; i++)
+    {
+        if (aBoneIds[i] < 0)
+            continue;
+        int texel = base + aBoneIds[i] * 3;
+        row0 += texelFetch(bonePalette, texel) * aWeights[i];
+        row1 += texelFetch(bonePalette, texel + 1) * aWeights[i];
+        row2 += texelFetch(bonePalette, texel + 2) * aWeights[i];
+        total += aWeights[i];
+    }
+    float rest = 1.0 - total;
+    row0.x += rest;
+    row1.y += rest;
+    row2.z += rest;
+    mat3 linear = transpose(mat3(row0.xyz, row1.xyz, row2.xyz));
+    position = linear * aPos + vec3(row0.w, row1.w, row2.w);
+    normal = linear * aNormal;
+}
+
+void skinDualQuaternion(int base, out vec3 position, out vec3 normal)
+{
+    vec4 real = vec4(0.0);
+    vec4 dual = vec4(0.0);
+    vec4 first = vec4(0.0);
+    float total = 0.0;
+    for (int i = 0; i < 4; i++)
+    {
+        if (aBoneIds[i] < 0)
+            continue;
+        int texel = base + aBoneIds[i] * 2;
+        vec4 boneReal = texelFetch(bonePalette, texel);
+        vec4 boneDual = texelFetch(bonePalette, texel + 1);
+        // keep every bone on the hemisphere of the first one
+        if (first == vec4(0.0))
+            first = boneReal;
+        float weight = dot(first, boneReal) < 0.0 ? -aWeights[i] : aWeights[i];
+        real += boneReal * weight;
+        dual += boneDual * weight;
+        total += aWeights[i];
+    }
+    // the identity (real part (0, 0, 0, 1), dual part 0), on the first bone's hemisphere too
+    real.w += first.w < 0.0 ? total - 1.0 : 1.0 - total;
+    float len = length(real);
+    real /= len;
+    dual /= len;
+    position = aPos + 2.0 * cross(real.xyz, cross(real.xyz, aPos) + real.w * aPos)
+        + 2.0 * (real.w * dual.xyz - dual.w * real.xyz + cross(real.xyz, dual.xyz));
+    normal = aNormal + 2.0 * cross(real.xyz, cross(real.xyz, aNormal) + real.w * aNormal);
+}
+
+mat4 instanceModel()
+{
+    if (modelBase < 0)
+        return model;
+    int texel = modelBase + gl_InstanceID * 3;
+    vec4 row0 = texelFetch(bonePalette, texel);
+    vec4 row1 = texelFetch(bonePalette, texel + 1);
+    vec4 row2 = texelFetch(bonePalette, texel + 2);
+    return transpose(mat4(row0, row1, row2, vec4(0.0, 0.0, 0.0, 1.0)));
+}
+
+void main()
+{
+    int base = boneBase + gl_InstanceID * boneStride;
+    vec3 position;
+    vec3 normal;
+    if (boneFormat == 0)
+        skinMatrix3x4(base, position, normal);
+    else
+        skinDualQuaternion(base, position, normal);
+
+    mat4 placement = instanceModel();
+    TexCoords = aTexCoords;
+    WorldPos = vec3(placement * vec4(position, 1.0));
+    Normal = mat3(placement) * normal;
+
+    gl_Position =  projection * view * vec4(WorldPos, 1.0);
+}
@@ -15,6 +15,7 @@
 #include <learnopengl/shader.h>
 #include <learnopengl/camera.h>
 #include <learnopengl/model.h>
+#include <learnopengl/bvh.h>
 
 #include <iostream>
 
@@ -39,6 +40,9 @@ float lastX = 800.0f / 2.0;
 float lastY = 600.0 / 2.0;
 bool firstMouse = true;
 bool mouseLeft = false;
+// right click: cursor position to pick from, consumed by the render loop
+bool pickRequested = false;
+double pickX = 0.0, pickY = 0.0;
 
 // timing
 float deltaTime = 0.0f;
@@ -139,7 +143,8 @@ int main()
 
     // initialize static shader uniforms before rendering
     // --------------------------------------------------
-    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    const float fovY = glm::radians(camera.Zoom);
+    glm::mat4 projection = glm::perspective(fovY, (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
     shader.use();
     shader.setMat4("projection", projection);
 
@@ -151,6 +156,16 @@ int main()
     int  renderObj= cylinder;
 
     loadOBJ();
+
+    // grid cells live in a BVH over their world boxes: it culls the grid and answers picking rays
+    BvhBox dragonBox = BvhBox::empty();
+    for (const glm::vec3& pos : loadedModelPos)
+        dragonBox.grow(pos);
+    DynamicBvh gridBvh(0.0f);
+    std::vector<uint32_t> gridProxies;
+    std::vector<unsigned char> cellVisible;
+    int gridObj = -1; // shape the BVH was built for
+    int selectedCell = -1;
     // load textures
 	unsigned int albedo = loadTexture("model/cgaxis_models_65_04_01_Albedo.png");
     unsigned int normal = loadTexture("model/cgaxis_models_65_04_01_Normal.png");
@@ -178,16 +193,11 @@ int main()
 
         if (renderObj == dragon)
         {
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, albedo);
-			glActiveTexture(GL_TEXTURE1);
-			glBindTexture(GL_TEXTURE_2D, normal);
-			glActiveTexture(GL_TEXTURE2);
-			glBindTexture(GL_TEXTURE_2D, metallic);
-			glActiveTexture(GL_TEXTURE3);
-			glBindTexture(GL_TEXTURE_2D, roughness);
-			glActiveTexture(GL_TEXTURE4);
-			glBindTexture(GL_TEXTURE_2D, ao);
+			GLStateCache::bindTexture2D(0, albedo);
+			GLStateCache::bindTexture2D(1, normal);
+			GLStateCache::bindTexture2D(2, metallic);
+			GLStateCache::bindTexture2D(3, roughness);
+			GLStateCache::bindTexture2D(4, ao);
         }
 
 		ImGui_ImplOpenGL3_NewFrame();
@@ -231,6 +241,11 @@ int main()
         ImGui::RadioButton("sphere", &renderObj, sphere); ImGui::SameLine();
         ImGui::RadioButton("cylinder", &renderObj, cylinder); ImGui::SameLine();
         ImGui::RadioButton("dragon", &renderObj, dragon);
+        if (selectedCell >= 0 && gridObj == renderObj)
+            ImGui::Text("selected: metallic %.2f, roughness %.2f", (float)(selectedCell / nrColumns) / (float)nrRows,
+                glm::clamp((float)(selectedCell % nrColumns) / (float)nrColumns, 0.05f, 1.0f));
+        else
+            ImGui::Text("right click an object to select it");
 		// Ends the window
 		ImGui::End();
 
@@ -249,14 +264,66 @@ int main()
             nrColumns = 7;
 
         }
+        if (gridObj != renderObj)
+        {
+            const BvhBox local = renderObj == dragon ? dragonBox :
+                renderObj == cylinder ? BvhBox(glm::vec3(-1.0f, -2.0f, -1.0f), glm::vec3(1.0f, 2.0f, 1.0f)) :
+                BvhBox(glm::vec3(-1.0f), glm::vec3(1.0f));
+            std::vector<BvhBox> cells;
+            for (int row = 0; row < nrRows; ++row)
+            {
+                for (int col = 0; col < nrColumns; ++col)
+                {
+                    const glm::vec3 offset((col - (nrColumns / 2)) * spacing, (row - (nrRows / 2)) * spacing, 0.0f);
+                    cells.push_back(BvhBox(local.min + offset, local.max + offset));
+                }
+            }
+            gridBvh.build(cells, gridProxies);
+            gridObj = renderObj;
+            selectedCell = -1;
+        }
+        if (pickRequested)
+        {
+            pickRequested = false;
+            int width, height;
+            glfwGetWindowSize(window, &width, &height);
+            const glm::vec2 ndc(2.0f * (float)pickX / width - 1.0f, 1.0f - 2.0f * (float)pickY / height);
+            const glm::mat4 inverseViewProjection = glm::inverse(projection * view);
+            glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndc, -1.0f, 1.0f);
+            glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndc, 1.0f, 1.0f);
+            const glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+            const glm::vec3 dir = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+            float distance = 100.0f;
+            const uint32_t hit = gridBvh.raycast(origin, dir, distance, [&](uint32_t cell, float boxEntry) {
+                if (renderObj != sphere)
+                    return boxEntry;
+                // unit sphere at the cell center
+                const BvhBox& box = gridBvh.node(gridProxies[cell]).tight;
+                const glm::vec3 oc = origin - box.center();
+                const float b = glm::dot(oc, dir);
+                const float disc = b * b - (glm::dot(oc, oc) - 1.0f);
+                return disc < 0.0f ? -1.0f : -b - std::sqrt(disc);
+            });
+            selectedCell = hit == DynamicBvh::NULL_NODE ? -1 : (int)hit;
+        }
+        const Frustum frustum = createFrustumFromCamera(camera, (float)SCR_WIDTH / (float)SCR_HEIGHT, fovY, 0.1f, 100.0f);
+        cellVisible.assign(nrRows * nrColumns, 0);
+        gridBvh.cullFrustum(frustum, [&](uint32_t cell) { cellVisible[cell] = 1; });
+
         // render rows*column number of spheres with varying metallic/roughness values scaled by rows and columns respectively
-		shader.setVec3("albedo", 0.0f, 0.0f, 1.f);
         glm::mat4 model = glm::mat4(1.0f);
         for (int row = 0; row < nrRows; ++row)
         {
             shader.setFloat("metallic", (float)row / (float)nrRows);
             for (int col = 0; col < nrColumns; ++col)
             {
+                const int cell = row * nrColumns + col;
+                if (!cellVisible[cell])
+                    continue;
+                if (cell == selectedCell)
+                    shader.setVec3("albedo", 1.0f, 0.8f, 0.0f);
+                else
+                    shader.setVec3("albedo", 0.0f, 0.0f, 1.f);
                 // we clamp the roughness to 0.05 - 1.0 as perfectly smooth surfaces (roughness of 0.0) tend to look a bit off
                 // on direct lighting.
                 shader.setFloat("roughness", glm::clamp((float)col / (float)nrColumns, 0.05f, 1.0f));
@@ -307,6 +374,8 @@ int main()
 
 		ImGui::Render();
 		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        // the ImGui backend binds its own program/VAO/texture behind the state cache's back
+        GLStateCache::invalidate();
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
         glfwSwapBuffers(window);
@@ -399,6 +468,11 @@ void MouseButtonCallback(GLFWwindow* window, int button, int state, int mods)
 	{
 		mouseLeft = false;
 	}
+	if (button == GLFW_MOUSE_BUTTON_RIGHT && state == GLFW_PRESS)
+	{
+		glfwGetCursorPos(window, &pickX, &pickY);
+		pickRequested = true;
+	}
 }
 
 // renders (and builds at first invocation) a sphere
@@ -479,7 +553,7 @@ void renderSphere()
                 data.push_back(uv[i].y);
             }
         }
-        glBindVertexArray(sphereVAO);
+        GLStateCache::bindVertexArray(sphereVAO);
         glBindBuffer(GL_ARRAY_BUFFER, vbo);
         glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), &data[0], GL_STATIC_DRAW);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
@@ -493,7 +567,7 @@ void renderSphere()
         glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
     }
 
-    glBindVertexArray(sphereVAO);
+    GLStateCache::bindVertexArray(sphereVAO);
     glDrawElements(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0);
 }
 
@@ -637,7 +711,7 @@ void renderCylinder()
             }
         }
 
-        glBindVertexArray(cylinderVAO);
+        GLStateCache::bindVertexArray(cylinderVAO);
         glBindBuffer(GL_ARRAY_BUFFER, vbo);
         glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), &data[0], GL_STATIC_DRAW);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
@@ -651,7 +725,7 @@ void renderCylinder()
         glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
     }
 
-    glBindVertexArray(cylinderVAO);
+    GLStateCache::bindVertexArray(cylinderVAO);
     glDrawArrays(GL_TRIANGLES, 0, indexCount);
 }
 
@@ -674,7 +748,7 @@ unsigned int loadTexture(char const* path)
         else if (nrComponents == 4)
             format = GL_RGBA;
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        GLStateCache::bindTexture2D(0, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
@@ -755,7 +829,7 @@ void renderCustomModel()
 		}
 	}
     //cout << "size" << uv.size() << " " << normals.size() << " " << positions.size() << "\n";
-	glBindVertexArray(modelVAO);
+	GLStateCache::bindVertexArray(modelVAO);
 	glBindBuffer(GL_ARRAY_BUFFER, modelVBO);
 	glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), &data[0], GL_STATIC_DRAW);
 	//glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
@@ -768,7 +842,7 @@ void renderCustomModel()
 	glEnableVertexAttribArray(2);
 	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
 
-    glBindVertexArray(modelVAO);
+    GLStateCache::bindVertexArray(modelVAO);
     //glDrawElements(GL_POINTS, data.size()/3, 0, 0);
     glDrawArrays(GL_TRIANGLES, 0, data.size()/3);
 }
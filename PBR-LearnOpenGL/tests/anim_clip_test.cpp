@@ -0,0 +1,193 @@
+//CompressedClip (anim_clip.h) and its compiler (anim_clip_compiler.h) on a synthetic clip: 64
+//bones in four chains, 600 keys per channel at 30 keys per second, every eighth bone translating
+//and all of them rotating. Checks that the compiled clip plays back within ClipTolerances of the
+//source keys, at the source key times and between them, for the default and a tighter setting;
+//that the default clip is at least 10x smaller than the source keys; and that OpenMemory rejects
+//truncated and corrupt images.
+#include <learnopengl/anim_clip_compiler.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <random>
+
+static int failures = 0;
+
+static void check(bool condition, const char* what)
+{
+	if (!condition)
+	{
+		printf("FAILED: %s\n", what);
+		++failures;
+	}
+}
+
+static const int BONE_COUNT = 64;
+static const unsigned int KEY_COUNT = 600;
+
+static std::unique_ptr<aiNodeAnim> makeChannel(int bone, std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> uniform(0.f, 6.28f);
+	const float phase = uniform(rng), frequency = 0.5f + uniform(rng) * 0.3f;
+	const glm::vec3 axis = glm::normalize(glm::vec3(1.f, std::sin(phase), 0.3f));
+	const bool moving = bone % 8 == 0;
+	std::unique_ptr<aiNodeAnim> channel(new aiNodeAnim());
+	channel->mNumPositionKeys = channel->mNumRotationKeys = channel->mNumScalingKeys = KEY_COUNT;
+	channel->mPositionKeys = new aiVectorKey[KEY_COUNT];
+	channel->mRotationKeys = new aiQuatKey[KEY_COUNT];
+	channel->mScalingKeys = new aiVectorKey[KEY_COUNT];
+	for (unsigned int k = 0; k < KEY_COUNT; ++k)
+	{
+		const float seconds = k / 30.f;
+		const aiVector3D position = moving
+			? aiVector3D(2.f * std::sin(seconds * frequency + phase), 0.1f * seconds, std::cos(seconds + phase))
+			: aiVector3D(0.f, 0.5f, 0.f);
+		const glm::quat rotation = glm::angleAxis(0.8f * std::sin(seconds * frequency * 2.f + phase), axis);
+		channel->mPositionKeys[k] = aiVectorKey(k, position);
+		channel->mRotationKeys[k] = aiQuatKey(k, aiQuaternion(rotation.w, rotation.x, rotation.y, rotation.z));
+		channel->mScalingKeys[k] = aiVectorKey(k, aiVector3D(1.f));
+	}
+	return channel;
+}
+
+//angle between two rotations, from the chord between the unit quaternions (acos of their dot
+//is too coarse near 0 in float)
+static double angleBetween(const glm::quat& a, const glm::quat& b)
+{
+	const glm::dquat da = glm::normalize(glm::dquat(a)), db = glm::normalize(glm::dquat(b));
+	const double sign = glm::dot(da, db) < 0.0 ? -1.0 : 1.0;
+	const glm::dvec4 chord(da.x - sign * db.x, da.y - sign * db.y, da.z - sign * db.z, da.w - sign * db.w);
+	return 4.0 * std::asin(std::min(glm::length(chord) * 0.5, 1.0));
+}
+
+struct Errors
+{
+	double position = 0.0, rotation = 0.0, scale = 0.0;
+};
+
+static Errors measure(const std::vector<Bone>& bones, const CompressedClip& clip, std::mt19937& rng)
+{
+	std::vector<float> times;
+	for (unsigned int k = 0; k < KEY_COUNT; ++k)
+		times.push_back(float(k));
+	std::uniform_real_distribution<float> uniform(0.f, float(KEY_COUNT - 1));
+	for (int i = 0; i < 20000; ++i)
+		times.push_back(uniform(rng));
+
+	Errors errors;
+	for (int b = 0; b < BONE_COUNT; ++b)
+	{
+		BoneCursor sourceCursor, clipCursor;
+		for (float time : times)
+		{
+			glm::vec3 sourcePosition, sourceScale, clipPosition, clipScale;
+			glm::quat sourceRotation, clipRotation;
+			bones[b].Sample(time, sourceCursor, sourcePosition, sourceRotation, sourceScale);
+			clip.Sample(b, time, clipCursor, clipPosition, clipRotation, clipScale);
+			errors.position = std::max<double>(errors.position, glm::length(sourcePosition - clipPosition));
+			errors.rotation = std::max(errors.rotation, angleBetween(sourceRotation, clipRotation));
+			errors.scale = std::max<double>(errors.scale, glm::length(sourceScale - clipScale));
+		}
+	}
+	return errors;
+}
+
+int main()
+{
+	std::mt19937 rng(5);
+	std::vector<Bone> bones;
+	std::vector<AnimationNode> nodes;
+	std::vector<std::string> nodeNames;
+	size_t sourceBytes = 0;
+	for (int b = 0; b < BONE_COUNT; ++b)
+	{
+		const std::string name = "bone_" + std::to_string(b);
+		std::unique_ptr<aiNodeAnim> channel = makeChannel(b, rng);
+		bones.push_back(Bone(name, b, channel.get()));
+		sourceBytes += bones[b].GetPositionTrack().Size() * (sizeof(float) + sizeof(glm::vec3))
+			+ bones[b].GetRotationTrack().Size() * (sizeof(float) + sizeof(glm::quat))
+			+ bones[b].GetScaleTrack().Size() * (sizeof(float) + sizeof(glm::vec3));
+
+		AnimationNode node;
+		node.transformation = SimdMat4(1.f);
+		node.parent = b % 16 == 0 ? -1 : b - 1;
+		node.bone = b;
+		nodes.push_back(node);
+		nodeNames.push_back(name);
+	}
+
+	ClipTolerances tight;
+	tight.position = 2e-4f;
+	tight.rotation = 1e-3f;
+	tight.scale = 1e-5f;
+	std::vector<char> image;
+	for (const ClipTolerances& tolerances : { ClipTolerances(), tight })
+	{
+		std::vector<char> built = BuildClip(nodes, nodeNames, bones, float(KEY_COUNT - 1), 30.f, tolerances);
+		CompressedClip clip;
+		check(clip.OpenMemory(built.data(), built.size()), "the compiled clip opens");
+		if (!clip.IsOpen())
+			continue;
+		check(clip.GetNodeCount() == BONE_COUNT && clip.GetTrackCount() == BONE_COUNT, "node and track counts");
+		check(clip.GetNodeName(17) == "bone_17" && clip.GetNode(17).parent == 16, "node names and parents");
+
+		const Errors errors = measure(bones, clip, rng);
+		const double ratio = double(sourceBytes) / clip.GetSizeInBytes();
+		printf("tolerances %.0e / %.0e rad / %.0e: %zu bytes, %.1fx smaller than the %zu bytes of source keys\n",
+			tolerances.position, tolerances.rotation, tolerances.scale, clip.GetSizeInBytes(), ratio, sourceBytes);
+		printf("  max error: position %.3e, rotation %.3e rad, scale %.3e\n", errors.position, errors.rotation, errors.scale);
+		//the compiler checks in float at the source key times, and between them the source slerps
+		//where the clip nlerps: allow 1% on top of the tolerance for both
+		check(errors.position <= tolerances.position * 1.01, "position error within tolerance");
+		check(errors.rotation <= tolerances.rotation * 1.01, "rotation error within tolerance");
+		check(errors.scale <= tolerances.scale * 1.01, "scale error within tolerance");
+		if (image.empty())
+		{
+			check(ratio >= 10.0, "default tolerances shrink the keys 10x");
+			image = built;
+		}
+	}
+
+	//corrupt copies of the default clip, each must be rejected
+	ClipHeader header;
+	std::memcpy(&header, image.data(), sizeof(header));
+	const size_t nodesOffset = sizeof(ClipHeader);
+	const size_t tracksOffset = nodesOffset + header.nodeCount * sizeof(ClipNode);
+	auto node = [&](std::vector<char>& copy, int i) { return reinterpret_cast<ClipNode*>(&copy[nodesOffset]) + i; };
+	auto track = [&](std::vector<char>& copy, int i) { return reinterpret_cast<ClipTrack*>(&copy[tracksOffset]) + i; };
+	struct Corruption
+	{
+		const char* name;
+		std::function<void(std::vector<char>&)> apply;
+	};
+	const Corruption corruptions[] = {
+		{ "truncated", [](std::vector<char>& copy) { copy.resize(copy.size() - 2); } },
+		{ "header only", [](std::vector<char>& copy) { copy.resize(sizeof(ClipHeader)); } },
+		{ "wrong magic", [](std::vector<char>& copy) { copy[0] = 'X'; } },
+		{ "wrapping node count", [](std::vector<char>& copy) { reinterpret_cast<ClipHeader*>(copy.data())->nodeCount += 0x80000000u / sizeof(ClipNode) * 2; } },
+		{ "name past the strings", [&](std::vector<char>& copy) { node(copy, 3)->nameOffset = header.stringBytes; } },
+		{ "name length past the strings", [&](std::vector<char>& copy) { node(copy, 3)->nameLength = 0xffffffffu; } },
+		{ "parent after its child", [&](std::vector<char>& copy) { node(copy, 3)->parent = 3; } },
+		{ "parent below -1", [&](std::vector<char>& copy) { node(copy, 3)->parent = -2; } },
+		{ "track past the tracks", [&](std::vector<char>& copy) { node(copy, 3)->track = BONE_COUNT; } },
+		{ "channel without keys", [&](std::vector<char>& copy) { track(copy, 5)->rotation.keyCount = 0; } },
+		{ "keys past the key data", [&](std::vector<char>& copy) { track(copy, 5)->position.keyOffset = header.keyBytes; } },
+		{ "key count past the key data", [&](std::vector<char>& copy) { track(copy, 63)->scale.keyCount = 0x80000000u; } },
+		{ "odd key offset", [&](std::vector<char>& copy) { track(copy, 0)->position.keyOffset += 1; } },
+	};
+	for (const Corruption& corruption : corruptions)
+	{
+		std::vector<char> copy = image;
+		corruption.apply(copy);
+		CompressedClip clip;
+		if (clip.OpenMemory(copy.data(), copy.size()) || clip.IsOpen())
+			printf("FAILED: %s clip opened\n", corruption.name), ++failures;
+	}
+	CompressedClip clip;
+	check(clip.OpenMemory(image.data(), image.size()), "the untouched copy still opens");
+
+	printf(failures ? "%d checks failed\n" : "all checks passed\n", failures);
+	return failures ? 1 : 0;
+}
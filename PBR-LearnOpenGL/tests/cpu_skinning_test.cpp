@@ -0,0 +1,225 @@
+//cpu_skinning.h on vertices with one to four influences, partial weights (summing to less than
+//1), no bone at all, and unused influence slots before the used ones. For both palette formats
+//checks SkinVerticesScalar against a reference blended from the bone transforms, SkinVertices
+//(AVX2 when built with it) and the threaded CpuSkinner against SkinVerticesScalar, and the rule
+//shared with shaders/pbr_skinned.vert: weight missing from 1 goes to the identity.
+#include <learnopengl/cpu_skinning.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstdio>
+#include <random>
+
+static int failures = 0;
+
+static void check(bool condition, const char* what)
+{
+	if (!condition)
+	{
+		printf("FAILED: %s\n", what);
+		++failures;
+	}
+}
+
+static const int BONE_COUNT = 64;
+static const size_t VERTEX_COUNT = 4099; //not a multiple of 8: the last block is partial
+
+struct RigidBone
+{
+	glm::quat rotation;
+	glm::vec3 translation;
+};
+
+static const char* formatName(BonePaletteFormat format)
+{
+	return format == BonePaletteFormat::Matrix3x4 ? "3x4 matrix" : "dual quaternion";
+}
+
+//Blend of the vertex's bones straight from their rotation and translation, with 1 - total
+//weight of identity
+static void reference(const Vertex& vertex, const std::vector<RigidBone>& bones, BonePaletteFormat format,
+	glm::vec3& position, glm::vec3& normal)
+{
+	float total = 0.0f;
+	if (format == BonePaletteFormat::Matrix3x4)
+	{
+		glm::mat4 blended(0.0f);
+		for (int k = 0; k < MAX_BONE_INFLUENCE; k++)
+		{
+			if (vertex.m_BoneIDs[k] < 0)
+				continue;
+			const RigidBone& bone = bones[vertex.m_BoneIDs[k]];
+			blended += glm::translate(glm::mat4(1.0f), bone.translation) * glm::mat4_cast(bone.rotation) * vertex.m_Weights[k];
+			total += vertex.m_Weights[k];
+		}
+		blended += glm::mat4(1.0f) * (1.0f - total);
+		position = glm::vec3(blended * glm::vec4(vertex.Position, 1.0f));
+		normal = glm::mat3(blended) * vertex.Normal;
+		return;
+	}
+
+	glm::quat real(0.0f, 0.0f, 0.0f, 0.0f), dual(0.0f, 0.0f, 0.0f, 0.0f), first(0.0f, 0.0f, 0.0f, 0.0f);
+	for (int k = 0; k < MAX_BONE_INFLUENCE; k++)
+	{
+		if (vertex.m_BoneIDs[k] < 0)
+			continue;
+		const RigidBone& bone = bones[vertex.m_BoneIDs[k]];
+		const glm::quat boneDual = glm::quat(0.0f, bone.translation) * bone.rotation * 0.5f;
+		if (total == 0.0f)
+			first = bone.rotation;
+		const float weight = glm::dot(first, bone.rotation) < 0.0f ? -vertex.m_Weights[k] : vertex.m_Weights[k];
+		real = real + bone.rotation * weight;
+		dual = dual + boneDual * weight;
+		total += vertex.m_Weights[k];
+	}
+	real.w += first.w < 0.0f ? total - 1.0f : 1.0f - total;
+	const float length = glm::length(real);
+	real = real * (1.0f / length);
+	dual = dual * (1.0f / length);
+	const glm::quat translation = dual * glm::conjugate(real) * 2.0f;
+	position = real * vertex.Position + glm::vec3(translation.x, translation.y, translation.z);
+	normal = real * vertex.Normal;
+}
+
+static double maxDifference(const std::vector<glm::vec3>& a, const std::vector<glm::vec3>& b, size_t begin = 0)
+{
+	double difference = 0.0;
+	for (size_t i = begin; i < a.size(); i++)
+		difference = std::max<double>(difference, glm::length(a[i] - b[i]));
+	return difference;
+}
+
+int main()
+{
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> uniform(-1.0f, 1.0f), positive(0.05f, 1.0f);
+
+	std::vector<RigidBone> bones(BONE_COUNT);
+	std::vector<SimdMat4> matrices(BONE_COUNT);
+	for (int b = 0; b < BONE_COUNT; b++)
+	{
+		bones[b].rotation = glm::normalize(glm::quat(uniform(rng), uniform(rng), uniform(rng), uniform(rng)));
+		bones[b].translation = glm::vec3(uniform(rng), uniform(rng), uniform(rng)) * 2.0f;
+		matrices[b] = toSimd(glm::translate(glm::mat4(1.0f), bones[b].translation) * glm::mat4_cast(bones[b].rotation));
+	}
+
+	//kinds, by index modulo 5: one bone; four bones; two bones weighing 0.6 together; no bone;
+	//two bones weighing 0.5 together in slots 2 and 3
+	std::vector<Vertex> vertices(VERTEX_COUNT);
+	for (size_t i = 0; i < VERTEX_COUNT; i++)
+	{
+		Vertex& vertex = vertices[i];
+		vertex.Position = glm::vec3(uniform(rng), uniform(rng), uniform(rng));
+		vertex.Normal = glm::normalize(glm::vec3(uniform(rng), uniform(rng), uniform(rng)) + glm::vec3(0.0f, 0.0f, 2.0f));
+		for (int k = 0; k < MAX_BONE_INFLUENCE; k++)
+		{
+			vertex.m_BoneIDs[k] = -1;
+			vertex.m_Weights[k] = 0.0f;
+		}
+		const int kind = static_cast<int>(i % 5);
+		const int firstSlot = kind == 4 ? 2 : 0;
+		const int used = kind == 0 ? 1 : kind == 1 ? 4 : kind == 3 ? 0 : 2;
+		const float total = kind == 2 ? 0.6f : kind == 4 ? 0.5f : 1.0f;
+		float sum = 0.0f;
+		for (int k = firstSlot; k < firstSlot + used; k++)
+		{
+			vertex.m_BoneIDs[k] = static_cast<int>(rng() % BONE_COUNT);
+			vertex.m_Weights[k] = positive(rng);
+			sum += vertex.m_Weights[k];
+		}
+		for (int k = firstSlot; k < firstSlot + used; k++)
+			vertex.m_Weights[k] *= total / sum;
+	}
+	SkinningSource source;
+	source.Build(vertices);
+	check(source.Size() == VERTEX_COUNT && source.positionX.size() % 8 == 0, "source padded to a multiple of 8");
+
+	JobSystem jobs(4);
+	std::vector<glm::vec3> scalarPositions(VERTEX_COUNT), scalarNormals(VERTEX_COUNT);
+	std::vector<glm::vec3> positions(VERTEX_COUNT), normals(VERTEX_COUNT);
+	for (BonePaletteFormat format : { BonePaletteFormat::Matrix3x4, BonePaletteFormat::DualQuaternion })
+	{
+		std::vector<glm::vec4> palette(BONE_COUNT * GetBonePaletteTexelsPerBone(format));
+		PackBonePalette(format, matrices.data(), BONE_COUNT, palette.data());
+		SkinVerticesScalar(source, palette.data(), format, 0, VERTEX_COUNT, scalarPositions.data(), scalarNormals.data());
+
+		double referenceError = 0.0;
+		bool bindPose = true;
+		for (size_t i = 0; i < VERTEX_COUNT; i++)
+		{
+			glm::vec3 position, normal;
+			reference(vertices[i], bones, format, position, normal);
+			referenceError = std::max<double>(referenceError, std::max(glm::length(position - scalarPositions[i]), glm::length(normal - scalarNormals[i])));
+			if (i % 5 == 3)
+				bindPose = bindPose && scalarPositions[i] == vertices[i].Position && scalarNormals[i] == vertices[i].Normal;
+		}
+
+		SkinVertices(source, palette.data(), format, 0, VERTEX_COUNT, positions.data(), normals.data());
+		const double kernelError = std::max(maxDifference(positions, scalarPositions), maxDifference(normals, scalarNormals));
+		bool kernelBindPose = true;
+		for (size_t i = 3; i < VERTEX_COUNT; i += 5)
+			kernelBindPose = kernelBindPose && positions[i] == vertices[i].Position && normals[i] == vertices[i].Normal;
+
+		//a range starting past 0 and ending inside the last block
+		std::fill(positions.begin(), positions.end(), glm::vec3(0.0f));
+		SkinVertices(source, palette.data(), format, 16, VERTEX_COUNT - 1, positions.data(), nullptr);
+		const bool rangeOnly = positions[15] == glm::vec3(0.0f) && positions[VERTEX_COUNT - 1] == glm::vec3(0.0f);
+		positions[VERTEX_COUNT - 1] = scalarPositions[VERTEX_COUNT - 1];
+		const double rangeError = maxDifference(positions, scalarPositions, 16);
+
+		CpuSkinner skinner(format);
+		skinner.SetPalette(matrices);
+		skinner.Skin(jobs, source, positions.data(), normals.data(), 256);
+		const double jobsError = std::max(maxDifference(positions, scalarPositions), maxDifference(normals, scalarNormals));
+
+		printf("%s: scalar vs reference %.2e, SkinVertices vs scalar %.2e, threaded vs scalar %.2e\n",
+			formatName(format), referenceError, kernelError, jobsError);
+		check(referenceError < 1e-4, "scalar kernel matches the reference blend");
+		check(kernelError < 1e-5, "SkinVertices matches the scalar kernel");
+		check(rangeError < 1e-5 && rangeOnly, "SkinVertices on a sub range writes exactly that range");
+		check(jobsError < 1e-5, "threaded CpuSkinner matches the scalar kernel");
+		check(bindPose && kernelBindPose, "vertices without bones keep their bind pose exactly");
+
+		if (format == BonePaletteFormat::DualQuaternion)
+		{
+			//q and -q are the same rotation: negating every bone's entry must not change the blend,
+			//the identity share included
+			for (glm::vec4& texel : palette)
+				texel = -texel;
+			SkinVerticesScalar(source, palette.data(), format, 0, VERTEX_COUNT, positions.data(), normals.data());
+			const double scalarSign = std::max(maxDifference(positions, scalarPositions), maxDifference(normals, scalarNormals));
+			SkinVertices(source, palette.data(), format, 0, VERTEX_COUNT, positions.data(), normals.data());
+			const double kernelSign = std::max(maxDifference(positions, scalarPositions), maxDifference(normals, scalarNormals));
+			printf("  negated palette vs original: scalar %.2e, SkinVertices %.2e\n", scalarSign, kernelSign);
+			check(scalarSign < 1e-5 && kernelSign < 1e-5, "negated dual quaternions skin the same");
+		}
+	}
+
+	//half weight on a bone moving by (2, 0, 0): the vertex moves by (1, 0, 0) in both formats
+	std::vector<Vertex> half(1);
+	half[0].Position = glm::vec3(0.5f, -0.25f, 1.0f);
+	half[0].Normal = glm::vec3(0.0f, 1.0f, 0.0f);
+	for (int k = 0; k < MAX_BONE_INFLUENCE; k++)
+	{
+		half[0].m_BoneIDs[k] = -1;
+		half[0].m_Weights[k] = 0.0f;
+	}
+	half[0].m_BoneIDs[1] = 0;
+	half[0].m_Weights[1] = 0.5f;
+	SkinningSource halfSource;
+	halfSource.Build(half);
+	const SimdMat4 translation = toSimd(glm::translate(glm::mat4(1.0f), glm::vec3(2.0f, 0.0f, 0.0f)));
+	for (BonePaletteFormat format : { BonePaletteFormat::Matrix3x4, BonePaletteFormat::DualQuaternion })
+	{
+		CpuSkinner skinner(format);
+		skinner.SetPalette(&translation, 1);
+		glm::vec3 position, normal;
+		skinner.Skin(halfSource, &position, &normal);
+		if (glm::length(position - (half[0].Position + glm::vec3(1.0f, 0.0f, 0.0f))) > 1e-6f || glm::length(normal - half[0].Normal) > 1e-6f)
+			printf("FAILED: %s: half weighted vertex should move half way\n", formatName(format)), ++failures;
+	}
+
+	printf(failures ? "%d checks failed\n" : "all checks passed\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,100 @@
+//OcclusionBuffer (occlusion.h) on a scene with a known answer: a 10x10 wall 10 units in front
+//of the camera, and boxes placed behind it, beside it, in front of it and across it. Checks the
+//rasterized depth, which boxes are hidden, that the threaded and single threaded paths agree,
+//and reports the culled-object ratio.
+#include <glad/glad.h>
+#include <learnopengl/shader.h>
+#include <learnopengl/camera.h>
+#include <learnopengl/model.h>
+#include <learnopengl/occlusion.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cstdio>
+
+static int failures = 0;
+
+static void check(bool condition, const char* what)
+{
+	if (!condition)
+	{
+		printf("FAILED: %s\n", what);
+		++failures;
+	}
+}
+
+int main()
+{
+	const float nearPlane = 0.1f, farPlane = 100.f;
+	const glm::mat4 projection = glm::perspective(glm::radians(45.f), 2.f, nearPlane, farPlane);
+	const glm::mat4 view = glm::lookAt(glm::vec3(0.f), glm::vec3(0.f, 0.f, -1.f), glm::vec3(0.f, 1.f, 0.f));
+
+	//the wall: a quad at z = -10, x and y in [-5, 5]
+	const glm::vec3 wall[4] = { { -5.f, -5.f, -10.f }, { 5.f, -5.f, -10.f }, { 5.f, 5.f, -10.f }, { -5.f, 5.f, -10.f } };
+	const unsigned int wallIndices[6] = { 0, 1, 2, 0, 2, 3 };
+
+	struct Case
+	{
+		const char* name;
+		glm::vec3 center, extents;
+		bool hidden;
+	};
+	const Case cases[] = {
+		{ "small box behind the wall", { 0.f, 0.f, -20.f }, glm::vec3(1.f), true },
+		{ "far box behind the wall corner", { 8.f, 8.f, -40.f }, glm::vec3(2.f), true },
+		{ "box in front of the wall", { 0.f, 0.f, -5.f }, glm::vec3(1.f), false },
+		{ "box through the wall", { 0.f, 0.f, -10.f }, glm::vec3(1.f), false },
+		{ "box behind, wider than the wall", { 0.f, 0.f, -20.f }, glm::vec3(12.f, 1.f, 1.f), false },
+		{ "box beside the wall", { 14.f, 0.f, -20.f }, glm::vec3(1.f), false },
+		{ "box around the camera", { 0.f, 0.f, 0.f }, glm::vec3(1.f), false },
+	};
+	const size_t caseCount = sizeof(cases) / sizeof(cases[0]);
+
+	JobSystem jobs(4);
+	OcclusionBuffer threaded, single;
+	for (OcclusionBuffer* buffer : { &threaded, &single })
+	{
+		buffer->begin(projection * view);
+		buffer->addOccluder(wall, sizeof(glm::vec3), wallIndices, 6, glm::mat4(1.f));
+	}
+	threaded.render(jobs);
+	single.render();
+
+	//the wall's depth at the screen center, and the cleared far plane in a corner
+	const glm::vec4 wallClip = projection * glm::vec4(0.f, 0.f, -10.f, 1.f);
+	const float wallDepth = wallClip.z / wallClip.w * 0.5f + 0.5f;
+	const int cx = threaded.width() / 2, cy = threaded.height() / 2;
+	check(std::abs(threaded.depth(cx, cy) - wallDepth) < 1e-5f, "depth at the center is the wall's");
+	check(threaded.depth(0, 0) == 1.f, "depth outside the wall is the far plane");
+	bool sameDepth = true;
+	for (int y = 0; y < threaded.height(); ++y)
+		for (int x = 0; x < threaded.width(); ++x)
+			sameDepth = sameDepth && threaded.depth(x, y) == single.depth(x, y);
+	check(sameDepth, "threaded and single threaded depth buffers are identical");
+	check(threaded.stats.occluderTriangles == 2 && threaded.stats.rasterizedTriangles == 2, "both wall triangles rasterized");
+
+	size_t expectedHidden = 0;
+	for (const Case& c : cases)
+	{
+		if (threaded.isVisible(c.center, c.extents) == c.hidden)
+			printf("FAILED: %s should be %s\n", c.name, c.hidden ? "hidden" : "visible"), ++failures;
+		expectedHidden += c.hidden;
+	}
+
+	//the batch path over a visibility mask, as after frustum culling; one box is already culled
+	BoundsSoA bounds;
+	bounds.resize(caseCount + 1);
+	for (size_t i = 0; i < caseCount; ++i)
+		bounds.set(i, cases[i].center, cases[i].extents);
+	bounds.set(caseCount, glm::vec3(0.f, 0.f, 50.f), glm::vec3(1.f));
+	std::vector<uint64_t> mask(1, (uint64_t(1) << caseCount) - 1);
+	const size_t culled = threaded.cullOccluded(jobs, bounds, mask);
+	check(culled == expectedHidden, "cullOccluded culls exactly the hidden boxes");
+	check(threaded.stats.tested == caseCount, "boxes already culled are not tested");
+	for (size_t i = 0; i < caseCount; ++i)
+		check(((mask[0] >> i) & 1) == (cases[i].hidden ? 0u : 1u), cases[i].name);
+
+	printf("occlusion: %zu of %zu boxes culled, ratio %.3f\n", threaded.stats.occluded, threaded.stats.tested, threaded.stats.culledRatio());
+	printf(failures ? "%d check(s) failed\n" : "all checks passed\n", failures);
+	return failures ? 1 : 0;
+}
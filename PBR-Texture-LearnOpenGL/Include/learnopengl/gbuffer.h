@@ -0,0 +1,122 @@
+#ifndef GBUFFER_H
+#define GBUFFER_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/gl_state.h>
+#include <learnopengl/shader.h>
+
+#include <iostream>
+
+// G-buffer of the deferred path. The geometry pass (pbr.fs with GBUFFER_PASS) stores what the
+// BRDF needs per pixel in 16 bytes, and the lighting pass (pbr.fs with DEFERRED_LIGHTING)
+// shades every pixel once, whatever the overdraw of the scene:
+//  - gAlbedo    RGBA8          sqrt of the linear albedo; a unused
+//  - gNormal    RG16           octahedral world space normal, remapped to [0, 1]
+//  - gMaterial  RGBA8          metallic, roughness, ao; a unused
+//  - gDepth     DEPTH24        the world position is rebuilt from it with inverseViewProjection
+// Only RG16 unorm is used for the normal: the snorm formats need not be renderable on GL 3.3.
+class GBuffer
+{
+public:
+    GBuffer()
+    {
+        glGenFramebuffers(1, &fbo);
+        glGenTextures(TEXTURE_COUNT, textures);
+        // the lighting pass has no vertex attributes, but core profile draws need a VAO
+        glGenVertexArrays(1, &emptyVao);
+    }
+
+    ~GBuffer()
+    {
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteTextures(TEXTURE_COUNT, textures);
+        glDeleteVertexArrays(1, &emptyVao);
+    }
+
+    GBuffer(const GBuffer&) = delete;
+    GBuffer& operator=(const GBuffer&) = delete;
+
+    // (re)allocates the attachments for a width x height framebuffer; nothing to do when the size is unchanged
+    void resize(int newWidth, int newHeight)
+    {
+        if (newWidth == width && newHeight == height)
+            return;
+        width = newWidth;
+        height = newHeight;
+
+        allocate(textures[ALBEDO], GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+        allocate(textures[NORMAL], GL_RG16, GL_RG, GL_UNSIGNED_SHORT);
+        allocate(textures[MATERIAL], GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+        allocate(textures[DEPTH], GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[ALBEDO], 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, textures[NORMAL], 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, textures[MATERIAL], 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, textures[DEPTH], 0);
+        const GLenum drawBuffers[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+        glDrawBuffers(3, drawBuffers);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::GBUFFER::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        // the texture binds above went around the state cache
+        GLStateCache::invalidate();
+    }
+
+    // directs the following draws into the G-buffer, cleared
+    void beginGeometryPass()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+
+    // back to the default framebuffer
+    void endGeometryPass()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // shades the G-buffer into the current framebuffer with lightingShader, one full screen
+    // triangle; pixels the geometry pass did not reach are discarded and keep the clear color
+    void drawLightingPass(Shader &lightingShader)
+    {
+        lightingShader.use();
+        bindTexture(lightingShader, "gAlbedo", textures[ALBEDO]);
+        bindTexture(lightingShader, "gNormal", textures[NORMAL]);
+        bindTexture(lightingShader, "gMaterial", textures[MATERIAL]);
+        bindTexture(lightingShader, "gDepth", textures[DEPTH]);
+        GLStateCache::bindVertexArray(emptyVao);
+        glDisable(GL_DEPTH_TEST);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glEnable(GL_DEPTH_TEST);
+    }
+
+private:
+    enum { ALBEDO, NORMAL, MATERIAL, DEPTH, TEXTURE_COUNT };
+
+    unsigned int fbo = 0;
+    unsigned int textures[TEXTURE_COUNT] = {};
+    unsigned int emptyVao = 0;
+    int width = 0;
+    int height = 0;
+
+    void allocate(unsigned int texture, GLint internalFormat, GLenum format, GLenum type)
+    {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+        // read with texelFetch only, but a complete texture still needs a non-mipmap filter
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+
+    static void bindTexture(Shader &shader, const char *name, unsigned int texture)
+    {
+        int unit = shader.getSamplerUnit(name);
+        if (unit >= 0)
+            GLStateCache::bindTexture2D(unit, texture);
+    }
+};
+#endif
@@ -0,0 +1,62 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <glad/glad.h>
+
+// GPU time spent on the commands between begin() and end(), from GL_TIME_ELAPSED queries.
+// Each end() moves on to the next of QUERY_COUNT queries and reads the result of the oldest,
+// which the GPU finished frames ago, so the CPU never waits on it; the time shown lags by a
+// few frames. Timers must not nest: GL allows one GL_TIME_ELAPSED query active at a time.
+class GpuTimer
+{
+public:
+    static const int QUERY_COUNT = 4;
+
+    GpuTimer()
+    {
+        glGenQueries(QUERY_COUNT, queries);
+    }
+
+    ~GpuTimer()
+    {
+        glDeleteQueries(QUERY_COUNT, queries);
+    }
+
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    void begin()
+    {
+        glBeginQuery(GL_TIME_ELAPSED, queries[current]);
+    }
+
+    void end()
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        issued[current] = true;
+        current = (current + 1) % QUERY_COUNT;
+
+        // the query begin() reuses next is the oldest one in flight
+        if (issued[current])
+        {
+            GLint available = 0;
+            glGetQueryObjectiv(queries[current], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available)
+            {
+                GLuint64 nanoseconds = 0;
+                glGetQueryObjectui64v(queries[current], GL_QUERY_RESULT, &nanoseconds);
+                ms = nanoseconds * 1e-6;
+            }
+        }
+    }
+
+    // last GPU time read back, in milliseconds
+    double milliseconds() const { return ms; }
+
+private:
+    unsigned int queries[QUERY_COUNT] = {};
+    bool issued[QUERY_COUNT] = {};
+    int current = 0;
+    double ms = 0.0;
+};
+#endif
@@ -0,0 +1,777 @@
+#ifndef IBL_BAKER_H
+#define IBL_BAKER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <stb_image.h>
+
+#include <learnopengl/gl_state.h>
+#include <learnopengl/shader.h>
+#include <learnopengl/sh_lighting.h>
+#include <learnopengl/thread_pool.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IBL_BAKER_SSE 1
+#endif
+
+// image based lighting precomputed on the CPU from an HDR equirectangular environment:
+//  - irradiance: the environment projected on 9 spherical harmonics (sh_lighting.h), already
+//    convolved with the cosine lobe, so diffuse ambient is albedo * irradiance.evaluate(N)
+//  - prefiltered: a cubemap whose mip i holds the environment convolved with the GGX lobe of
+//    roughness i / (levels - 1), importance sampled, for textureLod(prefilterMap, R, roughness * maxLod)
+//  - brdfLut: indexed by (NdotV, roughness), the split-sum scale and bias of F0 and the
+//    directional albedo Ess of the GGX lobe the analytic lights use, for energy compensation
+// The bake only touches memory, so it runs (and can be checked) without a GL context; rows of
+// every output are spread over a ThreadPool and the per-sample math runs 4 wide with SSE.
+// loadOrBakeIbl keeps the results on disk keyed by the hash of the HDR file, so only the first
+// run with a given environment pays for the bake. IblTextures uploads them.
+
+// sizes and sample counts of a bake; all of them are part of the cache key
+struct IblBakeSettings {
+    int sourceSize = 256;        // face size of the cubemap the equirect is resampled to
+    int prefilterSize = 128;     // face size of mip 0 of the prefiltered cubemap
+    int prefilterLevels = 6;     // roughness of mip i is i / (prefilterLevels - 1)
+    int prefilterSamples = 256;  // GGX samples per texel of mips 1 and up
+    int lutSize = 128;
+    int lutSamples = 512;
+};
+
+// float RGB cubemap with a mip chain. Faces are in GL order (+X, -X, +Y, -Y, +Z, -Z) and rows
+// in glTexImage2D order, so every level uploads as is.
+struct IblCubemap {
+    int size = 0;
+    std::vector<std::vector<float>> levels; // 6 faces of levelSize(level)^2 RGB texels each
+
+    void allocate(int faceSize, int levelCount)
+    {
+        size = faceSize;
+        levels.resize(levelCount);
+        for (int level = 0; level < levelCount; level++)
+            levels[level].assign(6 * levelSize(level) * levelSize(level) * 3, 0.0f);
+    }
+
+    int levelCount() const { return static_cast<int>(levels.size()); }
+    int levelSize(int level) const { return std::max(1, size >> level); }
+
+    float *face(int level, int f) { return &levels[level][f * levelSize(level) * levelSize(level) * 3]; }
+    const float *face(int level, int f) const { return &levels[level][f * levelSize(level) * levelSize(level) * 3]; }
+};
+
+struct IblMaps {
+    SH9 irradiance;             // E(n) / pi: multiply by albedo for the diffuse ambient
+    IblCubemap prefiltered;
+    int lutSize = 0;
+    std::vector<float> brdfLut; // RGB per texel (scale, bias, Ess): x = NdotV, y = roughness, rows in GL order
+};
+
+namespace ibl_detail {
+
+const float PI = 3.14159265359f;
+
+// per face, the direction of the texel at (s, t) in [-1, 1] is s * S + t * T + M (GL spec table)
+const float FACE_S[6][3] = { { 0, 0, -1 }, { 0, 0, 1 }, { 1, 0, 0 }, { 1, 0, 0 }, { 1, 0, 0 }, { -1, 0, 0 } };
+const float FACE_T[6][3] = { { 0, -1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }, { 0, -1, 0 }, { 0, -1, 0 } };
+const float FACE_M[6][3] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+
+inline glm::vec3 faceDirection(int face, float s, float t)
+{
+    return glm::normalize(glm::vec3(s * FACE_S[face][0] + t * FACE_T[face][0] + FACE_M[face][0],
+                                    s * FACE_S[face][1] + t * FACE_T[face][1] + FACE_M[face][1],
+                                    s * FACE_S[face][2] + t * FACE_T[face][2] + FACE_M[face][2]));
+}
+
+// face and [0, 1] texture coordinates of direction d, the inverse of faceDirection
+inline int directionToFace(const glm::vec3 &d, float &s, float &t)
+{
+    glm::vec3 a = glm::abs(d);
+    int face;
+    float sc, tc, ma;
+    if (a.x >= a.y && a.x >= a.z)
+    {
+        face = d.x >= 0.0f ? 0 : 1;
+        sc = d.x >= 0.0f ? -d.z : d.z;
+        tc = -d.y;
+        ma = a.x;
+    }
+    else if (a.y >= a.z)
+    {
+        face = d.y >= 0.0f ? 2 : 3;
+        sc = d.x;
+        tc = d.y >= 0.0f ? d.z : -d.z;
+        ma = a.y;
+    }
+    else
+    {
+        face = d.z >= 0.0f ? 4 : 5;
+        sc = d.z >= 0.0f ? d.x : -d.x;
+        tc = -d.y;
+        ma = a.z;
+    }
+    s = 0.5f * (sc / ma + 1.0f);
+    t = 0.5f * (tc / ma + 1.0f);
+    return face;
+}
+
+// bilinear fetch inside one face (clamped at its edges), s and t in [0, 1]
+inline glm::vec3 fetchFace(const IblCubemap &cube, int level, int face, float s, float t)
+{
+    const int size = cube.levelSize(level);
+    const float *texels = cube.face(level, face);
+    float x = s * size - 0.5f, y = t * size - 0.5f;
+    x = std::min(std::max(x, 0.0f), size - 1.0f);
+    y = std::min(std::max(y, 0.0f), size - 1.0f);
+    const int x0 = static_cast<int>(x), y0 = static_cast<int>(y);
+    const int x1 = std::min(x0 + 1, size - 1), y1 = std::min(y0 + 1, size - 1);
+    const float fx = x - x0, fy = y - y0;
+    const float *p00 = texels + (y0 * size + x0) * 3, *p10 = texels + (y0 * size + x1) * 3;
+    const float *p01 = texels + (y1 * size + x0) * 3, *p11 = texels + (y1 * size + x1) * 3;
+    glm::vec3 result;
+    for (int c = 0; c < 3; c++)
+    {
+        const float top = p00[c] + (p10[c] - p00[c]) * fx;
+        const float bottom = p01[c] + (p11[c] - p01[c]) * fx;
+        result[c] = top + (bottom - top) * fy;
+    }
+    return result;
+}
+
+// trilinear fetch between the two levels around lod
+inline glm::vec3 fetchFaceLod(const IblCubemap &cube, float lod, int face, float s, float t)
+{
+    lod = std::min(std::max(lod, 0.0f), static_cast<float>(cube.levelCount() - 1));
+    const int level = static_cast<int>(lod);
+    const float blend = lod - level;
+    glm::vec3 result = fetchFace(cube, level, face, s, t);
+    if (blend > 0.0f && level + 1 < cube.levelCount())
+        result += (fetchFace(cube, level + 1, face, s, t) - result) * blend;
+    return result;
+}
+
+// bilinear fetch of an equirectangular image (row 0 looks straight up, as stbi decodes it)
+inline glm::vec3 fetchEquirect(const float *rgb, int width, int height, const glm::vec3 &d)
+{
+    const float u = std::atan2(d.z, d.x) / (2.0f * PI) + 0.5f;
+    const float v = std::acos(std::min(std::max(d.y, -1.0f), 1.0f)) / PI;
+    float x = u * width - 0.5f, y = std::min(std::max(v * height - 0.5f, 0.0f), height - 1.0f);
+    const int x0 = static_cast<int>(std::floor(x)), y0 = static_cast<int>(y);
+    const float fx = x - x0, fy = y - y0;
+    const int xa = (x0 % width + width) % width, xb = (xa + 1) % width;
+    const int y1 = std::min(y0 + 1, height - 1);
+    glm::vec3 result;
+    for (int c = 0; c < 3; c++)
+    {
+        const float top = rgb[(y0 * width + xa) * 3 + c] + (rgb[(y0 * width + xb) * 3 + c] - rgb[(y0 * width + xa) * 3 + c]) * fx;
+        const float bottom = rgb[(y1 * width + xa) * 3 + c] + (rgb[(y1 * width + xb) * 3 + c] - rgb[(y1 * width + xa) * 3 + c]) * fx;
+        result[c] = top + (bottom - top) * fy;
+    }
+    return result;
+}
+
+inline float radicalInverse(uint32_t bits)
+{
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return static_cast<float>(bits) * 2.3283064365386963e-10f;
+}
+
+// GGX half vector around +Z for the Hammersley point i of count
+inline glm::vec3 importanceSampleGGX(int i, int count, float roughness)
+{
+    const float a = roughness * roughness;
+    const float phi = 2.0f * PI * (i + 0.5f) / count;
+    const float xi = radicalInverse(static_cast<uint32_t>(i));
+    const float cosTheta = std::sqrt((1.0f - xi) / (1.0f + (a * a - 1.0f) * xi));
+    const float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+    return glm::vec3(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+}
+
+// equirect -> level 0 of source, 2x2 samples per texel so big HDRs are not point sampled
+inline void resampleEquirect(const float *rgb, int width, int height, IblCubemap &source, ThreadPool &pool)
+{
+    const int size = source.size;
+    pool.parallelFor(6 * size, [&](size_t job) {
+        const int face = static_cast<int>(job) / size, y = static_cast<int>(job) % size;
+        float *row = source.face(0, face) + y * size * 3;
+        for (int x = 0; x < size; x++)
+        {
+            glm::vec3 sum(0.0f);
+            for (int sy = 0; sy < 2; sy++)
+                for (int sx = 0; sx < 2; sx++)
+                    sum += fetchEquirect(rgb, width, height, faceDirection(face,
+                        2.0f * (x + 0.25f + 0.5f * sx) / size - 1.0f, 2.0f * (y + 0.25f + 0.5f * sy) / size - 1.0f));
+            row[x * 3 + 0] = sum.r * 0.25f;
+            row[x * 3 + 1] = sum.g * 0.25f;
+            row[x * 3 + 2] = sum.b * 0.25f;
+        }
+    });
+}
+
+// 2x2 box filtered mip chain of a cubemap whose level 0 is filled
+inline void buildMips(IblCubemap &cube, ThreadPool &pool)
+{
+    for (int level = 1; level < cube.levelCount(); level++)
+    {
+        const int size = cube.levelSize(level), parentSize = cube.levelSize(level - 1);
+        pool.parallelFor(6, [&](size_t face) {
+            const float *parent = cube.face(level - 1, static_cast<int>(face));
+            float *texels = cube.face(level, static_cast<int>(face));
+            for (int y = 0; y < size; y++)
+                for (int x = 0; x < size; x++)
+                    for (int c = 0; c < 3; c++)
+                    {
+                        const int px = std::min(2 * x, parentSize - 1), py = std::min(2 * y, parentSize - 1);
+                        const int qx = std::min(px + 1, parentSize - 1), qy = std::min(py + 1, parentSize - 1);
+                        texels[(y * size + x) * 3 + c] = 0.25f *
+                            (parent[(py * parentSize + px) * 3 + c] + parent[(py * parentSize + qx) * 3 + c] +
+                             parent[(qy * parentSize + px) * 3 + c] + parent[(qy * parentSize + qx) * 3 + c]);
+                    }
+        });
+    }
+}
+
+// radiance projected on SH9 and convolved with the clamped cosine, divided by pi. Each texel
+// is weighted by its solid angle; a row's sums stay in 27 accumulators (4 texels per lane
+// group with SSE) and rows are added in a fixed order, so the result does not depend on the
+// thread count.
+inline SH9 projectIrradiance(const IblCubemap &cube, ThreadPool &pool)
+{
+    // 64 texels a face are plenty for 3 bands
+    int level = 0;
+    while (level + 1 < cube.levelCount() && cube.levelSize(level) > 64)
+        level++;
+    const int size = cube.levelSize(level);
+    const float texelArea = 4.0f / (size * size);
+    std::vector<float> rowSums(6 * size * 27, 0.0f);
+
+    pool.parallelFor(6 * size, [&](size_t job) {
+        const int face = static_cast<int>(job) / size, y = static_cast<int>(job) % size;
+        const float *row = cube.face(level, face) + y * size * 3;
+        const float t = 2.0f * (y + 0.5f) / size - 1.0f;
+        float *sums = &rowSums[job * 27];
+        int x = 0;
+#ifdef IBL_BAKER_SSE
+        __m128 acc[27];
+        for (int i = 0; i < 27; i++)
+            acc[i] = _mm_setzero_ps();
+        const __m128 half = _mm_set1_ps(0.5f), scale = _mm_set1_ps(2.0f / size), one = _mm_set1_ps(1.0f);
+        const __m128 tt = _mm_set1_ps(t), area = _mm_set1_ps(texelArea);
+        for (; x + 4 <= size; x += 4)
+        {
+            const __m128 xs = _mm_set_ps(x + 3.0f, x + 2.0f, x + 1.0f, static_cast<float>(x));
+            const __m128 s = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(xs, half), scale), one);
+            // |(s, t, 1)| is the same on every face; the solid angle of a texel is area / len^3
+            const __m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(s, s), _mm_mul_ps(tt, tt)), one);
+            const __m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSq));
+            const __m128 weight = _mm_mul_ps(area, _mm_mul_ps(invLength, _mm_mul_ps(invLength, invLength)));
+            __m128 d[3];
+            for (int k = 0; k < 3; k++)
+                d[k] = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(s, _mm_set1_ps(FACE_S[face][k])),
+                                             _mm_set1_ps(t * FACE_T[face][k] + FACE_M[face][k])), invLength);
+            __m128 basis[9];
+            basis[0] = _mm_mul_ps(weight, _mm_set1_ps(0.282095f));
+            basis[1] = _mm_mul_ps(weight, _mm_mul_ps(_mm_set1_ps(0.488603f), d[1]));
+            basis[2] = _mm_mul_ps(weight, _mm_mul_ps(_mm_set1_ps(0.488603f), d[2]));
+            basis[3] = _mm_mul_ps(weight, _mm_mul_ps(_mm_set1_ps(0.488603f), d[0]));
+            basis[4] = _mm_mul_ps(weight, _mm_mul_ps(_mm_set1_ps(1.092548f), _mm_mul_ps(d[0], d[1])));
+            basis[5] = _mm_mul_ps(weight, _mm_mul_ps(_mm_set1_ps(1.092548f), _mm_mul_ps(d[1], d[2])));
+            basis[6] = _mm_mul_ps(weight, _mm_mul_ps(_mm_set1_ps(0.315392f),
+                                  _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(3.0f), _mm_mul_ps(d[2], d[2])), one)));
+            basis[7] = _mm_mul_ps(weight, _mm_mul_ps(_mm_set1_ps(1.092548f), _mm_mul_ps(d[0], d[2])));
+            basis[8] = _mm_mul_ps(weight, _mm_mul_ps(_mm_set1_ps(0.546274f),
+                                  _mm_sub_ps(_mm_mul_ps(d[0], d[0]), _mm_mul_ps(d[1], d[1]))));
+            const float *p = row + x * 3;
+            const __m128 color[3] = { _mm_set_ps(p[9], p[6], p[3], p[0]),
+                                      _mm_set_ps(p[10], p[7], p[4], p[1]),
+                                      _mm_set_ps(p[11], p[8], p[5], p[2]) };
+            for (int i = 0; i < 9; i++)
+                for (int c = 0; c < 3; c++)
+                    acc[i * 3 + c] = _mm_add_ps(acc[i * 3 + c], _mm_mul_ps(basis[i], color[c]));
+        }
+        for (int i = 0; i < 27; i++)
+        {
+            float lanes[4];
+            _mm_storeu_ps(lanes, acc[i]);
+            sums[i] = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+        }
+#endif
+        for (; x < size; x++)
+        {
+            const float s = 2.0f * (x + 0.5f) / size - 1.0f;
+            const float lengthSq = s * s + t * t + 1.0f;
+            const float weight = texelArea / (lengthSq * std::sqrt(lengthSq));
+            float basis[9];
+            SH9::basis(faceDirection(face, s, t), basis);
+            for (int i = 0; i < 9; i++)
+                for (int c = 0; c < 3; c++)
+                    sums[i * 3 + c] += basis[i] * weight * row[x * 3 + c];
+        }
+    });
+
+    SH9 sh;
+    for (size_t job = 0; job < rowSums.size() / 27; job++)
+        for (int i = 0; i < 9; i++)
+            sh.c[i] += glm::vec3(rowSums[job * 27 + i * 3], rowSums[job * 27 + i * 3 + 1], rowSums[job * 27 + i * 3 + 2]);
+    for (int i = 0; i < 9; i++)
+        sh.c[i] *= SH9::irradianceScale(i);
+    return sh;
+}
+
+// light directions of a prefilter level in the tangent frame of N = V = R, with their NdotL
+// weight and the source lod that covers their solid angle (GPU Gems 3, ch. 20.4)
+struct PrefilterSamples {
+    std::vector<float> x, y, z, weight, lod;
+};
+
+inline PrefilterSamples makePrefilterSamples(float roughness, int count, int sourceSize, int sourceLevels)
+{
+    PrefilterSamples samples;
+    const float a2 = roughness * roughness * roughness * roughness;
+    const float texelSolidAngle = 4.0f * PI / (6.0f * sourceSize * sourceSize);
+    for (int i = 0; i < count; i++)
+    {
+        const glm::vec3 h = importanceSampleGGX(i, count, roughness);
+        const glm::vec3 l = 2.0f * h.z * h - glm::vec3(0.0f, 0.0f, 1.0f);
+        if (l.z <= 0.0f)
+            continue;
+        // with N = V the pdf of L is D(h) / 4
+        const float denominator = h.z * h.z * (a2 - 1.0f) + 1.0f;
+        const float pdf = a2 / (PI * denominator * denominator) * 0.25f;
+        const float sampleSolidAngle = 1.0f / (count * pdf + 1e-4f);
+        const float lod = 0.5f * std::log2(sampleSolidAngle / texelSolidAngle);
+        samples.x.push_back(l.x);
+        samples.y.push_back(l.y);
+        samples.z.push_back(l.z);
+        samples.weight.push_back(l.z);
+        samples.lod.push_back(std::min(std::max(lod, 0.0f), sourceLevels - 1.0f));
+    }
+    // pad to whole SSE groups with samples that weigh nothing
+    while (samples.x.size() % 4)
+    {
+        samples.x.push_back(0.0f);
+        samples.y.push_back(0.0f);
+        samples.z.push_back(1.0f);
+        samples.weight.push_back(0.0f);
+        samples.lod.push_back(0.0f);
+    }
+    return samples;
+}
+
+// radiance around n filtered by the samples: sum(L(l) * NdotL) / sum(NdotL). The tangent to
+// world rotation and the cube face selection run 4 samples at a time; the fetches are scalar.
+inline glm::vec3 prefilterTexel(const IblCubemap &source, const PrefilterSamples &samples, const glm::vec3 &n)
+{
+    const glm::vec3 up = std::abs(n.z) < 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+    const glm::vec3 tangent = glm::normalize(glm::cross(up, n));
+    const glm::vec3 bitangent = glm::cross(n, tangent);
+    glm::vec3 sum(0.0f);
+    float weightSum = 0.0f;
+    const size_t count = samples.x.size();
+#ifdef IBL_BAKER_SSE
+    const __m128 zero = _mm_setzero_ps(), half = _mm_set1_ps(0.5f);
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    for (size_t i = 0; i < count; i += 4)
+    {
+        const __m128 lx = _mm_loadu_ps(&samples.x[i]), ly = _mm_loadu_ps(&samples.y[i]), lz = _mm_loadu_ps(&samples.z[i]);
+        __m128 d[3];
+        for (int k = 0; k < 3; k++)
+            d[k] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, _mm_set1_ps(tangent[k])), _mm_mul_ps(ly, _mm_set1_ps(bitangent[k]))),
+                              _mm_mul_ps(lz, _mm_set1_ps(n[k])));
+        const __m128 ax = _mm_andnot_ps(signMask, d[0]), ay = _mm_andnot_ps(signMask, d[1]), az = _mm_andnot_ps(signMask, d[2]);
+        const __m128 isX = _mm_and_ps(_mm_cmpge_ps(ax, ay), _mm_cmpge_ps(ax, az));
+        const __m128 isY = _mm_andnot_ps(isX, _mm_cmpge_ps(ay, az));
+        const __m128 isZ = _mm_andnot_ps(_mm_or_ps(isX, isY), _mm_castsi128_ps(_mm_set1_epi32(-1)));
+        const __m128 negative[3] = { _mm_cmplt_ps(d[0], zero), _mm_cmplt_ps(d[1], zero), _mm_cmplt_ps(d[2], zero) };
+        // the GL face table: sc = -z, +z, x, x, x, -x and tc = -y, -y, z, -z, -y, -y
+        const __m128 scX = _mm_xor_ps(d[2], _mm_andnot_ps(negative[0], signMask));
+        const __m128 scZ = _mm_xor_ps(d[0], _mm_and_ps(negative[2], signMask));
+        const __m128 tcY = _mm_xor_ps(d[2], _mm_and_ps(negative[1], signMask));
+        const __m128 minusY = _mm_xor_ps(d[1], signMask);
+        const __m128 sc = _mm_or_ps(_mm_and_ps(isX, scX), _mm_or_ps(_mm_and_ps(isY, d[0]), _mm_and_ps(isZ, scZ)));
+        const __m128 tc = _mm_or_ps(_mm_and_ps(isY, tcY), _mm_andnot_ps(isY, minusY));
+        const __m128 ma = _mm_or_ps(_mm_and_ps(isX, ax), _mm_or_ps(_mm_and_ps(isY, ay), _mm_and_ps(isZ, az)));
+        const __m128 invMa = _mm_div_ps(half, ma);
+        float s[4], t[4];
+        _mm_storeu_ps(s, _mm_add_ps(_mm_mul_ps(sc, invMa), half));
+        _mm_storeu_ps(t, _mm_add_ps(_mm_mul_ps(tc, invMa), half));
+        const int xMask = _mm_movemask_ps(isX), yMask = _mm_movemask_ps(isY);
+        const int negMask[3] = { _mm_movemask_ps(negative[0]), _mm_movemask_ps(negative[1]), _mm_movemask_ps(negative[2]) };
+        for (int lane = 0; lane < 4; lane++)
+        {
+            const float weight = samples.weight[i + lane];
+            if (weight <= 0.0f)
+                continue;
+            const int axis = (xMask >> lane & 1) ? 0 : (yMask >> lane & 1) ? 1 : 2;
+            const int face = axis * 2 + (negMask[axis] >> lane & 1);
+            sum += fetchFaceLod(source, samples.lod[i + lane], face, s[lane], t[lane]) * weight;
+            weightSum += weight;
+        }
+    }
+#else
+    for (size_t i = 0; i < count; i++)
+    {
+        const float weight = samples.weight[i];
+        if (weight <= 0.0f)
+            continue;
+        const glm::vec3 l = tangent * samples.x[i] + bitangent * samples.y[i] + n * samples.z[i];
+        float s, t;
+        const int face = directionToFace(l, s, t);
+        sum += fetchFaceLod(source, samples.lod[i], face, s, t) * weight;
+        weightSum += weight;
+    }
+#endif
+    return weightSum > 0.0f ? sum / weightSum : sum;
+}
+
+inline void prefilter(const IblCubemap &source, IblCubemap &prefiltered, const IblBakeSettings &settings, ThreadPool &pool)
+{
+    prefiltered.allocate(settings.prefilterSize, settings.prefilterLevels);
+    std::vector<PrefilterSamples> samples(prefiltered.levelCount());
+    for (int level = 1; level < prefiltered.levelCount(); level++)
+        samples[level] = makePrefilterSamples(static_cast<float>(level) / (prefiltered.levelCount() - 1),
+                                              settings.prefilterSamples, source.size, source.levelCount());
+
+    // one job per row of every face and level, biggest levels first
+    struct Row { int level, face, y; };
+    std::vector<Row> rows;
+    for (int level = 0; level < prefiltered.levelCount(); level++)
+        for (int face = 0; face < 6; face++)
+            for (int y = 0; y < prefiltered.levelSize(level); y++)
+                rows.push_back({ level, face, y });
+
+    // mirror level: the source seen at the prefiltered resolution
+    const float mirrorLod = std::max(0.0f, std::log2(static_cast<float>(source.size) / settings.prefilterSize));
+    pool.parallelFor(rows.size(), [&](size_t job) {
+        const Row &r = rows[job];
+        const int size = prefiltered.levelSize(r.level);
+        float *texels = prefiltered.face(r.level, r.face) + r.y * size * 3;
+        const float t = 2.0f * (r.y + 0.5f) / size - 1.0f;
+        for (int x = 0; x < size; x++)
+        {
+            const float s = 2.0f * (x + 0.5f) / size - 1.0f;
+            glm::vec3 radiance = r.level == 0
+                ? fetchFaceLod(source, mirrorLod, r.face, 0.5f * (s + 1.0f), 0.5f * (t + 1.0f))
+                : prefilterTexel(source, samples[r.level], faceDirection(r.face, s, t));
+            texels[x * 3 + 0] = radiance.r;
+            texels[x * 3 + 1] = radiance.g;
+            texels[x * 3 + 2] = radiance.b;
+        }
+    });
+}
+
+// split-sum BRDF integral (Karis 2013) for F = F0 * scale + bias, plus the directional albedo
+// Ess = integral of f(F = 1) * NdotL of the lobe pbr.fs shades its lights with. The two only
+// differ in the Schlick-GGX k: roughness^2 / 2 for image based lighting, (roughness + 1)^2 / 8
+// for analytic lights. The GGX half vectors of a row are shared by every NdotV of the row and
+// 4 of them are evaluated at a time.
+inline std::vector<float> bakeBrdfLut(int size, int sampleCount, ThreadPool &pool)
+{
+    std::vector<float> lut(size * size * 3);
+    pool.parallelFor(size, [&](size_t y) {
+        const float roughness = (y + 0.5f) / size;
+        const float k = roughness * roughness / 2.0f;
+        const float kDirect = (roughness + 1.0f) * (roughness + 1.0f) / 8.0f;
+        std::vector<float> hx(sampleCount), hz(sampleCount);
+        for (int i = 0; i < sampleCount; i++)
+        {
+            const glm::vec3 h = importanceSampleGGX(i, sampleCount, roughness);
+            hx[i] = h.x;
+            hz[i] = h.z;
+        }
+        for (int x = 0; x < size; x++)
+        {
+            const float NdotV = (x + 0.5f) / size;
+            const float vx = std::sqrt(1.0f - NdotV * NdotV), vz = NdotV;
+            const float gV = NdotV / (NdotV * (1.0f - k) + k);
+            const float gVDirect = NdotV / (NdotV * (1.0f - kDirect) + kDirect);
+            float scale = 0.0f, bias = 0.0f, albedo = 0.0f;
+            int i = 0;
+#ifdef IBL_BAKER_SSE
+            const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f);
+            const __m128 VX = _mm_set1_ps(vx), VZ = _mm_set1_ps(vz);
+            const __m128 K = _mm_set1_ps(k), oneMinusK = _mm_set1_ps(1.0f - k);
+            const __m128 KDirect = _mm_set1_ps(kDirect), oneMinusKDirect = _mm_set1_ps(1.0f - kDirect);
+            const __m128 gVoverNdotV = _mm_set1_ps(gV / NdotV), gVDirectOverNdotV = _mm_set1_ps(gVDirect / NdotV);
+            __m128 scaleSum = zero, biasSum = zero, albedoSum = zero;
+            for (; i + 4 <= sampleCount; i += 4)
+            {
+                const __m128 HX = _mm_loadu_ps(&hx[i]), HZ = _mm_loadu_ps(&hz[i]);
+                const __m128 VdotH = _mm_max_ps(_mm_add_ps(_mm_mul_ps(VX, HX), _mm_mul_ps(VZ, HZ)), zero);
+                const __m128 NdotL = _mm_sub_ps(_mm_mul_ps(_mm_mul_ps(two, VdotH), HZ), VZ);
+                const __m128 valid = _mm_cmpgt_ps(NdotL, zero);
+                // G * VdotH / (NdotH * NdotV), for both k
+                const __m128 weight = _mm_and_ps(valid, _mm_div_ps(VdotH, HZ));
+                const __m128 gL = _mm_div_ps(NdotL, _mm_add_ps(_mm_mul_ps(NdotL, oneMinusK), K));
+                const __m128 gLDirect = _mm_div_ps(NdotL, _mm_add_ps(_mm_mul_ps(NdotL, oneMinusKDirect), KDirect));
+                const __m128 gVis = _mm_mul_ps(_mm_mul_ps(gL, gVoverNdotV), weight);
+                const __m128 f = _mm_sub_ps(one, VdotH);
+                const __m128 f2 = _mm_mul_ps(f, f);
+                const __m128 fc = _mm_mul_ps(_mm_mul_ps(f2, f2), f);
+                scaleSum = _mm_add_ps(scaleSum, _mm_mul_ps(_mm_sub_ps(one, fc), gVis));
+                biasSum = _mm_add_ps(biasSum, _mm_mul_ps(fc, gVis));
+                albedoSum = _mm_add_ps(albedoSum, _mm_mul_ps(_mm_mul_ps(gLDirect, gVDirectOverNdotV), weight));
+            }
+            float lanes[4];
+            _mm_storeu_ps(lanes, scaleSum);
+            scale = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+            _mm_storeu_ps(lanes, biasSum);
+            bias = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+            _mm_storeu_ps(lanes, albedoSum);
+            albedo = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+            for (; i < sampleCount; i++)
+            {
+                const float VdotH = std::max(vx * hx[i] + vz * hz[i], 0.0f);
+                const float NdotL = 2.0f * VdotH * hz[i] - vz;
+                if (NdotL <= 0.0f)
+                    continue;
+                const float weight = VdotH / (hz[i] * NdotV);
+                const float gVis = NdotL / (NdotL * (1.0f - k) + k) * gV * weight;
+                const float fc = std::pow(1.0f - VdotH, 5.0f);
+                scale += (1.0f - fc) * gVis;
+                bias += fc * gVis;
+                albedo += NdotL / (NdotL * (1.0f - kDirect) + kDirect) * gVDirect * weight;
+            }
+            lut[(y * size + x) * 3 + 0] = scale / sampleCount;
+            lut[(y * size + x) * 3 + 1] = bias / sampleCount;
+            lut[(y * size + x) * 3 + 2] = albedo / sampleCount;
+        }
+    });
+    return lut;
+}
+
+// stand-in environment when no HDR file is around: a sky gradient over a dark ground with a sun
+inline std::vector<float> proceduralSky(int width, int height)
+{
+    std::vector<float> rgb(width * height * 3);
+    const glm::vec3 sunDirection = glm::normalize(glm::vec3(0.4f, 0.6f, 0.5f));
+    const glm::vec3 zenith(0.15f, 0.3f, 0.8f), horizon(0.9f, 0.85f, 0.8f), ground(0.12f, 0.1f, 0.08f);
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+        {
+            const float phi = ((x + 0.5f) / width - 0.5f) * 2.0f * PI, theta = (y + 0.5f) / height * PI;
+            const glm::vec3 d(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+            glm::vec3 color = d.y > 0.0f ? glm::mix(horizon, zenith, std::sqrt(d.y))
+                                         : glm::mix(horizon, ground, std::min(1.0f, -d.y * 8.0f));
+            const float sun = glm::dot(d, sunDirection);
+            color += glm::vec3(1.0f, 0.9f, 0.7f) * (sun > 0.9995f ? 50.0f : 2.0f * std::pow(std::max(sun, 0.0f), 64.0f));
+            rgb[(y * width + x) * 3 + 0] = color.r;
+            rgb[(y * width + x) * 3 + 1] = color.g;
+            rgb[(y * width + x) * 3 + 2] = color.b;
+        }
+    return rgb;
+}
+
+// FNV-1a, 64 bit
+inline uint64_t hashBytes(const void *data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    return hash;
+}
+
+// bump when the bake or the file layout changes, so old cache files are ignored
+const uint32_t CACHE_VERSION = 2;
+const char CACHE_MAGIC[4] = { 'I', 'B', 'L', 'C' };
+
+inline bool readCache(const std::string &path, const IblBakeSettings &settings, IblMaps &maps)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    char magic[4];
+    uint32_t version;
+    IblBakeSettings stored;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char *>(&version), sizeof(version));
+    file.read(reinterpret_cast<char *>(&stored), sizeof(stored));
+    if (!file || !std::equal(magic, magic + 4, CACHE_MAGIC) || version != CACHE_VERSION ||
+        std::memcmp(&stored, &settings, sizeof(settings)) != 0)
+        return false;
+    file.read(reinterpret_cast<char *>(maps.irradiance.c), sizeof(maps.irradiance.c));
+    maps.prefiltered.allocate(settings.prefilterSize, settings.prefilterLevels);
+    for (std::vector<float> &level : maps.prefiltered.levels)
+        file.read(reinterpret_cast<char *>(level.data()), level.size() * sizeof(float));
+    maps.lutSize = settings.lutSize;
+    maps.brdfLut.resize(settings.lutSize * settings.lutSize * 3);
+    file.read(reinterpret_cast<char *>(maps.brdfLut.data()), maps.brdfLut.size() * sizeof(float));
+    return static_cast<bool>(file);
+}
+
+inline bool writeCache(const std::string &path, const IblBakeSettings &settings, const IblMaps &maps)
+{
+    // written under a temporary name first, so an interrupted run never leaves a torn cache
+    const std::string partial = path + ".partial";
+    {
+        std::ofstream file(partial, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+        file.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        file.write(reinterpret_cast<const char *>(&CACHE_VERSION), sizeof(CACHE_VERSION));
+        file.write(reinterpret_cast<const char *>(&settings), sizeof(settings));
+        file.write(reinterpret_cast<const char *>(maps.irradiance.c), sizeof(maps.irradiance.c));
+        for (const std::vector<float> &level : maps.prefiltered.levels)
+            file.write(reinterpret_cast<const char *>(level.data()), level.size() * sizeof(float));
+        file.write(reinterpret_cast<const char *>(maps.brdfLut.data()), maps.brdfLut.size() * sizeof(float));
+        if (!file)
+            return false;
+    }
+    std::remove(path.c_str());
+    return std::rename(partial.c_str(), path.c_str()) == 0;
+}
+
+} // namespace ibl_detail
+
+// bakes every map from a decoded equirectangular image (RGB floats, row 0 at the top)
+inline IblMaps bakeIbl(const float *rgb, int width, int height, ThreadPool &pool, const IblBakeSettings &settings = IblBakeSettings())
+{
+    IblCubemap source;
+    int sourceLevels = 1;
+    while ((settings.sourceSize >> sourceLevels) > 0)
+        sourceLevels++;
+    source.allocate(settings.sourceSize, sourceLevels);
+    ibl_detail::resampleEquirect(rgb, width, height, source, pool);
+    ibl_detail::buildMips(source, pool);
+
+    IblMaps maps;
+    maps.irradiance = ibl_detail::projectIrradiance(source, pool);
+    ibl_detail::prefilter(source, maps.prefiltered, settings, pool);
+    maps.lutSize = settings.lutSize;
+    maps.brdfLut = ibl_detail::bakeBrdfLut(settings.lutSize, settings.lutSamples, pool);
+    return maps;
+}
+
+// IBL maps of the HDR equirect at hdrPath, or of a procedural sky if the file cannot be read.
+// The maps are read from cacheDirectory when an earlier run baked the same file content with
+// the same settings; otherwise they are baked and stored there. fromCache reports which it was.
+inline IblMaps loadOrBakeIbl(const std::string &hdrPath, const std::string &cacheDirectory, ThreadPool &pool,
+                             const IblBakeSettings &settings = IblBakeSettings(), bool *fromCache = nullptr)
+{
+    std::vector<unsigned char> bytes;
+    {
+        std::ifstream file(hdrPath, std::ios::binary);
+        if (file)
+            bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    // the key covers the file content (not its name or date), the settings and the bake version
+    const char procedural[] = "procedural sky";
+    uint64_t key = bytes.empty() ? ibl_detail::hashBytes(procedural, sizeof(procedural))
+                                 : ibl_detail::hashBytes(bytes.data(), bytes.size());
+    key = ibl_detail::hashBytes(&settings, sizeof(settings), key);
+    key = ibl_detail::hashBytes(&ibl_detail::CACHE_VERSION, sizeof(ibl_detail::CACHE_VERSION), key);
+    char name[32];
+    std::snprintf(name, sizeof(name), "ibl_%016llx.bin", static_cast<unsigned long long>(key));
+    const std::string cachePath = cacheDirectory + "/" + name;
+
+    IblMaps maps;
+    if (ibl_detail::readCache(cachePath, settings, maps))
+    {
+        if (fromCache)
+            *fromCache = true;
+        return maps;
+    }
+    if (fromCache)
+        *fromCache = false;
+
+    int width = 0, height = 0, channels = 0;
+    float *pixels = bytes.empty() ? nullptr
+        : stbi_loadf_from_memory(bytes.data(), static_cast<int>(bytes.size()), &width, &height, &channels, 3);
+    if (pixels)
+    {
+        maps = bakeIbl(pixels, width, height, pool, settings);
+        stbi_image_free(pixels);
+    }
+    else
+    {
+        if (!bytes.empty())
+            std::cout << "IBL: failed to decode " << hdrPath << ", using a procedural sky" << std::endl;
+        width = 512;
+        height = 256;
+        std::vector<float> sky = ibl_detail::proceduralSky(width, height);
+        maps = bakeIbl(sky.data(), width, height, pool, settings);
+    }
+    if (!ibl_detail::writeCache(cachePath, settings, maps))
+        std::cout << "IBL: could not write the cache file " << cachePath << std::endl;
+    return maps;
+}
+
+// GL textures of baked IblMaps: the prefiltered cubemap (RGB16F with its mips) and the BRDF
+// LUT (RGB16F). Needs a current context; bind() makes them visible to shaders as prefilterMap
+// and brdfLUT.
+class IblTextures
+{
+public:
+    explicit IblTextures(const IblMaps &maps)
+    {
+        const IblCubemap &cube = maps.prefiltered;
+        levels = cube.levelCount();
+        glGenTextures(1, &prefilterMap);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, prefilterMap);
+        for (int level = 0; level < levels; level++)
+            for (int face = 0; face < 6; face++)
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_RGB16F, cube.levelSize(level), cube.levelSize(level),
+                             0, GL_RGB, GL_FLOAT, cube.face(level, face));
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        // the faces were filtered independently; let the GPU blend across their edges
+        glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+        glGenTextures(1, &brdfLut);
+        glBindTexture(GL_TEXTURE_2D, brdfLut);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, maps.lutSize, maps.lutSize, 0, GL_RGB, GL_FLOAT, maps.brdfLut.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        // the binds above went around the state cache
+        GLStateCache::invalidate();
+    }
+
+    ~IblTextures()
+    {
+        glDeleteTextures(1, &prefilterMap);
+        glDeleteTextures(1, &brdfLut);
+    }
+
+    IblTextures(const IblTextures&) = delete;
+    IblTextures& operator=(const IblTextures&) = delete;
+
+    // lod of the roughest prefiltered level, for textureLod(prefilterMap, R, roughness * maxLod)
+    float maxLod() const { return static_cast<float>(levels - 1); }
+
+    // binds both maps for draws with shader
+    void bind(Shader &shader)
+    {
+        int unit = shader.getSamplerUnit("prefilterMap");
+        if (unit >= 0)
+            GLStateCache::bindTextureCube(unit, prefilterMap);
+        unit = shader.getSamplerUnit("brdfLUT");
+        if (unit >= 0)
+            GLStateCache::bindTexture2D(unit, brdfLut);
+    }
+
+private:
+    unsigned int prefilterMap = 0;
+    unsigned int brdfLut = 0;
+    int levels = 0;
+};
+#endif
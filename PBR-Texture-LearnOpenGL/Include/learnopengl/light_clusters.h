@@ -0,0 +1,399 @@
+#ifndef LIGHT_CLUSTERS_H
+#define LIGHT_CLUSTERS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/gl_state.h>
+#include <learnopengl/shader.h>
+#include <learnopengl/thread_pool.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <xmmintrin.h>
+#define LIGHT_CLUSTERS_SSE 1
+#endif
+
+// clustered forward shading: the view frustum is cut into froxels (screen tiles times
+// exponentially spaced depth slices) and every frame the CPU lists, per froxel, the point
+// lights whose sphere of influence touches it. Fragments then only loop over the lights of
+// their own froxel instead of every light in the scene.
+//  - update() moves the lights to view space and bounds each one by a depth slice range and a
+//    conservative tile rectangle, 4 lights at a time with SSE. The depth slices are then spread
+//    over a ThreadPool; each tests the lights of its range against its froxel boxes, 4 froxels
+//    at a time. No two jobs write the same list, and lists keep their capacity between frames.
+//  - upload() sends the lights, the per-froxel (offset, count) grid and the light index lists
+//    as three texture buffers (GL 3.3 has no shader storage buffers); bind() exposes them to a
+//    shader as lightData, clusterGrid and lightIndices. The GL objects are created by the first
+//    upload(), so setProjection() and update() also run without a context (bench/).
+
+// a light as stored in the lightData texture buffer: two RGBA32F texels
+struct PointLight {
+    glm::vec3 position;
+    float radius;       // the light is cut off (smoothly) at this distance
+    glm::vec3 color;
+    float padding;
+};
+static_assert(sizeof(PointLight) == 32, "PointLight must be two vec4 texels");
+
+// distance at which a light of color has fallen under threshold with inverse square falloff
+inline float pointLightRadius(const glm::vec3 &color, float threshold = 0.05f)
+{
+    return std::sqrt(std::max(std::max(color.r, color.g), color.b) / threshold);
+}
+
+struct LightClusterStats {
+    unsigned int lights = 0;          // lights given to update, including culled ones
+    unsigned int visibleLights = 0;   // lights that touch at least the depth range of the grid
+    unsigned int indices = 0;         // entries in all light lists
+    unsigned int maxPerCluster = 0;
+};
+
+class LightClusters
+{
+public:
+    static const int TILE_SIZE = 80;       // pixels; 16 x 9 tiles at 1280 x 720
+    static const int DEPTH_SLICES = 24;
+
+    LightClusters() = default;
+
+    ~LightClusters()
+    {
+        if (buffers[0] == 0)
+            return;
+        glDeleteTextures(3, textures);
+        glDeleteBuffers(3, buffers);
+    }
+
+    LightClusters(const LightClusters&) = delete;
+    LightClusters& operator=(const LightClusters&) = delete;
+
+    // rebuilds the froxel boxes when the projection or the framebuffer size changed
+    void setProjection(const glm::mat4 &projection, int width, int height, float nearPlane, float farPlane)
+    {
+        if (projection == proj && width == screenWidth && height == screenHeight && nearPlane == zNear && farPlane == zFar)
+            return;
+        proj = projection;
+        screenWidth = std::max(width, 1);
+        screenHeight = std::max(height, 1);
+        zNear = nearPlane;
+        zFar = farPlane;
+        tilesX = (screenWidth + TILE_SIZE - 1) / TILE_SIZE;
+        tilesY = (screenHeight + TILE_SIZE - 1) / TILE_SIZE;
+        // tile rows padded to whole SSE groups; the padding froxels are empty boxes
+        rowStride = (tilesX + 3) & ~3;
+        const float logRatio = std::log(zFar / zNear);
+        sliceScale = DEPTH_SLICES / logRatio;
+        sliceBias = -DEPTH_SLICES * std::log(zNear) / logRatio;
+
+        const size_t boxCount = static_cast<size_t>(DEPTH_SLICES) * tilesY * rowStride;
+        for (int k = 0; k < 3; k++)
+        {
+            boxMin[k].assign(boxCount, 1e30f);
+            boxMax[k].assign(boxCount, -1e30f);
+        }
+        for (int z = 0; z < DEPTH_SLICES; z++)
+        {
+            const float depths[2] = { sliceDepth(z), sliceDepth(z + 1) };
+            for (int y = 0; y < tilesY; y++)
+                for (int x = 0; x < tilesX; x++)
+                {
+                    const float ndcX[2] = { pixelToNdc(x * TILE_SIZE, screenWidth), pixelToNdc(std::min((x + 1) * TILE_SIZE, screenWidth), screenWidth) };
+                    const float ndcY[2] = { pixelToNdc(y * TILE_SIZE, screenHeight), pixelToNdc(std::min((y + 1) * TILE_SIZE, screenHeight), screenHeight) };
+                    const size_t box = (static_cast<size_t>(z) * tilesY + y) * rowStride + x;
+                    // the 8 corners of the froxel in view space
+                    for (int d = 0; d < 2; d++)
+                        for (int i = 0; i < 2; i++)
+                            for (int j = 0; j < 2; j++)
+                            {
+                                const glm::vec3 corner((ndcX[i] + proj[2][0]) * depths[d] / proj[0][0],
+                                                       (ndcY[j] + proj[2][1]) * depths[d] / proj[1][1], -depths[d]);
+                                for (int k = 0; k < 3; k++)
+                                {
+                                    boxMin[k][box] = std::min(boxMin[k][box], corner[k]);
+                                    boxMax[k][box] = std::max(boxMax[k][box], corner[k]);
+                                }
+                            }
+                }
+        }
+        lists.resize(static_cast<size_t>(DEPTH_SLICES) * tilesY * tilesX);
+        grid.resize(lists.size() * 2);
+    }
+
+    // assigns count lights to the froxels for the camera's view matrix
+    void update(const PointLight *lights, size_t count, const glm::mat4 &view, ThreadPool &pool)
+    {
+        lightCount = count;
+        lightTexels.assign(reinterpret_cast<const float *>(lights), reinterpret_cast<const float *>(lights + count));
+        bounds.resize((count + 3) & ~size_t(3));
+        computeBounds(lights, count, view);
+
+        pool.parallelFor(DEPTH_SLICES, [&](size_t slice) { assignSlice(static_cast<int>(slice)); });
+
+        // concatenate the lists in froxel order; the grid holds each one's offset and length
+        stats = LightClusterStats();
+        stats.lights = static_cast<unsigned int>(count);
+        for (size_t i = 0; i < count; i++)
+            if (bounds[i].sliceMin <= bounds[i].sliceMax)
+                stats.visibleLights++;
+        indices.clear();
+        for (size_t cluster = 0; cluster < lists.size(); cluster++)
+        {
+            const std::vector<unsigned int> &list = lists[cluster];
+            grid[cluster * 2] = static_cast<unsigned int>(indices.size());
+            grid[cluster * 2 + 1] = static_cast<unsigned int>(list.size());
+            indices.insert(indices.end(), list.begin(), list.end());
+            stats.maxPerCluster = std::max(stats.maxPerCluster, static_cast<unsigned int>(list.size()));
+        }
+        stats.indices = static_cast<unsigned int>(indices.size());
+    }
+
+    // sends the lights, the grid and the lists of the last update to the GPU
+    void upload()
+    {
+        if (buffers[0] == 0)
+            createTextures();
+        uploadBuffer(0, lightTexels.data(), lightTexels.size() * sizeof(float));
+        uploadBuffer(1, grid.data(), grid.size() * sizeof(unsigned int));
+        uploadBuffer(2, indices.data(), indices.size() * sizeof(unsigned int));
+    }
+
+    // binds the three texture buffers for draws with shader
+    void bind(Shader &shader)
+    {
+        const char *names[3] = { "lightData", "clusterGrid", "lightIndices" };
+        for (int i = 0; i < 3; i++)
+        {
+            int unit = shader.getSamplerUnit(names[i]);
+            if (unit >= 0)
+                GLStateCache::bindTextureBuffer(unit, textures[i]);
+        }
+    }
+
+    // x, y: 1 / tile size in pixels, z, w: scale and bias turning log(view depth) into a slice
+    glm::vec4 shaderParams() const { return glm::vec4(1.0f / TILE_SIZE, 1.0f / TILE_SIZE, sliceScale, sliceBias); }
+    glm::uvec4 dimensions() const { return glm::uvec4(tilesX, tilesY, DEPTH_SLICES, 0); }
+
+    const LightClusterStats &lastStats() const { return stats; }
+
+    // what upload() sends, as of the last update: per froxel (x fastest, then y, then depth slice)
+    // the offset and count of its list in lightIndices()
+    const std::vector<unsigned int> &clusterGrid() const { return grid; }
+    const std::vector<unsigned int> &lightIndices() const { return indices; }
+
+private:
+    // what update() keeps of a light: its view space sphere and the froxel range it may touch
+    struct LightBounds {
+        float x, y, z, radius;
+        int tileMinX, tileMaxX, tileMinY, tileMaxY;
+        int sliceMin, sliceMax;     // sliceMin > sliceMax if the light is outside the depth range
+    };
+
+    glm::mat4 proj = glm::mat4(0.0f);
+    int screenWidth = 0, screenHeight = 0;
+    float zNear = 0.0f, zFar = 0.0f;
+    int tilesX = 0, tilesY = 0, rowStride = 0;
+    float sliceScale = 0.0f, sliceBias = 0.0f;
+    std::vector<float> boxMin[3], boxMax[3];    // view space froxel boxes, SoA, rows padded to rowStride
+
+    size_t lightCount = 0;
+    std::vector<LightBounds> bounds;
+    std::vector<std::vector<unsigned int>> lists; // per froxel, slice major
+    std::vector<unsigned int> grid;
+    std::vector<unsigned int> indices;
+    std::vector<float> lightTexels;
+    LightClusterStats stats;
+
+    unsigned int buffers[3] = { 0, 0, 0 };
+    unsigned int textures[3] = { 0, 0, 0 };
+    GLsizeiptr capacities[3] = { 0, 0, 0 };
+
+    static float pixelToNdc(int pixel, int size) { return 2.0f * pixel / size - 1.0f; }
+
+    float sliceDepth(int slice) const { return zNear * std::pow(zFar / zNear, static_cast<float>(slice) / DEPTH_SLICES); }
+
+    int depthToSlice(float depth) const
+    {
+        return static_cast<int>(std::floor(std::log(depth) * sliceScale + sliceBias));
+    }
+
+    int ndcToTile(float ndc, int size, int tiles) const
+    {
+        const int tile = static_cast<int>(std::floor((ndc * 0.5f + 0.5f) * size / TILE_SIZE));
+        return std::min(std::max(tile, 0), tiles - 1);
+    }
+
+    // view space spheres and their conservative froxel ranges. The sphere lies in the box
+    // center +- radius, and x / depth is monotonic along each axis of it, so the corners of the
+    // box give the extreme screen coordinates. Spheres reaching the near plane cover the screen.
+    void computeBounds(const PointLight *lights, size_t count, const glm::mat4 &view)
+    {
+        size_t i = 0;
+#ifdef LIGHT_CLUSTERS_SSE
+        const __m128 nearDepth = _mm_set1_ps(zNear);
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 px = _mm_loadu_ps(&lights[i].position.x), py = _mm_loadu_ps(&lights[i + 1].position.x);
+            __m128 pz = _mm_loadu_ps(&lights[i + 2].position.x), pr = _mm_loadu_ps(&lights[i + 3].position.x);
+            _MM_TRANSPOSE4_PS(px, py, pz, pr);
+            __m128 v[3];
+            for (int k = 0; k < 3; k++)
+                v[k] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(view[0][k])), _mm_mul_ps(py, _mm_set1_ps(view[1][k]))),
+                                  _mm_add_ps(_mm_mul_ps(pz, _mm_set1_ps(view[2][k])), _mm_set1_ps(view[3][k])));
+            const __m128 depth = _mm_sub_ps(_mm_setzero_ps(), v[2]);
+            const __m128 nearest = _mm_sub_ps(depth, pr), farthest = _mm_add_ps(depth, pr);
+            const __m128 clipsNear = _mm_cmple_ps(nearest, nearDepth);
+            // safe divisors for the lanes that cover the screen anyway
+            const __m128 invNear = _mm_div_ps(_mm_set1_ps(1.0f), _mm_max_ps(nearest, nearDepth));
+            const __m128 invFar = _mm_div_ps(_mm_set1_ps(1.0f), _mm_max_ps(farthest, nearDepth));
+            __m128 lo[2], hi[2];
+            for (int k = 0; k < 2; k++)
+            {
+                const __m128 scale = _mm_set1_ps(proj[k][k]), offset = _mm_set1_ps(proj[2][k]);
+                const __m128 a = _mm_mul_ps(_mm_sub_ps(v[k], pr), scale), b = _mm_mul_ps(_mm_add_ps(v[k], pr), scale);
+                const __m128 a0 = _mm_mul_ps(a, invNear), a1 = _mm_mul_ps(a, invFar);
+                const __m128 b0 = _mm_mul_ps(b, invNear), b1 = _mm_mul_ps(b, invFar);
+                lo[k] = _mm_sub_ps(_mm_min_ps(_mm_min_ps(a0, a1), _mm_min_ps(b0, b1)), offset);
+                hi[k] = _mm_sub_ps(_mm_max_ps(_mm_max_ps(a0, a1), _mm_max_ps(b0, b1)), offset);
+                lo[k] = _mm_or_ps(_mm_and_ps(clipsNear, _mm_set1_ps(-1.0f)), _mm_andnot_ps(clipsNear, lo[k]));
+                hi[k] = _mm_or_ps(_mm_and_ps(clipsNear, _mm_set1_ps(1.0f)), _mm_andnot_ps(clipsNear, hi[k]));
+            }
+            float x[4], y[4], z[4], r[4], lx[4], hx[4], ly[4], hy[4], nd[4], fd[4];
+            _mm_storeu_ps(x, v[0]);
+            _mm_storeu_ps(y, v[1]);
+            _mm_storeu_ps(z, v[2]);
+            _mm_storeu_ps(r, pr);
+            _mm_storeu_ps(lx, lo[0]);
+            _mm_storeu_ps(hx, hi[0]);
+            _mm_storeu_ps(ly, lo[1]);
+            _mm_storeu_ps(hy, hi[1]);
+            _mm_storeu_ps(nd, nearest);
+            _mm_storeu_ps(fd, farthest);
+            for (int lane = 0; lane < 4; lane++)
+                setBounds(bounds[i + lane], x[lane], y[lane], z[lane], r[lane], lx[lane], hx[lane], ly[lane], hy[lane], nd[lane], fd[lane]);
+        }
+#endif
+        for (; i < count; i++)
+        {
+            const glm::vec3 v = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+            const float r = lights[i].radius;
+            const float nearest = -v.z - r, farthest = -v.z + r;
+            float lo[2] = { -1.0f, -1.0f }, hi[2] = { 1.0f, 1.0f };
+            if (nearest > zNear)
+                for (int k = 0; k < 2; k++)
+                {
+                    const float a = (v[k] - r) * proj[k][k], b = (v[k] + r) * proj[k][k];
+                    lo[k] = std::min(std::min(a / nearest, a / farthest), std::min(b / nearest, b / farthest)) - proj[2][k];
+                    hi[k] = std::max(std::max(a / nearest, a / farthest), std::max(b / nearest, b / farthest)) - proj[2][k];
+                }
+            setBounds(bounds[i], v.x, v.y, v.z, r, lo[0], hi[0], lo[1], hi[1], nearest, farthest);
+        }
+    }
+
+    void setBounds(LightBounds &b, float x, float y, float z, float radius, float loX, float hiX, float loY, float hiY,
+                   float nearest, float farthest) const
+    {
+        b.x = x;
+        b.y = y;
+        b.z = z;
+        b.radius = radius;
+        b.sliceMin = 1;
+        b.sliceMax = 0;
+        if (radius <= 0.0f || farthest < zNear || nearest > zFar || loX > 1.0f || hiX < -1.0f || loY > 1.0f || hiY < -1.0f)
+            return;
+        b.sliceMin = std::max(depthToSlice(std::max(nearest, zNear)), 0);
+        b.sliceMax = std::min(depthToSlice(std::min(farthest, zFar)), DEPTH_SLICES - 1);
+        b.tileMinX = ndcToTile(loX, screenWidth, tilesX);
+        b.tileMaxX = ndcToTile(hiX, screenWidth, tilesX);
+        b.tileMinY = ndcToTile(loY, screenHeight, tilesY);
+        b.tileMaxY = ndcToTile(hiY, screenHeight, tilesY);
+    }
+
+    // fills the lists of one depth slice: sphere against froxel box, 4 froxels of a row at a time
+    void assignSlice(int slice)
+    {
+        const size_t firstList = static_cast<size_t>(slice) * tilesY * tilesX;
+        for (size_t i = 0; i < static_cast<size_t>(tilesY) * tilesX; i++)
+            lists[firstList + i].clear();
+        for (size_t light = 0; light < lightCount; light++)
+        {
+            const LightBounds &b = bounds[light];
+            if (slice < b.sliceMin || slice > b.sliceMax)
+                continue;
+            const float radiusSq = b.radius * b.radius;
+            for (int y = b.tileMinY; y <= b.tileMaxY; y++)
+            {
+                const size_t row = (static_cast<size_t>(slice) * tilesY + y) * rowStride;
+                std::vector<unsigned int> *rowLists = &lists[firstList + static_cast<size_t>(y) * tilesX];
+                int x = b.tileMinX & ~3;
+#ifdef LIGHT_CLUSTERS_SSE
+                const __m128 zero = _mm_setzero_ps(), r2 = _mm_set1_ps(radiusSq);
+                const __m128 center[3] = { _mm_set1_ps(b.x), _mm_set1_ps(b.y), _mm_set1_ps(b.z) };
+                for (; x <= b.tileMaxX; x += 4)
+                {
+                    __m128 distanceSq = zero;
+                    for (int k = 0; k < 3; k++)
+                    {
+                        const __m128 below = _mm_sub_ps(_mm_loadu_ps(&boxMin[k][row + x]), center[k]);
+                        const __m128 above = _mm_sub_ps(center[k], _mm_loadu_ps(&boxMax[k][row + x]));
+                        const __m128 d = _mm_max_ps(_mm_max_ps(below, above), zero);
+                        distanceSq = _mm_add_ps(distanceSq, _mm_mul_ps(d, d));
+                    }
+                    int hits = _mm_movemask_ps(_mm_cmple_ps(distanceSq, r2));
+                    for (int lane = 0; lane < 4; lane++)
+                    {
+                        const int tile = x + lane;
+                        if ((hits >> lane & 1) && tile >= b.tileMinX && tile <= b.tileMaxX)
+                            rowLists[tile].push_back(static_cast<unsigned int>(light));
+                    }
+                }
+#else
+                for (x = b.tileMinX; x <= b.tileMaxX; x++)
+                {
+                    float distanceSq = 0.0f;
+                    const float c[3] = { b.x, b.y, b.z };
+                    for (int k = 0; k < 3; k++)
+                    {
+                        const float d = std::max(std::max(boxMin[k][row + x] - c[k], c[k] - boxMax[k][row + x]), 0.0f);
+                        distanceSq += d * d;
+                    }
+                    if (distanceSq <= radiusSq)
+                        rowLists[x].push_back(static_cast<unsigned int>(light));
+                }
+#endif
+            }
+        }
+    }
+
+    void createTextures()
+    {
+        glGenBuffers(3, buffers);
+        glGenTextures(3, textures);
+        const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+        for (int i = 0; i < 3; i++)
+        {
+            // the textures read whatever store their buffer has: upload() can reallocate freely
+            GLStateCache::bindTextureBuffer(0, textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+        }
+    }
+
+    void uploadBuffer(int i, const void *data, size_t size)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+        // never empty, so the texture always has a store to read
+        const GLsizeiptr bytes = std::max<GLsizeiptr>(static_cast<GLsizeiptr>(size), 16);
+        if (bytes > capacities[i])
+            capacities[i] = std::max<GLsizeiptr>(bytes, capacities[i] * 2);
+        // a fresh store each frame (orphaning), so draws of the previous frame do not stall the upload
+        glBufferData(GL_TEXTURE_BUFFER, capacities[i], nullptr, GL_STREAM_DRAW);
+        if (size > 0)
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+};
+#endif
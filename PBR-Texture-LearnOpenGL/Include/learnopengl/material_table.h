@@ -0,0 +1,274 @@
+#ifndef MATERIAL_TABLE_H
+#define MATERIAL_TABLE_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+#include <glm/glm.hpp>
+#include <stb_image.h>
+
+#include <learnopengl/gl_state.h>
+#include <learnopengl/ring_buffer.h>
+#include <learnopengl/shader.h>
+#include <learnopengl/thread_pool.h>
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// per-instance record read by the material table shaders (pbr.vs, locations 3-9)
+struct MaterialInstance {
+    glm::mat4 model;
+    glm::vec4 albedoMetallic; // albedo.rgb, metallic; only used when material < 0
+    float roughness;          // only used when material < 0
+    int material;             // index into the MaterialTable, -1 shades with the constants above
+};
+
+// feeds MaterialInstance records from a RingBuffer to every instanced VAO
+class InstanceBuffer
+{
+public:
+    explicit InstanceBuffer(RingBuffer &ring) : ring(ring)
+    {
+    }
+
+    // enables the per-instance attributes of vao; where they read from is set by upload()
+    void attach(unsigned int vao)
+    {
+        GLStateCache::bindVertexArray(vao);
+        for (unsigned int location = 3; location <= 9; location++)
+        {
+            glEnableVertexAttribArray(location);
+            glVertexAttribDivisor(location, 1);
+        }
+    }
+
+    // writes instances to the ring and points the bound VAO's per-instance attributes at them.
+    // Returns false (and leaves the VAO alone) if the ring's frame region is full.
+    bool upload(const MaterialInstance *instances, unsigned int count)
+    {
+        RingBuffer::Allocation allocation = ring.push(instances, count * sizeof(MaterialInstance));
+        if (allocation.size == 0)
+            return false;
+        ring.flush();
+        glBindBuffer(GL_ARRAY_BUFFER, ring.ID);
+        const GLsizei stride = sizeof(MaterialInstance);
+        const GLintptr base = allocation.offset;
+        // a mat4 attribute takes four consecutive locations, one per column
+        for (unsigned int column = 0; column < 4; column++)
+            glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, stride, (void*)(base + offsetof(MaterialInstance, model) + column * sizeof(glm::vec4)));
+        glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, stride, (void*)(base + offsetof(MaterialInstance, albedoMetallic)));
+        glVertexAttribPointer(8, 1, GL_FLOAT, GL_FALSE, stride, (void*)(base + offsetof(MaterialInstance, roughness)));
+        glVertexAttribIPointer(9, 1, GL_INT, stride, (void*)(base + offsetof(MaterialInstance, material)));
+        return true;
+    }
+
+private:
+    RingBuffer &ring;
+};
+
+// all PBR materials of a scene in a few GL objects, so draws select a material by index instead
+// of binding textures. Maps are packed into one texture array per (size, format) class: albedo and
+// normal maps are stored as RGBA8, metallic/roughness/ao as R8. A uniform block lists, for every
+// material and map, which array and layer holds it; the shader picks the array by branching over
+// a fixed set of sampler2DArray uniforms, which is all GL 3.3 allows (no bindless, no dynamic
+// sampler indexing).
+class MaterialTable
+{
+public:
+    enum Map { ALBEDO, NORMAL, METALLIC, ROUGHNESS, AO, MAP_COUNT };
+
+    // these must match materialArrays[] and MaterialTable in pbr.fs
+    static const unsigned int MAX_MATERIALS = 64;
+    static const unsigned int MAX_ARRAYS = 4;
+    static const unsigned int UNIFORM_BLOCK_BINDING = 0;
+
+    // registers the material whose maps are <directory>/albedo.png, normal.png, metallic.png, roughness.png
+    // and ao.png and returns its index. Nothing is loaded before build().
+    int add(const std::string &directory)
+    {
+        if (materials.size() >= MAX_MATERIALS)
+        {
+            std::cout << "ERROR::MATERIAL_TABLE: more than " << MAX_MATERIALS << " materials, ignoring " << directory << std::endl;
+            return -1;
+        }
+        Material material;
+        for (unsigned int map = 0; map < MAP_COUNT; map++)
+        {
+            material.maps[map].path = directory + "/" + MAP_FILES[map];
+            material.maps[map].array = -1;
+            material.maps[map].layer = -1;
+        }
+        materials.push_back(material);
+        return static_cast<int>(materials.size() - 1);
+    }
+
+    // decodes every map (in parallel), sorts them into size/format classes and creates the texture
+    // arrays and the uniform buffer. Must run on the thread owning the GL context, once, after all add()s.
+    // Maps that fail to load fall back to a neutral constant in the shader.
+    void build()
+    {
+        std::vector<MapSource*> sources;
+        for (Material &material : materials)
+            for (unsigned int map = 0; map < MAP_COUNT; map++)
+                sources.push_back(&material.maps[map]);
+        std::vector<MapPixels> pixels(sources.size());
+        ThreadPool pool;
+        pool.parallelFor(sources.size(), [&](size_t i) {
+            pixels[i] = decodeMap(sources[i]->path, (i % MAP_COUNT) < METALLIC ? 4 : 1);
+        });
+
+        // assign layers
+        for (size_t i = 0; i < sources.size(); i++)
+        {
+            if (pixels[i].data.empty())
+            {
+                std::cout << "Texture failed to load at path: " << sources[i]->path << std::endl;
+                continue;
+            }
+            int array = findOrAddArray(pixels[i]);
+            if (array < 0)
+            {
+                std::cout << "ERROR::MATERIAL_TABLE: more than " << MAX_ARRAYS << " size/format classes, skipping " << sources[i]->path << std::endl;
+                continue;
+            }
+            sources[i]->array = array;
+            sources[i]->layer = arrays[array].layers++;
+        }
+
+        // upload, one array at a time
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (unsigned int a = 0; a < arrays.size(); a++)
+        {
+            TextureArray &array = arrays[a];
+            glGenTextures(1, &array.texture);
+            GLStateCache::bindTexture2DArray(0, array.texture);
+            const GLenum format = array.channels == 4 ? GL_RGBA : GL_RED;
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, array.channels == 4 ? GL_RGBA8 : GL_R8, array.width, array.height, array.layers, 0, format, GL_UNSIGNED_BYTE, nullptr);
+            for (size_t i = 0; i < sources.size(); i++)
+            {
+                if (sources[i]->array == static_cast<int>(a))
+                    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, sources[i]->layer, array.width, array.height, 1, format, GL_UNSIGNED_BYTE, pixels[i].data.data());
+            }
+            glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        // std140 layout of pbr.fs' MaterialEntry: ivec4 layer (albedo, normal, metallic, roughness),
+        // ivec4 array (same order), ivec4 ao (layer, array, -, -)
+        std::vector<GLint> entries(MAX_MATERIALS * 12, -1);
+        for (size_t m = 0; m < materials.size(); m++)
+        {
+            GLint *entry = &entries[m * 12];
+            for (unsigned int map = 0; map < AO; map++)
+            {
+                entry[map] = materials[m].maps[map].layer;
+                entry[4 + map] = materials[m].maps[map].array;
+            }
+            entry[8] = materials[m].maps[AO].layer;
+            entry[9] = materials[m].maps[AO].array;
+        }
+        glGenBuffers(1, &UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, entries.size() * sizeof(GLint), entries.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    // points shader's MaterialTable block at the table's binding point; once per shader
+    void attach(Shader &shader)
+    {
+        shader.setUniformBlockBinding("MaterialTable", UNIFORM_BLOCK_BINDING);
+    }
+
+    // binds the arrays and the uniform buffer for draws with shader
+    void bind(Shader &shader)
+    {
+        shader.use();
+        for (unsigned int a = 0; a < arrays.size(); a++)
+        {
+            int unit = shader.getSamplerUnit("materialArrays[" + std::to_string(a) + "]");
+            if (unit >= 0)
+                GLStateCache::bindTexture2DArray(unit, arrays[a].texture);
+        }
+        glBindBufferBase(GL_UNIFORM_BUFFER, UNIFORM_BLOCK_BINDING, UBO);
+    }
+
+    unsigned int arrayCount() const { return static_cast<unsigned int>(arrays.size()); }
+    unsigned int materialCount() const { return static_cast<unsigned int>(materials.size()); }
+
+private:
+    static const char *const MAP_FILES[MAP_COUNT];
+
+    struct MapSource {
+        std::string path;
+        int array, layer;
+    };
+    struct Material {
+        MapSource maps[MAP_COUNT];
+    };
+    // a decoded map, already converted to the channel count of its array
+    struct MapPixels {
+        std::vector<unsigned char> data;
+        int width = 0, height = 0, channels = 0;
+    };
+    struct TextureArray {
+        int width, height, channels;
+        int layers;
+        unsigned int texture;
+    };
+
+    std::vector<Material> materials;
+    std::vector<TextureArray> arrays;
+    unsigned int UBO = 0;
+
+    // runs on a worker thread: decodes path and converts it to RGBA8 (channels 4) or to its first channel (channels 1)
+    static MapPixels decodeMap(const std::string &path, int channels)
+    {
+        MapPixels pixels;
+        int nrComponents;
+        unsigned char *data = stbi_load(path.c_str(), &pixels.width, &pixels.height, &nrComponents, 0);
+        if (!data)
+            return pixels;
+        const size_t texels = static_cast<size_t>(pixels.width) * pixels.height;
+        pixels.channels = channels;
+        pixels.data.resize(texels * channels);
+        for (size_t t = 0; t < texels; t++)
+        {
+            const unsigned char *src = data + t * nrComponents;
+            unsigned char *dst = &pixels.data[t * channels];
+            if (channels == 1)
+            {
+                dst[0] = src[0];
+                continue;
+            }
+            // grey (+alpha) expands to rgb, missing alpha is opaque
+            dst[0] = src[0];
+            dst[1] = nrComponents >= 3 ? src[1] : src[0];
+            dst[2] = nrComponents >= 3 ? src[2] : src[0];
+            dst[3] = nrComponents == 4 ? src[3] : nrComponents == 2 ? src[1] : 255;
+        }
+        stbi_image_free(data);
+        return pixels;
+    }
+
+    int findOrAddArray(const MapPixels &pixels)
+    {
+        for (unsigned int a = 0; a < arrays.size(); a++)
+        {
+            if (arrays[a].width == pixels.width && arrays[a].height == pixels.height && arrays[a].channels == pixels.channels)
+                return static_cast<int>(a);
+        }
+        if (arrays.size() >= MAX_ARRAYS)
+            return -1;
+        TextureArray array = { pixels.width, pixels.height, pixels.channels, 0, 0 };
+        arrays.push_back(array);
+        return static_cast<int>(arrays.size() - 1);
+    }
+};
+
+const char *const MaterialTable::MAP_FILES[MaterialTable::MAP_COUNT] = { "albedo.png", "normal.png", "metallic.png", "roughness.png", "ao.png" };
+#endif
@@ -12,16 +12,26 @@
 
 #include <learnopengl/mesh.h>
 #include <learnopengl/shader.h>
+#include <learnopengl/thread_pool.h>
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <unordered_map>
 #include <vector>
 using namespace std;
 
+// pixels of an image file decoded by stb_image, not yet uploaded to the GPU.
+struct TextureImage {
+    unsigned char *data = nullptr;
+    int width = 0, height = 0, nrComponents = 0;
+};
+
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
+TextureImage DecodeTextureFile(const char *path, const string &directory);
+unsigned int UploadTexture(TextureImage &image, const char *path);
 
 class Model 
 {
@@ -46,7 +56,16 @@ public:
     }
     
 private:
+    // CPU side of a mesh: everything processMesh extracts before any GL object exists.
+    struct MeshData {
+        vector<Vertex>       vertices;
+        vector<unsigned int> indices;
+        vector<Texture>      textures; // only type and path are filled in until the GL upload
+    };
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+    // vertex conversion and texture decoding are spread over a thread pool (one job per aiMesh / per image);
+    // all GL buffer and texture creation is batched at the end on the calling thread, which owns the context.
     void loadModel(string const &path)
     {
         // read file via ASSIMP
@@ -61,35 +80,83 @@ private:
         // retrieve the directory path of the filepath
         directory = path.substr(0, path.find_last_of('/'));
 
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        // gather the meshes referenced by ASSIMP's node tree, in the order the recursive walk visits them
+        vector<aiMesh*> sceneMeshes;
+        processNode(scene->mRootNode, scene, sceneMeshes);
+
+        ThreadPool pool;
+
+        // 1. convert vertices/indices and collect texture references of every mesh in parallel
+        vector<MeshData> meshData(sceneMeshes.size());
+        pool.parallelFor(sceneMeshes.size(), [&](size_t i) {
+            meshData[i] = processMesh(sceneMeshes[i], scene);
+        });
+
+        // 2. resolve texture references in mesh order so the first use of a path decides its type, exactly
+        // like the serial loader did, and decode all images that aren't loaded yet in parallel
+        unordered_map<string, size_t> loadedByPath;
+        for (size_t i = 0; i < textures_loaded.size(); i++)
+            loadedByPath.emplace(textures_loaded[i].path, i);
+        vector<Texture> pending;
+        for (MeshData &data : meshData)
+        {
+            for (Texture &texture : data.textures)
+            {
+                if (loadedByPath.count(texture.path) == 0)
+                {
+                    loadedByPath.emplace(texture.path, textures_loaded.size() + pending.size());
+                    pending.push_back(texture);
+                }
+            }
+        }
+        vector<TextureImage> images(pending.size());
+        pool.parallelFor(pending.size(), [&](size_t i) {
+            images[i] = DecodeTextureFile(pending[i].path.c_str(), this->directory);
+        });
+
+        // 3. GL uploads, batched on the context thread
+        for (size_t i = 0; i < pending.size(); i++)
+        {
+            pending[i].id = UploadTexture(images[i], pending[i].path.c_str());
+            textures_loaded.push_back(pending[i]);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+        }
+        meshes.reserve(meshes.size() + meshData.size());
+        for (MeshData &data : meshData)
+        {
+            for (Texture &texture : data.textures)
+                texture = textures_loaded[loadedByPath[texture.path]];
+            meshes.push_back(Mesh(std::move(data.vertices), std::move(data.indices), std::move(data.textures)));
+        }
     }
 
-    // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
+    // processes a node in a recursive fashion. Collects each individual mesh located at the node and repeats this process on its children nodes (if any).
+    void processNode(aiNode *node, const aiScene *scene, vector<aiMesh*> &sceneMeshes)
     {
-        // process each mesh located at the current node
+        // collect each mesh located at the current node
         for(unsigned int i = 0; i < node->mNumMeshes; i++)
         {
             // the node object only contains indices to index the actual objects in the scene. 
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            sceneMeshes.push_back(scene->mMeshes[node->mMeshes[i]]);
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, sceneMeshes);
         }
 
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    // runs on a worker thread: must only read the scene and must not touch GL or shared model state.
+    MeshData processMesh(aiMesh *mesh, const aiScene *scene)
     {
         // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+        MeshData data;
+        vector<Vertex> &vertices = data.vertices;
+        vector<unsigned int> &indices = data.indices;
+        vector<Texture> &textures = data.textures;
+        vertices.reserve(mesh->mNumVertices);
+        indices.reserve(mesh->mNumFaces * 3);
 
         // walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
@@ -164,12 +231,12 @@ private:
         std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
         
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        // return the extracted mesh data, the GL objects are created by loadModel
+        return data;
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
+    // collects the texture references of a given type. The textures themselves are decoded and
+    // uploaded (once per path) by loadModel; here only type and path are recorded.
     vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
     {
         vector<Texture> textures;
@@ -177,26 +244,11 @@ private:
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-            }
+            Texture texture;
+            texture.id = 0;
+            texture.type = typeName;
+            texture.path = str.C_Str();
+            textures.push_back(texture);
         }
         return textures;
     }
@@ -204,27 +256,40 @@ private:
 
 
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
+{
+    TextureImage image = DecodeTextureFile(path, directory);
+    return UploadTexture(image, path);
+}
+
+// decodes an image file into memory; safe to call from worker threads.
+TextureImage DecodeTextureFile(const char *path, const string &directory)
 {
     string filename = string(path);
     filename = directory + '/' + filename;
 
+    TextureImage image;
+    image.data = stbi_load(filename.c_str(), &image.width, &image.height, &image.nrComponents, 0);
+    return image;
+}
+
+// creates a GL texture from a decoded image and releases the pixels; must run on the context thread.
+unsigned int UploadTexture(TextureImage &image, const char *path)
+{
     unsigned int textureID;
     glGenTextures(1, &textureID);
 
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
+    if (image.data)
     {
         GLenum format;
-        if (nrComponents == 1)
+        if (image.nrComponents == 1)
             format = GL_RED;
-        else if (nrComponents == 3)
+        else if (image.nrComponents == 3)
             format = GL_RGB;
-        else if (nrComponents == 4)
+        else if (image.nrComponents == 4)
             format = GL_RGBA;
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+        GLStateCache::bindTexture2D(0, textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -232,13 +297,14 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-        stbi_image_free(data);
+        stbi_image_free(image.data);
     }
     else
     {
         std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+        stbi_image_free(image.data);
     }
+    image.data = nullptr;
 
     return textureID;
 }
@@ -0,0 +1,196 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/gl_state.h>
+#include <learnopengl/shader.h>
+
+#include <cstdint>
+#include <vector>
+
+// what to draw: a vertex array and how to issue the call on it
+struct DrawGeometry {
+    unsigned int vao;
+    GLenum mode;
+    GLsizei count;
+    bool indexed; // glDrawElements with GL_UNSIGNED_INT indices, otherwise glDrawArrays
+};
+
+struct RenderItem {
+    uint64_t key;
+    Shader *shader;
+    DrawGeometry geometry;
+    unsigned int object; // caller-defined index, handed back when the item is drawn
+};
+
+// state changes issued by the last RenderQueue::submitInstanced
+struct RenderQueueStats {
+    unsigned int draws = 0;
+    unsigned int instances = 0;
+    unsigned int programSwitches = 0;
+    unsigned int vaoSwitches = 0;
+};
+
+// collects the draws of a frame, sorts them so that items sharing a program, then a VAO end up
+// next to each other (front-to-back inside each group) and submits them with only the binds that
+// actually change. Materials are per instance (MaterialTable), so they don't split the sort.
+// Sort key layout, most significant first:
+//   program slot (8 bits) | VAO slot (12 bits) | unused (20 bits) | depth (24 bits)
+// Slots are handed out in the order programs/VAOs are first pushed in a frame.
+class RenderQueue
+{
+public:
+    // starts a new frame; depth keys are distances from eye, normalized by farPlane
+    void clear(const glm::vec3 &eye, float farPlane)
+    {
+        items.clear();
+        programs.clear();
+        vaos.clear();
+        eyePosition = eye;
+        invFarPlane = 1.0f / farPlane;
+    }
+
+    void push(Shader &shader, const DrawGeometry &geometry, const glm::vec3 &worldPosition, unsigned int object)
+    {
+        const uint64_t programSlot = slotOf(programs, shader.ID);
+        const uint64_t vaoSlot = slotOf(vaos, geometry.vao);
+
+        float depth = glm::clamp(glm::length(worldPosition - eyePosition) * invFarPlane, 0.0f, 1.0f);
+        const uint64_t depthBits = static_cast<uint64_t>(depth * float((1 << 24) - 1));
+
+        RenderItem item;
+        item.key = (programSlot & 0xff) << 56 | (vaoSlot & 0xfff) << 44 | depthBits;
+        item.shader = &shader;
+        item.geometry = geometry;
+        item.object = object;
+        items.push_back(item);
+    }
+
+    // sorts and draws everything pushed since clear(). Runs of sorted items that share program and
+    // geometry are drawn with one instanced call. perBatch(batch, count) is called right before each call with the
+    // run's state bound; it is expected to upload per-instance data for batch[0..count-1] in order
+    // and returns false to skip the run.
+    template<typename F>
+    void submitInstanced(F &&perBatch)
+    {
+        sortItems();
+        beginSubmit();
+        unsigned int i = 0;
+        while (i < order.size())
+        {
+            const RenderItem &first = items[order[i]];
+            batch.clear();
+            batch.push_back(&first);
+            for (i++; i < order.size() && sameBatch(first, items[order[i]]); i++)
+                batch.push_back(&items[order[i]]);
+
+            bindState(first);
+            const GLsizei count = static_cast<GLsizei>(batch.size());
+            if (!perBatch(batch.data(), count))
+                continue;
+            if (first.geometry.indexed)
+                glDrawElementsInstanced(first.geometry.mode, first.geometry.count, GL_UNSIGNED_INT, 0, count);
+            else
+                glDrawArraysInstanced(first.geometry.mode, 0, first.geometry.count, count);
+            lastStats.draws++;
+            lastStats.instances += count;
+        }
+    }
+
+    const RenderQueueStats &stats() const { return lastStats; }
+
+private:
+    std::vector<RenderItem> items;
+    std::vector<unsigned int> programs;
+    std::vector<unsigned int> vaos;
+    glm::vec3 eyePosition = glm::vec3(0.0f);
+    float invFarPlane = 1.0f;
+    RenderQueueStats lastStats;
+    Shader *currentShader = nullptr;
+    unsigned int currentVAO = ~0u;
+    std::vector<const RenderItem*> batch;
+
+    // sort scratch, kept between frames so steady-state sorting doesn't allocate
+    std::vector<unsigned int> order;
+    std::vector<unsigned int> scratch;
+
+    void beginSubmit()
+    {
+        lastStats = RenderQueueStats();
+        currentShader = nullptr;
+        currentVAO = ~0u;
+    }
+
+    // binds whatever of item's program and VAO differs from the previous item
+    void bindState(const RenderItem &item)
+    {
+        if (item.shader != currentShader)
+        {
+            item.shader->use();
+            currentShader = item.shader;
+            lastStats.programSwitches++;
+        }
+        if (item.geometry.vao != currentVAO)
+        {
+            GLStateCache::bindVertexArray(item.geometry.vao);
+            currentVAO = item.geometry.vao;
+            lastStats.vaoSwitches++;
+        }
+    }
+
+    static bool sameBatch(const RenderItem &a, const RenderItem &b)
+    {
+        return a.shader == b.shader && a.geometry.vao == b.geometry.vao &&
+               a.geometry.mode == b.geometry.mode && a.geometry.count == b.geometry.count &&
+               a.geometry.indexed == b.geometry.indexed;
+    }
+
+    static uint64_t slotOf(std::vector<unsigned int> &names, unsigned int name)
+    {
+        for (unsigned int i = 0; i < names.size(); i++)
+        {
+            if (names[i] == name)
+                return i;
+        }
+        names.push_back(name);
+        return names.size() - 1;
+    }
+
+    // LSD radix sort of item indices by key, one byte per pass. Passes where every key has
+    // the same byte are skipped, so the unused key bits cost nothing.
+    void sortItems()
+    {
+        const unsigned int n = static_cast<unsigned int>(items.size());
+        order.resize(n);
+        scratch.resize(n);
+        for (unsigned int i = 0; i < n; i++)
+            order[i] = i;
+
+        for (unsigned int shift = 0; shift < 64; shift += 8)
+        {
+            unsigned int histogram[256] = { 0 };
+            for (unsigned int i = 0; i < n; i++)
+                histogram[(items[i].key >> shift) & 0xff]++;
+            if (n == 0 || histogram[(items[0].key >> shift) & 0xff] == n)
+                continue;
+
+            unsigned int offset = 0;
+            for (unsigned int b = 0; b < 256; b++)
+            {
+                unsigned int count = histogram[b];
+                histogram[b] = offset;
+                offset += count;
+            }
+            for (unsigned int i = 0; i < n; i++)
+            {
+                unsigned int index = order[i];
+                scratch[histogram[(items[index].key >> shift) & 0xff]++] = index;
+            }
+            order.swap(scratch);
+        }
+    }
+};
+#endif
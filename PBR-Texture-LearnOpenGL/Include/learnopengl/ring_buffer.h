@@ -0,0 +1,143 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// one GL buffer split into FRAMES equal regions; each frame writes its dynamic data (uniform
+// blocks, instance attributes) linearly into the next region and draws bind it by offset. A fence
+// is placed when a frame is done, and the region is only reused once the GPU has passed it, so
+// writes never wait on the driver and nothing is ever overwritten while still being read.
+//
+// On GL 4.4+ the buffer is created with glBufferStorage and stays persistently, coherently mapped:
+// push() is a plain memcpy. On GL 3.3 it is written through a CPU copy that flush() hands over with an
+// unsynchronized glMapBufferRange; the fences already guarantee the range is idle.
+class RingBuffer
+{
+public:
+    static const unsigned int FRAMES = 3;
+
+    unsigned int ID = 0;
+
+    // where a push() landed; size 0 means the frame's region was full
+    struct Allocation {
+        GLintptr offset;
+        GLsizeiptr size;
+    };
+
+    explicit RingBuffer(GLsizeiptr bytesPerFrame) : regionSize(bytesPerFrame)
+    {
+        GLint uniformAlignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+        alignment = uniformAlignment > 16 ? uniformAlignment : 16;
+        regionSize = (regionSize + alignment - 1) / alignment * alignment;
+
+        glGenBuffers(1, &ID);
+        glBindBuffer(GL_ARRAY_BUFFER, ID);
+        persistent = GLAD_GL_VERSION_4_4 && glBufferStorage != nullptr;
+        if (persistent)
+        {
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_ARRAY_BUFFER, regionSize * FRAMES, nullptr, flags);
+            mapped = static_cast<unsigned char*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, regionSize * FRAMES, flags));
+            persistent = mapped != nullptr;
+        }
+        if (!persistent)
+        {
+            glBufferData(GL_ARRAY_BUFFER, regionSize * FRAMES, nullptr, GL_STREAM_DRAW);
+            staging.resize(regionSize);
+        }
+        for (unsigned int i = 0; i < FRAMES; i++)
+            fences[i] = 0;
+    }
+
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+
+    bool isPersistent() const { return persistent; }
+    GLsizeiptr bytesPerFrame() const { return regionSize; }
+    // bytes pushed into the current frame so far
+    GLsizeiptr used() const { return head; }
+
+    // moves on to the next region, waiting for the GPU in the rare case it is still FRAMES frames behind
+    void beginFrame()
+    {
+        frame = (frame + 1) % FRAMES;
+        head = 0;
+        flushed = 0;
+        if (fences[frame])
+        {
+            GLenum status = glClientWaitSync(fences[frame], 0, 0);
+            while (status == GL_TIMEOUT_EXPIRED)
+                status = glClientWaitSync(fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+            glDeleteSync(fences[frame]);
+            fences[frame] = 0;
+        }
+    }
+
+    // call after the last draw reading this frame's region has been issued
+    void endFrame()
+    {
+        flush();
+        fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // copies size bytes into the frame's region, at an offset usable for both glBindBufferRange
+    // and vertex attribute pointers
+    Allocation push(const void *data, GLsizeiptr size)
+    {
+        Allocation allocation = { 0, 0 };
+        const GLintptr offset = (head + alignment - 1) / alignment * alignment;
+        if (offset + size > regionSize)
+        {
+            std::cout << "ERROR::RING_BUFFER: frame needs more than " << regionSize << " bytes" << std::endl;
+            return allocation;
+        }
+        if (persistent)
+            std::memcpy(mapped + frame * regionSize + offset, data, size);
+        else
+            std::memcpy(&staging[offset], data, size);
+        head = offset + size;
+        allocation.offset = frame * regionSize + offset;
+        allocation.size = size;
+        return allocation;
+    }
+
+    // makes everything pushed so far visible to the GL; must run before draws read it.
+    // A no-op for the persistent (coherent) mapping.
+    void flush()
+    {
+        if (persistent || flushed == head)
+            return;
+        glBindBuffer(GL_ARRAY_BUFFER, ID);
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT;
+        void *target = glMapBufferRange(GL_ARRAY_BUFFER, frame * regionSize + flushed, head - flushed, flags);
+        if (target)
+        {
+            std::memcpy(target, &staging[flushed], head - flushed);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
+        flushed = head;
+    }
+
+    // binds an allocation to an indexed uniform block binding point
+    void bindUniform(GLuint binding, const Allocation &allocation)
+    {
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding, ID, allocation.offset, allocation.size);
+    }
+
+private:
+    GLsizeiptr regionSize;
+    GLsizeiptr alignment = 256;
+    bool persistent = false;
+    unsigned char *mapped = nullptr;
+    std::vector<unsigned char> staging;
+    GLsync fences[FRAMES];
+    unsigned int frame = FRAMES - 1;
+    GLsizeiptr head = 0;
+    GLsizeiptr flushed = 0;
+};
+#endif
@@ -0,0 +1,160 @@
+#ifndef SH_LIGHTING_H
+#define SH_LIGHTING_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <xmmintrin.h>
+#define SH_LIGHTING_SSE 1
+#endif
+
+// ambient lighting reduced to 9 spherical harmonics coefficients. Environments (ibl_baker.h)
+// and point lights are projected on the CPU and summed; the fragment shader evaluates the sum
+// at the normal for a constant cost, reading one small uniform block (AmbientSH in pbr.fs).
+// Coefficients here hold irradiance already convolved with the cosine lobe and divided by pi,
+// so the diffuse ambient is albedo * evaluate(N).
+
+// a function on the sphere in the real spherical harmonics basis, bands 0 to 2
+struct SH9 {
+    glm::vec3 c[9];
+
+    SH9()
+    {
+        for (int i = 0; i < 9; i++)
+            c[i] = glm::vec3(0.0f);
+    }
+
+    static void basis(const glm::vec3 &n, float y[9])
+    {
+        y[0] = 0.282095f;
+        y[1] = 0.488603f * n.y;
+        y[2] = 0.488603f * n.z;
+        y[3] = 0.488603f * n.x;
+        y[4] = 1.092548f * n.x * n.y;
+        y[5] = 1.092548f * n.y * n.z;
+        y[6] = 0.315392f * (3.0f * n.z * n.z - 1.0f);
+        y[7] = 1.092548f * n.x * n.z;
+        y[8] = 0.546274f * (n.x * n.x - n.y * n.y);
+    }
+
+    // factor turning radiance coefficient i into irradiance / pi: the clamped cosine is
+    // pi, 2pi/3 and pi/4 in bands 0, 1 and 2
+    static float irradianceScale(int i)
+    {
+        return i == 0 ? 1.0f : i < 4 ? 2.0f / 3.0f : 0.25f;
+    }
+
+    glm::vec3 evaluate(const glm::vec3 &n) const
+    {
+        float y[9];
+        basis(n, y);
+        glm::vec3 result(0.0f);
+        for (int i = 0; i < 9; i++)
+            result += c[i] * y[i];
+        return result;
+    }
+
+    SH9 &operator+=(const SH9 &other)
+    {
+        for (int i = 0; i < 9; i++)
+            c[i] += other.c[i];
+        return *this;
+    }
+
+    SH9 operator*(float scale) const
+    {
+        SH9 result;
+        for (int i = 0; i < 9; i++)
+            result.c[i] = c[i] * scale;
+        return result;
+    }
+};
+
+// mirrors the std140 AmbientSH block of pbr.fs
+struct AmbientSHUniforms {
+    glm::vec4 coefficients[9];
+
+    explicit AmbientSHUniforms(const SH9 &sh = SH9())
+    {
+        for (int i = 0; i < 9; i++)
+            coefficients[i] = glm::vec4(sh.c[i], 0.0f);
+    }
+};
+static_assert(sizeof(AmbientSHUniforms) == 144, "AmbientSHUniforms must match the std140 layout of AmbientSH");
+
+// irradiance / pi at probe from count point lights (xyz of positions, rgb of colors; w is
+// ignored), each seen as a direction carrying color / distance^2. Lights are transposed into
+// SoA 4 at a time and their 9 basis values accumulated in 27 SSE sums, so a few thousand
+// lights project in microseconds and the ambient can follow moving lights every frame.
+// Lights closer than minDistance are clamped to it.
+inline SH9 projectPointLights(const glm::vec4 *positions, const glm::vec4 *colors, size_t count,
+                              const glm::vec3 &probe, float minDistance = 0.1f)
+{
+    float sums[27] = {};
+    size_t i = 0;
+#ifdef SH_LIGHTING_SSE
+    __m128 acc[27];
+    for (int k = 0; k < 27; k++)
+        acc[k] = _mm_setzero_ps();
+    const __m128 px = _mm_set1_ps(probe.x), py = _mm_set1_ps(probe.y), pz = _mm_set1_ps(probe.z);
+    const __m128 minDistanceSq = _mm_set1_ps(minDistance * minDistance), tiny = _mm_set1_ps(1e-12f);
+    const __m128 one = _mm_set1_ps(1.0f), three = _mm_set1_ps(3.0f);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(&positions[i].x), y = _mm_loadu_ps(&positions[i + 1].x);
+        __m128 z = _mm_loadu_ps(&positions[i + 2].x), w = _mm_loadu_ps(&positions[i + 3].x);
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+        __m128 r = _mm_loadu_ps(&colors[i].x), g = _mm_loadu_ps(&colors[i + 1].x);
+        __m128 b = _mm_loadu_ps(&colors[i + 2].x), a = _mm_loadu_ps(&colors[i + 3].x);
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+
+        const __m128 dx = _mm_sub_ps(x, px), dy = _mm_sub_ps(y, py), dz = _mm_sub_ps(z, pz);
+        const __m128 distanceSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        const __m128 invDistance = _mm_div_ps(one, _mm_sqrt_ps(_mm_max_ps(distanceSq, tiny)));
+        const __m128 attenuation = _mm_div_ps(one, _mm_max_ps(distanceSq, minDistanceSq));
+        const __m128 nx = _mm_mul_ps(dx, invDistance), ny = _mm_mul_ps(dy, invDistance), nz = _mm_mul_ps(dz, invDistance);
+
+        __m128 basis[9];
+        basis[0] = _mm_set1_ps(0.282095f);
+        basis[1] = _mm_mul_ps(_mm_set1_ps(0.488603f), ny);
+        basis[2] = _mm_mul_ps(_mm_set1_ps(0.488603f), nz);
+        basis[3] = _mm_mul_ps(_mm_set1_ps(0.488603f), nx);
+        basis[4] = _mm_mul_ps(_mm_set1_ps(1.092548f), _mm_mul_ps(nx, ny));
+        basis[5] = _mm_mul_ps(_mm_set1_ps(1.092548f), _mm_mul_ps(ny, nz));
+        basis[6] = _mm_mul_ps(_mm_set1_ps(0.315392f), _mm_sub_ps(_mm_mul_ps(three, _mm_mul_ps(nz, nz)), one));
+        basis[7] = _mm_mul_ps(_mm_set1_ps(1.092548f), _mm_mul_ps(nx, nz));
+        basis[8] = _mm_mul_ps(_mm_set1_ps(0.546274f), _mm_sub_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)));
+        const __m128 radiance[3] = { _mm_mul_ps(r, attenuation), _mm_mul_ps(g, attenuation), _mm_mul_ps(b, attenuation) };
+        for (int k = 0; k < 9; k++)
+            for (int c = 0; c < 3; c++)
+                acc[k * 3 + c] = _mm_add_ps(acc[k * 3 + c], _mm_mul_ps(basis[k], radiance[c]));
+    }
+    for (int k = 0; k < 27; k++)
+    {
+        float lanes[4];
+        _mm_storeu_ps(lanes, acc[k]);
+        sums[k] = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    }
+#endif
+    for (; i < count; i++)
+    {
+        const glm::vec3 d = glm::vec3(positions[i]) - probe;
+        const float distanceSq = glm::dot(d, d);
+        const glm::vec3 radiance = glm::vec3(colors[i]) / std::max(distanceSq, minDistance * minDistance);
+        float basis[9];
+        SH9::basis(d / std::sqrt(std::max(distanceSq, 1e-12f)), basis);
+        for (int k = 0; k < 9; k++)
+            for (int c = 0; c < 3; c++)
+                sums[k * 3 + c] += basis[k] * radiance[c];
+    }
+
+    SH9 sh;
+    for (int k = 0; k < 9; k++)
+        sh.c[k] = glm::vec3(sums[k * 3], sums[k * 3 + 1], sums[k * 3 + 2]) * SH9::irradianceScale(k);
+    return sh;
+}
+#endif
@@ -0,0 +1,107 @@
+// LightClusters::update (light_clusters.h) with 1k point lights moving every frame, at 1280x720
+// and the 16x9x24 froxel grid of main.cpp: milliseconds per update on one thread and on every
+// hardware thread, and the size of the lists. Then checks, over points sampled in the frustum,
+// that every light reaching a point is in the list of the point's froxel; fails if one is missing.
+// usage: light_clusters_bench [lights] [frames]
+#include <learnopengl/light_clusters.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv)
+{
+    const size_t lightCount = argc > 1 ? std::max(1, atoi(argv[1])) : 1024;
+    const int frames = argc > 2 ? std::max(1, atoi(argv[2])) : 300;
+    const int width = 1280, height = 720;
+    const float nearPlane = 0.1f, farPlane = 100.0f;
+#ifdef LIGHT_CLUSTERS_SSE
+    const char *path = "SSE";
+#else
+    const char *path = "scalar";
+#endif
+
+    const glm::mat4 projection = glm::perspective(glm::radians(45.0f), float(width) / height, nearPlane, farPlane);
+    const glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 18.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    // small lights spread over the scene, circling around their start every frame
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    std::vector<PointLight> lights(lightCount);
+    std::vector<glm::vec3> start(lightCount);
+    for (size_t i = 0; i < lightCount; i++)
+    {
+        start[i] = glm::vec3(uniform(rng) * 20.0f - 10.0f, uniform(rng) * 12.0f - 6.0f, uniform(rng) * 8.0f - 4.0f);
+        lights[i].color = glm::vec3(1.0f + uniform(rng) * 2.0f);
+        lights[i].radius = pointLightRadius(lights[i].color, 0.1f);
+    }
+    auto move = [&](float time) {
+        for (size_t i = 0; i < lightCount; i++)
+            lights[i].position = start[i] + glm::vec3(std::sin(time + i) * 1.5f, std::cos(time * 1.3f + i) * 1.5f, 0.0f);
+    };
+
+    LightClusters clusters;
+    clusters.setProjection(projection, width, height, nearPlane, farPlane);
+    const unsigned int hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    printf("%zu moving lights, %dx%d, %s path, ms per update\n", lightCount, width, height, path);
+    printf("%8s %10s %10s %16s\n", "threads", "update", "entries", "max per froxel");
+    for (unsigned int threads : { 1u, hardwareThreads })
+    {
+        ThreadPool pool(threads);
+        move(0.0f);
+        clusters.update(lights.data(), lights.size(), view, pool); // warm up: lists reach their capacity
+        const auto begin = std::chrono::steady_clock::now();
+        for (int f = 0; f < frames; f++)
+        {
+            move(f * 0.016f);
+            clusters.update(lights.data(), lights.size(), view, pool);
+        }
+        const double ms = millisecondsSince(begin) / frames;
+        const LightClusterStats &stats = clusters.lastStats();
+        printf("%8u %10.3f %10u %16u\n", threads, ms, stats.indices, stats.maxPerCluster);
+        if (threads == hardwareThreads)
+            break;
+    }
+
+    // coverage of the last update: points on view rays at random depths
+    const std::vector<unsigned int> &grid = clusters.clusterGrid();
+    const std::vector<unsigned int> &indices = clusters.lightIndices();
+    const glm::uvec4 dimensions = clusters.dimensions();
+    const glm::vec4 params = clusters.shaderParams();
+    const glm::mat4 inverseView = glm::inverse(view);
+    size_t pairs = 0, missing = 0;
+    for (int s = 0; s < 20000; s++)
+    {
+        const float px = uniform(rng) * width, py = uniform(rng) * height;
+        const float depth = nearPlane * std::pow(farPlane / nearPlane, uniform(rng));
+        const glm::vec3 viewPoint((px / width * 2.0f - 1.0f) / projection[0][0] * depth,
+                                  (py / height * 2.0f - 1.0f) / projection[1][1] * depth, -depth);
+        const glm::vec3 point = glm::vec3(inverseView * glm::vec4(viewPoint, 1.0f));
+        const int slice = std::min(std::max(static_cast<int>(std::floor(std::log(depth) * params.z + params.w)), 0),
+                                   static_cast<int>(dimensions.z) - 1);
+        const size_t cluster = (static_cast<size_t>(slice) * dimensions.y + static_cast<int>(py * params.y)) * dimensions.x
+                             + static_cast<int>(px * params.x);
+        const unsigned int *list = indices.data() + grid[cluster * 2];
+        const unsigned int *listEnd = list + grid[cluster * 2 + 1];
+        for (size_t i = 0; i < lightCount; i++)
+        {
+            if (glm::length(lights[i].position - point) >= lights[i].radius)
+                continue;
+            pairs++;
+            if (std::find(list, listEnd, static_cast<unsigned int>(i)) == listEnd)
+                missing++;
+        }
+    }
+    printf("coverage: %zu lit (light, point) pairs sampled, %zu lights missing from the point's froxel\n", pairs, missing);
+    return missing == 0 ? 0 : 1;
+}
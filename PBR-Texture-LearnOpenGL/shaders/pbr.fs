@@ -3,54 +3,108 @@
 //https://github.com/JoeyDeVries/LearnOpenGL/blob/master/src/6.pbr/1.2.lighting_textured/1.2.pbr.fs
 
 #version 330 core
+// one source, three programs (Shader's defines argument): forward shading by default,
+// GBUFFER_PASS writes the surface into the G-buffer (gbuffer.h) instead of lighting it, and
+// DEFERRED_LIGHTING lights a full screen triangle (deferred.vs) from the G-buffer
+#ifdef GBUFFER_PASS
+layout (location = 0) out vec4 GAlbedo;     // sqrt of the linear albedo, for 8 bit precision in the darks
+layout (location = 1) out vec2 GNormal;     // octahedral normal, remapped to [0, 1]
+layout (location = 2) out vec4 GMaterial;   // metallic, roughness, ao
+#else
 out vec4 FragColor;
+#endif
+
+#ifdef DEFERRED_LIGHTING
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormal;
+uniform sampler2D gMaterial;
+uniform sampler2D gDepth;
+vec3 WorldPos;      // reconstructed from the depth in main
+#else
 in vec2 TexCoords;
 in vec3 WorldPos;
 in vec3 Normal;
 
-// material parameters
-uniform float useColor;
-uniform vec3 albedoVal;
-uniform float metallicVal;
-uniform float roughnessVal;
-uniform float aoVal;
-
-uniform sampler2D albedoMap;
-uniform sampler2D normalMap;
-uniform sampler2D metallicMap;
-uniform sampler2D roughnessMap;
-uniform sampler2D aoMap;
-
-uniform float useCorrection;
-uniform float ambientVal;
-uniform float showDiffuse;
-uniform float showSpecular;
-uniform float f0Val;
-uniform float useFresnelSchlick;
-uniform float useGeometry;
-uniform float useNDF;
-
-// lights
-uniform vec3 lightPositions[8];
-uniform vec3 lightColors[8];
-
-uniform vec3 camPos;
+// material parameters: Material indexes the material table, or is -1 to shade with the constants
+flat in int Material;
+flat in vec3 AlbedoVal;
+flat in float MetallicVal;
+flat in float RoughnessVal;
+
+// material table (see material_table.h): every map lives in a layer of one of the arrays
+struct MaterialEntry {
+    ivec4 layer;    // albedo, normal, metallic, roughness; -1 if the map is missing
+    ivec4 array;    // index into materialArrays, same order
+    ivec4 ao;       // layer, array
+};
+layout (std140) uniform MaterialTable {
+    MaterialEntry materials[64];
+};
+uniform sampler2DArray materialArrays[4];
+#endif
+
+// ambient irradiance / pi as spherical harmonics (sh_lighting.h): the environment plus the
+// point lights, projected on the CPU every frame
+layout (std140) uniform AmbientSH {
+    vec4 shCoefficients[9];
+};
+
+// image based lighting baked by ibl_baker.h
+uniform samplerCube prefilterMap;
+uniform sampler2D brdfLUT;
+
+// clustered lights (light_clusters.h): 2 texels per light (position and radius, color), the
+// (offset, count) of every froxel's list, and the lists of light indices
+uniform samplerBuffer lightData;
+uniform usamplerBuffer clusterGrid;
+uniform usamplerBuffer lightIndices;
+
+// per-frame constants, written once a frame into the ring buffer (FrameUniforms in main.cpp)
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 camPos;
+    float padding0;
+    float useCorrection;
+    float showDiffuse;
+    float showSpecular;
+    float f0Val;
+    float useFresnelSchlick;
+    float useGeometry;
+    float useNDF;
+    float aoVal;
+    vec4 iblParams;     // x: specular IBL intensity, y: lod of the roughest prefiltered level, z: multiscatter on/off
+    vec4 clusterParams; // light_clusters.h: xy: 1 / tile size in pixels, zw: log depth to slice scale and bias
+    uvec4 clusterDims;  // tiles x, tiles y, depth slices
+    mat4 inverseViewProjection; // deferred lighting: depth buffer to world space
+};
 
 const float PI = 3.14159265359;
+#ifndef DEFERRED_LIGHTING
+// ----------------------------------------------------------------------------
+// GLSL 3.30 only allows constant sampler array indices, so branch to the array. Derivatives
+// are taken by the caller because neighbouring pixels may be on different instances.
+vec4 sampleMap(int array, int layer, vec4 fallback, vec2 dx, vec2 dy)
+{
+    if (layer < 0)
+        return fallback;
+    vec3 coord = vec3(TexCoords, float(layer));
+    if (array == 0)
+        return textureGrad(materialArrays[0], coord, dx, dy);
+    if (array == 1)
+        return textureGrad(materialArrays[1], coord, dx, dy);
+    if (array == 2)
+        return textureGrad(materialArrays[2], coord, dx, dy);
+    return textureGrad(materialArrays[3], coord, dx, dy);
+}
 // ----------------------------------------------------------------------------
 // Easy trick to get tangent-normals to world-space to keep PBR code simplified.
 // Don't worry if you don't get what's going on; you generally want to do normal 
 // mapping the usual way for performance anways; I do plan make a note of this 
 // technique somewhere later in the normal mapping tutorial.
-vec3 getNormalFromMap()
+// The derivatives are passed in since this runs inside the per-material branch.
+vec3 getNormalFromMap(vec3 tangentNormal, vec3 Q1, vec3 Q2, vec2 st1, vec2 st2)
 {
-    vec3 tangentNormal = texture(normalMap, TexCoords).xyz * 2.0 - 1.0;
-
-    vec3 Q1  = dFdx(WorldPos);
-    vec3 Q2  = dFdy(WorldPos);
-    vec2 st1 = dFdx(TexCoords);
-    vec2 st2 = dFdy(TexCoords);
-
     vec3 N   = normalize(Normal);
     vec3 T  = normalize(Q1*st2.t - Q2*st1.t);
     vec3 B  = -normalize(cross(N, T));
@@ -58,6 +112,41 @@ vec3 getNormalFromMap()
 
     return normalize(TBN * tangentNormal);
 }
+#endif
+// ----------------------------------------------------------------------------
+// octahedral normal encoding (Cigolle et al. 2014): the unit sphere folded onto a square
+vec2 octEncode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.xy;
+    if (n.z < 0.0)
+        e = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return e;
+}
+// ----------------------------------------------------------------------------
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+// ----------------------------------------------------------------------------
+vec3 ambientIrradiance(vec3 n)
+{
+    vec3 result = shCoefficients[0].rgb * 0.282095
+                + shCoefficients[1].rgb * (0.488603 * n.y)
+                + shCoefficients[2].rgb * (0.488603 * n.z)
+                + shCoefficients[3].rgb * (0.488603 * n.x)
+                + shCoefficients[4].rgb * (1.092548 * n.x * n.y)
+                + shCoefficients[5].rgb * (1.092548 * n.y * n.z)
+                + shCoefficients[6].rgb * (0.315392 * (3.0 * n.z * n.z - 1.0))
+                + shCoefficients[7].rgb * (1.092548 * n.x * n.z)
+                + shCoefficients[8].rgb * (0.546274 * (n.x * n.x - n.y * n.y));
+    // 3 bands ring slightly below zero opposite strong lights
+    return max(result, vec3(0.0));
+}
 // ----------------------------------------------------------------------------
 float DistributionGGX(vec3 N, vec3 H, float roughness)
 {
@@ -108,12 +197,50 @@ vec3 fresnelSchlick(float cosTheta, vec3 F0)
 // ----------------------------------------------------------------------------
 void main()
 {
-    vec3 albedo     = mix(pow(texture(albedoMap, TexCoords).rgb, vec3(2.2)), albedoVal, useColor);
-    float metallic  = mix(texture(metallicMap, TexCoords).r, metallicVal, useColor);
-    float roughness = mix(texture(roughnessMap, TexCoords).r, roughnessVal, useColor);
-    float ao        = mix(texture(aoMap, TexCoords).r, aoVal, useColor);
+#ifdef DEFERRED_LIGHTING
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    if (depth == 1.0)
+        discard;    // nothing was drawn here
+    vec4 ndc = vec4(gl_FragCoord.xy / vec2(textureSize(gDepth, 0)), depth, 1.0) * 2.0 - 1.0;
+    vec4 world = inverseViewProjection * ndc;
+    WorldPos = world.xyz / world.w;
 
-    vec3 N = useColor == 1. ? normalize(Normal) : getNormalFromMap();
+    vec3 albedo     = texelFetch(gAlbedo, pixel, 0).rgb;
+    albedo         *= albedo;
+    vec3 material   = texelFetch(gMaterial, pixel, 0).rgb;
+    float metallic  = material.r;
+    float roughness = material.g;
+    float ao        = material.b;
+    vec3 N          = octDecode(texelFetch(gNormal, pixel, 0).rg * 2.0 - 1.0);
+#else
+    vec3 albedo     = AlbedoVal;
+    float metallic  = MetallicVal;
+    float roughness = RoughnessVal;
+    float ao        = aoVal;
+    vec3 N          = normalize(Normal);
+    vec2 dx = dFdx(TexCoords);
+    vec2 dy = dFdy(TexCoords);
+    vec3 dPdx = dFdx(WorldPos);
+    vec3 dPdy = dFdy(WorldPos);
+    if (Material >= 0)
+    {
+        // missing maps read as white albedo, a flat normal, dielectric, rough and unoccluded
+        MaterialEntry m = materials[Material];
+        albedo    = pow(sampleMap(m.array.x, m.layer.x, vec4(1.0), dx, dy).rgb, vec3(2.2));
+        metallic  = sampleMap(m.array.z, m.layer.z, vec4(0.0), dx, dy).r;
+        roughness = sampleMap(m.array.w, m.layer.w, vec4(1.0), dx, dy).r;
+        ao        = sampleMap(m.ao.y, m.ao.x, vec4(1.0), dx, dy).r;
+        if (m.layer.y >= 0)
+            N = getNormalFromMap(sampleMap(m.array.y, m.layer.y, vec4(0.5, 0.5, 1.0, 1.0), dx, dy).xyz * 2.0 - 1.0,
+                                 dPdx, dPdy, dx, dy);
+    }
+#endif
+#ifdef GBUFFER_PASS
+    GAlbedo = vec4(sqrt(albedo), 1.0);
+    GNormal = octEncode(N) * 0.5 + 0.5;
+    GMaterial = vec4(metallic, roughness, ao, 1.0);
+#else
     vec3 V = normalize(camPos - WorldPos);
 
     // calculate reflectance at normal incidence; if dia-electric (like plastic) use F0 
@@ -121,16 +248,37 @@ void main()
     vec3 F0 = vec3(f0Val); 
     F0 = mix(F0, albedo, metallic);
 
-    // reflectance equation
+    // one fetch gives the split-sum scale and bias of F0 (rg) and the directional albedo Ess of
+    // the lights' GGX lobe (b). Single scattering GGX loses the energy that bounces between
+    // microfacets, most of it at high roughness; scaling the specular by 1 + F0 (1 / Ess - 1)
+    // puts it back (Fdez-Aguera 2019, Turquin 2019).
+    float NdotV = max(dot(N, V), 0.0);
+    vec3 dfg = texture(brdfLUT, vec2(NdotV, roughness)).rgb;
+    vec3 lightCompensation = mix(vec3(1.0), 1.0 + F0 * (1.0 / max(dfg.b, 1e-3) - 1.0), iblParams.z);
+    vec3 iblCompensation = mix(vec3(1.0), 1.0 + F0 * (1.0 / max(dfg.r + dfg.g, 1e-3) - 1.0), iblParams.z);
+
+    // the froxel of this fragment: screen tile and exponential depth slice
+    float viewDepth = -(view * vec4(WorldPos, 1.0)).z;
+    ivec3 cluster = ivec3(ivec2(gl_FragCoord.xy * clusterParams.xy), int(floor(log(viewDepth) * clusterParams.z + clusterParams.w)));
+    cluster = clamp(cluster, ivec3(0), ivec3(clusterDims.xyz) - 1);
+    uvec2 lightList = texelFetch(clusterGrid, (cluster.z * int(clusterDims.y) + cluster.y) * int(clusterDims.x) + cluster.x).rg;
+
+    // reflectance equation, over the lights of the froxel only
     vec3 Lo = vec3(0.0);
-    for(int i = 0; i < 8; ++i) 
+    for(uint l = 0u; l < lightList.y; ++l) 
     {
-        // calculate per-light radiance
-        vec3 L = normalize(lightPositions[i] - WorldPos);
+        int light = int(texelFetch(lightIndices, int(lightList.x + l)).r);
+        vec4 positionRadius = texelFetch(lightData, light * 2);
+        vec3 lightColor = texelFetch(lightData, light * 2 + 1).rgb;
+
+        // calculate per-light radiance; the inverse square falloff is windowed to reach
+        // zero at the light's radius (Karis 2013)
+        vec3 L = normalize(positionRadius.xyz - WorldPos);
         vec3 H = normalize(V + L);
-        float distance = length(lightPositions[i] - WorldPos);
-        float attenuation = 1.0 / (distance * distance);
-        vec3 radiance = lightColors[i] * attenuation;
+        float distance = length(positionRadius.xyz - WorldPos);
+        float window = clamp(1.0 - pow(distance / positionRadius.w, 4.0), 0.0, 1.0);
+        float attenuation = window * window / (distance * distance);
+        vec3 radiance = lightColor * attenuation;
 
         // Cook-Torrance BRDF
         float NDF = DistributionGGX(N, H, roughness);   
@@ -139,7 +287,7 @@ void main()
            
         vec3 numerator    = NDF * G * F; 
         float denominator = 4.0 * max(dot(N, V), 0.0) * max(dot(N, L), 0.0) + 0.0001; // + 0.0001 to prevent divide by zero
-        vec3 specular = numerator / denominator;
+        vec3 specular = numerator / denominator * lightCompensation;
         
         // kS is equal to Fresnel
         vec3 kS = F;
@@ -159,9 +307,16 @@ void main()
         Lo += (kD * albedo / PI * showDiffuse + specular * showSpecular) * radiance * NdotL;  // note that we already multiplied the BRDF by the Fresnel (kS) so we won't multiply by kS again
     }   
     
-    // ambient lighting (note that the next IBL tutorial will replace 
-    // this ambient lighting with environment lighting).
-    vec3 ambient = vec3(ambientVal) * albedo * ao;
+    // specular image based lighting with the split-sum approximation: the environment
+    // prefiltered for this roughness, times the BRDF integral as a scale and bias of F0
+    vec3 R = reflect(-V, N);
+    vec3 prefilteredColor = textureLod(prefilterMap, R, roughness * iblParams.y).rgb;
+    vec3 specularEnergy = (F0 * dfg.r + dfg.g) * iblCompensation;
+    vec3 specularIBL = prefilteredColor * specularEnergy * iblParams.x * showSpecular;
+
+    // ambient lighting: the SH irradiance for the diffuse part, minus what the specular IBL reflects
+    vec3 kDAmbient = (vec3(1.0) - specularEnergy) * (1.0 - metallic);
+    vec3 ambient = (kDAmbient * albedo * ambientIrradiance(N) * showDiffuse + specularIBL) * ao;
 
     vec3 color = ambient + Lo;
 
@@ -172,4 +327,5 @@ void main()
     color = mix(ambient + Lo, color, useCorrection);
 
     FragColor = vec4(color, 1.0);
+#endif
 }
\ No newline at end of file
@@ -2,20 +2,49 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+// per instance (MaterialInstance in material_table.h)
+layout (location = 3) in mat4 aModel;
+layout (location = 7) in vec4 aAlbedoMetallic;
+layout (location = 8) in float aRoughness;
+layout (location = 9) in int aMaterial;
 
 out vec2 TexCoords;
 out vec3 WorldPos;
 out vec3 Normal;
+flat out int Material;
+flat out vec3 AlbedoVal;
+flat out float MetallicVal;
+flat out float RoughnessVal;
 
-uniform mat4 projection;
-uniform mat4 view;
-uniform mat4 model;
+// per-frame constants, written once a frame into the ring buffer (FrameUniforms in main.cpp)
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 camPos;
+    float padding0;
+    float useCorrection;
+    float showDiffuse;
+    float showSpecular;
+    float f0Val;
+    float useFresnelSchlick;
+    float useGeometry;
+    float useNDF;
+    float aoVal;
+    vec4 iblParams;     // x: specular IBL intensity, y: lod of the roughest prefiltered level, z: multiscatter on/off
+    vec4 clusterParams; // light_clusters.h: xy: 1 / tile size in pixels, zw: log depth to slice scale and bias
+    uvec4 clusterDims;  // tiles x, tiles y, depth slices
+    mat4 inverseViewProjection; // deferred lighting: depth buffer to world space
+};
 
 void main()
 {
     TexCoords = aTexCoords;
-    WorldPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(model) * aNormal;   
+    WorldPos = vec3(aModel * vec4(aPos, 1.0));
+    Normal = mat3(aModel) * aNormal;   
+    Material = aMaterial;
+    AlbedoVal = aAlbedoMetallic.rgb;
+    MetallicVal = aAlbedoMetallic.a;
+    RoughnessVal = aRoughness;
 
     gl_Position =  projection * view * vec4(WorldPos, 1.0);
 }
\ No newline at end of file
@@ -14,19 +14,26 @@
 #include <learnopengl/shader.h>
 #include <learnopengl/camera.h>
 #include <learnopengl/model.h>
+#include <learnopengl/material_table.h>
+#include <learnopengl/render_queue.h>
+#include <learnopengl/ibl_baker.h>
+#include <learnopengl/sh_lighting.h>
+#include <learnopengl/light_clusters.h>
+#include <learnopengl/gbuffer.h>
+#include <learnopengl/gpu_timer.h>
 
 #include <iostream>
+#include <random>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void MouseButtonCallback(GLFWwindow* window, int button, int state, int mods);
 void processInput(GLFWwindow* window);
-unsigned int loadTexture(const char* path);
-void renderSphere();
-void renderCylinder();
+DrawGeometry sphereGeometry();
+DrawGeometry cylinderGeometry();
 bool loadOBJ();
-void renderCustomModel();
+DrawGeometry customModelGeometry();
 
 // settings
 const unsigned int SCR_WIDTH = 1280;
@@ -55,45 +62,31 @@ float lightZ = 10.f;
 float lightD = 2.5f;
 float lightMoveSpeed = 2.f;
 
-struct TextureProfile {
-    string path;
-    bool loaded;
-    unsigned int albedo, normal, metallic, roughness, ao;
-
-    explicit TextureProfile(const string& path) : path(path), loaded(false),
-                                                  albedo(-1), normal(-1), metallic(-1), roughness(-1), ao(-1) {
-    }
-
-    void load() {
-        string tmp;
-        tmp = path + "/albedo.png";
-        albedo = loadTexture(tmp.c_str());
-        tmp = path + "/normal.png";
-        normal = loadTexture(tmp.c_str());
-        tmp = path + "/metallic.png";
-        metallic = loadTexture(tmp.c_str());
-        tmp = path + "/roughness.png";
-        roughness = loadTexture(tmp.c_str());
-        tmp = path + "/ao.png";
-        ao = loadTexture(tmp.c_str());
-        loaded = true;
-    }
-
-    void apply() {
-        if (!loaded) load();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, albedo);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, normal);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, metallic);
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, roughness);
-        glActiveTexture(GL_TEXTURE4);
-        glBindTexture(GL_TEXTURE_2D, ao);
-    }
+// mirrors the std140 FrameData block of pbr.vs/pbr.fs; every member is 4-byte aligned and
+// placed exactly where std140 puts it, so the struct is copied into the ring buffer as is
+struct FrameUniforms {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec3 camPos;
+    float padding0;
+    float useCorrection;
+    float showDiffuse;
+    float showSpecular;
+    float f0Val;
+    float useFresnelSchlick;
+    float useGeometry;
+    float useNDF;
+    float aoVal;
+    glm::vec4 iblParams;
+    glm::vec4 clusterParams;
+    glm::uvec4 clusterDims;
+    glm::mat4 inverseViewProjection;
 };
-
+static_assert(sizeof(FrameUniforms) == 288, "FrameUniforms must match the std140 layout of FrameData");
+const unsigned int FRAME_DATA_BINDING = 1;
+const unsigned int AMBIENT_SH_BINDING = 2;
+// the 8 lights of the panel plus up to MAX_LIGHTS - 8 small animated ones
+const unsigned int MAX_LIGHTS = 1024;
 
 int main()
 {
@@ -139,22 +132,60 @@ int main()
     // build and compile shaders
     // -------------------------
     Shader shader("shaders/pbr.vs", "shaders/pbr.fs");
+    // deferred path: the same material code writing the G-buffer, and the same BRDF reading it
+    Shader gbufferShader("shaders/pbr.vs", "shaders/pbr.fs", nullptr, "#define GBUFFER_PASS\n");
+    Shader deferredShader("shaders/deferred.vs", "shaders/pbr.fs", nullptr, "#define DEFERRED_LIGHTING\n");
+
+    // load PBR material textures into the material table; draws pick a material by index
+    // -----------------------------------------------------------------------------------
+    MaterialTable materialTable;
+    int mtGold = materialTable.add("resources/textures/pbr/gold");
+    int mtGrass = materialTable.add("resources/textures/pbr/grass");
+    int mtPlastic = materialTable.add("resources/textures/pbr/plastic");
+    int mtRusted = materialTable.add("resources/textures/pbr/rusted_iron");
+    int mtWall = materialTable.add("resources/textures/pbr/wall");
+    int mtCamera = materialTable.add("model/kcar");
+    materialTable.build();
+    materialTable.attach(shader);
+    shader.setUniformBlockBinding("FrameData", FRAME_DATA_BINDING);
+    shader.setUniformBlockBinding("AmbientSH", AMBIENT_SH_BINDING);
+    materialTable.attach(gbufferShader);
+    gbufferShader.setUniformBlockBinding("FrameData", FRAME_DATA_BINDING);
+    deferredShader.setUniformBlockBinding("FrameData", FRAME_DATA_BINDING);
+    deferredShader.setUniformBlockBinding("AmbientSH", AMBIENT_SH_BINDING);
+    GBuffer gbuffer;
+    GpuTimer forwardTimer, geometryTimer, lightingTimer;
+
+    // image based lighting: baked on the CPU on the first run, read from the cache afterwards.
+    // Without the HDR file the baker falls back to a procedural sky.
+    // ----------------------------------------------------------------------------------------
+    ThreadPool threadPool;
+    IblMaps iblMaps;
+    {
+        bool iblFromCache = false;
+        double bakeStart = glfwGetTime();
+        iblMaps = loadOrBakeIbl("resources/textures/hdr/newport_loft.hdr", "resources", threadPool, IblBakeSettings(), &iblFromCache);
+        std::cout << "IBL " << (iblFromCache ? "loaded from cache" : "baked") << " in "
+                  << (glfwGetTime() - bakeStart) * 1000.0 << " ms" << std::endl;
+    }
+    IblTextures iblTextures(iblMaps);
 
-    shader.use();
-    shader.setInt("albedoMap", 0);
-    shader.setInt("normalMap", 1);
-    shader.setInt("metallicMap", 2);
-    shader.setInt("roughnessMap", 3);
-    shader.setInt("aoMap", 4);
-
-    // load PBR material textures
-    // --------------------------
-    TextureProfile txGold("resources/textures/pbr/gold");
-    TextureProfile txGrass("resources/textures/pbr/grass");
-    TextureProfile txPlastic("resources/textures/pbr/plastic");
-    TextureProfile txRusted("resources/textures/pbr/rusted_iron");
-    TextureProfile txWall("resources/textures/pbr/wall");
-    TextureProfile txCamera("model/kcar");
+    // lights are assigned to froxels on the CPU every frame (light_clusters.h)
+    LightClusters lightClusters;
+    std::vector<PointLight> lights(MAX_LIGHTS);
+    std::vector<glm::vec3> extraLightCenters(MAX_LIGHTS);
+    {
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> unit(0.f, 1.f);
+        for (unsigned int i = 8; i < MAX_LIGHTS; i++)
+        {
+            extraLightCenters[i] = glm::vec3(unit(random) * 18.f - 9.f, unit(random) * 18.f - 9.f, unit(random) * 2.5f + .5f);
+            glm::vec3 hue = glm::vec3(unit(random), unit(random), unit(random));
+            lights[i].color = hue / std::max(std::max(hue.r, hue.g), std::max(hue.b, .01f)) * (2.f + unit(random) * 2.f);
+            lights[i].radius = pointLightRadius(lights[i].color, .1f);
+        }
+    }
+    glm::vec4 shLightPositions[8], shLightColors[8];
 
  	// Initialize ImGUI
 	IMGUI_CHECKVERSION();
@@ -200,13 +231,27 @@ int main()
     // initialize static shader uniforms before rendering
     // --------------------------------------------------
     glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-    shader.use();
-    shader.setMat4("projection", projection);
+    FrameUniforms frame;
+    frame.projection = projection;
+    frame.aoVal = 1.f;
+    frame.iblParams = glm::vec4(1.f, iblTextures.maxLod(), 0.f, 0.f);
     enum Shape { sphere, cylinder, custome };
     int  renderObj= cylinder;
 
     loadOBJ();
     glDisable(GL_CULL_FACE);
+
+    // per-frame and per-instance data is streamed through a triple-buffered ring
+    RingBuffer ringBuffer(256 * 1024);
+    // every shape is drawn instanced, so each VAO also reads per-instance attributes
+    InstanceBuffer instanceBuffer(ringBuffer);
+    instanceBuffer.attach(sphereGeometry().vao);
+    instanceBuffer.attach(cylinderGeometry().vao);
+    instanceBuffer.attach(customModelGeometry().vao);
+
+    RenderQueue renderQueue;
+    std::vector<MaterialInstance> objectParams;
+    std::vector<MaterialInstance> batchInstances;
     // render loop
     // -----------
     while (!glfwWindowShouldClose(window))
@@ -237,50 +282,50 @@ int main()
         ImGui::RadioButton("custome", &renderObj, custome);
 
         static const char* texture_names[] = { "color", "gold", "grass", "plastic", "rusted", "wall" };
-        static TextureProfile* texture_files[] = { nullptr, &txGold, &txGrass, &txPlastic, &txRusted, &txWall };
+        const int texture_materials[] = { -1, mtGold, mtGrass, mtPlastic, mtRusted, mtWall };
         static int selected_texture = 0;
         static float roughness = .2, metallic = 0.;
         static float albedo[3] = { 1., 0., 0. };
         static bool gradient = true;
         ImGui::Combo("texture", &selected_texture, texture_names, IM_ARRAYSIZE(texture_names));
+        int objectMaterial = -1;
         if (renderObj == custome) {
-            shader.setFloat("useColor", 0.);
             gradient = false;
-            txCamera.apply();
+            objectMaterial = mtCamera;
         }
-        else if (texture_files[selected_texture]) {
-            shader.setFloat("useColor", 0.);
+        else if (texture_materials[selected_texture] >= 0) {
             gradient = false;
-            texture_files[selected_texture]->apply();
+            objectMaterial = texture_materials[selected_texture];
         }
         else {
             ImGui::ColorEdit3("albedo", albedo);
             ImGui::Checkbox("gradient roughness/metallic", &gradient);
-            shader.setFloat("useColor", 1.);
-            shader.setVec3("albedoVal", glm::vec3(albedo[0], albedo[1], albedo[2]));
-            shader.setFloat("aoVal", 1.);
             if (!gradient) {
                 ImGui::SliderFloat("roughness", &roughness, 0., 1., "%.4f");
                 ImGui::SliderFloat("metallic", &metallic, 0., 1., "%.4f");
-                shader.setFloat("roughnessVal", roughness);
-                shader.setFloat("metallicVal", metallic);
             }
         }
 
-        static float ambient = .03;
+        static float environment = 1.f, light_bounce = .02f;
         static bool hdr_gamma = true, show_diffuse = true, show_specular = true;
         ImGui::Checkbox("HDR / Gamma Correction", &hdr_gamma);
-        ImGui::SliderFloat("ambient", &ambient, 0, 0.1, "%.4f");
+        ImGui::SliderFloat("environment", &environment, 0.f, 2.f, "%.2f");
+        ImGui::SliderFloat("light bounce", &light_bounce, 0.f, 0.2f, "%.3f");
         ImGui::Checkbox("diffuse", &show_diffuse);
         ImGui::Checkbox("specular", &show_specular);
-        shader.setFloat("showDiffuse", show_diffuse ? 1. : 0.);
-        shader.setFloat("showSpecular", show_specular ? 1. : 0.);
-        shader.setFloat("ambientVal", ambient);
-        shader.setFloat("useCorrection", hdr_gamma ? 1. : 0.);
+        frame.showDiffuse = show_diffuse ? 1.f : 0.f;
+        frame.showSpecular = show_specular ? 1.f : 0.f;
+        static float ibl_specular = 1.f;
+        ImGui::SliderFloat("IBL specular", &ibl_specular, 0.f, 2.f, "%.2f");
+        frame.iblParams.x = ibl_specular;
+        static bool multiscatter = true;
+        ImGui::Checkbox("multiscatter energy compensation", &multiscatter);
+        frame.iblParams.z = multiscatter ? 1.f : 0.f;
+        frame.useCorrection = hdr_gamma ? 1.f : 0.f;
         
         static float fresnel0 = 0.04;
         ImGui::SliderFloat("F0", &fresnel0, 0., 1., "%.4f");
-        shader.setFloat("f0Val", fresnel0);
+        frame.f0Val = fresnel0;
 
         static const char* fn_options[] = { "Schlick", "constant" };
         static const char* ndf_options[] = { "GGX Trowbridge-Reitz", "Blinn-Phong", "off"};
@@ -289,9 +334,9 @@ int main()
         ImGui::Combo("Fresnel", &selected_fn, fn_options, IM_ARRAYSIZE(fn_options));
         ImGui::Combo("Normal Distribution", &selected_ndf, ndf_options, IM_ARRAYSIZE(ndf_options));
         ImGui::Combo("Geometry", &selected_geo, geo_options, IM_ARRAYSIZE(geo_options));
-        shader.setFloat("useFresnelSchlick", 1. - selected_fn);
-        shader.setFloat("useNDF", selected_ndf);
-        shader.setFloat("useGeometry", selected_geo);
+        frame.useFresnelSchlick = 1.f - selected_fn;
+        frame.useNDF = static_cast<float>(selected_ndf);
+        frame.useGeometry = static_cast<float>(selected_geo);
 
         //light source related options
 		if (ImGui::Checkbox("light", &turnonlight)) {
@@ -332,6 +377,25 @@ int main()
         ImGui::RadioButton("move set 2", &lightMoveSet, moveSet2);
 
         ImGui::SliderFloat("light source move speed", &lightMoveSpeed, 0.f, 5.f);
+        static int extra_lights = 0;
+        ImGui::SliderInt("extra lights", &extra_lights, 0, MAX_LIGHTS - 8);
+        static double cluster_ms = 0.;
+        const LightClusterStats& clusterStats = lightClusters.lastStats();
+        ImGui::Text("clusters: %u of %u lights visible, %u indices (max %u per froxel), CPU %.2f ms", clusterStats.visibleLights,
+                    clusterStats.lights, clusterStats.indices, clusterStats.maxPerCluster, cluster_ms);
+
+        static bool deferred = false;
+        ImGui::Checkbox("deferred shading", &deferred);
+        if (deferred)
+            ImGui::Text("GPU: G-buffer %.2f ms, lighting %.2f ms", geometryTimer.milliseconds(), lightingTimer.milliseconds());
+        else
+            ImGui::Text("GPU: forward %.2f ms", forwardTimer.milliseconds());
+
+        const RenderQueueStats& queueStats = renderQueue.stats();
+        ImGui::Text("draws %u (%u instances), switches: program %u, VAO %u", queueStats.draws,
+                    queueStats.instances, queueStats.programSwitches, queueStats.vaoSwitches);
+        ImGui::Text("ring buffer: %d of %d bytes per frame (%s)", static_cast<int>(ringBuffer.used()),
+                    static_cast<int>(ringBuffer.bytesPerFrame()), ringBuffer.isPersistent() ? "persistent map" : "unsynchronized map");
 
         if (ImGui::SliderFloat("light depth", &lightZ, 2.f, 20.f)) {
             for (int i = 0; i < 8; ++i) {
@@ -353,10 +417,8 @@ int main()
 		// Ends the window
 		ImGui::End();
 
-        shader.use();
-        glm::mat4 view = camera.GetViewMatrix();
-        shader.setMat4("view", view);
-        shader.setVec3("camPos", camera.Position);
+        frame.view = camera.GetViewMatrix();
+        frame.camPos = camera.Position;
                 if (renderObj == custome)
         {
             nrRows = 1;
@@ -368,36 +430,37 @@ int main()
         }
 
         // render rows*column number of spheres with material properties defined by textures (they all have the same material properties)
-        glm::mat4 model = glm::mat4(1.0f);
+        // draws are only collected here; the render queue sorts them and issues the GL calls below
+        renderQueue.clear(camera.Position, 100.0f);
+        Shader& sceneShader = deferred ? gbufferShader : shader;
+        objectParams.clear();
+        DrawGeometry objectGeometry = renderObj == custome ? customModelGeometry()
+                                    : renderObj == cylinder ? cylinderGeometry() : sphereGeometry();
+        MaterialInstance params;
+        params.albedoMetallic = glm::vec4(albedo[0], albedo[1], albedo[2], metallic);
+        params.roughness = roughness;
+        params.material = objectMaterial;
         for (int row = 0; row < nrRows; ++row)
         {
-            if (gradient) shader.setFloat("metallicVal", 1. * (row) / (nrRows));
+            if (gradient) params.albedoMetallic.a = 1.f * (row) / (nrRows);
             for (int col = 0; col < nrColumns; ++col)
             {
-                if (gradient) shader.setFloat("roughnessVal", glm::clamp(1. * (col) / (nrColumns), 0.05, 1.0));
-                model = glm::mat4(1.0f);
-                model = glm::translate(model, glm::vec3(
+                if (gradient) params.roughness = glm::clamp(1.f * (col) / (nrColumns), 0.05f, 1.0f);
+                glm::vec3 position = glm::vec3(
                     (float)(col - (nrColumns / 2)) * spacing,
                     (float)(row - (nrRows / 2)) * spacing,
                     0.0f
-                ));
-                shader.setMat4("model", model);
-                if (renderObj == custome) {
-                    renderCustomModel();
-                }
-                if (renderObj == cylinder) {
-                    renderCylinder();
-                }
-                else if (renderObj == sphere){
-                    renderSphere();
-                }
+                );
+                params.model = glm::translate(glm::mat4(1.0f), position);
+                renderQueue.push(sceneShader, objectGeometry, position, static_cast<unsigned int>(objectParams.size()));
+                objectParams.push_back(params);
             }
         }
 
         // render light source (simply re-render sphere at light positions)
         // this looks a bit off as we use the same shader, but it'll make their positions obvious and 
         // keeps the codeprint small.
-        shader.setVec3("albedoVal", glm::vec3(1., 1., 1.));
+        params.albedoMetallic = glm::vec4(1., 1., 1., params.albedoMetallic.a);
         for (unsigned int i = 0; i < sizeof(lightPositions) / sizeof(lightPositions[0]); ++i)
         {
             glm::vec3 newPos = lightPositions[i];
@@ -421,18 +484,85 @@ int main()
 					newPos = glm::vec3(rotateMat * glm::vec4(newPos, 1.f));
                 }
             }
-            shader.setVec3("lightPositions[" + std::to_string(i) + "]", newPos);
-            shader.setVec3("lightColors[" + std::to_string(i) + "]", lightColors[i]);
-
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, newPos);
-            model = glm::scale(model, glm::vec3(0.5f));
-            shader.setMat4("model", model);
-            renderSphere();
+            lights[i].position = newPos;
+            lights[i].color = lightColors[i];
+            lights[i].radius = pointLightRadius(lightColors[i]);
+            shLightPositions[i] = glm::vec4(newPos, 1.f);
+            shLightColors[i] = glm::vec4(lightColors[i], 1.f);
+
+            params.model = glm::mat4(1.0f);
+            params.model = glm::translate(params.model, newPos);
+            params.model = glm::scale(params.model, glm::vec3(0.5f));
+            renderQueue.push(sceneShader, sphereGeometry(), newPos, static_cast<unsigned int>(objectParams.size()));
+            objectParams.push_back(params);
         }
 
+        // ambient SH: the baked environment plus a bounce of the point lights seen from the
+        // scene center, projected again every frame so the ambient follows moving lights
+        SH9 ambientSH = iblMaps.irradiance * environment;
+        ambientSH += projectPointLights(shLightPositions, shLightColors, 8, glm::vec3(0.0f)) * light_bounce;
+        AmbientSHUniforms ambientUniforms(ambientSH);
+
+        // the extra lights circle around their centers; then every light goes to its froxels
+        const float lightTime = static_cast<float>(glfwGetTime()) * lightMoveSpeed * .5f;
+        for (unsigned int i = 8; i < 8u + extra_lights; i++)
+            lights[i].position = extraLightCenters[i] + 1.5f * glm::vec3(sin(lightTime + i), cos(lightTime * 1.3f + i), 0.f);
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        double clusterStart = glfwGetTime();
+        lightClusters.setProjection(projection, framebufferWidth, framebufferHeight, 0.1f, 100.0f);
+        lightClusters.update(lights.data(), 8 + extra_lights, frame.view, threadPool);
+        cluster_ms = (glfwGetTime() - clusterStart) * 1000.0;
+        lightClusters.upload();
+        frame.clusterParams = lightClusters.shaderParams();
+        frame.clusterDims = lightClusters.dimensions();
+        frame.inverseViewProjection = glm::inverse(frame.projection * frame.view);
+
+        // all dynamic data of the frame goes through the ring buffer: the FrameData block first,
+        // then the instances of each batch as the queue reaches it
+        ringBuffer.beginFrame();
+        RingBuffer::Allocation frameData = ringBuffer.push(&frame, sizeof(frame));
+        ringBuffer.bindUniform(FRAME_DATA_BINDING, frameData);
+        ringBuffer.bindUniform(AMBIENT_SH_BINDING, ringBuffer.push(&ambientUniforms, sizeof(ambientUniforms)));
+        auto uploadBatch = [&](const RenderItem* const* batch, GLsizei count) {
+            batchInstances.clear();
+            for (GLsizei i = 0; i < count; i++)
+                batchInstances.push_back(objectParams[batch[i]->object]);
+            return instanceBuffer.upload(batchInstances.data(), static_cast<unsigned int>(count));
+        };
+        if (deferred)
+        {
+            // geometry pass: only the surface attributes, at the cost of the scene's overdraw;
+            // then every pixel is lit once, from the same light clusters as the forward path
+            gbuffer.resize(framebufferWidth, framebufferHeight);
+            geometryTimer.begin();
+            gbuffer.beginGeometryPass();
+            materialTable.bind(gbufferShader);
+            renderQueue.submitInstanced(uploadBatch);
+            gbuffer.endGeometryPass();
+            geometryTimer.end();
+
+            lightingTimer.begin();
+            iblTextures.bind(deferredShader);
+            lightClusters.bind(deferredShader);
+            gbuffer.drawLightingPass(deferredShader);
+            lightingTimer.end();
+        }
+        else
+        {
+            forwardTimer.begin();
+            materialTable.bind(shader);
+            iblTextures.bind(shader);
+            lightClusters.bind(shader);
+            renderQueue.submitInstanced(uploadBatch);
+            forwardTimer.end();
+        }
+        ringBuffer.endFrame();
+
 		ImGui::Render();
 		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        // the ImGui backend binds its own program/VAO/texture behind the state cache's back
+        GLStateCache::invalidate();
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
         glfwSwapBuffers(window);
@@ -527,11 +657,11 @@ void MouseButtonCallback(GLFWwindow* window, int button, int state, int mods)
 	}
 }
 
-// renders (and builds at first invocation) a sphere
-// -------------------------------------------------
+// builds (at first invocation) a sphere and returns how to draw it
+// -----------------------------------------------------------------
 unsigned int sphereVAO = 0;
-unsigned int indexCount;
-void renderSphere()
+unsigned int sphereIndexCount;
+DrawGeometry sphereGeometry()
 {
     if (sphereVAO == 0)
     {
@@ -585,7 +715,7 @@ void renderSphere()
             }
             oddRow = !oddRow;
         }
-        indexCount = static_cast<unsigned int>(indices.size());
+        sphereIndexCount = static_cast<unsigned int>(indices.size());
 
         std::vector<float> data;
         for (unsigned int i = 0; i < positions.size(); ++i)
@@ -605,7 +735,7 @@ void renderSphere()
                 data.push_back(uv[i].y);
             }
         }
-        glBindVertexArray(sphereVAO);
+        GLStateCache::bindVertexArray(sphereVAO);
         glBindBuffer(GL_ARRAY_BUFFER, vbo);
         glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), &data[0], GL_STATIC_DRAW);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
@@ -619,11 +749,11 @@ void renderSphere()
         glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
     }
 
-    glBindVertexArray(sphereVAO);
-    glDrawElements(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0);
+    DrawGeometry geometry = { sphereVAO, GL_TRIANGLE_STRIP, static_cast<GLsizei>(sphereIndexCount), true };
+    return geometry;
 }
 
-// renders a cylinder 
+// builds (at first invocation) a cylinder and returns how to draw it
 // -------------------------------------------------
 // util functions
 GLfloat R(glm::vec3 A, glm::vec3 B, GLfloat u) {
@@ -640,8 +770,8 @@ inline glm::vec3 S(GLfloat u, GLfloat t, glm::vec3 A, glm::vec3 B)
     return glm::vec3(R(A, B, u) * sin(2 * PI * t), Y(A, B, u), R(A, B, u) * cos(2 * PI * t));
 }
 unsigned int cylinderVAO = 0;
-//unsigned int indexCount;
-void renderCylinder()
+unsigned int cylinderIndexCount;
+DrawGeometry cylinderGeometry()
 {
     if (cylinderVAO == 0)
     {
@@ -730,7 +860,7 @@ void renderCylinder()
             }
             oddRow = !oddRow;
         }
-        indexCount = static_cast<unsigned int>(indices.size());
+        cylinderIndexCount = static_cast<unsigned int>(indices.size());
 
         std::vector<float> data;
         for (unsigned int i = 0; i < positions.size(); ++i)
@@ -751,7 +881,7 @@ void renderCylinder()
             }
         }
 
-        glBindVertexArray(cylinderVAO);
+        GLStateCache::bindVertexArray(cylinderVAO);
         glBindBuffer(GL_ARRAY_BUFFER, vbo);
         glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), &data[0], GL_STATIC_DRAW);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
@@ -765,47 +895,8 @@ void renderCylinder()
         glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
     }
 
-    glBindVertexArray(cylinderVAO);
-    glDrawArrays(GL_TRIANGLES, 0, indexCount);
-}
-
-// utility function for loading a 2D texture from file
-// ---------------------------------------------------
-unsigned int loadTexture(char const* path)
-{
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    DrawGeometry geometry = { cylinderVAO, GL_TRIANGLES, static_cast<GLsizei>(cylinderIndexCount), false };
+    return geometry;
 }
 
 bool loadOBJ()
@@ -853,18 +944,21 @@ bool loadOBJ()
 }
 
 unsigned int modelVAO = 0, modelVBO = 0;
-// render third party model
-void renderCustomModel()
+GLsizei modelVertexCount = 0;
+// builds (at first invocation) the third party model and returns how to draw it
+DrawGeometry customModelGeometry()
 {
+    if (modelVAO == 0)
+    {
 	glGenVertexArrays(1, &modelVAO);
 
 	//unsigned int vbo, ebo;
 	glGenBuffers(1, &modelVBO);
 	//glGenBuffers(1, &ebo);
 
-	std::vector<glm::vec3> positions = loadedModelPos;
-	std::vector<glm::vec2> uv = loadedModelUv;
-	std::vector<glm::vec3> normals = loadedModelNormals;
+	std::vector<glm::vec3>& positions = loadedModelPos;
+	std::vector<glm::vec2>& uv = loadedModelUv;
+	std::vector<glm::vec3>& normals = loadedModelNormals;
 	//std::vector<unsigned int> indices;
 
 	//indexCount = static_cast<unsigned int>(indices.size());
@@ -888,7 +982,7 @@ void renderCustomModel()
 		}
 	}
     //cout << "size" << uv.size() << " " << normals.size() << " " << positions.size() << "\n";
-	glBindVertexArray(modelVAO);
+	GLStateCache::bindVertexArray(modelVAO);
 	glBindBuffer(GL_ARRAY_BUFFER, modelVBO);
 	glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), &data[0], GL_STATIC_DRAW);
 	//glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
@@ -900,8 +994,10 @@ void renderCustomModel()
 	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
 	glEnableVertexAttribArray(2);
 	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
+	modelVertexCount = static_cast<GLsizei>(data.size() / 3);
+    }
 
-    glBindVertexArray(modelVAO);
     //glDrawElements(GL_POINTS, data.size()/3, 0, 0);
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, data.size()/3);
+    DrawGeometry geometry = { modelVAO, GL_TRIANGLE_STRIP, modelVertexCount, false };
+    return geometry;
 }
@@ -0,0 +1,109 @@
+// ibl_detail::bakeBrdfLut (ibl_baker.h) against a brute force Monte Carlo integral of the same
+// BRDF: directions drawn uniformly over the hemisphere in double precision, 4M per texel, nothing
+// shared with the baker's importance sampled Hammersley set. Checks scale, bias and Ess at a grid
+// of texels with roughness >= 0.3 (below that the uniform estimate is too noisy to judge 0.01),
+// and that every texel of the LUT is a valid albedo.
+#include <learnopengl/ibl_baker.h>
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+static int failures = 0;
+
+static void check(bool condition, const char *what)
+{
+    if (!condition)
+    {
+        printf("FAILED: %s\n", what);
+        ++failures;
+    }
+}
+
+// largest difference allowed between the LUT and the reference, in absolute albedo
+static const double TOLERANCE = 0.01;
+
+struct BrdfIntegrals {
+    double scale = 0.0, bias = 0.0, albedo = 0.0;
+};
+
+// the integrals bakeBrdfLut estimates, for N = +z and V in the xz plane: with
+// f = D * G / (4 * NdotL * NdotV), scale and bias are the integrals of f * NdotL * (1 - Fc) and
+// f * NdotL * Fc with Schlick-GGX k = roughness^2 / 2, Ess the integral of f * NdotL with
+// k = (roughness + 1)^2 / 8
+static BrdfIntegrals integrate(double NdotV, double roughness, long sampleCount, std::mt19937_64 &rng)
+{
+    const double PI = 3.14159265358979;
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    const double a = roughness * roughness, a2 = a * a;
+    const double k = roughness * roughness / 2.0, kDirect = (roughness + 1.0) * (roughness + 1.0) / 8.0;
+    const double vx = std::sqrt(1.0 - NdotV * NdotV), vz = NdotV;
+    BrdfIntegrals sum;
+    for (long i = 0; i < sampleCount; i++)
+    {
+        // uniform over the hemisphere: pdf 1 / (2 pi)
+        const double lz = uniform(rng), phi = 2.0 * PI * uniform(rng), s = std::sqrt(1.0 - lz * lz);
+        const double lx = s * std::cos(phi), ly = s * std::sin(phi);
+        glm::dvec3 h = glm::normalize(glm::dvec3(lx + vx, ly, lz + vz));
+        const double VdotH = vx * h.x + vz * h.z;
+        const double d = h.z * h.z * (a2 - 1.0) + 1.0;
+        const double D = a2 / (PI * d * d);
+        const double G = lz / (lz * (1.0 - k) + k) * NdotV / (NdotV * (1.0 - k) + k);
+        const double GDirect = lz / (lz * (1.0 - kDirect) + kDirect) * NdotV / (NdotV * (1.0 - kDirect) + kDirect);
+        const double base = D / (4.0 * NdotV) * 2.0 * PI;
+        const double fc = std::pow(1.0 - VdotH, 5.0);
+        sum.scale += base * G * (1.0 - fc);
+        sum.bias += base * G * fc;
+        sum.albedo += base * GDirect;
+    }
+    sum.scale /= sampleCount;
+    sum.bias /= sampleCount;
+    sum.albedo /= sampleCount;
+    return sum;
+}
+
+int main()
+{
+    ThreadPool pool;
+    const IblBakeSettings settings;
+    const int size = settings.lutSize;
+    const auto start = std::chrono::steady_clock::now();
+    const std::vector<float> lut = ibl_detail::bakeBrdfLut(size, settings.lutSamples, pool);
+    const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    printf("LUT %dx%d, %d samples per texel: %.1f ms\n", size, size, settings.lutSamples, milliseconds);
+
+    bool valid = true;
+    for (int i = 0; i < size * size; i++)
+    {
+        const float scale = lut[i * 3], bias = lut[i * 3 + 1], albedo = lut[i * 3 + 2];
+        valid = valid && scale >= 0.0f && bias >= 0.0f && scale + bias <= 1.001f && albedo > 0.0f && albedo <= 1.001f;
+    }
+    check(valid, "every texel has scale, bias >= 0, scale + bias <= 1 and Ess in (0, 1]");
+
+    std::mt19937_64 rng(7);
+    double worst[3] = { 0.0, 0.0, 0.0 };
+    const int columns[] = { 4, 16, 32, 64, 96, 127 };
+    const int rows[] = { 38, 51, 64, 90, 115, 127 };
+    printf("%8s %9s %22s %22s\n", "NdotV", "roughness", "LUT scale bias Ess", "reference");
+    for (int y : rows)
+    {
+        for (int x : columns)
+        {
+            const double NdotV = (x + 0.5) / size, roughness = (y + 0.5) / size;
+            const BrdfIntegrals reference = integrate(NdotV, roughness, 4000000, rng);
+            const float *texel = &lut[(y * size + x) * 3];
+            worst[0] = std::max(worst[0], std::abs(texel[0] - reference.scale));
+            worst[1] = std::max(worst[1], std::abs(texel[1] - reference.bias));
+            worst[2] = std::max(worst[2], std::abs(texel[2] - reference.albedo));
+            printf("%8.3f %9.3f %8.4f %6.4f %6.4f %8.4f %6.4f %6.4f\n", NdotV, roughness,
+                   texel[0], texel[1], texel[2], reference.scale, reference.bias, reference.albedo);
+        }
+    }
+    printf("max difference: scale %.4f, bias %.4f, Ess %.4f (tolerance %.2f)\n", worst[0], worst[1], worst[2], TOLERANCE);
+    check(worst[0] <= TOLERANCE, "scale within tolerance of the reference");
+    check(worst[1] <= TOLERANCE, "bias within tolerance of the reference");
+    check(worst[2] <= TOLERANCE, "Ess within tolerance of the reference");
+
+    printf(failures ? "%d checks failed\n" : "all checks passed\n", failures);
+    return failures ? 1 : 0;
+}